@@ -0,0 +1,352 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// Spawns short-lived processes at a fixed rate while observer threads look up the CPID of each new PID,
+// the way a monitoring agent does when it is told about process starts.
+// Lookups that fail because the process already exited and was reaped are counted as misses.
+
+#if defined(__linux__)
+// We enforce standard C with no extensions in CMake
+// This is needed for clock_gettime, nanosleep and the process methods to be defined
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include "cpid/cpid_macos.h"
+#else
+#include "cpid/cpid_linux.h"
+#endif
+
+#define DEFAULT_RATE 1000
+#define DEFAULT_DURATION_MS 5000
+#define DEFAULT_LIFETIME_US 1000
+#define DEFAULT_OBSERVER_COUNT 1
+#define MAX_OBSERVERS 64
+// spawned PIDs waiting for an observer, PIDs that don't fit are dropped
+#define QUEUE_CAPACITY 65536
+
+typedef struct {
+    pid_t pid;
+    uint64_t spawn_ns;
+} spawn_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    spawn_t spawns[QUEUE_CAPACITY];
+    size_t head;
+    size_t count;
+    int closed;
+} queue_t;
+
+typedef struct {
+    queue_t *queue;
+    cpid_handle_t handle;
+    pthread_t thread;
+    // per lookup, from the return of fork to the CPID and of the lookup alone
+    uint64_t *spawn_latencies_ns;
+    uint64_t *lookup_latencies_ns;
+    size_t capacity;
+    size_t lookups;
+    size_t hits;
+} observer_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static void sleep_ns(const uint64_t duration_ns) {
+    struct timespec ts = {(time_t) (duration_ns / 1000000000u), (long) (duration_ns % 1000000000u)};
+    while (nanosleep(&ts, &ts) && EINTR == errno) {
+    }
+}
+
+static int queue_push(queue_t *const queue, const spawn_t spawn) {
+    int return_code = 0;
+    pthread_mutex_lock(&queue->mutex);
+    if (QUEUE_CAPACITY == queue->count) {
+        return_code = -1;
+    } else {
+        queue->spawns[(queue->head + queue->count) % QUEUE_CAPACITY] = spawn;
+        queue->count++;
+        pthread_cond_signal(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return return_code;
+}
+
+// Returns -1 once the queue is closed and empty.
+static int queue_pop(queue_t *const queue, spawn_t *const spawn) {
+    int return_code = 0;
+    pthread_mutex_lock(&queue->mutex);
+    while (!queue->count && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    if (queue->count) {
+        *spawn = queue->spawns[queue->head];
+        queue->head = (queue->head + 1) % QUEUE_CAPACITY;
+        queue->count--;
+    } else {
+        return_code = -1;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return return_code;
+}
+
+static void queue_close(queue_t *const queue) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static void *observer_main(void *const argument) {
+    observer_t *const observer = argument;
+
+    spawn_t spawn;
+    while (!queue_pop(observer->queue, &spawn)) {
+        uuid_t uuid;
+        const uint64_t lookup_start_ns = now_ns();
+        const int status = cpid_get_uuid(observer->handle, spawn.pid, uuid);
+        const uint64_t lookup_end_ns = now_ns();
+
+        if (observer->lookups < observer->capacity && !status) {
+            observer->spawn_latencies_ns[observer->hits] = lookup_end_ns - spawn.spawn_ns;
+            observer->lookup_latencies_ns[observer->hits] = lookup_end_ns - lookup_start_ns;
+            observer->hits++;
+        }
+        observer->lookups++;
+    }
+
+    return NULL;
+}
+
+static atomic_int spawning_done;
+
+// Reaps children as soon as they exit, like the parent of a short-lived process would.
+static void *reaper_main(void *const argument) {
+    (void) argument;
+
+    for (;;) {
+        if (waitpid(-1, NULL, 0) >= 0 || EINTR == errno) {
+            continue;
+        }
+        // ECHILD, there are no children right now
+        if (atomic_load(&spawning_done)) {
+            break;
+        }
+        sleep_ns(100000);
+    }
+
+    return NULL;
+}
+
+static int compare_uint64(const void *const a, const void *const b) {
+    const uint64_t left = *(const uint64_t *) a;
+    const uint64_t right = *(const uint64_t *) b;
+    return left < right ? -1 : left > right;
+}
+
+// Sorts the latencies and prints the percentiles.
+static void print_latencies(const char *const name, uint64_t *const latencies_ns, const size_t count) {
+    if (!count) {
+        printf("%-16s -\n", name);
+        return;
+    }
+
+    qsort(latencies_ns, count, sizeof(uint64_t), compare_uint64);
+    #define PERCENTILE_US(p) ((double) latencies_ns[(size_t) ((double) (count - 1) * (p))] / 1000.0)
+    printf("%-16s p50 %9.1f us   p90 %9.1f us   p99 %9.1f us   max %9.1f us\n", name, PERCENTILE_US(0.5), PERCENTILE_US(0.9), PERCENTILE_US(0.99), PERCENTILE_US(1.0));
+}
+
+static int parse_count(const char *const text, const unsigned long max, unsigned long *const value) {
+    char *endptr = NULL;
+    *value = strtoul(text, &endptr, 10);
+    return endptr == text || *endptr || '-' == text[0] || *value > max ? -1 : 0;
+}
+
+static void print_usage(const char *const program) {
+    fprintf(stderr,
+            "usage: %s [--rate N] [--duration-ms N] [--lifetime-us N] [--observers N] [--cache N]\n"
+            "\n"
+            "  --rate         processes spawned per second (default %d)\n"
+            "  --duration-ms  how long to spawn processes for (default %d)\n"
+            "  --lifetime-us  how long each process lives before it exits (default %d)\n"
+            "  --observers    threads looking up the CPIDs of spawned processes (default %d)\n"
+            "  --cache        capacity of the CPID cache of each observer, 0 for none (default 0)\n",
+            program, DEFAULT_RATE, DEFAULT_DURATION_MS, DEFAULT_LIFETIME_US, DEFAULT_OBSERVER_COUNT);
+}
+
+int main(int argc, char **argv) {
+    unsigned long rate = DEFAULT_RATE;
+    unsigned long duration_ms = DEFAULT_DURATION_MS;
+    unsigned long lifetime_us = DEFAULT_LIFETIME_US;
+    unsigned long observer_count = DEFAULT_OBSERVER_COUNT;
+    unsigned long cache_capacity = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--rate") && i + 1 < argc && !parse_count(argv[i + 1], 1000000, &rate) && rate) {
+            i++;
+        } else if (!strcmp(argv[i], "--duration-ms") && i + 1 < argc && !parse_count(argv[i + 1], 3600000, &duration_ms) && duration_ms) {
+            i++;
+        } else if (!strcmp(argv[i], "--lifetime-us") && i + 1 < argc && !parse_count(argv[i + 1], 60000000, &lifetime_us)) {
+            i++;
+        } else if (!strcmp(argv[i], "--observers") && i + 1 < argc && !parse_count(argv[i + 1], MAX_OBSERVERS, &observer_count) && observer_count) {
+            i++;
+        } else if (!strcmp(argv[i], "--cache") && i + 1 < argc && !parse_count(argv[i + 1], 1 << 24, &cache_capacity)) {
+            i++;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // every lookup result is kept, there are at most as many as processes spawned
+    const size_t capacity = (size_t) (rate * duration_ms / 1000 + 1);
+
+    static queue_t queue;
+    pthread_mutex_init(&queue.mutex, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+
+    observer_t observers[MAX_OBSERVERS];
+    memset(observers, 0, sizeof(observers));
+
+    int return_code = 0;
+    unsigned long started = 0;
+    for (; started < observer_count; started++) {
+        observer_t *const observer = &observers[started];
+        observer->queue = &queue;
+        observer->capacity = capacity;
+        observer->handle = cpid_initialize();
+        observer->spawn_latencies_ns = malloc(capacity * sizeof(uint64_t));
+        observer->lookup_latencies_ns = malloc(capacity * sizeof(uint64_t));
+        if (!observer->handle || !observer->spawn_latencies_ns || !observer->lookup_latencies_ns) {
+            return_code = -1;
+        }
+#if !defined(__APPLE__)
+        if (!return_code && cache_capacity && cpid_cache_enable(observer->handle, cache_capacity, 0)) {
+            return_code = -1;
+        }
+#endif
+        if (return_code || pthread_create(&observer->thread, NULL, observer_main, observer)) {
+            cpid_finalize(observer->handle);
+            free(observer->spawn_latencies_ns);
+            free(observer->lookup_latencies_ns);
+            return_code = -1;
+            break;
+        }
+    }
+#if defined(__APPLE__)
+    if (cache_capacity) {
+        fprintf(stderr, "There is no CPID cache on macOS, --cache is ignored.\n");
+    }
+#endif
+
+    pthread_t reaper;
+    atomic_init(&spawning_done, 0);
+    if (!return_code && pthread_create(&reaper, NULL, reaper_main, NULL)) {
+        return_code = -1;
+    }
+
+    size_t spawned = 0;
+    size_t spawn_failures = 0;
+    size_t dropped = 0;
+    uint64_t spawn_end_ns = 0;
+    const uint64_t interval_ns = 1000000000u / rate;
+    const uint64_t spawn_start_ns = now_ns();
+    if (!return_code) {
+        // spawns are scheduled at fixed times, a spawn that is late doesn't delay the next ones
+        uint64_t next_spawn_ns = spawn_start_ns;
+        const uint64_t end_ns = spawn_start_ns + (uint64_t) duration_ms * 1000000u;
+        const struct timespec lifetime = {(time_t) (lifetime_us / 1000000), (long) (lifetime_us % 1000000) * 1000};
+        while (next_spawn_ns < end_ns) {
+            const uint64_t current_ns = now_ns();
+            if (current_ns < next_spawn_ns) {
+                sleep_ns(next_spawn_ns - current_ns);
+            }
+            next_spawn_ns += interval_ns;
+
+            pid_t pid = fork();
+            if (0 == pid) {
+                // only async-signal-safe calls in the child
+                nanosleep(&lifetime, NULL);
+                _exit(0);
+            }
+            if (pid < 0) {
+                spawn_failures++;
+                continue;
+            }
+
+            spawned++;
+            const spawn_t spawn = {pid, now_ns()};
+            if (queue_push(&queue, spawn)) {
+                dropped++;
+            }
+        }
+        spawn_end_ns = now_ns();
+
+        atomic_store(&spawning_done, 1);
+        pthread_join(reaper, NULL);
+    }
+
+    queue_close(&queue);
+
+    size_t lookups = 0;
+    size_t hits = 0;
+    uint64_t *spawn_latencies_ns = NULL;
+    uint64_t *lookup_latencies_ns = NULL;
+    for (unsigned long i = 0; i < started; i++) {
+        pthread_join(observers[i].thread, NULL);
+        lookups += observers[i].lookups;
+        hits += observers[i].hits;
+    }
+
+    if (!return_code) {
+        spawn_latencies_ns = malloc((hits + 1) * sizeof(uint64_t));
+        lookup_latencies_ns = malloc((hits + 1) * sizeof(uint64_t));
+        if (!spawn_latencies_ns || !lookup_latencies_ns) {
+            return_code = -1;
+        }
+    }
+
+    if (!return_code) {
+        size_t offset = 0;
+        for (unsigned long i = 0; i < started; i++) {
+            memcpy(spawn_latencies_ns + offset, observers[i].spawn_latencies_ns, observers[i].hits * sizeof(uint64_t));
+            memcpy(lookup_latencies_ns + offset, observers[i].lookup_latencies_ns, observers[i].hits * sizeof(uint64_t));
+            offset += observers[i].hits;
+        }
+
+        const double elapsed_s = (double) (spawn_end_ns - spawn_start_ns) / 1e9;
+        printf("spawned          %zu (%.0f/s, %zu fork failures)\n", spawned, (double) spawned / elapsed_s, spawn_failures);
+        printf("looked up        %zu (%zu dropped by a full queue)\n", lookups, dropped);
+        printf("misses           %zu (%.2f%%)\n", lookups - hits, lookups ? 100.0 * (double) (lookups - hits) / (double) lookups : 0.0);
+        print_latencies("spawn to CPID", spawn_latencies_ns, hits);
+        print_latencies("lookup", lookup_latencies_ns, hits);
+    } else {
+        fprintf(stderr, "Failed to start the fork storm.\n");
+    }
+
+    for (unsigned long i = 0; i < started; i++) {
+        cpid_finalize(observers[i].handle);
+        free(observers[i].spawn_latencies_ns);
+        free(observers[i].lookup_latencies_ns);
+    }
+    free(spawn_latencies_ns);
+    free(lookup_latencies_ns);
+
+    return return_code ? 1 : 0;
+}
@@ -0,0 +1,414 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// Measures the throughput of the CPID calculations and lookups across thread counts.
+// Where the kernel allows it, hardware cycles and system calls are counted per operation too.
+
+// We enforce standard C with no extensions in CMake
+// This is needed for clock_gettime and syscall to be defined
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpid/cpid_linux.h"
+
+#define DEFAULT_DURATION_MS 1000
+#define MAX_THREADS 256
+#define MAX_THREAD_COUNTS 16
+// operations between two checks of the clock
+#define CHUNK_SIZE 256
+#define BATCH_SIZE 64
+#define CACHE_CAPACITY 65536
+#define ENUMERATE_HEADROOM 1024
+#define FAKE_PID_NAMESPACE 4026531836
+
+// the system call tracepoint, with tracefs mounted in either of its usual places
+static const char *const syscall_tracepoint_id_paths[] = {
+    "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+    "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+};
+
+typedef struct benchmark benchmark_t;
+
+typedef struct {
+    const benchmark_t *benchmark;
+    cpid_handle_t handle;
+    const cpid_entry_t *entries;
+    size_t entry_count;
+    uint64_t duration_ns;
+    atomic_int *ready_count;
+    atomic_int *start;
+    pthread_t thread;
+    // results
+    uint64_t ops;
+    uint64_t failures;
+    uint64_t elapsed_ns;
+    int cycles_status;
+    uint64_t cycles;
+    int syscalls_status;
+    uint64_t syscalls;
+} worker_t;
+
+struct benchmark {
+    const char *name;
+    // 0 or the capacity of the cache enabled on each handle
+    size_t cache_capacity;
+    // runs CHUNK_SIZE operations, or CHUNK_SIZE batches, and returns how many were done
+    uint64_t (*run_chunk)(worker_t *const worker, uint64_t *const cursor);
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t run_make_uuid(worker_t *const worker, uint64_t *const cursor) {
+    uuid_t uuid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++, (*cursor)++) {
+        if (cpid_make_uuid(worker->handle, (pid_t) (*cursor & 0x3FFFFF), *cursor, FAKE_PID_NAMESPACE, uuid)) {
+            worker->failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static uint64_t run_make_uuid_batch(worker_t *const worker, uint64_t *const cursor) {
+    cpid_linux_input_t inputs[BATCH_SIZE];
+    uuid_t uuids[BATCH_SIZE];
+    for (size_t i = 0; i < CHUNK_SIZE; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++, (*cursor)++) {
+            inputs[j].pid_namespace_tgid = (pid_t) (*cursor & 0x3FFFFF);
+            inputs[j].creation_time_ticks = *cursor;
+            inputs[j].pid_namespace = FAKE_PID_NAMESPACE;
+        }
+        if (cpid_make_uuid_batch(worker->handle, inputs, BATCH_SIZE, uuids)) {
+            worker->failures += BATCH_SIZE;
+        }
+    }
+    return CHUNK_SIZE * BATCH_SIZE;
+}
+
+static uint64_t run_get_uuid_self(worker_t *const worker, uint64_t *const cursor) {
+    (void) cursor;
+    const pid_t pid = getpid();
+    uuid_t uuid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++) {
+        if (cpid_get_uuid(worker->handle, pid, uuid)) {
+            worker->failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static uint64_t run_get_uuid_all(worker_t *const worker, uint64_t *const cursor) {
+    uuid_t uuid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++, (*cursor)++) {
+        // processes that exited since the enumeration count as failures
+        if (cpid_get_uuid(worker->handle, worker->entries[*cursor % worker->entry_count].pid, uuid)) {
+            worker->failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static uint64_t run_get_uuid_string_self(worker_t *const worker, uint64_t *const cursor) {
+    (void) cursor;
+    const pid_t pid = getpid();
+    uuid_string_t uuid_string;
+    for (size_t i = 0; i < CHUNK_SIZE; i++) {
+        if (cpid_get_uuid_string(worker->handle, pid, uuid_string)) {
+            worker->failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static const benchmark_t benchmarks[] = {
+    {"make_uuid", 0, run_make_uuid},
+    {"make_uuid_batch", 0, run_make_uuid_batch},
+    {"get_uuid_self", 0, run_get_uuid_self},
+    {"get_uuid_all", 0, run_get_uuid_all},
+    {"get_uuid_all_cached", CACHE_CAPACITY, run_get_uuid_all},
+    {"get_uuid_string_self", 0, run_get_uuid_string_self},
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static int read_syscall_tracepoint_id(uint64_t *const id) {
+    for (size_t i = 0; i < sizeof(syscall_tracepoint_id_paths) / sizeof(syscall_tracepoint_id_paths[0]); i++) {
+        FILE *file = fopen(syscall_tracepoint_id_paths[i], "r");
+        if (!file) {
+            continue;
+        }
+        unsigned long long value = 0;
+        int matched = fscanf(file, "%llu", &value);
+        fclose(file);
+        if (1 == matched) {
+            *id = value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Opens a disabled counter for the calling thread, -1 if the kernel doesn't permit it.
+static int open_counter(const uint32_t type, const uint64_t config, const int exclude_kernel) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static int read_counter(const int fd, uint64_t *const value) {
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    return sizeof(*value) == read(fd, value, sizeof(*value)) ? 0 : -1;
+}
+
+static void *worker_main(void *const argument) {
+    worker_t *const worker = argument;
+
+    // the system calls of the lookups are made in the kernel, so its cycles count if permitted
+    int cycles_fd = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0);
+    if (cycles_fd < 0) {
+        cycles_fd = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 1);
+    }
+    uint64_t tracepoint_id = 0;
+    int syscalls_fd = read_syscall_tracepoint_id(&tracepoint_id) ? -1 : open_counter(PERF_TYPE_TRACEPOINT, tracepoint_id, 0);
+
+    atomic_fetch_add(worker->ready_count, 1);
+    while (!atomic_load(worker->start)) {
+    }
+
+    uint64_t cursor = 0;
+    if (cycles_fd >= 0) {
+        ioctl(cycles_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    if (syscalls_fd >= 0) {
+        ioctl(syscalls_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    const uint64_t start_ns = now_ns();
+    uint64_t elapsed_ns = 0;
+    do {
+        worker->ops += worker->benchmark->run_chunk(worker, &cursor);
+        elapsed_ns = now_ns() - start_ns;
+    } while (elapsed_ns < worker->duration_ns);
+    worker->elapsed_ns = elapsed_ns;
+
+    worker->cycles_status = cycles_fd < 0 ? -1 : read_counter(cycles_fd, &worker->cycles);
+    worker->syscalls_status = syscalls_fd < 0 ? -1 : read_counter(syscalls_fd, &worker->syscalls);
+    if (cycles_fd >= 0) {
+        close(cycles_fd);
+    }
+    if (syscalls_fd >= 0) {
+        close(syscalls_fd);
+    }
+
+    return NULL;
+}
+
+static int run_benchmark(const benchmark_t *const benchmark, cpid_context_t const context, const cpid_entry_t *const entries, const size_t entry_count, const unsigned thread_count, const uint64_t duration_ns) {
+    worker_t *workers = calloc(thread_count, sizeof(worker_t));
+    if (!workers) {
+        return -1;
+    }
+
+    atomic_int ready_count;
+    atomic_int start;
+    atomic_init(&ready_count, 0);
+    atomic_init(&start, 0);
+
+    int return_code = 0;
+    unsigned started = 0;
+    for (; started < thread_count; started++) {
+        worker_t *const worker = &workers[started];
+        worker->benchmark = benchmark;
+        worker->entries = entries;
+        worker->entry_count = entry_count;
+        worker->duration_ns = duration_ns;
+        worker->ready_count = &ready_count;
+        worker->start = &start;
+        worker->handle = cpid_initialize_from_context(context);
+        if (!worker->handle || (benchmark->cache_capacity && cpid_cache_enable(worker->handle, benchmark->cache_capacity, 0))) {
+            cpid_finalize(worker->handle);
+            return_code = -1;
+            break;
+        }
+        if (pthread_create(&worker->thread, NULL, worker_main, worker)) {
+            cpid_finalize(worker->handle);
+            return_code = -1;
+            break;
+        }
+    }
+
+    // all workers start together, once their counters are open
+    while (atomic_load(&ready_count) < (int) started) {
+    }
+    atomic_store(&start, 1);
+
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        cpid_finalize(workers[i].handle);
+    }
+
+    if (!return_code) {
+        uint64_t ops = 0, failures = 0, elapsed_ns = 0, cycles = 0, syscalls = 0;
+        int cycles_status = 0, syscalls_status = 0;
+        double ops_per_second = 0;
+        for (unsigned i = 0; i < thread_count; i++) {
+            ops += workers[i].ops;
+            failures += workers[i].failures;
+            elapsed_ns += workers[i].elapsed_ns;
+            cycles += workers[i].cycles;
+            syscalls += workers[i].syscalls;
+            cycles_status |= workers[i].cycles_status;
+            syscalls_status |= workers[i].syscalls_status;
+            ops_per_second += (double) workers[i].ops * 1e9 / (double) workers[i].elapsed_ns;
+        }
+
+        char cycles_text[32] = "-";
+        char syscalls_text[32] = "-";
+        if (!cycles_status) {
+            snprintf(cycles_text, sizeof(cycles_text), "%.0f", (double) cycles / (double) ops);
+        }
+        if (!syscalls_status) {
+            snprintf(syscalls_text, sizeof(syscalls_text), "%.2f", (double) syscalls / (double) ops);
+        }
+        printf("%-22s %7u %14.0f %10.1f %11s %12s %10llu\n", benchmark->name, thread_count, ops_per_second, (double) elapsed_ns / (double) ops, cycles_text, syscalls_text, (unsigned long long) failures);
+    }
+
+    free(workers);
+
+    return return_code;
+}
+
+static int enumerate_processes(cpid_handle_t const handle, cpid_entry_t **const entries, size_t *const count) {
+    size_t capacity = ENUMERATE_HEADROOM;
+    *entries = NULL;
+    int return_code = -1;
+    for (int attempt = 0; attempt < 3 && return_code; attempt++) {
+        cpid_entry_t *new_entries = realloc(*entries, capacity * sizeof(cpid_entry_t));
+        if (!new_entries) {
+            break;
+        }
+        *entries = new_entries;
+        return_code = cpid_enumerate_all(handle, *entries, capacity, count, 0);
+        if (return_code && *count <= capacity) {
+            break;
+        }
+        capacity = *count + ENUMERATE_HEADROOM;
+    }
+
+    if (!return_code && !*count) {
+        return_code = -1;
+    }
+
+    return return_code;
+}
+
+static int parse_thread_counts(char *const text, unsigned thread_counts[MAX_THREAD_COUNTS], size_t *const count) {
+    *count = 0;
+    for (char *token = strtok(text, ","); token; token = strtok(NULL, ",")) {
+        char *endptr = NULL;
+        unsigned long value = strtoul(token, &endptr, 10);
+        if (endptr == token || *endptr || !value || value > MAX_THREADS || MAX_THREAD_COUNTS == *count) {
+            return -1;
+        }
+        thread_counts[(*count)++] = (unsigned) value;
+    }
+    return *count ? 0 : -1;
+}
+
+static void print_usage(const char *const program) {
+    fprintf(stderr,
+            "usage: %s [--threads N[,N...]] [--duration-ms N] [--filter NAME]\n"
+            "\n"
+            "  --threads      thread counts to run each benchmark with (default 1 and powers of two up to the processor count)\n"
+            "  --duration-ms  how long each benchmark runs per thread count (default %d)\n"
+            "  --filter       only run the benchmarks whose name contains NAME\n",
+            program, DEFAULT_DURATION_MS);
+}
+
+int main(int argc, char **argv) {
+    unsigned thread_counts[MAX_THREAD_COUNTS];
+    size_t thread_count_count = 0;
+    unsigned long duration_ms = DEFAULT_DURATION_MS;
+    const char *filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        char *endptr = NULL;
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc && !parse_thread_counts(argv[i + 1], thread_counts, &thread_count_count)) {
+            i++;
+        } else if (!strcmp(argv[i], "--duration-ms") && i + 1 < argc && (duration_ms = strtoul(argv[i + 1], &endptr, 10)) && !*endptr) {
+            i++;
+        } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!thread_count_count) {
+        long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (unsigned threads = 1; thread_count_count < MAX_THREAD_COUNTS && threads <= MAX_THREADS; threads *= 2) {
+            if (threads >= processor_count) {
+                thread_counts[thread_count_count++] = processor_count < 1 ? 1 : (unsigned) (processor_count > MAX_THREADS ? MAX_THREADS : processor_count);
+                break;
+            }
+            thread_counts[thread_count_count++] = threads;
+        }
+    }
+
+    cpid_context_t context = cpid_context_create();
+    if (!context) {
+        fprintf(stderr, "Error initializing CPID library.\n");
+        return 1;
+    }
+
+    int return_code = 0;
+    cpid_handle_t handle = cpid_initialize_from_context(context);
+    cpid_entry_t *entries = NULL;
+    size_t entry_count = 0;
+    if (!handle || enumerate_processes(handle, &entries, &entry_count)) {
+        fprintf(stderr, "Failed to enumerate processes.\n");
+        return_code = 1;
+    }
+    cpid_finalize(handle);
+
+    if (!return_code) {
+        printf("%zu processes, %lu ms per run\n\n", entry_count, duration_ms);
+        printf("%-22s %7s %14s %10s %11s %12s %10s\n", "benchmark", "threads", "ops/s", "ns/op", "cycles/op", "syscalls/op", "failures");
+    }
+
+    for (size_t i = 0; !return_code && i < BENCHMARK_COUNT; i++) {
+        if (filter && !strstr(benchmarks[i].name, filter)) {
+            continue;
+        }
+        for (size_t j = 0; !return_code && j < thread_count_count; j++) {
+            if (run_benchmark(&benchmarks[i], context, entries, entry_count, thread_counts[j], (uint64_t) duration_ms * 1000000u)) {
+                fprintf(stderr, "Failed to run %s with %u threads.\n", benchmarks[i].name, thread_counts[j]);
+                return_code = 1;
+            }
+        }
+    }
+
+    free(entries);
+    cpid_context_release(context);
+
+    return return_code;
+}
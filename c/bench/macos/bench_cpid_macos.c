@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// Measures the throughput of the CPID calculations and lookups across thread counts.
+// macOS has no public interface to the hardware counters, so only time is measured.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpid/cpid_macos.h"
+
+#define DEFAULT_DURATION_MS 1000
+#define MAX_THREADS 256
+#define MAX_THREAD_COUNTS 16
+// operations between two checks of the clock
+#define CHUNK_SIZE 256
+
+typedef struct benchmark benchmark_t;
+
+typedef struct {
+    const benchmark_t *benchmark;
+    cpid_handle_t handle;
+    const cpid_entry_t *entries;
+    size_t entry_count;
+    uint64_t duration_ns;
+    atomic_int *ready_count;
+    atomic_int *start;
+    pthread_t thread;
+    // results
+    uint64_t ops;
+    uint64_t failures;
+    uint64_t elapsed_ns;
+} worker_t;
+
+struct benchmark {
+    const char *name;
+    // runs CHUNK_SIZE operations and returns how many were done
+    uint64_t (*run_chunk)(worker_t *const worker, uint64_t *const cursor);
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t run_make_uuid(worker_t *const worker, uint64_t *const cursor) {
+    uuid_t uuid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++, (*cursor)++) {
+        if (cpid_make_uuid(worker->handle, (pid_t) (*cursor & 0xFFFFF), (int64_t) (*cursor / 1000000), (int32_t) (*cursor % 1000000), uuid)) {
+            worker->failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static uint64_t run_get_uuid_self(worker_t *const worker, uint64_t *const cursor) {
+    (void) cursor;
+    const pid_t pid = getpid();
+    uuid_t uuid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++) {
+        if (cpid_get_uuid(worker->handle, pid, uuid)) {
+            worker->failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static uint64_t run_get_uuid_all(worker_t *const worker, uint64_t *const cursor) {
+    uuid_t uuid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++, (*cursor)++) {
+        // processes that exited since the snapshot count as failures
+        if (cpid_get_uuid(worker->handle, worker->entries[*cursor % worker->entry_count].pid, uuid)) {
+            worker->failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static uint64_t run_get_uuid_string_self(worker_t *const worker, uint64_t *const cursor) {
+    (void) cursor;
+    const pid_t pid = getpid();
+    uuid_string_t uuid_string;
+    for (size_t i = 0; i < CHUNK_SIZE; i++) {
+        if (cpid_get_uuid_string(worker->handle, pid, uuid_string)) {
+            worker->failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static const benchmark_t benchmarks[] = {
+    {"make_uuid", run_make_uuid},
+    {"get_uuid_self", run_get_uuid_self},
+    {"get_uuid_all", run_get_uuid_all},
+    {"get_uuid_string_self", run_get_uuid_string_self},
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static void *worker_main(void *const argument) {
+    worker_t *const worker = argument;
+
+    atomic_fetch_add(worker->ready_count, 1);
+    while (!atomic_load(worker->start)) {
+    }
+
+    uint64_t cursor = 0;
+    const uint64_t start_ns = now_ns();
+    uint64_t elapsed_ns = 0;
+    do {
+        worker->ops += worker->benchmark->run_chunk(worker, &cursor);
+        elapsed_ns = now_ns() - start_ns;
+    } while (elapsed_ns < worker->duration_ns);
+    worker->elapsed_ns = elapsed_ns;
+
+    return NULL;
+}
+
+static int run_benchmark(const benchmark_t *const benchmark, const cpid_entry_t *const entries, const size_t entry_count, const unsigned thread_count, const uint64_t duration_ns) {
+    worker_t *workers = calloc(thread_count, sizeof(worker_t));
+    if (!workers) {
+        return -1;
+    }
+
+    atomic_int ready_count;
+    atomic_int start;
+    atomic_init(&ready_count, 0);
+    atomic_init(&start, 0);
+
+    int return_code = 0;
+    unsigned started = 0;
+    for (; started < thread_count; started++) {
+        worker_t *const worker = &workers[started];
+        worker->benchmark = benchmark;
+        worker->entries = entries;
+        worker->entry_count = entry_count;
+        worker->duration_ns = duration_ns;
+        worker->ready_count = &ready_count;
+        worker->start = &start;
+        // handles aren't thread-safe, each worker has its own
+        worker->handle = cpid_initialize();
+        if (!worker->handle || pthread_create(&worker->thread, NULL, worker_main, worker)) {
+            cpid_finalize(worker->handle);
+            return_code = -1;
+            break;
+        }
+    }
+
+    // all workers start together
+    while (atomic_load(&ready_count) < (int) started) {
+    }
+    atomic_store(&start, 1);
+
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        cpid_finalize(workers[i].handle);
+    }
+
+    if (!return_code) {
+        uint64_t ops = 0, failures = 0, elapsed_ns = 0;
+        double ops_per_second = 0;
+        for (unsigned i = 0; i < thread_count; i++) {
+            ops += workers[i].ops;
+            failures += workers[i].failures;
+            elapsed_ns += workers[i].elapsed_ns;
+            ops_per_second += (double) workers[i].ops * 1e9 / (double) workers[i].elapsed_ns;
+        }
+
+        printf("%-22s %7u %14.0f %10.1f %10llu\n", benchmark->name, thread_count, ops_per_second, (double) elapsed_ns / (double) ops, (unsigned long long) failures);
+    }
+
+    free(workers);
+
+    return return_code;
+}
+
+static int parse_thread_counts(char *const text, unsigned thread_counts[MAX_THREAD_COUNTS], size_t *const count) {
+    *count = 0;
+    for (char *token = strtok(text, ","); token; token = strtok(NULL, ",")) {
+        char *endptr = NULL;
+        unsigned long value = strtoul(token, &endptr, 10);
+        if (endptr == token || *endptr || !value || value > MAX_THREADS || MAX_THREAD_COUNTS == *count) {
+            return -1;
+        }
+        thread_counts[(*count)++] = (unsigned) value;
+    }
+    return *count ? 0 : -1;
+}
+
+static void print_usage(const char *const program) {
+    fprintf(stderr,
+            "usage: %s [--threads N[,N...]] [--duration-ms N] [--filter NAME]\n"
+            "\n"
+            "  --threads      thread counts to run each benchmark with (default 1 and powers of two up to the processor count)\n"
+            "  --duration-ms  how long each benchmark runs per thread count (default %d)\n"
+            "  --filter       only run the benchmarks whose name contains NAME\n",
+            program, DEFAULT_DURATION_MS);
+}
+
+int main(int argc, char **argv) {
+    unsigned thread_counts[MAX_THREAD_COUNTS];
+    size_t thread_count_count = 0;
+    unsigned long duration_ms = DEFAULT_DURATION_MS;
+    const char *filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        char *endptr = NULL;
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc && !parse_thread_counts(argv[i + 1], thread_counts, &thread_count_count)) {
+            i++;
+        } else if (!strcmp(argv[i], "--duration-ms") && i + 1 < argc && (duration_ms = strtoul(argv[i + 1], &endptr, 10)) && !*endptr) {
+            i++;
+        } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!thread_count_count) {
+        long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (unsigned threads = 1; thread_count_count < MAX_THREAD_COUNTS && threads <= MAX_THREADS; threads *= 2) {
+            if (threads >= processor_count) {
+                thread_counts[thread_count_count++] = processor_count < 1 ? 1 : (unsigned) (processor_count > MAX_THREADS ? MAX_THREADS : processor_count);
+                break;
+            }
+            thread_counts[thread_count_count++] = threads;
+        }
+    }
+
+    cpid_handle_t handle = cpid_initialize();
+    if (!handle) {
+        fprintf(stderr, "Error initializing CPID library.\n");
+        return 1;
+    }
+
+    // the snapshot is owned by the handle, which is kept until the benchmarks are done
+    int return_code = 0;
+    const cpid_entry_t *entries = NULL;
+    size_t entry_count = 0;
+    if (cpid_snapshot_all(handle, &entries, &entry_count) || !entry_count) {
+        fprintf(stderr, "Failed to enumerate processes.\n");
+        return_code = 1;
+    } else {
+        printf("%zu processes, %lu ms per run\n\n", entry_count, duration_ms);
+        printf("%-22s %7s %14s %10s %10s\n", "benchmark", "threads", "ops/s", "ns/op", "failures");
+    }
+
+    for (size_t i = 0; !return_code && i < BENCHMARK_COUNT; i++) {
+        if (filter && !strstr(benchmarks[i].name, filter)) {
+            continue;
+        }
+        for (size_t j = 0; !return_code && j < thread_count_count; j++) {
+            if (run_benchmark(&benchmarks[i], entries, entry_count, thread_counts[j], (uint64_t) duration_ms * 1000000u)) {
+                fprintf(stderr, "Failed to run %s with %u threads.\n", benchmarks[i].name, thread_counts[j]);
+                return_code = 1;
+            }
+        }
+    }
+
+    cpid_finalize(handle);
+
+    return return_code;
+}
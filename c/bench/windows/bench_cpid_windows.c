@@ -0,0 +1,371 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// Measures the throughput of the CPID calculations and lookups across thread counts.
+// Cycles are the CPU cycles charged to the benchmark threads, in user and kernel mode.
+
+#include <assert.h>
+#include <cpid/cpid_windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_DURATION_MS 1000
+#define MAX_THREADS 64
+#define MAX_THREAD_COUNTS 16
+// operations between two checks of the clock
+#define CHUNK_SIZE 256
+#define BATCH_SIZE 64
+
+typedef struct _BENCHMARK BENCHMARK;
+
+typedef struct _WORKER
+{
+    const BENCHMARK* Benchmark;
+    HANDLE LibraryHandle;
+    const cpid_entry_t* Entries;
+    size_t EntryCount;
+    UINT64 DurationTicks;
+    volatile LONG* ReadyCount;
+    volatile LONG* Start;
+    HANDLE Thread;
+    // results
+    UINT64 Ops;
+    UINT64 Failures;
+    UINT64 ElapsedTicks;
+    UINT64 Cycles;
+} WORKER;
+
+struct _BENCHMARK
+{
+    const char* Name;
+    // runs CHUNK_SIZE operations, or CHUNK_SIZE batches, and returns how many were done
+    UINT64 (*RunChunk)(_Inout_ WORKER* const worker, _Inout_ UINT64* const cursor);
+};
+
+static UINT64 now_ticks(void)
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (UINT64)counter.QuadPart;
+}
+
+static UINT64 run_make_cpid(_Inout_ WORKER* const worker, _Inout_ UINT64* const cursor)
+{
+    UUID cpid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++, (*cursor)++)
+    {
+        if (ERROR_SUCCESS != cpid_make_cpid(worker->LibraryHandle, (DWORD)(*cursor & 0xFFFFF) * 4, *cursor, &cpid))
+        {
+            worker->Failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static UINT64 run_make_cpid_batch(_Inout_ WORKER* const worker, _Inout_ UINT64* const cursor)
+{
+    DWORD pids[BATCH_SIZE];
+    UINT64 pcts[BATCH_SIZE];
+    UUID cpids[BATCH_SIZE];
+    for (size_t i = 0; i < CHUNK_SIZE; i++)
+    {
+        for (size_t j = 0; j < BATCH_SIZE; j++, (*cursor)++)
+        {
+            pids[j] = (DWORD)(*cursor & 0xFFFFF) * 4;
+            pcts[j] = *cursor;
+        }
+        if (ERROR_SUCCESS != cpid_make_cpid_batch(worker->LibraryHandle, pids, pcts, BATCH_SIZE, cpids))
+        {
+            worker->Failures += BATCH_SIZE;
+        }
+    }
+    return CHUNK_SIZE * BATCH_SIZE;
+}
+
+static UINT64 run_get_cpid_self(_Inout_ WORKER* const worker, _Inout_ UINT64* const cursor)
+{
+    UNREFERENCED_PARAMETER(cursor);
+    const DWORD pid = GetCurrentProcessId();
+    UUID cpid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++)
+    {
+        if (ERROR_SUCCESS != cpid_get_cpid(worker->LibraryHandle, pid, &cpid))
+        {
+            worker->Failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static UINT64 run_get_cpid_from_handle_self(_Inout_ WORKER* const worker, _Inout_ UINT64* const cursor)
+{
+    UNREFERENCED_PARAMETER(cursor);
+    // the pseudo handle has full access and needs no closing
+    const HANDLE processHandle = GetCurrentProcess();
+    UUID cpid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++)
+    {
+        if (ERROR_SUCCESS != cpid_get_cpid_from_handle(worker->LibraryHandle, processHandle, &cpid))
+        {
+            worker->Failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static UINT64 run_get_cpid_all(_Inout_ WORKER* const worker, _Inout_ UINT64* const cursor)
+{
+    UUID cpid;
+    for (size_t i = 0; i < CHUNK_SIZE; i++, (*cursor)++)
+    {
+        // processes that exited since the snapshot, or that can't be opened, count as failures
+        if (ERROR_SUCCESS != cpid_get_cpid(worker->LibraryHandle, worker->Entries[*cursor % worker->EntryCount].Pid, &cpid))
+        {
+            worker->Failures++;
+        }
+    }
+    return CHUNK_SIZE;
+}
+
+static const BENCHMARK Benchmarks[] = {
+    { "make_cpid", run_make_cpid },
+    { "make_cpid_batch", run_make_cpid_batch },
+    { "get_cpid_self", run_get_cpid_self },
+    { "get_cpid_from_handle_self", run_get_cpid_from_handle_self },
+    { "get_cpid_all", run_get_cpid_all },
+};
+
+#define BENCHMARK_COUNT (sizeof(Benchmarks) / sizeof(Benchmarks[0]))
+
+static DWORD WINAPI worker_main(_In_ LPVOID argument)
+{
+    WORKER* const worker = argument;
+
+    InterlockedIncrement(worker->ReadyCount);
+    while (!InterlockedCompareExchange(worker->Start, 0, 0))
+    {
+        YieldProcessor();
+    }
+
+    UINT64 cursor = 0;
+    ULONG64 startCycles = 0;
+    QueryThreadCycleTime(GetCurrentThread(), &startCycles);
+    const UINT64 startTicks = now_ticks();
+    UINT64 elapsedTicks = 0;
+    do
+    {
+        worker->Ops += worker->Benchmark->RunChunk(worker, &cursor);
+        elapsedTicks = now_ticks() - startTicks;
+    } while (elapsedTicks < worker->DurationTicks);
+    worker->ElapsedTicks = elapsedTicks;
+
+    ULONG64 endCycles = 0;
+    QueryThreadCycleTime(GetCurrentThread(), &endCycles);
+    worker->Cycles = endCycles - startCycles;
+
+    return 0;
+}
+
+static DWORD run_benchmark(_In_ const BENCHMARK* const benchmark,
+                           _In_reads_(entryCount) const cpid_entry_t* const entries,
+                           _In_ const size_t entryCount,
+                           _In_ const unsigned threadCount,
+                           _In_ const UINT64 durationMs)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    unsigned started = 0;
+    volatile LONG readyCount = 0;
+    volatile LONG start = 0;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    WORKER* workers = calloc(threadCount, sizeof(WORKER));
+    if (NULL == workers)
+    {
+        w32err = ERROR_NOT_ENOUGH_MEMORY;
+        goto Exit;
+    }
+
+    for (; started < threadCount; started++)
+    {
+        WORKER* const worker = &workers[started];
+        worker->Benchmark = benchmark;
+        worker->Entries = entries;
+        worker->EntryCount = entryCount;
+        worker->DurationTicks = durationMs * (UINT64)frequency.QuadPart / 1000;
+        worker->ReadyCount = &readyCount;
+        worker->Start = &start;
+
+        // each worker has its own handle, as the library handle keeps per-call state
+        w32err = cpid_initialize(&worker->LibraryHandle);
+        if (ERROR_SUCCESS != w32err)
+        {
+            break;
+        }
+
+        worker->Thread = CreateThread(NULL, 0, worker_main, worker, 0, NULL);
+        if (NULL == worker->Thread)
+        {
+            w32err = GetLastError();
+            assert(ERROR_SUCCESS != w32err);
+            (void)cpid_finalize(worker->LibraryHandle);
+            break;
+        }
+    }
+
+    // all workers start together
+    while (InterlockedCompareExchange(&readyCount, 0, 0) < (LONG)started)
+    {
+        YieldProcessor();
+    }
+    InterlockedExchange(&start, 1);
+
+    for (unsigned i = 0; i < started; i++)
+    {
+        WaitForSingleObject(workers[i].Thread, INFINITE);
+        CloseHandle(workers[i].Thread);
+        (void)cpid_finalize(workers[i].LibraryHandle);
+    }
+
+    if (ERROR_SUCCESS == w32err)
+    {
+        UINT64 ops = 0;
+        UINT64 failures = 0;
+        UINT64 elapsedTicks = 0;
+        UINT64 cycles = 0;
+        double opsPerSecond = 0;
+        for (unsigned i = 0; i < threadCount; i++)
+        {
+            ops += workers[i].Ops;
+            failures += workers[i].Failures;
+            elapsedTicks += workers[i].ElapsedTicks;
+            cycles += workers[i].Cycles;
+            opsPerSecond += (double)workers[i].Ops * (double)frequency.QuadPart / (double)workers[i].ElapsedTicks;
+        }
+
+        const double nsPerOp = (double)elapsedTicks * 1e9 / (double)frequency.QuadPart / (double)ops;
+        printf("%-26s %7u %14.0f %10.1f %11.0f %10llu\n",
+               benchmark->Name, threadCount, opsPerSecond, nsPerOp, (double)cycles / (double)ops, failures);
+    }
+
+Exit:
+    free(workers);
+
+    return w32err;
+}
+
+static BOOL parse_thread_counts(_Inout_z_ char* const text,
+                                _Out_writes_(MAX_THREAD_COUNTS) unsigned* const threadCounts,
+                                _Out_ size_t* const count)
+{
+    char* context = NULL;
+    *count = 0;
+    for (char* token = strtok_s(text, ",", &context); NULL != token; token = strtok_s(NULL, ",", &context))
+    {
+        char* endptr = NULL;
+        unsigned long value = strtoul(token, &endptr, 10);
+        if (endptr == token || '\0' != *endptr || 0 == value || value > MAX_THREADS || MAX_THREAD_COUNTS == *count)
+        {
+            return FALSE;
+        }
+        threadCounts[(*count)++] = (unsigned)value;
+    }
+    return 0 != *count;
+}
+
+static void print_usage(_In_z_ const char* const program)
+{
+    fprintf(stderr,
+            "usage: %s [--threads N[,N...]] [--duration-ms N] [--filter NAME]\n"
+            "\n"
+            "  --threads      thread counts to run each benchmark with (default 1 and powers of two up to the processor count)\n"
+            "  --duration-ms  how long each benchmark runs per thread count (default %d)\n"
+            "  --filter       only run the benchmarks whose name contains NAME\n",
+            program, DEFAULT_DURATION_MS);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threadCounts[MAX_THREAD_COUNTS];
+    size_t threadCountCount = 0;
+    unsigned long durationMs = DEFAULT_DURATION_MS;
+    const char* filter = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        char* endptr = NULL;
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc && parse_thread_counts(argv[i + 1], threadCounts, &threadCountCount))
+        {
+            i++;
+        }
+        else if (!strcmp(argv[i], "--duration-ms") && i + 1 < argc && 0 != (durationMs = strtoul(argv[i + 1], &endptr, 10)) && '\0' == *endptr)
+        {
+            i++;
+        }
+        else if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    if (0 == threadCountCount)
+    {
+        DWORD processorCount = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+        for (unsigned threads = 1; threadCountCount < MAX_THREAD_COUNTS && threads <= MAX_THREADS; threads *= 2)
+        {
+            if (threads >= processorCount)
+            {
+                threadCounts[threadCountCount++] = processorCount > MAX_THREADS ? MAX_THREADS : (processorCount < 1 ? 1 : processorCount);
+                break;
+            }
+            threadCounts[threadCountCount++] = threads;
+        }
+    }
+
+    HANDLE libraryHandle;
+    DWORD w32err = cpid_initialize(&libraryHandle);
+    if (ERROR_SUCCESS != w32err)
+    {
+        fprintf(stderr, "Error code %lu when initializing CPID library.\n", w32err);
+        return w32err;
+    }
+
+    cpid_entry_t* entries = NULL;
+    size_t entryCount = 0;
+    w32err = cpid_snapshot_all(libraryHandle, &entries, &entryCount);
+    (void)cpid_finalize(libraryHandle);
+    if (ERROR_SUCCESS != w32err || 0 == entryCount)
+    {
+        fprintf(stderr, "Error code %lu when enumerating processes.\n", w32err);
+        cpid_snapshot_free(entries);
+        return ERROR_SUCCESS != w32err ? w32err : ERROR_NOT_FOUND;
+    }
+
+    printf("%zu processes, %lu ms per run\n\n", entryCount, durationMs);
+    printf("%-26s %7s %14s %10s %11s %10s\n", "benchmark", "threads", "ops/s", "ns/op", "cycles/op", "failures");
+
+    for (size_t i = 0; ERROR_SUCCESS == w32err && i < BENCHMARK_COUNT; i++)
+    {
+        if (NULL != filter && NULL == strstr(Benchmarks[i].Name, filter))
+        {
+            continue;
+        }
+        for (size_t j = 0; ERROR_SUCCESS == w32err && j < threadCountCount; j++)
+        {
+            w32err = run_benchmark(&Benchmarks[i], entries, entryCount, threadCounts[j], durationMs);
+            if (ERROR_SUCCESS != w32err)
+            {
+                fprintf(stderr, "Error code %lu when running %s with %u threads.\n", w32err, Benchmarks[i].Name, threadCounts[j]);
+            }
+        }
+    }
+
+    cpid_snapshot_free(entries);
+
+    return w32err;
+}
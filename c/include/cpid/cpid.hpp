@@ -0,0 +1,430 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Header-only C++20 wrapper of the CPID library for Linux, macOS and Windows.
+// Nothing is allocated per call and batch calls write straight into the caller's spans.
+
+#if defined(_WIN32)
+#include "cpid/cpid_windows.h"
+#elif defined(__APPLE__)
+#include "cpid/cpid_macos.h"
+#else
+#include "cpid/cpid_linux.h"
+#endif
+#include "cpid/cpid_format.h"
+
+#include <array>
+#include <cerrno>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+namespace cpid {
+
+#if defined(_WIN32)
+using pid_type = DWORD;
+using native_handle_type = HANDLE;
+using native_uuid_type = UUID;
+#else
+using pid_type = pid_t;
+using native_handle_type = cpid_handle_t;
+using native_uuid_type = uuid_t;
+#endif
+
+/**
+ * A CPID as 16 bytes in the memory layout of the C API.
+ *
+ * @details That is RFC 9562 byte order on Linux and macOS (uuid_t) and the GUID layout on Windows (UUID),
+ *          so that spans of uuid can be passed to the C API as arrays of the native type without copies.
+ *          Comparisons are by byte, which is the order of memcmp on the native type.
+ */
+struct alignas(alignof(native_uuid_type)) uuid {
+    std::array<unsigned char, 16> bytes{};
+
+    friend constexpr bool operator==(const uuid &, const uuid &) noexcept = default;
+    friend constexpr auto operator<=>(const uuid &, const uuid &) noexcept = default;
+
+    /**
+     * Gets a pointer to the bytes as the native type of the C API.
+     */
+#if defined(_WIN32)
+    native_uuid_type *native() noexcept {
+        return reinterpret_cast<native_uuid_type *>(bytes.data());
+    }
+
+    const native_uuid_type *native() const noexcept {
+        return reinterpret_cast<const native_uuid_type *>(bytes.data());
+    }
+#else
+    unsigned char *native() noexcept {
+        return bytes.data();
+    }
+
+    const unsigned char *native() const noexcept {
+        return bytes.data();
+    }
+#endif
+
+    /**
+     * Formats the CPID as a lowercase RFC 9562 string into a caller-supplied buffer.
+     */
+    void to_chars(char (&out)[CPID_UUID_STRING_LENGTH + 1]) const noexcept {
+#if defined(_WIN32)
+        cpid_format_guid_batch(bytes.data(), 1, out, sizeof(out));
+#else
+        cpid_format_batch(bytes.data(), 1, out, sizeof(out));
+#endif
+    }
+
+    /**
+     * Formats the CPID as a lowercase RFC 9562 string.
+     */
+    std::string to_string() const {
+        char out[CPID_UUID_STRING_LENGTH + 1];
+        to_chars(out);
+        return std::string(out, CPID_UUID_STRING_LENGTH);
+    }
+};
+
+static_assert(sizeof(uuid) == sizeof(native_uuid_type), "cpid::uuid must have the size of the native UUID");
+static_assert(alignof(uuid) == alignof(native_uuid_type), "cpid::uuid must have the alignment of the native UUID");
+static_assert(std::is_trivially_copyable_v<uuid> && std::is_standard_layout_v<uuid>, "cpid::uuid must be layout compatible with the native UUID");
+static_assert(offsetof(uuid, bytes) == 0);
+
+/**
+ * Formats CPIDs as lowercase RFC 9562 strings.
+ *
+ * @details The NUL terminated string for in[i] is written to out.data() + i * stride,
+ *          see cpid_format_batch. out must hold in.size() * stride bytes.
+ */
+inline std::error_code format_batch(std::span<const uuid> in, std::span<char> out, const std::size_t stride) noexcept {
+    if (stride <= CPID_UUID_STRING_LENGTH || out.size() / stride < in.size()) {
+        return std::make_error_code(std::errc::invalid_argument);
+    }
+#if defined(_WIN32)
+    const int return_code = cpid_format_guid_batch(in.data(), in.size(), out.data(), stride);
+#else
+    const int return_code = cpid_format_batch(in.data(), in.size(), out.data(), stride);
+#endif
+    return return_code ? std::make_error_code(std::errc::invalid_argument) : std::error_code();
+}
+
+namespace detail {
+
+#if defined(_WIN32)
+inline std::error_code make_error(const DWORD w32err) noexcept {
+    return std::error_code(static_cast<int>(w32err), std::system_category());
+}
+#else
+// the C API reports failure with -1 and leaves errno from the failed call, if there was one
+inline std::error_code make_error(const int return_code) noexcept {
+    if (!return_code) {
+        return std::error_code();
+    }
+    return std::error_code(errno ? errno : EIO, std::generic_category());
+}
+#endif
+
+template <typename T>
+auto *native_uuids(std::span<T> uuids) noexcept {
+#if defined(_WIN32)
+    return reinterpret_cast<native_uuid_type *>(uuids.data());
+#else
+    return reinterpret_cast<uuid_t *>(uuids.data());
+#endif
+}
+
+} // namespace detail
+
+#if defined(__linux__)
+/**
+ * The process-specific CPID UUID inputs, as passed to cpid_make_uuid_batch.
+ */
+using input = cpid_linux_input_t;
+
+/**
+ * A shared CPID context, see cpid_context_create.
+ *
+ * @details Copies share the context through cpid_context_retain, so a context can be handed
+ *          to several threads that each create their own handle from it.
+ */
+class context {
+public:
+    /**
+     * Creates a context for the boot of the running system, throws std::system_error on error.
+     */
+    context() {
+        errno = 0;
+        native_ = cpid_context_create();
+        if (!native_) {
+            throw std::system_error(detail::make_error(-1), "cpid_context_create");
+        }
+    }
+
+    /**
+     * Creates a context for a supplied boot UUID, see cpid_context_create_with_boot_uuid.
+     */
+    explicit context(const uuid &boot_uuid) {
+        errno = 0;
+        native_ = cpid_context_create_with_boot_uuid(boot_uuid.native());
+        if (!native_) {
+            throw std::system_error(detail::make_error(-1), "cpid_context_create_with_boot_uuid");
+        }
+    }
+
+    context(const context &other) noexcept : native_(other.native_ ? cpid_context_retain(other.native_) : nullptr) {
+    }
+
+    context(context &&other) noexcept : native_(std::exchange(other.native_, nullptr)) {
+    }
+
+    context &operator=(context other) noexcept {
+        std::swap(native_, other.native_);
+        return *this;
+    }
+
+    ~context() {
+        if (native_) {
+            cpid_context_release(native_);
+        }
+    }
+
+    cpid_context_t native() const noexcept {
+        return native_;
+    }
+
+private:
+    cpid_context_t native_ = nullptr;
+};
+#elif defined(__APPLE__)
+/**
+ * The process-specific CPID UUID inputs, as passed to cpid_make_uuid.
+ */
+struct input {
+    pid_t pid;
+    int64_t creation_time_unix_epoch_seconds;
+    int32_t creation_time_micros_offset;
+};
+#endif
+
+/**
+ * A move-only owner of a CPID library handle.
+ *
+ * @details The handle is finalized when the owner is destroyed. Whether a handle can be used
+ *          from several threads follows the C API: not on Linux and macOS, yes on Windows.
+ *          Methods return an empty std::error_code on success.
+ */
+class handle {
+public:
+    /**
+     * Initializes a handle for the running system, throws std::system_error on error.
+     */
+    handle() {
+#if defined(_WIN32)
+        const DWORD w32err = cpid_initialize(&native_);
+        if (ERROR_SUCCESS != w32err) {
+            throw std::system_error(detail::make_error(w32err), "cpid_initialize");
+        }
+#else
+        errno = 0;
+        native_ = cpid_initialize();
+        if (!native_) {
+            throw std::system_error(detail::make_error(-1), "cpid_initialize");
+        }
+#endif
+    }
+
+#if defined(__linux__)
+    /**
+     * Initializes a handle from a shared context, throws std::system_error on error.
+     */
+    explicit handle(const context &shared_context) {
+        errno = 0;
+        native_ = cpid_initialize_from_context(shared_context.native());
+        if (!native_) {
+            throw std::system_error(detail::make_error(-1), "cpid_initialize_from_context");
+        }
+    }
+#endif
+
+    /**
+     * Takes ownership of a handle returned by the C API.
+     */
+    explicit handle(const native_handle_type native) noexcept : native_(native) {
+    }
+
+    handle(const handle &) = delete;
+    handle &operator=(const handle &) = delete;
+
+    handle(handle &&other) noexcept : native_(std::exchange(other.native_, nullptr)) {
+    }
+
+    handle &operator=(handle &&other) noexcept {
+        if (this != &other) {
+            reset();
+            native_ = std::exchange(other.native_, nullptr);
+        }
+        return *this;
+    }
+
+    ~handle() {
+        reset();
+    }
+
+    native_handle_type native() const noexcept {
+        return native_;
+    }
+
+    /**
+     * Gives up ownership of the handle without finalizing it.
+     */
+    native_handle_type release() noexcept {
+        return std::exchange(native_, nullptr);
+    }
+
+    explicit operator bool() const noexcept {
+        return native_ != nullptr;
+    }
+
+    /**
+     * Gets the CPID of a running process, see cpid_get_uuid (Linux, macOS) and cpid_get_cpid (Windows).
+     */
+    std::error_code get(const pid_type pid, uuid &out) noexcept {
+#if defined(_WIN32)
+        return detail::make_error(cpid_get_cpid(native_, pid, out.native()));
+#else
+        errno = 0;
+        return detail::make_error(cpid_get_uuid(native_, pid, out.native()));
+#endif
+    }
+
+#if defined(__linux__)
+    /**
+     * Gets the CPID of the process a pidfd refers to, see cpid_get_uuid_pidfd.
+     */
+    std::error_code get_pidfd(const int pidfd, uuid &out) noexcept {
+        errno = 0;
+        return detail::make_error(cpid_get_uuid_pidfd(native_, pidfd, out.native()));
+    }
+
+    /**
+     * Makes a CPID from caller-supplied inputs, see cpid_make_uuid.
+     */
+    std::error_code make(const input &in, uuid &out) noexcept {
+        errno = 0;
+        return detail::make_error(cpid_make_uuid(native_, in.pid_namespace_tgid, in.creation_time_ticks, in.pid_namespace, out.native()));
+    }
+
+    /**
+     * Makes the CPIDs of a batch of inputs in place, see cpid_make_uuid_batch.
+     *
+     * @details out[i] is made from in[i]. out must hold at least in.size() elements.
+     */
+    std::error_code make_batch(std::span<const input> in, std::span<uuid> out) noexcept {
+        if (out.size() < in.size()) {
+            return std::make_error_code(std::errc::invalid_argument);
+        }
+        errno = 0;
+        return detail::make_error(cpid_make_uuid_batch(native_, in.data(), in.size(), detail::native_uuids(out)));
+    }
+
+    /**
+     * Gets the CPIDs of all processes, see cpid_enumerate_all.
+     *
+     * @details count is populated with the number of entries written to out.
+     */
+    std::error_code enumerate_all(std::span<cpid_entry_t> out, std::size_t &count, const unsigned threads = 1) noexcept {
+        errno = 0;
+        return detail::make_error(cpid_enumerate_all(native_, out.data(), out.size(), &count, threads));
+    }
+#elif defined(__APPLE__)
+    /**
+     * Makes a CPID from caller-supplied inputs, see cpid_make_uuid.
+     */
+    std::error_code make(const input &in, uuid &out) noexcept {
+        errno = 0;
+        return detail::make_error(cpid_make_uuid(native_, in.pid, in.creation_time_unix_epoch_seconds, in.creation_time_micros_offset, out.native()));
+    }
+
+    /**
+     * Makes the CPIDs of a batch of inputs in place.
+     *
+     * @details out[i] is made from in[i]. out must hold at least in.size() elements.
+     *          The macOS C API has no batch call, so each CPID is made with cpid_make_uuid.
+     */
+    std::error_code make_batch(std::span<const input> in, std::span<uuid> out) noexcept {
+        if (out.size() < in.size()) {
+            return std::make_error_code(std::errc::invalid_argument);
+        }
+        for (std::size_t i = 0; i < in.size(); i++) {
+            if (const std::error_code error = make(in[i], out[i])) {
+                return error;
+            }
+        }
+        return std::error_code();
+    }
+#elif defined(_WIN32)
+    /**
+     * Gets the CPID of the process of an open process handle, see cpid_get_cpid_from_handle.
+     */
+    std::error_code get_from_handle(const HANDLE process, uuid &out) noexcept {
+        return detail::make_error(cpid_get_cpid_from_handle(native_, process, out.native()));
+    }
+
+    /**
+     * Makes a CPID from a caller-supplied PID and PCT, see cpid_make_cpid.
+     */
+    std::error_code make(const pid_type pid, const UINT64 pct, uuid &out) noexcept {
+        return detail::make_error(cpid_make_cpid(native_, pid, pct, out.native()));
+    }
+
+    /**
+     * Makes the CPIDs of a batch of PIDs and PCTs in place, see cpid_make_cpid_batch.
+     *
+     * @details out[i] is made from pids[i] and pcts[i]. pids and pcts must have the same size
+     *          and out must hold at least that many elements.
+     */
+    std::error_code make_batch(std::span<const pid_type> pids, std::span<const UINT64> pcts, std::span<uuid> out) noexcept {
+        if (pids.size() != pcts.size() || out.size() < pids.size()) {
+            return detail::make_error(ERROR_INVALID_PARAMETER);
+        }
+        return detail::make_error(cpid_make_cpid_batch(native_, pids.data(), pcts.data(), pids.size(), detail::native_uuids(out)));
+    }
+#endif
+
+private:
+    void reset() noexcept {
+        if (native_) {
+            cpid_finalize(native_);
+            native_ = nullptr;
+        }
+    }
+
+    native_handle_type native_ = nullptr;
+};
+
+} // namespace cpid
+
+/**
+ * Hashes a CPID by its leading bytes, which is sound since CPIDs are SHA-256 digest output.
+ */
+namespace std {
+
+template <>
+struct hash<cpid::uuid> {
+    size_t operator()(const cpid::uuid &value) const noexcept {
+        size_t result;
+        memcpy(&result, value.bytes.data(), sizeof(result));
+        return result;
+    }
+};
+
+} // namespace std
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+// Length of a UUID string without the NUL terminator, the output stride must be larger.
+#define CPID_UUID_STRING_LENGTH 36
+
+/**
+ * Formats UUIDs as lowercase RFC 9562 strings.
+ *
+ * @details in points to n consecutive 16-byte UUIDs in RFC 9562 binary byte order,
+ *          which is the uuid_t layout on Linux and macOS.
+ *          The NUL terminated string for the i-th UUID is written to out + i * stride,
+ *          so stride must be at least CPID_UUID_STRING_LENGTH + 1. Bytes in between are left alone.
+ *          Nothing is allocated. Passing n equal to 0 is not an error.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_format_batch(const void *const in, const size_t n, char *const out, const size_t stride);
+
+/**
+ * Formats UUIDs in the Windows GUID memory layout as lowercase RFC 9562 strings.
+ *
+ * @details Like cpid_format_batch, except that the first three fields of each UUID
+ *          (Data1, Data2 and Data3 of a GUID) are little-endian. The output matches UuidToStringA.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_format_guid_batch(const void *const in, const size_t n, char *const out, const size_t stride);
+
+#ifdef __cplusplus
+}
+#endif
@@ -6,27 +6,122 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <uuid/uuid.h>
 
 typedef void *cpid_handle_t;
 
+typedef void *cpid_context_t;
+
 // uuid_string_t isn't defined by libuuid on Linux
 typedef char uuid_string_t[37];
 
+/**
+ * The process-specific CPID UUID inputs, as passed to cpid_make_uuid.
+ */
+typedef struct {
+    pid_t pid_namespace_tgid;
+    uint64_t creation_time_ticks;
+    ino_t pid_namespace;
+} cpid_linux_input_t;
+
+/**
+ * Creates a CPID context.
+ * 
+ * @details The context holds the boot identity and the resources that don't change after creation.
+ *          It is read-only and reference counted, so it can be shared by all threads of a process.
+ *          The reference returned by this method must be released with cpid_context_release.
+ *
+ * @return NULL on error, a CPID context on success.
+ */
+cpid_context_t cpid_context_create(void);
+
+/**
+ * Creates a CPID context for a given boot identity.
+ *
+ * @details The context is like one returned by cpid_context_create, except that boot_uuid
+ *          takes the place of the local /proc/sys/kernel/random/boot_id.
+ *          This allows CPID UUIDs to be calculated from recorded inputs of another host or an earlier boot.
+ *          Handles created from this context only support cpid_make_uuid and cpid_make_uuid_batch,
+ *          methods that source inputs from /proc fail.
+ *          The reference returned by this method must be released with cpid_context_release.
+ *
+ * @return NULL on error, a CPID context on success.
+ */
+cpid_context_t cpid_context_create_with_boot_uuid(const uuid_t boot_uuid);
+
+/**
+ * Gets the process-wide CPID context.
+ *
+ * @details The context is created like one from cpid_context_create by the first call in the process,
+ *          later calls only take a reference to it. Unlike cpid_context_create, the SHA-256
+ *          implementation is fetched from OpenSSL by the first CPID UUID calculation rather than up front.
+ *          The context is released by the process exiting, never by its last reference.
+ *          This method is thread-safe.
+ *          The reference returned by this method must be released with cpid_context_release.
+ *
+ * @return NULL on error, a CPID context on success.
+ */
+cpid_context_t cpid_context_get_default(void);
+
+/**
+ * Takes an additional reference to a CPID context.
+ * 
+ * @details This method is thread-safe.
+ *
+ * @return the given context.
+ */
+cpid_context_t cpid_context_retain(cpid_context_t const context);
+
+/**
+ * Releases a reference to a CPID context.
+ * 
+ * @details The context is freed when its last reference, including the references held by handles, is released.
+ *          This method is thread-safe.
+ */
+void cpid_context_release(cpid_context_t const context);
+
+/**
+ * Initializes a CPID handle from a shared CPID context.
+ * 
+ * @details The handle holds the mutable per-thread state for CPID method calls
+ *          and keeps its own reference to the context.
+ *          This is cheap compared to cpid_initialize, so one handle can be created per thread.
+ *          Handles created from the same context can be used concurrently from different threads.
+ *          cpid_finalize must be called when the handle is no longer needed.
+ *
+ * @return NULL on error, a CPID library handle on success.
+ */
+cpid_handle_t cpid_initialize_from_context(cpid_context_t const context);
+
 /**
  * Initializes a CPID handle
  * 
  * @details The returned handle must be passed to other CPID methods.
  *          It contains state that can be reused across CPID method calls.
- *          CPID handles are not thread-safe.
+ *          CPID handles are not thread-safe, use one handle per thread.
+ *          Threads can share a context through cpid_initialize_from_context instead.
  *          cpid_finalize must be called when the handle is no longer needed.
  *
  * @return NULL on error, a CPID library handle on success.
  */
 cpid_handle_t cpid_initialize(void);
 
+/**
+ * Initializes a CPID handle from the process-wide CPID context.
+ *
+ * @details Like cpid_initialize, except that the boot identity and /proc are only read
+ *          by the first call in the process, see cpid_context_get_default, and that the digest
+ *          is set up by the first CPID UUID calculation of the handle.
+ *          This suits short-lived tools and per-request workers that initialize often.
+ *          cpid_finalize must be called when the handle is no longer needed.
+ *
+ * @return NULL on error, a CPID library handle on success.
+ */
+cpid_handle_t cpid_initialize_lazy(void);
+
 /**
  * Finalizes a CPID handle.
  * 
@@ -44,15 +139,42 @@ void cpid_finalize(cpid_handle_t const library_handle);
  */
 int cpid_make_uuid(cpid_handle_t const library_handle, const pid_t pid_namespace_tgid, const uint64_t creation_time_ticks, const ino_t pid_namespace, uuid_t uuid);
 
+/**
+ * Calculates CPID UUIDs for many processes at once.
+ * 
+ * @details uuids[i] is populated with the CPID UUID for inputs[i], for each of the n inputs.
+ *          The result for each input is identical to calling cpid_make_uuid with the same values.
+ *          With CPID_BUILTIN_SHA256 the digests of up to 16 inputs are computed side by side
+ *          in the AVX-512, AVX2 or NEON vector lanes the CPU has, with OpenSSL they are computed one by one.
+ *          Passing n equal to 0 is not an error.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_make_uuid_batch(cpid_handle_t const library_handle, const cpid_linux_input_t *const inputs, const size_t n, uuid_t *const uuids);
+
 /**
  * Sources information for a CPID UUID and performs the calculation.
  * 
  * @details uuid is populated with the CPID UUID for the living process with the given userspace PID.
+ *          The PID is interpreted in the PID namespace of the /proc mount, and must be a process ID (TGID)
+ *          rather than the ID of a non-leader thread.
  *
  * @return 0 on success, -1 on error.
  */
 int cpid_get_uuid(cpid_handle_t const library_handle, const pid_t pid, uuid_t uuid);
 
+/**
+ * Sources information for a CPID UUID through a pidfd and performs the calculation.
+ * 
+ * @details uuid is populated with the CPID UUID for the living process referred to by pidfd,
+ *          as returned by pidfd_open or clone3 with CLONE_PIDFD.
+ *          Unlike cpid_get_uuid, the result can't belong to a different process that reused the PID.
+ *          The NSpid field of the pidfd fdinfo is required, which is available from Linux 5.10.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_get_uuid_pidfd(cpid_handle_t const library_handle, const int pidfd, uuid_t uuid);
+
 /**
  * Sources information for a CPID UUID, performs the calculation
  * and converts the result to a string.
@@ -64,6 +186,371 @@ int cpid_get_uuid(cpid_handle_t const library_handle, const pid_t pid, uuid_t uu
  */
 int cpid_get_uuid_string(cpid_handle_t const library_handle, const pid_t pid, uuid_string_t uuid_string);
 
+/**
+ * A process with its CPID UUID, the inputs of the CPID UUID and its parent.
+ */
+typedef struct {
+    pid_t pid;
+    // the parent PID as seen by the PID namespace of /proc, 0 if there is no visible parent
+    pid_t parent_pid;
+    cpid_linux_input_t input;
+    uuid_t uuid;
+    // 0 if parent_uuid is populated, -1 otherwise
+    int parent_status;
+    uuid_t parent_uuid;
+} cpid_record_t;
+
+// Also calculate the CPID UUID of the parent, see cpid_get_process_record.
+#define CPID_RECORD_PARENT_UUID 1
+
+/**
+ * Sources a process record for the living process with the given PID.
+ * 
+ * @details record is populated with the CPID UUID, its inputs and the parent PID,
+ *          all taken from the same reads that cpid_get_uuid performs.
+ *          With the CPID_RECORD_PARENT_UUID flag the CPID UUID of the parent is calculated too.
+ *          Failing to do so, e.g. since the parent has already exited, doesn't fail the call
+ *          but leaves parent_status at -1. A parent that started after the process
+ *          (a reused PID) is treated as exited.
+ *          The handle's cache is used and updated if it has one.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_get_process_record(cpid_handle_t const library_handle, const pid_t pid, const int flags, cpid_record_t *const record);
+
+/**
+ * Calculates the CPID UUIDs of a process and its ancestors.
+ * 
+ * @details chain is populated with the CPID UUID of the process at index 0, of its parent
+ *          at index 1 and so on, up to init or max_depth entries. depth is set to the
+ *          number of entries populated. The chain ends early at an ancestor that has
+ *          already exited, whose PID was reused, or that isn't visible in /proc.
+ *          Parents are found with the same reads that calculate the CPID UUIDs.
+ *          With a cache (see cpid_cache_enable) ancestors are taken from the cache, so
+ *          processes sharing ancestors only pay for the shared part of the chain once.
+ *
+ * @return 0 on success, -1 on error or if the process itself can't be found.
+ */
+int cpid_get_ancestry(cpid_handle_t const library_handle, const pid_t pid, uuid_t *const chain, const size_t max_depth, size_t *const depth);
+
+// Cache hits are returned without revalidation, see cpid_cache_enable.
+#define CPID_CACHE_TRUST_EVICTION 1
+
+/**
+ * Enables a PID keyed cache of CPID UUIDs on a handle.
+ * 
+ * @details With a cache cpid_get_uuid and cpid_get_uuid_string first look the PID up.
+ *          A hit is revalidated by reading the start time of the PID alone,
+ *          which is cheaper than sourcing all CPID inputs and hashing them.
+ *          With the CPID_CACHE_TRUST_EVICTION flag hits are returned without any I/O.
+ *          This is only correct if cpid_cache_evict is called for every process exit,
+ *          e.g. by reading a CPID stream opened with the same handle.
+ *          The cache holds up to capacity entries, when full new entries replace old ones.
+ *          Enabling again replaces the cache with an empty one, a capacity of 0 disables it.
+ *          Like the handle, the cache isn't thread-safe.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_cache_enable(cpid_handle_t const library_handle, const size_t capacity, const int flags);
+
+/**
+ * Removes the cache entry of a PID.
+ * 
+ * @details Should be called when the process exits, so a later process with the same PID
+ *          doesn't get the cached CPID UUID. CPID streams do this for their handle.
+ *          Nothing happens if the handle has no cache or the PID isn't cached.
+ */
+void cpid_cache_evict(cpid_handle_t const library_handle, const pid_t pid);
+
+/**
+ * The stages of sourcing and calculating a CPID UUID, see cpid_get_stats.
+ */
+typedef enum {
+    // opening /proc/<pid>, fails when the process is gone
+    CPID_STAGE_OPEN_PID_DIRECTORY = 0,
+    // reading the ns/pid link, fails without ptrace read access to the process
+    CPID_STAGE_PID_NAMESPACE = 1,
+    // reading the NSpid line of the status file, skipped for processes of the /proc PID namespace
+    CPID_STAGE_PID_NAMESPACE_TGID = 2,
+    // reading the start time from the stat file
+    CPID_STAGE_CREATION_TIME = 3,
+    // hashing the inputs
+    CPID_STAGE_DIGEST = 4,
+    // rereading the start time of a cache hit
+    CPID_STAGE_CACHE_REVALIDATION = 5,
+    CPID_STAGE_COUNT = 6
+} cpid_stage_t;
+
+#define CPID_STATS_HISTOGRAM_BUCKET_COUNT 32
+
+/**
+ * Call counts and latencies of one stage.
+ *
+ * @details latency_histogram[i] counts the calls that took from 2^i up to 2^(i+1) nanoseconds.
+ *          The first bucket also counts calls below 1 nanosecond, the last one all calls above its range.
+ */
+typedef struct {
+    uint64_t calls;
+    uint64_t failures;
+    uint64_t total_latency_ns;
+    uint64_t latency_histogram[CPID_STATS_HISTOGRAM_BUCKET_COUNT];
+} cpid_stage_stats_t;
+
+/**
+ * Counters of a handle, see cpid_get_stats.
+ */
+typedef struct {
+    // cpid_get_uuid and cpid_get_uuid_string calls, and how many of them failed
+    uint64_t lookups;
+    uint64_t lookup_failures;
+    // lookups answered from the cache
+    uint64_t cache_hits;
+    cpid_stage_stats_t stages[CPID_STAGE_COUNT];
+} cpid_stats_t;
+
+/**
+ * Gets the counters of a handle.
+ *
+ * @details The counters are only kept when the library is built with -DCPID_ENABLE_STATS=ON,
+ *          otherwise the instrumentation is compiled out and this method fails.
+ *          They count the calls made with this handle since it was initialized, including those
+ *          made by its CPID stream, and never reset. Like the handle, they aren't thread-safe,
+ *          so a thread reads the counters of its own handles. Per-stage counters are updated
+ *          by every method that sources or hashes CPID UUID inputs.
+ *
+ * @return 0 on success, -1 on error or if the library is built without stats.
+ */
+int cpid_get_stats(cpid_handle_t const library_handle, cpid_stats_t *const stats);
+
+/**
+ * A process, its creation time in clock ticks and its CPID UUID.
+ */
+typedef struct {
+    pid_t pid;
+    uint64_t creation_time_ticks;
+    uuid_t uuid;
+} cpid_entry_t;
+
+/**
+ * Calculates CPID UUIDs for every process visible in /proc.
+ * 
+ * @details The /proc directory is read in a single pass and the PIDs are split across
+ *          threads worker threads, each with its own handle created from the context of
+ *          library_handle. The calling thread is one of the workers. A threads value of 0
+ *          uses one worker per online processor. If some of the threads can't be started,
+ *          the workers that are running sweep the whole of /proc.
+ *          Up to cap entries are written to out in /proc order and n is set to the number written.
+ *          Processes that exit during the sweep, or whose CPID inputs the caller isn't
+ *          permitted to read, are left out.
+ *          If more than cap processes are found -1 is returned and n is set to the
+ *          number of processes found, so the call can be retried with a larger buffer.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_enumerate_all(cpid_handle_t const library_handle, cpid_entry_t *const out, const size_t cap, size_t *const n, const unsigned threads);
+
+/**
+ * Calculates CPID UUIDs for every process visible in /proc, along with their inputs.
+ *
+ * @details Like cpid_enumerate_all, except that inputs, which holds up to cap inputs like out,
+ *          is populated with the CPID UUID inputs of each entry: inputs[i] are those of out[i].
+ *          This spares callers that also want the inputs a second sweep that could find other processes.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_enumerate_all_with_inputs(cpid_handle_t const library_handle, cpid_entry_t *const out, cpid_linux_input_t *const inputs, const size_t cap, size_t *const n, const unsigned threads);
+
+/**
+ * Process events delivered by a CPID stream.
+ */
+typedef enum {
+    CPID_STREAM_EVENT_FORK = 1,
+    CPID_STREAM_EVENT_EXEC = 2,
+    CPID_STREAM_EVENT_EXIT = 3
+} cpid_stream_event_t;
+
+/**
+ * A process event with the CPID UUID of the process.
+ *
+ * @details status is 0 when uuid holds the CPID UUID of the process with the given PID.
+ *          creation_time_ticks is then the creation time the CPID UUID was calculated from.
+ *          status is -1 when the CPID UUID inputs couldn't be sourced, e.g. because the process
+ *          was already gone, and creation_time_ticks and uuid are zeroed.
+ */
+typedef struct {
+    pid_t pid;
+    cpid_stream_event_t event;
+    int status;
+    uint64_t creation_time_ticks;
+    uuid_t uuid;
+} cpid_stream_record_t;
+
+typedef void *cpid_stream_t;
+
+/**
+ * Opens a stream of process events using the netlink proc connector.
+ * 
+ * @details The stream calculates CPID UUIDs with the given handle as events arrive,
+ *          so short-lived processes are captured before they exit.
+ *          The handle must outlive the stream and shouldn't be used concurrently with it.
+ *          If the handle has a cache (see cpid_cache_enable), the stream stores the CPIDs it calculates,
+ *          evicts exited processes and takes the CPIDs of EXIT records from the cache.
+ *          Requires CAP_NET_ADMIN and a /proc mount of the initial PID namespace.
+ *          The handle can't be from a context with a given boot UUID, since the events are of the
+ *          local boot, the call then fails with errno set to ENOTSUP.
+ *          cpid_stream_close must be called when the stream is no longer needed.
+ *
+ * @return NULL on error, a CPID stream on success.
+ */
+cpid_stream_t cpid_stream_open(cpid_handle_t const library_handle);
+
+/**
+ * Closes a CPID stream.
+ * 
+ * @details The stream is no longer valid after this method is called.
+ */
+void cpid_stream_close(cpid_stream_t const stream);
+
+/**
+ * Gets the descriptor of a CPID stream for use with poll, select or epoll.
+ * 
+ * @details The descriptor becomes readable when cpid_stream_next_batch won't block.
+ *
+ * @return -1 on error, the stream descriptor on success.
+ */
+int cpid_stream_get_fd(cpid_stream_t const stream);
+
+/**
+ * Reads the next batch of process events from a CPID stream.
+ * 
+ * @details Blocks until at least one event is available, then also takes the events
+ *          that are already queued, up to capacity. The CPID UUIDs of the batch are hashed in one pass.
+ *          Thread creation and exit events are skipped.
+ *          count is populated with the number of records written to records.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_stream_next_batch(cpid_stream_t const stream, cpid_stream_record_t *const records, const size_t capacity, size_t *const count);
+
+/**
+ * Gets the number of times the kernel dropped events of a CPID stream.
+ *
+ * @details The proc connector drops events when the socket buffer of the stream overflows.
+ *          It doesn't say how many, each increment is one or more lost events.
+ *          Callers that track processes should sweep /proc again when the count goes up.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_stream_get_lost_count(cpid_stream_t const stream, uint64_t *const lost_count);
+
+typedef void *cpid_shm_t;
+
+// The shared-memory table that cpidd publishes by default.
+#define CPID_SHM_DEFAULT_NAME "/cpid"
+
+// Consumers ignore a table whose producer hasn't called cpid_shm_heartbeat for this long.
+#define CPID_SHM_HEARTBEAT_TIMEOUT_MS 5000
+
+/**
+ * Creates a shared-memory table of CPID UUIDs keyed by PID, for a single producer.
+ * 
+ * @details The table is a POSIX shared-memory object that consumers map read-only with cpid_shm_open.
+ *          It holds up to capacity processes. An existing object with the same name is replaced,
+ *          consumers of the old one fall back once its heartbeat stops.
+ *          Consumers ignore the table until the first cpid_shm_heartbeat, which should follow the
+ *          initial cpid_shm_replace_all. The producer methods aren't thread-safe.
+ *          cpid_shm_close must be called when the table is no longer needed, which also removes it.
+ *
+ * @return NULL on error, a CPID shared-memory table on success.
+ */
+cpid_shm_t cpid_shm_create(const char *const name, const size_t capacity);
+
+/**
+ * Inserts or replaces the CPID UUID of a PID in a table created with cpid_shm_create.
+ *
+ * @details creation_time_ticks is the creation time the CPID UUID was calculated from,
+ *          as in cpid_entry_t and cpid_stream_record_t. Consumers check it before using the entry.
+ *
+ * @return 0 on success, -1 on error (including when the table is full).
+ */
+int cpid_shm_publish(cpid_shm_t const shm, const pid_t pid, const uint64_t creation_time_ticks, const uuid_t uuid);
+
+/**
+ * Removes the CPID UUID of a PID, if there is one, from a table created with cpid_shm_create.
+ */
+void cpid_shm_withdraw(cpid_shm_t const shm, const pid_t pid);
+
+/**
+ * Replaces the contents of a table created with cpid_shm_create with n entries.
+ * 
+ * @details PIDs that aren't among the entries are removed, the others are published.
+ *          Consumers may miss PIDs while this is in progress but never see a CPID UUID
+ *          that wasn't published for the PID.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_shm_replace_all(cpid_shm_t const shm, const cpid_entry_t *const entries, const size_t n);
+
+/**
+ * Marks a table created with cpid_shm_create as current.
+ * 
+ * @details Must be called more often than CPID_SHM_HEARTBEAT_TIMEOUT_MS for consumers to use the table.
+ */
+void cpid_shm_heartbeat(cpid_shm_t const shm);
+
+// Hits are returned without checking the creation time in /proc, see cpid_shm_open.
+#define CPID_SHM_TRUST_EVICTION 1
+
+/**
+ * Maps a table published by cpid_shm_create read-only, e.g. the one of cpidd.
+ * 
+ * @details Fails if the table is of another PID namespace, since its PIDs would be those of the producer.
+ *          Also fails with EACCES unless the object is owned by root or the effective user of the caller
+ *          and isn't writable by its group or others, since any user can create a name in /dev/shm
+ *          while the producer isn't running. See cpid_shm_open_with_owner for producers of another user.
+ *          Hits are checked against the creation time of the PID in /proc, which the mapping keeps open.
+ *          With the CPID_SHM_TRUST_EVICTION flag hits are returned without any system call.
+ *          This is only correct if the PIDs of the processes looked up can't be reused,
+ *          e.g. because they are children of the caller that haven't been reaped yet.
+ *          The mapping is thread-safe, any number of threads can look up PIDs in it concurrently.
+ *          cpid_shm_close must be called when the table is no longer needed.
+ *
+ * @return NULL on error, a CPID shared-memory table on success.
+ */
+cpid_shm_t cpid_shm_open(const char *const name, const int flags);
+
+/**
+ * Maps a table published by cpid_shm_create read-only, with the user of the producer.
+ *
+ * @details Like cpid_shm_open, except that the object must be owned by root or owner_uid,
+ *          e.g. the service user that cpidd runs as, rather than the effective user of the caller.
+ *
+ * @return NULL on error, a CPID shared-memory table on success.
+ */
+cpid_shm_t cpid_shm_open_with_owner(const char *const name, const uid_t owner_uid, const int flags);
+
+/**
+ * Looks up the CPID UUID of a PID in a table mapped with cpid_shm_open.
+ * 
+ * @details A hit is served from shared memory after a single read of the stat file of the PID,
+ *          which is much cheaper than sourcing all CPID inputs and hashing them.
+ *          The producer may not have processed the exit of a PID yet, or may have lost the events
+ *          of a reused PID until its next sweep of /proc, so an entry whose creation time
+ *          doesn't match the one in /proc is treated as a miss.
+ *          On a miss, or if the producer's heartbeat has stopped, the CPID UUID is calculated
+ *          with cpid_get_uuid when library_handle isn't NULL.
+ *
+ * @return 0 on success, -1 on error (including a miss without a library_handle).
+ */
+int cpid_shm_get_uuid(cpid_shm_t const shm, cpid_handle_t const library_handle, const pid_t pid, uuid_t uuid);
+
+/**
+ * Unmaps a table, and removes it if it was created with cpid_shm_create.
+ * 
+ * @details The table is no longer valid after this method is called.
+ */
+void cpid_shm_close(cpid_shm_t const shm);
+
 #ifdef __cplusplus
 }
 #endif
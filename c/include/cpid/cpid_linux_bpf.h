@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "cpid/cpid_linux.h"
+
+typedef void *cpid_bpf_t;
+
+/**
+ * Loads and attaches the CPID input capture BPF program.
+ * 
+ * @details The program reads the CPID UUID inputs straight from the kernel task at fork, exec and exit time
+ *          and delivers them through a BPF ring buffer, so /proc isn't read at all and
+ *          exiting processes still get their CPID UUID.
+ *          CPID UUIDs are calculated with the given handle, which must outlive the capture
+ *          and shouldn't be used concurrently with it. The handle can't be from a context with a given
+ *          boot UUID, since the events are of the local boot, the call then fails with errno set to ENOTSUP.
+ *          Start times are shifted by the boottime offset of the time namespace of the caller,
+ *          as /proc does for its readers, so the CPID UUIDs are those that cpid_get_uuid calculates.
+ *          Requires a kernel with BTF and CAP_BPF plus CAP_PERFMON (or CAP_SYS_ADMIN).
+ *          Without them the call fails with errno set to EPERM or ENOSYS.
+ *          cpid_bpf_close must be called when the capture is no longer needed.
+ *
+ * @return NULL on error, a CPID BPF capture on success.
+ */
+cpid_bpf_t cpid_bpf_open(cpid_handle_t const library_handle);
+
+/**
+ * Detaches the capture BPF program and frees its resources.
+ * 
+ * @details The capture is no longer valid after this method is called.
+ */
+void cpid_bpf_close(cpid_bpf_t const capture);
+
+/**
+ * Gets an epoll descriptor that becomes readable when capture events are available.
+ *
+ * @return -1 on error, the descriptor on success.
+ */
+int cpid_bpf_get_fd(cpid_bpf_t const capture);
+
+/**
+ * Reads the next batch of process events captured by the BPF program.
+ * 
+ * @details Waits up to timeout_ms milliseconds for events (-1 waits indefinitely),
+ *          then takes the events that are available, up to capacity.
+ *          The records use the same layout as the proc connector stream.
+ *          Thread creation and exit events are skipped by the BPF program.
+ *          count is populated with the number of records written to records, which may be 0 on timeout.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_bpf_next_batch(cpid_bpf_t const capture, cpid_stream_record_t *const records, const size_t capacity, size_t *const count, const int timeout_ms);
+
+/**
+ * Gets the number of process events the BPF program has dropped.
+ *
+ * @details Events are dropped when the ring buffer is full because the caller isn't reading them fast enough.
+ *          Unlike with cpid_stream_get_lost_count, each event is counted.
+ *          Callers that track processes should sweep /proc again when the count goes up.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_bpf_get_lost_count(cpid_bpf_t const capture, uint64_t *const lost_count);
+
+#ifdef __cplusplus
+}
+#endif
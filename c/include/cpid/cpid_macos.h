@@ -6,12 +6,35 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <uuid/uuid.h>
 
 typedef void *cpid_handle_t;
 
+typedef struct {
+    pid_t pid;
+    uuid_t uuid;
+} cpid_entry_t;
+
+/**
+ * A process with its CPID UUID, the inputs of the CPID UUID and its parent.
+ */
+typedef struct {
+    pid_t pid;
+    pid_t parent_pid;
+    int64_t creation_time_unix_epoch_seconds;
+    int32_t creation_time_micros_offset;
+    uuid_t uuid;
+    // 0 if parent_uuid is populated, -1 otherwise
+    int parent_status;
+    uuid_t parent_uuid;
+} cpid_record_t;
+
+// Also calculate the CPID UUID of the parent, see cpid_get_process_record.
+#define CPID_RECORD_PARENT_UUID 1
+
 /**
  * Initializes a CPID handle
  * 
@@ -24,6 +47,49 @@ typedef void *cpid_handle_t;
  */
 cpid_handle_t cpid_initialize(void);
 
+#define CPID_SERIAL_NUMBER_BUFFER_SIZE 16
+
+/**
+ * The boot identifying CPID UUID inputs of a host, as sourced by cpid_initialize.
+ */
+typedef struct {
+    // the platform serial number, NUL terminated
+    char serial_number[CPID_SERIAL_NUMBER_BUFFER_SIZE];
+    uuid_t hardware_uuid;
+    int64_t kernel_task_creation_time_unix_epoch_seconds;
+    int32_t kernel_task_creation_time_micros_offset;
+    int64_t launchd_creation_time_unix_epoch_seconds;
+    int32_t launchd_creation_time_micros_offset;
+} cpid_macos_boot_identity_t;
+
+/**
+ * Initializes a CPID handle for a given boot identity.
+ *
+ * @details The handle is like one returned by cpid_initialize, except that boot_identity
+ *          takes the place of the serial number, hardware UUID and boot times of the local host.
+ *          This allows CPID UUIDs to be calculated from recorded inputs of another host or an earlier boot.
+ *          The handle only supports cpid_make_uuid, methods that source local processes fail.
+ *          cpid_finalize must be called when the handle is no longer needed.
+ *
+ * @return NULL on error, a CPID library handle on success.
+ */
+cpid_handle_t cpid_initialize_with_boot_identity(const cpid_macos_boot_identity_t *const boot_identity);
+
+/**
+ * Initializes a CPID handle from the process-wide boot identity.
+ *
+ * @details Like cpid_initialize, except that the boot identity is only sourced by the first call
+ *          in the process, and that the digest is set up by the first CPID UUID calculation of the handle.
+ *          If cache_path isn't NULL, the first call loads the boot identity from that file when it was
+ *          written in the current boot, as told by kern.boottime, and otherwise sources it and replaces
+ *          the file. The file should be in a directory only writable by the user of the process.
+ *          This suits short-lived tools and per-request workers that initialize often.
+ *          cpid_finalize must be called when the handle is no longer needed.
+ *
+ * @return NULL on error, a CPID library handle on success.
+ */
+cpid_handle_t cpid_initialize_lazy(const char *const cache_path);
+
 /**
  * Finalizes a CPID handle.
  * 
@@ -50,6 +116,20 @@ int cpid_make_uuid(cpid_handle_t const library_handle, const pid_t pid, const in
  */
 int cpid_get_uuid(cpid_handle_t const library_handle, const pid_t pid, uuid_t uuid);
 
+/**
+ * Sources a process record for the living process with the given PID.
+ * 
+ * @details record is populated with the CPID UUID, its inputs and the parent PID,
+ *          all taken from the same sysctl that cpid_get_uuid performs.
+ *          With the CPID_RECORD_PARENT_UUID flag the CPID UUID of the parent is calculated too.
+ *          Failing to do so, e.g. since the parent has already exited, doesn't fail the call
+ *          but leaves parent_status at -1. A parent that started after the process
+ *          (a reused PID) is treated as exited.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_get_process_record(cpid_handle_t const library_handle, const pid_t pid, const int flags, cpid_record_t *const record);
+
 /**
  * Sources information for a CPID UUID, performs the calculation
  * and converts the result to a string.
@@ -61,6 +141,19 @@ int cpid_get_uuid(cpid_handle_t const library_handle, const pid_t pid, uuid_t uu
  */
 int cpid_get_uuid_string(cpid_handle_t const library_handle, const pid_t pid, uuid_string_t uuid_string);
 
+/**
+ * Calculates CPID UUIDs for every process on the system.
+ *
+ * @details The PID and creation time of every process are read with a single
+ *          KERN_PROC_ALL sysctl rather than one sysctl per process.
+ *          On success entries points to an array of count PID and CPID UUID pairs.
+ *          The array is owned by the handle and reused by later calls,
+ *          it is valid until the next cpid_snapshot_all or cpid_finalize call on the handle.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_snapshot_all(cpid_handle_t const library_handle, const cpid_entry_t **const entries, size_t *const count);
+
 #ifdef __cplusplus
 }
 #endif
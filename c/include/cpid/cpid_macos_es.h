@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <EndpointSecurity/EndpointSecurity.h>
+
+#include "cpid/cpid_macos.h"
+
+/**
+ * Calculates the CPID UUID of a process of an Endpoint Security message.
+ *
+ * @details The PID and start time are taken from the audit token and start_time of process,
+ *          so the process isn't looked up and may already have exited.
+ *          message_version is the version of the es_message_t that process belongs to.
+ *          Messages before version 3 have no start_time, the CPID UUID is then sourced
+ *          with cpid_get_uuid, which fails for processes that are gone.
+ *          The message is of the local boot, so the handle can't be from cpid_initialize_with_boot_identity.
+ *          uuid is populated with the CPID UUID.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_make_uuid_from_es_process(cpid_handle_t const library_handle, const es_process_t *const process, const uint32_t message_version, uuid_t uuid);
+
+/**
+ * Process events delivered by a CPID Endpoint Security client.
+ */
+typedef enum {
+    CPID_ES_EVENT_FORK = 1,
+    CPID_ES_EVENT_EXEC = 2,
+    CPID_ES_EVENT_EXIT = 3
+} cpid_es_event_t;
+
+/**
+ * A process event with the CPID UUID of the process.
+ *
+ * @details For fork events the process is the child. status is 0 when uuid holds the CPID UUID
+ *          of the process with the given PID, -1 otherwise, in which case uuid is zeroed.
+ */
+typedef struct {
+    pid_t pid;
+    cpid_es_event_t event;
+    int status;
+    uuid_t uuid;
+} cpid_es_record_t;
+
+typedef void *cpid_es_t;
+
+/**
+ * Opens an Endpoint Security client that subscribes to fork, exec and exit notifications.
+ *
+ * @details Events are queued as Endpoint Security delivers them, with the inputs of their CPID UUIDs,
+ *          and hashed with the given handle by cpid_es_next_batch.
+ *          The handle must outlive the client and shouldn't be used concurrently with cpid_es_next_batch.
+ *          It can't be from cpid_initialize_with_boot_identity, since the events are of the local boot.
+ *          Requires root and the com.apple.developer.endpoint-security.client entitlement.
+ *          Agents that already have an Endpoint Security client can use cpid_make_uuid_from_es_process instead.
+ *          cpid_es_close must be called when the client is no longer needed.
+ *
+ * @return NULL on error, a CPID Endpoint Security client on success.
+ */
+cpid_es_t cpid_es_open(cpid_handle_t const library_handle);
+
+/**
+ * Closes a CPID Endpoint Security client.
+ *
+ * @details The client is no longer valid after this method is called.
+ */
+void cpid_es_close(cpid_es_t const es);
+
+/**
+ * Reads the next batch of process events of a CPID Endpoint Security client.
+ *
+ * @details Waits up to timeout_ms milliseconds for events (-1 waits indefinitely),
+ *          then takes the events that are queued, up to capacity.
+ *          count is populated with the number of records written to records, which may be 0 on timeout.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_es_next_batch(cpid_es_t const es, cpid_es_record_t *const records, const size_t capacity, size_t *const count, const int timeout_ms);
+
+/**
+ * Gets the number of process events a CPID Endpoint Security client has dropped
+ * because its queue was full.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_es_get_lost_count(cpid_es_t const es, uint64_t *const lost_count);
+
+#ifdef __cplusplus
+}
+#endif
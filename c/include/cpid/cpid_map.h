@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <uuid/uuid.h>
+
+typedef void *cpid_map_t;
+
+/**
+ * Creates an empty map from CPID UUIDs to 64-bit values.
+ * 
+ * @details The map is a fixed size hash table that is never resized or rehashed.
+ *          The bits of the CPID UUID are used directly as the hash, which is sound since
+ *          CPID UUIDs are SHA-256 digest output. Keys should be CPID UUIDs calculated by
+ *          this library, arbitrary UUIDs from untrusted sources don't have this property.
+ *          The table is sized for capacity entries at a load factor of at most one half
+ *          and split into shards. Since keys are spread uniformly the map holds capacity entries,
+ *          an insert only fails if the shard of the key is full.
+ *          All map methods are thread-safe. Lookups never block and don't write shared memory,
+ *          inserts and removals only exclude other inserts and removals in the same shard.
+ *          cpid_map_destroy must be called when the map is no longer needed.
+ *
+ * @return NULL on error, a CPID map on success.
+ */
+cpid_map_t cpid_map_create(const size_t capacity);
+
+/**
+ * Destroys a map.
+ * 
+ * @details The map must not be in use by other threads.
+ *          The map is no longer valid after this method is called.
+ */
+void cpid_map_destroy(cpid_map_t const map);
+
+/**
+ * Inserts a CPID UUID with a value, or replaces the value if the CPID UUID is present.
+ * 
+ * @details The all-zero UUID can't be inserted, it is never a CPID UUID.
+ *
+ * @return 0 on success, -1 on error or if the map is full.
+ */
+int cpid_map_insert(cpid_map_t const map, const uuid_t cpid, const uint64_t value);
+
+/**
+ * Looks up a CPID UUID.
+ * 
+ * @details value is populated with the value of the CPID UUID if value is not NULL,
+ *          so the map can also be used as a set.
+ *
+ * @return 0 if the CPID UUID is present, -1 otherwise.
+ */
+int cpid_map_find(cpid_map_t const map, const uuid_t cpid, uint64_t *const value);
+
+/**
+ * Removes a CPID UUID.
+ *
+ * @return 0 if the CPID UUID was present, -1 otherwise.
+ */
+int cpid_map_remove(cpid_map_t const map, const uuid_t cpid);
+
+/**
+ * Gets the number of entries in a map.
+ * 
+ * @details The count may be outdated by the time it's returned if other threads modify the map.
+ */
+size_t cpid_map_count(cpid_map_t const map);
+
+#ifdef __cplusplus
+}
+#endif
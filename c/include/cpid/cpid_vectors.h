@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Golden-vector files hold CPID digest inputs with their expected CPID UUIDs, to check
+ * implementations of the specification against each other with cpid_validate.
+ *
+ * A file is a cpid_vectors_header_t followed by count records of record_size bytes.
+ * A record is the digest input of the layout, exactly as it is hashed, followed by
+ * the expected CPID UUID in RFC 9562 binary byte order (the order of its string form,
+ * also for the Windows layout whose GUIDs have little-endian fields in memory).
+ * The integers of the header are little-endian, like those of the digest inputs
+ * on every platform the reference implementation supports.
+ */
+
+#define CPID_VECTORS_MAGIC "CPIDVEC"
+#define CPID_VECTORS_VERSION 1
+
+typedef enum {
+    // boot UUID, PID namespace, creation time ticks, namespace TGID
+    CPID_VECTORS_LAYOUT_LINUX = 1,
+    // machine GUID, System process creation time, process creation time, PID
+    CPID_VECTORS_LAYOUT_WINDOWS = 2,
+    // serial number, hardware UUID, kernel_task, launchd and process creation times, PID
+    CPID_VECTORS_LAYOUT_MACOS = 3,
+} cpid_vectors_layout_t;
+
+#define CPID_VECTORS_LINUX_MESSAGE_SIZE 40
+#define CPID_VECTORS_WINDOWS_MESSAGE_SIZE 40
+#define CPID_VECTORS_MACOS_MESSAGE_SIZE 88
+#define CPID_VECTORS_UUID_SIZE 16
+
+typedef struct {
+    // CPID_VECTORS_MAGIC including its NUL terminator
+    char magic[8];
+    uint32_t version;
+    // a cpid_vectors_layout_t
+    uint32_t layout;
+    uint32_t message_size;
+    // message_size + CPID_VECTORS_UUID_SIZE
+    uint32_t record_size;
+    uint64_t count;
+} cpid_vectors_header_t;
+
+#ifdef __cplusplus
+}
+#endif
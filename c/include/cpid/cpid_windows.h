@@ -7,6 +7,33 @@
 
 EXTERN_C_START
 
+/**
+* A process in a snapshot taken by cpid_snapshot_all().
+*/
+typedef struct _CPID_ENTRY
+{
+    DWORD   Pid;
+    UINT64  Pct;
+    UUID    Cpid;
+} cpid_entry_t;
+
+/**
+* A process with its CPID, the inputs of the CPID and its parent.
+*/
+typedef struct _CPID_RECORD
+{
+    DWORD   Pid;
+    DWORD   ParentPid;
+    UINT64  Pct;
+    UUID    Cpid;
+    // ERROR_SUCCESS if ParentCpid is populated, a Win32 error code otherwise.
+    DWORD   ParentStatus;
+    UUID    ParentCpid;
+} cpid_record_t;
+
+// Also make the CPID of the parent, see cpid_get_process_record().
+#define CPID_RECORD_PARENT_CPID 1
+
 /**
 * Initializes the CPID library.
 *
@@ -21,6 +48,43 @@ EXTERN_C_START
 */
 DWORD cpid_initialize(_Out_ HANDLE* const libraryHandle);
 
+/**
+* Initializes the CPID library for a supplied boot identity.
+*
+* @details Like cpid_initialize() except that the machine GUID and boot time
+*          (the creation time of the System process) are supplied by the
+*          caller rather than read from the local computer. This allows CPIDs
+*          to be made from the recorded PIDs and PCTs of another computer or
+*          of an earlier boot, and doesn't require high integrity. The handle
+*          only supports cpid_make_cpid() and cpid_make_cpid_batch(), the
+*          functions that query local processes fail with ERROR_NOT_SUPPORTED.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_initialize_with_boot_identity(_In_ const UUID* const machineGuid,
+                                         _In_ const UINT64 bootTime,
+                                         _Out_ HANDLE* const libraryHandle);
+
+/**
+* Initializes the CPID library from the process-wide boot identity.
+*
+* @details Like cpid_initialize() except that the machine GUID and boot time
+*          are only read by the first call in the process, and that the SHA256
+*          algorithm is opened by the first hash and shared by the handles of
+*          this function. If cachePath isn't NULL, the first call loads the boot
+*          identity from that file when it was written in the current boot, as
+*          told by the kernel boot time, and otherwise reads it and replaces the
+*          file. The file should be in a directory only writable by the user of
+*          the process. A file that isn't owned by that user or by SYSTEM is
+*          ignored, and the file is written with access for that user only.
+*          This suits short-lived tools and per-request workers that initialize
+*          often.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_initialize_lazy(_In_opt_ PCSTR cachePath,
+                           _Out_ HANDLE* const libraryHandle);
+
 /**
 * Makes a CPID using the supplied PID and process creation time (PCT).
 *
@@ -41,6 +105,26 @@ DWORD cpid_make_cpid(_In_ const HANDLE libraryHandle,
                      _In_ const UINT64 pct,
                      _Out_ UUID* const cpid);
 
+/**
+* Makes CPIDs for a batch of caller-supplied PIDs and process creation times.
+*
+* @details Equivalent to calling cpid_make_cpid() for each index but a single
+*          reusable hash object is created for the whole batch, which avoids
+*          the per-call hash object setup of the one-shot hash. Before Windows 8,
+*          which has no reusable hash objects, one is created per CPID. The pids, pcts
+*          and cpids arrays must each hold at least count elements and the
+*          CPID at index i is made from the PID and PCT at index i. A count of
+*          zero is permitted and does nothing. On failure the contents of the
+*          cpids array are unspecified.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_make_cpid_batch(_In_ const HANDLE libraryHandle,
+                           _In_reads_(count) const DWORD* const pids,
+                           _In_reads_(count) const UINT64* const pcts,
+                           _In_ const size_t count,
+                           _Out_writes_(count) UUID* const cpids);
+
 /**
 * Gets the CPID for the process identified by the supplied PID.
 *
@@ -57,6 +141,155 @@ DWORD cpid_get_cpid(_In_ const HANDLE libraryHandle,
                     _In_ const DWORD pid,
                     _Out_ UUID* const cpid);
 
+/**
+* Gets the CPID for the process of an already open process handle.
+*
+* @details Like cpid_get_cpid() except that the PID and the PCT are read
+*          through the supplied handle instead of a handle opened by PID. This
+*          saves opening and closing a handle per call and, since the handle
+*          keeps the process object alive, the CPID can't be that of a later
+*          process that reused the PID. The handle must have at least
+*          PROCESS_QUERY_LIMITED_INFORMATION access rights and is not closed.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_get_cpid_from_handle(_In_ const HANDLE libraryHandle,
+                                _In_ const HANDLE processHandle,
+                                _Out_ UUID* const cpid);
+
+/**
+* Gets a process record for the process identified by the supplied PID.
+*
+* @details The record is populated with the CPID, the PCT and the parent PID,
+*          all read through the single process handle that cpid_get_cpid()
+*          opens. With the CPID_RECORD_PARENT_CPID flag the CPID of the parent
+*          is made too. Failing to do so, e.g. since the parent has exited,
+*          doesn't fail the call but is reported in ParentStatus. A process
+*          with the parent PID that was created after the child (a reused PID)
+*          is reported as ERROR_NOT_FOUND. The same access rights as for
+*          cpid_get_cpid() are required.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_get_process_record(_In_ const HANDLE libraryHandle,
+                              _In_ const DWORD pid,
+                              _In_ const DWORD flags,
+                              _Out_ cpid_record_t* const record);
+
+/**
+* Gets the CPIDs of every process running on the system.
+*
+* @details The PID and process creation time (PCT) of every process are read
+*          with a single NtQuerySystemInformation(SystemProcessInformation)
+*          call and then hashed as one batch via cpid_make_cpid_batch(). Unlike
+*          cpid_get_cpid() no process is opened, so protected processes are
+*          included and no particular access rights are required. The System
+*          Idle Process (PID 0) is not included. On success the caller owns
+*          the returned array and must release it with cpid_snapshot_free().
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_snapshot_all(_In_ const HANDLE libraryHandle,
+                        _Outptr_result_buffer_(*count) cpid_entry_t** const entries,
+                        _Out_ size_t* const count);
+
+/**
+* Releases a snapshot returned by cpid_snapshot_all().
+*/
+void cpid_snapshot_free(_In_opt_ cpid_entry_t* const entries);
+
+/**
+* Process events delivered by a CPID stream.
+*/
+typedef enum _CPID_STREAM_EVENT
+{
+    CPID_STREAM_EVENT_START = 1,
+    CPID_STREAM_EVENT_EXIT = 3
+} cpid_stream_event_t;
+
+/**
+* A process event with the CPID of the process.
+*/
+typedef struct _CPID_STREAM_RECORD
+{
+    DWORD               Pid;
+    // Zero for exit events, which don't carry the parent PID.
+    DWORD               ParentPid;
+    UINT64              Pct;
+    cpid_stream_event_t Event;
+    UUID                Cpid;
+} cpid_stream_record_t;
+
+/**
+* Opens a stream of process events using Event Tracing for Windows.
+*
+* @details A private real-time ETW session is started with the
+*          Microsoft-Windows-Kernel-Process provider enabled. The PID and PCT
+*          are taken from the ProcessStart and ProcessStop events themselves,
+*          so no process is opened and processes that exit before their events
+*          are read still get their CPID. Events are queued by a thread of the
+*          stream and are delivered with a latency of up to a second, the
+*          flush interval of the session. The caller must be an administrator
+*          or a member of the Performance Log Users group. The library handle
+*          must outlive the stream and can't have been initialized with
+*          cpid_initialize_with_boot_identity(). cpid_stream_close() must be
+*          called when the stream is no longer needed.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_stream_open(_In_ const HANDLE libraryHandle,
+                       _Out_ HANDLE* const stream);
+
+/**
+* Gets the wait handle of a CPID stream.
+*
+* @details The returned event is signalled when cpid_stream_next_batch() won't
+*          block. It is owned by the stream and must not be closed.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_stream_get_wait_handle(_In_ const HANDLE stream,
+                                  _Out_ HANDLE* const waitHandle);
+
+/**
+* Reads the next batch of process events from a CPID stream.
+*
+* @details Blocks until at least one event is available, then also takes the
+*          events that are already queued, up to capacity. The CPIDs of the
+*          batch are made via cpid_make_cpid_batch(). count is populated with
+*          the number of records written to records. Once the session has
+*          stopped and the queue is drained the error of the session is
+*          returned, ERROR_NO_MORE_ITEMS if it stopped without one.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_stream_next_batch(_In_ const HANDLE stream,
+                             _Out_writes_to_(capacity, *count) cpid_stream_record_t* const records,
+                             _In_ const size_t capacity,
+                             _Out_ size_t* const count);
+
+/**
+* Gets the number of process events a CPID stream has lost.
+*
+* @details Counts both the events dropped because the queue of the stream was
+*          full and the events that ETW reports as lost by the session.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_stream_get_lost_count(_In_ const HANDLE stream,
+                                 _Out_ UINT64* const lostCount);
+
+/**
+* Closes a CPID stream.
+*
+* @details Stops the ETW session and waits for the thread of the stream. The
+*          stream is not valid for use after this function is called and must
+*          not be in use by another thread when it is called.
+*
+* @return ERROR_SUCCESS on success, appropriate Win32 error code otherwise.
+*/
+DWORD cpid_stream_close(_In_ const HANDLE stream);
+
 /**
 * Finalizes the CPID library.
 *
@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cpid/cpid_format.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPID_FORMAT_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CPID_FORMAT_NEON
+#include <arm_neon.h>
+#endif
+
+#define UUID_SIZE 16
+#define UUID_HEX_DIGIT_COUNT (2 * UUID_SIZE)
+
+// Converts the 16 bytes of a UUID to 32 lowercase hex digits, most significant nibble first.
+static void uuid_to_hex_digits(const uint8_t *const uuid, char hex_digits[UUID_HEX_DIGIT_COUNT]) {
+#if defined(CPID_FORMAT_SSE2)
+    const __m128i bytes = _mm_loadu_si128((const __m128i *) uuid);
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+    // there is no byte shift, the bits shifted in from the neighbouring byte are masked off
+    const __m128i high_nibbles = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask);
+    const __m128i low_nibbles = _mm_and_si128(bytes, nibble_mask);
+
+    // '0' + nibble, plus the distance from '9' + 1 to 'a' for nibbles above 9
+    const __m128i digit_offset = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i letter_offset = _mm_set1_epi8('a' - '9' - 1);
+    const __m128i high_digits = _mm_add_epi8(_mm_add_epi8(high_nibbles, digit_offset), _mm_and_si128(_mm_cmpgt_epi8(high_nibbles, nine), letter_offset));
+    const __m128i low_digits = _mm_add_epi8(_mm_add_epi8(low_nibbles, digit_offset), _mm_and_si128(_mm_cmpgt_epi8(low_nibbles, nine), letter_offset));
+
+    _mm_storeu_si128((__m128i *) hex_digits, _mm_unpacklo_epi8(high_digits, low_digits));
+    _mm_storeu_si128((__m128i *) (hex_digits + UUID_SIZE), _mm_unpackhi_epi8(high_digits, low_digits));
+#elif defined(CPID_FORMAT_NEON)
+    static const uint8_t hex_alphabet[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+    const uint8x16_t alphabet = vld1q_u8(hex_alphabet);
+    const uint8x16_t bytes = vld1q_u8(uuid);
+    const uint8x16_t high_digits = vqtbl1q_u8(alphabet, vshrq_n_u8(bytes, 4));
+    const uint8x16_t low_digits = vqtbl1q_u8(alphabet, vandq_u8(bytes, vdupq_n_u8(0x0F)));
+
+    vst1q_u8((uint8_t *) hex_digits, vzip1q_u8(high_digits, low_digits));
+    vst1q_u8((uint8_t *) hex_digits + UUID_SIZE, vzip2q_u8(high_digits, low_digits));
+#else
+    static const char hex_alphabet[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+    for (size_t i = 0; i < UUID_SIZE; i++) {
+        hex_digits[2 * i] = hex_alphabet[uuid[i] >> 4];
+        hex_digits[2 * i + 1] = hex_alphabet[uuid[i] & 0x0F];
+    }
+#endif
+}
+
+// Writes the 8-4-4-4-12 string form and a NUL terminator.
+static void uuid_to_string(const uint8_t *const uuid, char *const out) {
+    char hex_digits[UUID_HEX_DIGIT_COUNT];
+    uuid_to_hex_digits(uuid, hex_digits);
+
+    memcpy(out, hex_digits, 8);
+    out[8] = '-';
+    memcpy(out + 9, hex_digits + 8, 4);
+    out[13] = '-';
+    memcpy(out + 14, hex_digits + 12, 4);
+    out[18] = '-';
+    memcpy(out + 19, hex_digits + 16, 4);
+    out[23] = '-';
+    memcpy(out + 24, hex_digits + 20, 12);
+    out[CPID_UUID_STRING_LENGTH] = '\0';
+}
+
+static int check_arguments(const void *const in, const size_t n, char *const out, const size_t stride) {
+    if (stride <= CPID_UUID_STRING_LENGTH) {
+        return -1;
+    }
+
+    if (n && (!in || !out)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int cpid_format_batch(const void *const in, const size_t n, char *const out, const size_t stride) {
+    if (check_arguments(in, n, out, stride)) {
+        return -1;
+    }
+
+    const uint8_t *const uuids = in;
+    for (size_t i = 0; i < n; i++) {
+        uuid_to_string(uuids + i * UUID_SIZE, out + i * stride);
+    }
+
+    return 0;
+}
+
+int cpid_format_guid_batch(const void *const in, const size_t n, char *const out, const size_t stride) {
+    if (check_arguments(in, n, out, stride)) {
+        return -1;
+    }
+
+    const uint8_t *const guids = in;
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *const guid = guids + i * UUID_SIZE;
+
+        // Data1, Data2 and Data3 are byte swapped to RFC 9562 order, Data4 is already in order
+        const uint8_t uuid[UUID_SIZE] = {
+            guid[3], guid[2], guid[1], guid[0],
+            guid[5], guid[4],
+            guid[7], guid[6],
+            guid[8], guid[9], guid[10], guid[11], guid[12], guid[13], guid[14], guid[15],
+        };
+        uuid_to_string(uuid, out + i * stride);
+    }
+
+    return 0;
+}
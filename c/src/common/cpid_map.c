@@ -0,0 +1,363 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpid/cpid_map.h"
+
+#define CPID_MAP_CACHE_LINE_SIZE 64
+#define CPID_MAP_SLOTS_PER_BUCKET 2
+#define CPID_MAP_MAX_SHARD_COUNT 16
+// smaller maps use fewer shards, so that keys spread evenly enough over the shards
+#define CPID_MAP_MIN_SHARD_BUCKET_COUNT 64
+
+// A bucket fills one cache line, so a lookup usually touches a single line.
+// Keys and values are atomics so that lock-free readers don't race with writers.
+// A zero key marks an empty slot, CPID UUIDs are never zero since the version bits are set.
+typedef struct {
+    _Alignas(CPID_MAP_CACHE_LINE_SIZE) atomic_uint_least32_t sequence;
+    // number of keys in later buckets whose probe sequence passed this full bucket
+    atomic_uint_least32_t overflow_count;
+    struct {
+        atomic_uint_least64_t key[2];
+        atomic_uint_least64_t value;
+    } slots[CPID_MAP_SLOTS_PER_BUCKET];
+} cpid_map_bucket_t;
+
+_Static_assert(CPID_MAP_CACHE_LINE_SIZE == sizeof(cpid_map_bucket_t), "cpid_map_bucket_t should fill one cache line.");
+
+// Writers of a shard are serialized by its lock and publish bucket changes with a
+// per-bucket sequence lock. Readers retry a bucket if a write to it overlapped their read.
+typedef struct {
+    _Alignas(CPID_MAP_CACHE_LINE_SIZE) pthread_mutex_t lock;
+    size_t bucket_mask;
+    size_t count;
+    cpid_map_bucket_t *buckets;
+} cpid_map_shard_t;
+
+typedef struct {
+    size_t shard_mask;
+    cpid_map_shard_t *shards;
+} *cpid_map_internal_t;
+
+typedef struct {
+    uint64_t words[2];
+    // bytes 0 to 3 of the UUID select the bucket and byte 4 the shard,
+    // the version and variant bits in bytes 6 and 8 are constant and aren't used
+    uint32_t bucket_bits;
+    uint8_t shard_bits;
+} cpid_map_key_t;
+
+static void make_key(const uuid_t cpid, cpid_map_key_t *const key) {
+    memcpy(key->words, cpid, sizeof(key->words));
+    memcpy(&key->bucket_bits, cpid, sizeof(key->bucket_bits));
+    key->shard_bits = cpid[4];
+}
+
+static void *allocate_cache_lines(const size_t count, const size_t size) {
+    // aligned_alloc requires a multiple of the alignment
+    size_t allocation_size = (count * size + CPID_MAP_CACHE_LINE_SIZE - 1) / CPID_MAP_CACHE_LINE_SIZE * CPID_MAP_CACHE_LINE_SIZE;
+    void *allocation = aligned_alloc(CPID_MAP_CACHE_LINE_SIZE, allocation_size);
+    if (allocation) {
+        memset(allocation, 0, allocation_size);
+    }
+    return allocation;
+}
+
+cpid_map_t cpid_map_create(const size_t capacity) {
+    if (0 == capacity || capacity > SIZE_MAX / 2 / sizeof(cpid_map_bucket_t)) {
+        return NULL;
+    }
+
+    // keep the load factor at or below one half
+    size_t bucket_count = 1;
+    while (bucket_count * CPID_MAP_SLOTS_PER_BUCKET < capacity * 2) {
+        bucket_count *= 2;
+    }
+
+    size_t shard_count = 1;
+    while (shard_count < CPID_MAP_MAX_SHARD_COUNT && bucket_count / (shard_count * 2) >= CPID_MAP_MIN_SHARD_BUCKET_COUNT) {
+        shard_count *= 2;
+    }
+    size_t shard_bucket_count = bucket_count / shard_count;
+
+    cpid_map_internal_t map_internal = calloc(1, sizeof(*map_internal));
+    if (!map_internal) {
+        return NULL;
+    }
+
+    map_internal->shard_mask = shard_count - 1;
+    map_internal->shards = allocate_cache_lines(shard_count, sizeof(cpid_map_shard_t));
+    if (!map_internal->shards) {
+        free(map_internal);
+        return NULL;
+    }
+
+    size_t initialized_count = 0;
+    for (; initialized_count < shard_count; initialized_count++) {
+        cpid_map_shard_t *const shard = &map_internal->shards[initialized_count];
+        shard->bucket_mask = shard_bucket_count - 1;
+        shard->buckets = allocate_cache_lines(shard_bucket_count, sizeof(cpid_map_bucket_t));
+        if (!shard->buckets) {
+            break;
+        }
+        if (pthread_mutex_init(&shard->lock, NULL)) {
+            free(shard->buckets);
+            break;
+        }
+    }
+
+    if (initialized_count != shard_count) {
+        for (size_t i = 0; i < initialized_count; i++) {
+            pthread_mutex_destroy(&map_internal->shards[i].lock);
+            free(map_internal->shards[i].buckets);
+        }
+        free(map_internal->shards);
+        free(map_internal);
+        return NULL;
+    }
+
+    return map_internal;
+}
+
+void cpid_map_destroy(cpid_map_t const map) {
+
+    cpid_map_internal_t map_internal = (cpid_map_internal_t) map;
+
+    if (map_internal) {
+        for (size_t i = 0; i <= map_internal->shard_mask; i++) {
+            pthread_mutex_destroy(&map_internal->shards[i].lock);
+            free(map_internal->shards[i].buckets);
+        }
+        free(map_internal->shards);
+        free(map_internal);
+    }
+}
+
+static int slot_matches(cpid_map_bucket_t *const bucket, const size_t slot, const cpid_map_key_t *const key) {
+    return atomic_load_explicit(&bucket->slots[slot].key[0], memory_order_relaxed) == key->words[0]
+        && atomic_load_explicit(&bucket->slots[slot].key[1], memory_order_relaxed) == key->words[1];
+}
+
+static int slot_is_empty(cpid_map_bucket_t *const bucket, const size_t slot) {
+    return 0 == atomic_load_explicit(&bucket->slots[slot].key[0], memory_order_relaxed)
+        && 0 == atomic_load_explicit(&bucket->slots[slot].key[1], memory_order_relaxed);
+}
+
+// Bucket writes happen with the shard lock held, between two increments of the
+// sequence. An odd sequence tells readers that the bucket is being written.
+static void begin_bucket_write(cpid_map_bucket_t *const bucket) {
+    atomic_fetch_add_explicit(&bucket->sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void end_bucket_write(cpid_map_bucket_t *const bucket) {
+    atomic_fetch_add_explicit(&bucket->sequence, 1, memory_order_release);
+}
+
+// Finds the bucket and slot of a key. Must be called with the shard lock held.
+static cpid_map_bucket_t *find_locked(cpid_map_shard_t *const shard, const cpid_map_key_t *const key, size_t *const slot) {
+    size_t bucket_index = key->bucket_bits & shard->bucket_mask;
+    for (size_t probe = 0; probe <= shard->bucket_mask; probe++) {
+        cpid_map_bucket_t *const bucket = &shard->buckets[bucket_index];
+        for (size_t i = 0; i < CPID_MAP_SLOTS_PER_BUCKET; i++) {
+            if (slot_matches(bucket, i, key)) {
+                *slot = i;
+                return bucket;
+            }
+        }
+
+        if (0 == atomic_load_explicit(&bucket->overflow_count, memory_order_relaxed)) {
+            break;
+        }
+        bucket_index = (bucket_index + 1) & shard->bucket_mask;
+    }
+
+    return NULL;
+}
+
+int cpid_map_insert(cpid_map_t const map, const uuid_t cpid, const uint64_t value) {
+    if (!map || !cpid) {
+        return -1;
+    }
+
+    cpid_map_internal_t map_internal = (cpid_map_internal_t) map;
+    cpid_map_key_t key;
+    make_key(cpid, &key);
+    if (0 == key.words[0] && 0 == key.words[1]) {
+        return -1;
+    }
+
+    cpid_map_shard_t *const shard = &map_internal->shards[key.shard_bits & map_internal->shard_mask];
+    if (pthread_mutex_lock(&shard->lock)) {
+        return -1;
+    }
+
+    int return_code = 0;
+    size_t slot = 0;
+    cpid_map_bucket_t *bucket = find_locked(shard, &key, &slot);
+    if (bucket) {
+        begin_bucket_write(bucket);
+        atomic_store_explicit(&bucket->slots[slot].value, value, memory_order_relaxed);
+        end_bucket_write(bucket);
+    } else {
+        // find the first free slot on the probe sequence
+        const size_t home_index = key.bucket_bits & shard->bucket_mask;
+        size_t bucket_index = home_index;
+        size_t probe = 0;
+        for (; probe <= shard->bucket_mask && !bucket; probe++) {
+            for (size_t i = 0; i < CPID_MAP_SLOTS_PER_BUCKET; i++) {
+                if (slot_is_empty(&shard->buckets[bucket_index], i)) {
+                    bucket = &shard->buckets[bucket_index];
+                    slot = i;
+                    break;
+                }
+            }
+            if (!bucket) {
+                bucket_index = (bucket_index + 1) & shard->bucket_mask;
+            }
+        }
+
+        if (!bucket) {
+            return_code = -1;
+        } else {
+            // Count the key as passing through the full buckets before its bucket, then publish it.
+            // A reader either stops before the key is published, consistent with the insert
+            // not having happened yet, or probes far enough to find it.
+            for (size_t i = home_index; i != bucket_index; i = (i + 1) & shard->bucket_mask) {
+                begin_bucket_write(&shard->buckets[i]);
+                atomic_fetch_add_explicit(&shard->buckets[i].overflow_count, 1, memory_order_relaxed);
+                end_bucket_write(&shard->buckets[i]);
+            }
+
+            begin_bucket_write(bucket);
+            atomic_store_explicit(&bucket->slots[slot].value, value, memory_order_relaxed);
+            atomic_store_explicit(&bucket->slots[slot].key[0], key.words[0], memory_order_relaxed);
+            atomic_store_explicit(&bucket->slots[slot].key[1], key.words[1], memory_order_relaxed);
+            end_bucket_write(bucket);
+
+            shard->count++;
+        }
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return return_code;
+}
+
+int cpid_map_find(cpid_map_t const map, const uuid_t cpid, uint64_t *const value) {
+    if (!map || !cpid) {
+        return -1;
+    }
+
+    cpid_map_internal_t map_internal = (cpid_map_internal_t) map;
+    cpid_map_key_t key;
+    make_key(cpid, &key);
+
+    cpid_map_shard_t *const shard = &map_internal->shards[key.shard_bits & map_internal->shard_mask];
+    size_t bucket_index = key.bucket_bits & shard->bucket_mask;
+    for (size_t probe = 0; probe <= shard->bucket_mask; probe++) {
+        cpid_map_bucket_t *const bucket = &shard->buckets[bucket_index];
+
+        int found = 0;
+        uint64_t found_value = 0;
+        uint_least32_t overflow_count = 0;
+        uint_least32_t sequence = 0;
+        do {
+            sequence = atomic_load_explicit(&bucket->sequence, memory_order_acquire);
+            if (sequence & 1) {
+                // a writer is in the middle of updating the bucket
+                continue;
+            }
+
+            found = 0;
+            for (size_t i = 0; i < CPID_MAP_SLOTS_PER_BUCKET; i++) {
+                if (slot_matches(bucket, i, &key)) {
+                    found = 1;
+                    found_value = atomic_load_explicit(&bucket->slots[i].value, memory_order_relaxed);
+                    break;
+                }
+            }
+            overflow_count = atomic_load_explicit(&bucket->overflow_count, memory_order_relaxed);
+
+            atomic_thread_fence(memory_order_acquire);
+        } while ((sequence & 1) || sequence != atomic_load_explicit(&bucket->sequence, memory_order_relaxed));
+
+        if (found) {
+            if (value) {
+                *value = found_value;
+            }
+            return 0;
+        }
+
+        if (0 == overflow_count) {
+            break;
+        }
+        bucket_index = (bucket_index + 1) & shard->bucket_mask;
+    }
+
+    return -1;
+}
+
+int cpid_map_remove(cpid_map_t const map, const uuid_t cpid) {
+    if (!map || !cpid) {
+        return -1;
+    }
+
+    cpid_map_internal_t map_internal = (cpid_map_internal_t) map;
+    cpid_map_key_t key;
+    make_key(cpid, &key);
+
+    cpid_map_shard_t *const shard = &map_internal->shards[key.shard_bits & map_internal->shard_mask];
+    if (pthread_mutex_lock(&shard->lock)) {
+        return -1;
+    }
+
+    int return_code = -1;
+    size_t slot = 0;
+    cpid_map_bucket_t *const bucket = find_locked(shard, &key, &slot);
+    if (bucket) {
+        begin_bucket_write(bucket);
+        atomic_store_explicit(&bucket->slots[slot].key[0], 0, memory_order_relaxed);
+        atomic_store_explicit(&bucket->slots[slot].key[1], 0, memory_order_relaxed);
+        atomic_store_explicit(&bucket->slots[slot].value, 0, memory_order_relaxed);
+        end_bucket_write(bucket);
+
+        // Entries are never moved, so concurrent readers can't miss unrelated keys.
+        // The overflow counts of the buckets passed on insertion are dropped again instead.
+        const size_t home_index = key.bucket_bits & shard->bucket_mask;
+        const size_t bucket_index = (size_t) (bucket - shard->buckets);
+        for (size_t i = home_index; i != bucket_index; i = (i + 1) & shard->bucket_mask) {
+            begin_bucket_write(&shard->buckets[i]);
+            atomic_fetch_sub_explicit(&shard->buckets[i].overflow_count, 1, memory_order_relaxed);
+            end_bucket_write(&shard->buckets[i]);
+        }
+
+        shard->count--;
+        return_code = 0;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return return_code;
+}
+
+size_t cpid_map_count(cpid_map_t const map) {
+    if (!map) {
+        return 0;
+    }
+
+    cpid_map_internal_t map_internal = (cpid_map_internal_t) map;
+
+    size_t count = 0;
+    for (size_t i = 0; i <= map_internal->shard_mask; i++) {
+        pthread_mutex_lock(&map_internal->shards[i].lock);
+        count += map_internal->shards[i].count;
+        pthread_mutex_unlock(&map_internal->shards[i].lock);
+    }
+
+    return count;
+}
@@ -0,0 +1,395 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpid_sha256.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CPID_SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define CPID_SHA256_ARM
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+typedef void (*compress_function_t)(uint32_t words[8], const uint8_t *blocks, size_t block_count);
+
+static const uint32_t round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+void cpid_sha256_init(cpid_sha256_state_t *const state) {
+    static const uint32_t initial_words[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(state->words, initial_words, sizeof(initial_words));
+}
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void compress_portable(uint32_t words[8], const uint8_t *blocks, size_t block_count) {
+    for (; block_count; block_count--, blocks += CPID_SHA256_BLOCK_SIZE) {
+        uint32_t schedule[64];
+        for (size_t i = 0; i < 16; i++) {
+            schedule[i] = (uint32_t) blocks[4 * i] << 24 | (uint32_t) blocks[4 * i + 1] << 16 | (uint32_t) blocks[4 * i + 2] << 8 | (uint32_t) blocks[4 * i + 3];
+        }
+        for (size_t i = 16; i < 64; i++) {
+            const uint32_t s0 = ROTR(schedule[i - 15], 7) ^ ROTR(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+            const uint32_t s1 = ROTR(schedule[i - 2], 17) ^ ROTR(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+            schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+        }
+
+        uint32_t a = words[0], b = words[1], c = words[2], d = words[3];
+        uint32_t e = words[4], f = words[5], g = words[6], h = words[7];
+        for (size_t i = 0; i < 64; i++) {
+            const uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + round_constants[i] + schedule[i];
+            const uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        words[0] += a;
+        words[1] += b;
+        words[2] += c;
+        words[3] += d;
+        words[4] += e;
+        words[5] += f;
+        words[6] += g;
+        words[7] += h;
+    }
+}
+
+#if defined(CPID_SHA256_X86)
+// Four rounds; the SHA extensions keep the state as ABEF/CDGH and take the rounds two at a time.
+#define X86_FOUR_ROUNDS(message, k)                                                             \
+    do {                                                                                        \
+        __m128i round_input = _mm_add_epi32((message), _mm_loadu_si128((const __m128i *) (k))); \
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, round_input);                                  \
+        round_input = _mm_shuffle_epi32(round_input, 0x0E);                                     \
+        abef = _mm_sha256rnds2_epu32(abef, cdgh, round_input);                                  \
+    } while (0)
+
+// The message schedule for the next four rounds, from the previous sixteen words.
+#define X86_NEXT_MESSAGE(m0, m1, m2, m3) _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32((m0), (m1)), _mm_alignr_epi8((m3), (m2), 4)), (m3))
+
+__attribute__((target("sha,sse4.1,ssse3"))) static void compress_x86_sha(uint32_t words[8], const uint8_t *blocks, size_t block_count) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // the rounds take the state as ABEF and CDGH, with A and C in the top lanes
+    __m128i abef = _mm_set_epi32((int) words[0], (int) words[1], (int) words[4], (int) words[5]);
+    __m128i cdgh = _mm_set_epi32((int) words[2], (int) words[3], (int) words[6], (int) words[7]);
+
+    for (; block_count; block_count--, blocks += CPID_SHA256_BLOCK_SIZE) {
+        const __m128i saved_abef = abef;
+        const __m128i saved_cdgh = cdgh;
+
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) blocks), byte_swap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (blocks + 16)), byte_swap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (blocks + 32)), byte_swap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (blocks + 48)), byte_swap);
+
+        X86_FOUR_ROUNDS(m0, round_constants);
+        X86_FOUR_ROUNDS(m1, round_constants + 4);
+        X86_FOUR_ROUNDS(m2, round_constants + 8);
+        X86_FOUR_ROUNDS(m3, round_constants + 12);
+        for (size_t i = 16; i < 64; i += 16) {
+            m0 = X86_NEXT_MESSAGE(m0, m1, m2, m3);
+            X86_FOUR_ROUNDS(m0, round_constants + i);
+            m1 = X86_NEXT_MESSAGE(m1, m2, m3, m0);
+            X86_FOUR_ROUNDS(m1, round_constants + i + 4);
+            m2 = X86_NEXT_MESSAGE(m2, m3, m0, m1);
+            X86_FOUR_ROUNDS(m2, round_constants + i + 8);
+            m3 = X86_NEXT_MESSAGE(m3, m0, m1, m2);
+            X86_FOUR_ROUNDS(m3, round_constants + i + 12);
+        }
+
+        abef = _mm_add_epi32(abef, saved_abef);
+        cdgh = _mm_add_epi32(cdgh, saved_cdgh);
+    }
+
+    uint32_t lanes[8];
+    _mm_storeu_si128((__m128i *) lanes, abef);
+    _mm_storeu_si128((__m128i *) (lanes + 4), cdgh);
+    words[0] = lanes[3];
+    words[1] = lanes[2];
+    words[2] = lanes[7];
+    words[3] = lanes[6];
+    words[4] = lanes[1];
+    words[5] = lanes[0];
+    words[6] = lanes[5];
+    words[7] = lanes[4];
+}
+
+static int cpu_has_x86_sha(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    // SSSE3 and SSE4.1
+    if (!(ecx & (1u << 9)) || !(ecx & (1u << 19))) {
+        return 0;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    // SHA
+    return !!(ebx & (1u << 29));
+}
+#endif
+
+#if defined(CPID_SHA256_ARM)
+#if defined(__ARM_FEATURE_SHA2)
+#define CPID_SHA256_ARM_TARGET
+#elif defined(__clang__)
+#define CPID_SHA256_ARM_TARGET __attribute__((target("sha2")))
+#else
+#define CPID_SHA256_ARM_TARGET __attribute__((target("+sha2")))
+#endif
+
+// Four rounds; vsha256hq_u32 and vsha256h2q_u32 both need the state from before the rounds.
+#define ARM_FOUR_ROUNDS(message, k)                                        \
+    do {                                                                   \
+        const uint32x4_t round_input = vaddq_u32((message), vld1q_u32(k)); \
+        const uint32x4_t previous_abcd = abcd;                             \
+        abcd = vsha256hq_u32(abcd, efgh, round_input);                     \
+        efgh = vsha256h2q_u32(efgh, previous_abcd, round_input);           \
+    } while (0)
+
+CPID_SHA256_ARM_TARGET static void compress_arm_sha2(uint32_t words[8], const uint8_t *blocks, size_t block_count) {
+    uint32x4_t abcd = vld1q_u32(words);
+    uint32x4_t efgh = vld1q_u32(words + 4);
+
+    for (; block_count; block_count--, blocks += CPID_SHA256_BLOCK_SIZE) {
+        const uint32x4_t saved_abcd = abcd;
+        const uint32x4_t saved_efgh = efgh;
+
+        uint32x4_t m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks)));
+        uint32x4_t m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16)));
+        uint32x4_t m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 32)));
+        uint32x4_t m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 48)));
+
+        ARM_FOUR_ROUNDS(m0, round_constants);
+        ARM_FOUR_ROUNDS(m1, round_constants + 4);
+        ARM_FOUR_ROUNDS(m2, round_constants + 8);
+        ARM_FOUR_ROUNDS(m3, round_constants + 12);
+        for (size_t i = 16; i < 64; i += 16) {
+            m0 = vsha256su1q_u32(vsha256su0q_u32(m0, m1), m2, m3);
+            ARM_FOUR_ROUNDS(m0, round_constants + i);
+            m1 = vsha256su1q_u32(vsha256su0q_u32(m1, m2), m3, m0);
+            ARM_FOUR_ROUNDS(m1, round_constants + i + 4);
+            m2 = vsha256su1q_u32(vsha256su0q_u32(m2, m3), m0, m1);
+            ARM_FOUR_ROUNDS(m2, round_constants + i + 8);
+            m3 = vsha256su1q_u32(vsha256su0q_u32(m3, m0), m1, m2);
+            ARM_FOUR_ROUNDS(m3, round_constants + i + 12);
+        }
+
+        abcd = vaddq_u32(abcd, saved_abcd);
+        efgh = vaddq_u32(efgh, saved_efgh);
+    }
+
+    vst1q_u32(words, abcd);
+    vst1q_u32(words + 4, efgh);
+}
+
+static int cpu_has_arm_sha2(void) {
+#if defined(__ARM_FEATURE_SHA2) || defined(__APPLE__)
+    // every Apple silicon CPU has the SHA2 instructions
+    return 1;
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+    return !!(getauxval(AT_HWCAP) & HWCAP_SHA2);
+#else
+    return 0;
+#endif
+}
+#endif
+
+// The lane kernels compress one block per 32-bit lane, for as many independent messages as there are lanes.
+// They are written with the vector extensions of GCC and clang, which the target attributes lower to
+// AVX2 or AVX-512 instructions, and to NEON on arm64 where it is always available.
+#if defined(CPID_SHA256_X86) || defined(CPID_SHA256_ARM)
+#define CPID_SHA256_LANES
+
+typedef void (*compress_lanes_function_t)(const uint32_t words[8], const uint8_t *blocks, cpid_sha256_state_t *states);
+
+typedef struct {
+    compress_lanes_function_t compress_lanes;
+    // 0 if the blocks are compressed one by one
+    size_t lane_count;
+} lanes_implementation_t;
+
+static const lanes_implementation_t no_lanes = {NULL, 0};
+
+#define LANE_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Defines a function that compresses lane_count consecutive blocks, each from words into its own state.
+#define DEFINE_COMPRESS_LANES(name, target, lane_vector_t, lane_count)                                                                             \
+    target static void name(const uint32_t words[8], const uint8_t *blocks, cpid_sha256_state_t *states) {                                         \
+        /* the message words are transposed so that each vector holds the same word of every block */                                            \
+        lane_vector_t schedule[16];                                                                                                                 \
+        for (size_t i = 0; i < 16; i++) {                                                                                                           \
+            for (size_t lane = 0; lane < (lane_count); lane++) {                                                                                    \
+                const uint8_t *const word = blocks + lane * CPID_SHA256_BLOCK_SIZE + 4 * i;                                                         \
+                schedule[i][lane] = (uint32_t) word[0] << 24 | (uint32_t) word[1] << 16 | (uint32_t) word[2] << 8 | (uint32_t) word[3];             \
+            }                                                                                                                                       \
+        }                                                                                                                                           \
+                                                                                                                                                    \
+        const lane_vector_t zero = {0};                                                                                                             \
+        lane_vector_t a = zero + words[0], b = zero + words[1], c = zero + words[2], d = zero + words[3];                                           \
+        lane_vector_t e = zero + words[4], f = zero + words[5], g = zero + words[6], h = zero + words[7];                                           \
+        for (size_t i = 0; i < 64; i++) {                                                                                                           \
+            /* the schedule is kept as a ring of the last sixteen words */                                                                          \
+            if (i >= 16) {                                                                                                                          \
+                const lane_vector_t w15 = schedule[(i - 15) & 15];                                                                                  \
+                const lane_vector_t w2 = schedule[(i - 2) & 15];                                                                                    \
+                schedule[i & 15] += (LANE_ROTR(w15, 7) ^ LANE_ROTR(w15, 18) ^ (w15 >> 3)) + schedule[(i - 7) & 15]                                  \
+                        + (LANE_ROTR(w2, 17) ^ LANE_ROTR(w2, 19) ^ (w2 >> 10));                                                                     \
+            }                                                                                                                                       \
+            const lane_vector_t t1 = h + (LANE_ROTR(e, 6) ^ LANE_ROTR(e, 11) ^ LANE_ROTR(e, 25)) + ((e & f) ^ (~e & g)) + round_constants[i]        \
+                    + schedule[i & 15];                                                                                                             \
+            const lane_vector_t t2 = (LANE_ROTR(a, 2) ^ LANE_ROTR(a, 13) ^ LANE_ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));                     \
+            h = g;                                                                                                                                  \
+            g = f;                                                                                                                                  \
+            f = e;                                                                                                                                  \
+            e = d + t1;                                                                                                                             \
+            d = c;                                                                                                                                  \
+            c = b;                                                                                                                                  \
+            b = a;                                                                                                                                  \
+            a = t1 + t2;                                                                                                                            \
+        }                                                                                                                                           \
+                                                                                                                                                    \
+        for (size_t lane = 0; lane < (lane_count); lane++) {                                                                                        \
+            states[lane].words[0] = words[0] + a[lane];                                                                                             \
+            states[lane].words[1] = words[1] + b[lane];                                                                                             \
+            states[lane].words[2] = words[2] + c[lane];                                                                                             \
+            states[lane].words[3] = words[3] + d[lane];                                                                                             \
+            states[lane].words[4] = words[4] + e[lane];                                                                                             \
+            states[lane].words[5] = words[5] + f[lane];                                                                                             \
+            states[lane].words[6] = words[6] + g[lane];                                                                                             \
+            states[lane].words[7] = words[7] + h[lane];                                                                                             \
+        }                                                                                                                                           \
+    }
+#endif
+
+#if defined(CPID_SHA256_X86)
+typedef uint32_t lane16_vector_t __attribute__((vector_size(64)));
+typedef uint32_t lane8_vector_t __attribute__((vector_size(32)));
+
+DEFINE_COMPRESS_LANES(compress_lanes_avx512, __attribute__((target("avx512f"))), lane16_vector_t, 16)
+DEFINE_COMPRESS_LANES(compress_lanes_avx2, __attribute__((target("avx2"))), lane8_vector_t, 8)
+
+// The OS must also save the registers, as told by XCR0.
+static uint64_t read_xcr0(void) {
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t) edx << 32 | eax;
+}
+
+#define XCR0_AVX_STATE 0x06
+#define XCR0_AVX512_STATE 0xE6
+
+static const lanes_implementation_t avx512_lanes = {compress_lanes_avx512, 16};
+static const lanes_implementation_t avx2_lanes = {compress_lanes_avx2, 8};
+
+static const lanes_implementation_t *select_lanes_implementation(void) {
+    unsigned int eax, ebx, ecx, edx;
+    // OSXSAVE
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & (1u << 27))) {
+        return &no_lanes;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return &no_lanes;
+    }
+    const uint64_t xcr0 = read_xcr0();
+
+    // AVX512F
+    if ((ebx & (1u << 16)) && XCR0_AVX512_STATE == (xcr0 & XCR0_AVX512_STATE)) {
+        return &avx512_lanes;
+    }
+    // AVX2, which doesn't outrun the SHA extensions
+    if ((ebx & (1u << 5)) && XCR0_AVX_STATE == (xcr0 & XCR0_AVX_STATE) && !cpu_has_x86_sha()) {
+        return &avx2_lanes;
+    }
+    return &no_lanes;
+}
+#elif defined(CPID_SHA256_ARM)
+typedef uint32_t lane4_vector_t __attribute__((vector_size(16)));
+
+DEFINE_COMPRESS_LANES(compress_lanes_neon, , lane4_vector_t, 4)
+
+static const lanes_implementation_t neon_lanes = {compress_lanes_neon, 4};
+
+static const lanes_implementation_t *select_lanes_implementation(void) {
+    // four lanes don't outrun the SHA2 instructions
+    return cpu_has_arm_sha2() ? &no_lanes : &neon_lanes;
+}
+#endif
+
+static compress_function_t select_compress_function(void) {
+#if defined(CPID_SHA256_X86)
+    if (cpu_has_x86_sha()) {
+        return compress_x86_sha;
+    }
+#elif defined(CPID_SHA256_ARM)
+    if (cpu_has_arm_sha2()) {
+        return compress_arm_sha2;
+    }
+#endif
+    return compress_portable;
+}
+
+void cpid_sha256_compress(cpid_sha256_state_t *const state, const uint8_t *const blocks, const size_t block_count) {
+    // racing first calls select the same function, so a relaxed store is enough
+    static _Atomic(compress_function_t) compress_function = NULL;
+    compress_function_t compress = atomic_load_explicit(&compress_function, memory_order_relaxed);
+    if (!compress) {
+        compress = select_compress_function();
+        atomic_store_explicit(&compress_function, compress, memory_order_relaxed);
+    }
+
+    compress(state->words, blocks, block_count);
+}
+
+void cpid_sha256_compress_many(const cpid_sha256_state_t *const state, const uint8_t *const blocks, const size_t count, cpid_sha256_state_t *const states) {
+    size_t i = 0;
+
+#if defined(CPID_SHA256_LANES)
+    // racing first calls select the same implementation, which is constant, so a relaxed store is enough
+    static _Atomic(const lanes_implementation_t *) lanes_implementation = NULL;
+    const lanes_implementation_t *implementation = atomic_load_explicit(&lanes_implementation, memory_order_relaxed);
+    if (!implementation) {
+        implementation = select_lanes_implementation();
+        atomic_store_explicit(&lanes_implementation, implementation, memory_order_relaxed);
+    }
+
+    if (implementation->lane_count) {
+        for (; count - i >= implementation->lane_count; i += implementation->lane_count) {
+            implementation->compress_lanes(state->words, blocks + i * CPID_SHA256_BLOCK_SIZE, states + i);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        states[i] = *state;
+        cpid_sha256_compress(&states[i], blocks + i * CPID_SHA256_BLOCK_SIZE, 1);
+    }
+}
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CPID_SHA256_BLOCK_SIZE 64
+#define CPID_SHA256_DIGEST_SIZE 32
+// the padding and the 64-bit message length must fit after the tail in the last block
+#define CPID_SHA256_MAX_TAIL_SIZE 55
+
+/**
+ * The SHA-256 hash state between blocks.
+ */
+typedef struct {
+    uint32_t words[8];
+} cpid_sha256_state_t;
+
+/**
+ * Sets the initial SHA-256 hash state.
+ */
+void cpid_sha256_init(cpid_sha256_state_t *const state);
+
+/**
+ * Updates the hash state with block_count consecutive 64-byte blocks.
+ *
+ * @details The implementation is picked on the first call, using the x86 SHA extensions
+ *          or the ARMv8 SHA2 instructions when the CPU has them and portable C otherwise.
+ *          This method is thread-safe.
+ */
+void cpid_sha256_compress(cpid_sha256_state_t *const state, const uint8_t *const blocks, const size_t block_count);
+
+/**
+ * Updates count copies of state, each with its own 64-byte block.
+ *
+ * @details states[i] is populated with state updated with the block at blocks + i * CPID_SHA256_BLOCK_SIZE.
+ *          Where the CPU has them, the blocks are compressed side by side in the 32-bit lanes of
+ *          AVX-512 (16 blocks), AVX2 (8 blocks) or NEON (4 blocks) registers, and the blocks that
+ *          don't fill the lanes with cpid_sha256_compress. The lanes are only used where they outrun
+ *          the SHA instructions of cpid_sha256_compress. This method is thread-safe.
+ */
+void cpid_sha256_compress_many(const cpid_sha256_state_t *const state, const uint8_t *const blocks, const size_t count, cpid_sha256_state_t *const states);
+
+/**
+ * Lays out the last block of a message whose full blocks have already been compressed.
+ *
+ * @details tail holds the last tail_size bytes of the message of message_size bytes,
+ *          where tail_size is at most CPID_SHA256_MAX_TAIL_SIZE so the padding fits one block.
+ */
+static inline void cpid_sha256_pad(const void *const tail, const size_t tail_size, const uint64_t message_size, uint8_t block[CPID_SHA256_BLOCK_SIZE]) {
+    memset(block, 0, CPID_SHA256_BLOCK_SIZE);
+    memcpy(block, tail, tail_size);
+    block[tail_size] = 0x80;
+
+    // the message length in bits, big-endian
+    const uint64_t message_bits = message_size * 8;
+    for (size_t i = 0; i < 8; i++) {
+        block[CPID_SHA256_BLOCK_SIZE - 1 - i] = (uint8_t) (message_bits >> (8 * i));
+    }
+}
+
+/**
+ * Writes the digest of a final hash state, big-endian.
+ */
+static inline void cpid_sha256_get_digest(const cpid_sha256_state_t *const state, uint8_t digest[CPID_SHA256_DIGEST_SIZE]) {
+    for (size_t i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t) (state->words[i] >> 24);
+        digest[4 * i + 1] = (uint8_t) (state->words[i] >> 16);
+        digest[4 * i + 2] = (uint8_t) (state->words[i] >> 8);
+        digest[4 * i + 3] = (uint8_t) state->words[i];
+    }
+}
+
+/**
+ * Finishes the digest of a message whose full blocks have already been compressed into state.
+ *
+ * @details tail holds the last tail_size bytes of the message of message_size bytes,
+ *          where tail_size is at most CPID_SHA256_MAX_TAIL_SIZE so the padding fits one block.
+ *          CPID messages have constant sizes, so inlining this lets the compiler lay out
+ *          the padding at compile time. state is left unchanged.
+ */
+static inline void cpid_sha256_finish(const cpid_sha256_state_t *const state, const void *const tail, const size_t tail_size, const uint64_t message_size, uint8_t digest[CPID_SHA256_DIGEST_SIZE]) {
+    uint8_t block[CPID_SHA256_BLOCK_SIZE];
+    cpid_sha256_pad(tail, tail_size, message_size, block);
+
+    cpid_sha256_state_t final_state = *state;
+    cpid_sha256_compress(&final_state, block, 1);
+    cpid_sha256_get_digest(&final_state, digest);
+}
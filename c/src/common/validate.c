@@ -0,0 +1,519 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// Generates and verifies golden-vector files (see cpid/cpid_vectors.h) for the digest input
+// layouts of every platform, so implementations of the specification can be checked against
+// the reference at scale, independently of the platform the check runs on.
+// Files are mapped rather than read and their records are split over worker threads.
+// The CPIDs are calculated straight from the digest inputs with the built-in SHA-256,
+// reusing the midstate of the boot identifying block of the macOS layout like cpid_macos.c.
+
+#if defined(__linux__)
+// We enforce standard C with no extensions in CMake
+// This is needed for mmap, ftruncate and sysconf to be defined
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpid/cpid_format.h"
+#include "cpid/cpid_vectors.h"
+#include "cpid_sha256.h"
+
+#define HEADER_SIZE 32
+#define MAX_THREADS 256
+// mismatches printed by verify, the rest are only counted
+#define DEFAULT_MAX_REPORTED 10
+#define MAX_REPORTED 1000
+// generated records share their boot identifying fields in groups of this size
+#define BOOT_GROUP_SIZE 4096
+// the boot identifying fields of the macOS layout, hashed once per group
+#define MACOS_PREFIX_SIZE CPID_SHA256_BLOCK_SIZE
+
+_Static_assert(HEADER_SIZE == sizeof(cpid_vectors_header_t), "cpid_vectors_header_t should be 32 bytes.");
+_Static_assert(sizeof(CPID_VECTORS_MAGIC) == sizeof(((cpid_vectors_header_t *) 0)->magic), "CPID_VECTORS_MAGIC should fill the magic field.");
+_Static_assert(CPID_VECTORS_LINUX_MESSAGE_SIZE <= CPID_SHA256_MAX_TAIL_SIZE, "The Linux layout should fit one SHA-256 block.");
+_Static_assert(CPID_VECTORS_WINDOWS_MESSAGE_SIZE <= CPID_SHA256_MAX_TAIL_SIZE, "The Windows layout should fit one SHA-256 block.");
+_Static_assert(CPID_VECTORS_MACOS_MESSAGE_SIZE - MACOS_PREFIX_SIZE <= CPID_SHA256_MAX_TAIL_SIZE, "The macOS layout should fit two SHA-256 blocks.");
+
+typedef struct {
+    const char *name;
+    cpid_vectors_layout_t layout;
+    size_t message_size;
+    // the CPID of the example of the specification, which is the first record of generated files
+    const char *example_cpid;
+} layout_spec_t;
+
+static const layout_spec_t layout_specs[] = {
+    {"linux", CPID_VECTORS_LAYOUT_LINUX, CPID_VECTORS_LINUX_MESSAGE_SIZE, "b770a0ed-8463-822c-b5f6-30d9081ddbd9"},
+    {"windows", CPID_VECTORS_LAYOUT_WINDOWS, CPID_VECTORS_WINDOWS_MESSAGE_SIZE, "ec88c71a-1d67-853c-a76c-3f10f2acdb6e"},
+    {"macos", CPID_VECTORS_LAYOUT_MACOS, CPID_VECTORS_MACOS_MESSAGE_SIZE, "6082233e-8eed-8457-a287-daa46ebdbdf7"},
+};
+#define LAYOUT_COUNT (sizeof(layout_specs) / sizeof(layout_specs[0]))
+
+typedef struct {
+    cpid_sha256_state_t prefix_state;
+    uint8_t prefix[MACOS_PREFIX_SIZE];
+    int has_prefix;
+} hasher_t;
+
+typedef struct {
+    const layout_spec_t *spec;
+    uint8_t *records;
+    size_t record_size;
+    uint64_t start;
+    uint64_t end;
+    uint64_t seed;
+    int generate;
+    uint64_t mismatch_count;
+    uint64_t reported[MAX_REPORTED];
+    size_t reported_count;
+    size_t max_reported;
+    pthread_t thread;
+} worker_t;
+
+static void store_le(uint8_t *const destination, const uint64_t value, const size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        destination[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+static uint64_t load_le(const uint8_t *const source, const size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= (uint64_t) source[i] << (8 * i);
+    }
+    return value;
+}
+
+static void calculate_cpid(hasher_t *const hasher, const cpid_vectors_layout_t layout, const uint8_t *const message, uint8_t cpid[CPID_VECTORS_UUID_SIZE]) {
+    uint8_t digest[CPID_SHA256_DIGEST_SIZE];
+    if (CPID_VECTORS_LAYOUT_MACOS == layout) {
+        if (!hasher->has_prefix || memcmp(hasher->prefix, message, MACOS_PREFIX_SIZE)) {
+            cpid_sha256_init(&hasher->prefix_state);
+            cpid_sha256_compress(&hasher->prefix_state, message, 1);
+            memcpy(hasher->prefix, message, MACOS_PREFIX_SIZE);
+            hasher->has_prefix = 1;
+        }
+        cpid_sha256_finish(&hasher->prefix_state, message + MACOS_PREFIX_SIZE, CPID_VECTORS_MACOS_MESSAGE_SIZE - MACOS_PREFIX_SIZE, CPID_VECTORS_MACOS_MESSAGE_SIZE, digest);
+    } else {
+        cpid_sha256_state_t state;
+        cpid_sha256_init(&state);
+        cpid_sha256_finish(&state, message, CPID_VECTORS_LINUX_MESSAGE_SIZE, CPID_VECTORS_LINUX_MESSAGE_SIZE, digest);
+    }
+
+    memcpy(cpid, digest, CPID_VECTORS_UUID_SIZE);
+    if (CPID_VECTORS_LAYOUT_WINDOWS == layout) {
+        // the digest is cast to a GUID, whose first three fields are little-endian
+        static const uint8_t guid_byte_order[CPID_VECTORS_UUID_SIZE] = {3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+        for (size_t i = 0; i < CPID_VECTORS_UUID_SIZE; i++) {
+            cpid[i] = digest[guid_byte_order[i]];
+        }
+    }
+
+    // the version and variant bits, at the same place of the RFC 9562 byte order for every platform
+    cpid[6] = (uint8_t) ((cpid[6] & 0x0F) | 0x80);
+    cpid[8] = (uint8_t) ((cpid[8] & 0x3F) | 0x80);
+}
+
+static void write_example_message(const cpid_vectors_layout_t layout, uint8_t *const message) {
+    if (CPID_VECTORS_LAYOUT_LINUX == layout) {
+        static const uint8_t boot_uuid[CPID_VECTORS_UUID_SIZE] = {0x28, 0x99, 0xda, 0xe4, 0x4f, 0xa4, 0x4e, 0xef, 0x95, 0xb6, 0x6b, 0xc9, 0x53, 0x25, 0xf6, 0x1a};
+        memcpy(message, boot_uuid, sizeof(boot_uuid));
+        store_le(message + 16, 4026532263u, 8);
+        store_le(message + 24, 55558, 8);
+        store_le(message + 32, 29, 8);
+    } else if (CPID_VECTORS_LAYOUT_WINDOWS == layout) {
+        // b3b44fe1-8a3b-4191-a91e-d3581e766fac in the GUID memory layout
+        static const uint8_t machine_guid[CPID_VECTORS_UUID_SIZE] = {0xe1, 0x4f, 0xb4, 0xb3, 0x3b, 0x8a, 0x91, 0x41, 0xa9, 0x1e, 0xd3, 0x58, 0x1e, 0x76, 0x6f, 0xac};
+        memcpy(message, machine_guid, sizeof(machine_guid));
+        store_le(message + 16, 133494576686106382u, 8);
+        store_le(message + 24, 133494576996587731u, 8);
+        store_le(message + 32, 4992, 8);
+    } else {
+        static const uint8_t hardware_uuid[CPID_VECTORS_UUID_SIZE] = {0x8e, 0x92, 0x33, 0x75, 0x95, 0x10, 0x57, 0x29, 0xa6, 0xcc, 0x2f, 0x66, 0x44, 0x45, 0x73, 0xc9};
+        memset(message, 0, 16);
+        memcpy(message, "T2T3GKP272", 10);
+        memcpy(message + 16, hardware_uuid, sizeof(hardware_uuid));
+        static const uint64_t times_and_pid[7] = {1703173115, 212514, 1703173115, 282857, 1703174125, 741886, 1330};
+        for (size_t i = 0; i < 7; i++) {
+            store_le(message + 32 + 8 * i, times_and_pid[i], 8);
+        }
+    }
+}
+
+// so that a broken SHA-256 path can't produce or accept wrong vectors
+static int check_examples(void) {
+    for (size_t i = 0; i < LAYOUT_COUNT; i++) {
+        uint8_t message[CPID_VECTORS_MACOS_MESSAGE_SIZE];
+        uint8_t cpid[CPID_VECTORS_UUID_SIZE];
+        char cpid_string[CPID_UUID_STRING_LENGTH + 1];
+        hasher_t hasher = {0};
+        write_example_message(layout_specs[i].layout, message);
+        calculate_cpid(&hasher, layout_specs[i].layout, message, cpid);
+        cpid_format_batch(cpid, 1, cpid_string, sizeof(cpid_string));
+        if (strcmp(cpid_string, layout_specs[i].example_cpid)) {
+            fprintf(stderr, "The %s example calculates to %s instead of %s.\n", layout_specs[i].name, cpid_string, layout_specs[i].example_cpid);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15u;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9u;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBu;
+    return x ^ (x >> 31);
+}
+
+// fills size bytes, a multiple of 8, with the random stream of key
+static void fill_random(uint8_t *const destination, const size_t size, const uint64_t key) {
+    for (size_t i = 0; i < size; i += 8) {
+        store_le(destination + i, splitmix64(key + i), 8);
+    }
+}
+
+// the contents of a record only depend on the seed and its index, not on the thread count
+static void write_random_message(const cpid_vectors_layout_t layout, const uint64_t seed, const uint64_t index, uint8_t *const message) {
+    if (0 == index) {
+        write_example_message(layout, message);
+        return;
+    }
+
+    const uint64_t group_key = splitmix64(seed ^ splitmix64(index / BOOT_GROUP_SIZE));
+    const uint64_t record_key = splitmix64(~seed ^ splitmix64(index));
+    if (CPID_VECTORS_LAYOUT_MACOS == layout) {
+        // an ASCII serial number of 10 to 12 characters padded with NULs, then random bytes
+        static const char serial_characters[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        uint8_t serial_random[16];
+        fill_random(serial_random, sizeof(serial_random), group_key);
+        const size_t serial_length = 10 + serial_random[15] % 3;
+        memset(message, 0, 16);
+        for (size_t i = 0; i < serial_length; i++) {
+            message[i] = (uint8_t) serial_characters[serial_random[i] % (sizeof(serial_characters) - 1)];
+        }
+        fill_random(message + 16, MACOS_PREFIX_SIZE - 16, ~group_key);
+        fill_random(message + MACOS_PREFIX_SIZE, CPID_VECTORS_MACOS_MESSAGE_SIZE - MACOS_PREFIX_SIZE, record_key);
+    } else if (CPID_VECTORS_LAYOUT_WINDOWS == layout) {
+        // machine GUID and System process creation time
+        fill_random(message, 24, group_key);
+        fill_random(message + 24, CPID_VECTORS_WINDOWS_MESSAGE_SIZE - 24, record_key);
+    } else {
+        // boot UUID
+        fill_random(message, 16, group_key);
+        fill_random(message + 16, CPID_VECTORS_LINUX_MESSAGE_SIZE - 16, record_key);
+    }
+}
+
+static void *worker_main(void *argument) {
+    worker_t *const worker = argument;
+    const size_t message_size = worker->spec->message_size;
+
+    hasher_t hasher = {0};
+    for (uint64_t i = worker->start; i < worker->end; i++) {
+        uint8_t *const record = worker->records + i * worker->record_size;
+        if (worker->generate) {
+            write_random_message(worker->spec->layout, worker->seed, i, record);
+            calculate_cpid(&hasher, worker->spec->layout, record, record + message_size);
+            continue;
+        }
+
+        uint8_t cpid[CPID_VECTORS_UUID_SIZE];
+        calculate_cpid(&hasher, worker->spec->layout, record, cpid);
+        if (memcmp(cpid, record + message_size, CPID_VECTORS_UUID_SIZE)) {
+            if (worker->reported_count < worker->max_reported) {
+                worker->reported[worker->reported_count++] = i;
+            }
+            worker->mismatch_count++;
+        }
+    }
+
+    return NULL;
+}
+
+// splits the records in contiguous ranges, the main thread takes the first
+static int run_workers(worker_t *const workers, const unsigned thread_count, const uint64_t count) {
+    for (unsigned i = 0; i < thread_count; i++) {
+        workers[i].start = count * i / thread_count;
+        workers[i].end = count * (i + 1) / thread_count;
+    }
+
+    unsigned started_count = 1;
+    for (; started_count < thread_count; started_count++) {
+        if (pthread_create(&workers[started_count].thread, NULL, worker_main, &workers[started_count])) {
+            break;
+        }
+    }
+
+    worker_main(&workers[0]);
+
+    for (unsigned i = 1; i < started_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    return started_count == thread_count ? 0 : -1;
+}
+
+static const layout_spec_t *find_layout(const uint32_t layout) {
+    for (size_t i = 0; i < LAYOUT_COUNT; i++) {
+        if (layout == (uint32_t) layout_specs[i].layout) {
+            return &layout_specs[i];
+        }
+    }
+    return NULL;
+}
+
+static int generate(const char *const path, const layout_spec_t *const spec, const uint64_t count, const uint64_t seed, const unsigned thread_count) {
+    const size_t record_size = spec->message_size + CPID_VECTORS_UUID_SIZE;
+    if (count > (SIZE_MAX - HEADER_SIZE) / record_size) {
+        fprintf(stderr, "%llu vectors don't fit the address space.\n", (unsigned long long) count);
+        return -1;
+    }
+    const size_t file_size = HEADER_SIZE + count * record_size;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    int return_code = -1;
+    uint8_t *file = MAP_FAILED;
+    worker_t *workers = NULL;
+    do {
+        if (ftruncate(fd, (off_t) file_size)) {
+            fprintf(stderr, "Failed to size %s: %s\n", path, strerror(errno));
+            break;
+        }
+        file = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == file) {
+            fprintf(stderr, "Failed to map %s: %s\n", path, strerror(errno));
+            break;
+        }
+
+        memcpy(file, CPID_VECTORS_MAGIC, sizeof(CPID_VECTORS_MAGIC));
+        store_le(file + offsetof(cpid_vectors_header_t, version), CPID_VECTORS_VERSION, 4);
+        store_le(file + offsetof(cpid_vectors_header_t, layout), spec->layout, 4);
+        store_le(file + offsetof(cpid_vectors_header_t, message_size), spec->message_size, 4);
+        store_le(file + offsetof(cpid_vectors_header_t, record_size), record_size, 4);
+        store_le(file + offsetof(cpid_vectors_header_t, count), count, 8);
+
+        workers = calloc(thread_count, sizeof(worker_t));
+        if (!workers) {
+            fprintf(stderr, "Failed to allocate memory.\n");
+            break;
+        }
+        for (unsigned i = 0; i < thread_count; i++) {
+            workers[i] = (worker_t) {.spec = spec, .records = file + HEADER_SIZE, .record_size = record_size, .seed = seed, .generate = 1};
+        }
+
+        if (run_workers(workers, thread_count, count)) {
+            fprintf(stderr, "Failed to start worker threads.\n");
+            break;
+        }
+
+        if (msync(file, file_size, MS_SYNC)) {
+            fprintf(stderr, "Failed to write %s: %s\n", path, strerror(errno));
+            break;
+        }
+        return_code = 0;
+    } while (0);
+
+    free(workers);
+    if (MAP_FAILED != file) {
+        munmap(file, file_size);
+    }
+    close(fd);
+
+    if (!return_code) {
+        printf("Generated %llu %s vectors.\n", (unsigned long long) count, spec->name);
+    }
+
+    return return_code;
+}
+
+// returns 0 if every vector matches, 1 if some don't and -1 on error
+static int verify(const char *const path, const size_t max_reported, const unsigned thread_count) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    int return_code = -1;
+    struct stat file_stat;
+    size_t file_size = 0;
+    uint8_t *file = MAP_FAILED;
+    worker_t *workers = NULL;
+    do {
+        if (fstat(fd, &file_stat) || file_stat.st_size < HEADER_SIZE || (uint64_t) file_stat.st_size > SIZE_MAX) {
+            fprintf(stderr, "%s is not a vector file.\n", path);
+            break;
+        }
+        file_size = (size_t) file_stat.st_size;
+        file = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == file) {
+            fprintf(stderr, "Failed to map %s: %s\n", path, strerror(errno));
+            break;
+        }
+        posix_madvise(file, file_size, POSIX_MADV_SEQUENTIAL);
+
+        const layout_spec_t *const spec = find_layout((uint32_t) load_le(file + offsetof(cpid_vectors_header_t, layout), 4));
+        const uint64_t record_size = load_le(file + offsetof(cpid_vectors_header_t, record_size), 4);
+        const uint64_t count = load_le(file + offsetof(cpid_vectors_header_t, count), 8);
+        if (memcmp(file, CPID_VECTORS_MAGIC, sizeof(CPID_VECTORS_MAGIC))
+            || CPID_VECTORS_VERSION != load_le(file + offsetof(cpid_vectors_header_t, version), 4)
+            || !spec
+            || spec->message_size != load_le(file + offsetof(cpid_vectors_header_t, message_size), 4)
+            || spec->message_size + CPID_VECTORS_UUID_SIZE != record_size
+            || (file_size - HEADER_SIZE) / record_size != count
+            || (file_size - HEADER_SIZE) % record_size) {
+            fprintf(stderr, "%s is not a vector file, or is truncated.\n", path);
+            break;
+        }
+
+        workers = calloc(thread_count, sizeof(worker_t));
+        if (!workers) {
+            fprintf(stderr, "Failed to allocate memory.\n");
+            break;
+        }
+        for (unsigned i = 0; i < thread_count; i++) {
+            workers[i] = (worker_t) {.spec = spec, .records = file + HEADER_SIZE, .record_size = (size_t) record_size, .max_reported = max_reported};
+        }
+
+        if (run_workers(workers, thread_count, count)) {
+            fprintf(stderr, "Failed to start worker threads.\n");
+            break;
+        }
+
+        // the ranges are in order, so the lowest mismatching indices come first
+        uint64_t mismatch_count = 0;
+        size_t reported_count = 0;
+        for (unsigned i = 0; i < thread_count; i++) {
+            for (size_t j = 0; j < workers[i].reported_count && reported_count < max_reported; j++, reported_count++) {
+                const uint64_t index = workers[i].reported[j];
+                const uint8_t *const record = file + HEADER_SIZE + index * record_size;
+                uint8_t cpid[CPID_VECTORS_UUID_SIZE];
+                hasher_t hasher = {0};
+                calculate_cpid(&hasher, spec->layout, record, cpid);
+
+                char strings[2][CPID_UUID_STRING_LENGTH + 1];
+                cpid_format_batch(record + spec->message_size, 1, strings[0], sizeof(strings[0]));
+                cpid_format_batch(cpid, 1, strings[1], sizeof(strings[1]));
+                printf("Vector %llu has %s, expected %s.\n", (unsigned long long) index, strings[0], strings[1]);
+            }
+            mismatch_count += workers[i].mismatch_count;
+        }
+
+        printf("Checked %llu %s vectors, %llu mismatched.\n", (unsigned long long) count, spec->name, (unsigned long long) mismatch_count);
+        return_code = mismatch_count ? 1 : 0;
+    } while (0);
+
+    free(workers);
+    if (MAP_FAILED != file) {
+        munmap(file, file_size);
+    }
+    close(fd);
+
+    return return_code;
+}
+
+static int parse_count(const char *const text, uint64_t *const value) {
+    char *endptr = NULL;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &endptr, 0);
+    if (endptr == text || *endptr || ERANGE == errno || '-' == text[0]) {
+        return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+static void print_usage(const char *const program) {
+    fprintf(stderr,
+            "Usage: %s generate --layout linux|windows|macos --count N [--seed N] [--threads N] FILE\n"
+            "       %s verify [--max-report N] [--threads N] FILE\n"
+            "\n"
+            "  generate      write N random vectors of the layout with their reference CPIDs,\n"
+            "                starting with the example of the specification\n"
+            "  verify        check the CPIDs of a vector file, e.g. one written by another implementation,\n"
+            "                exits with 1 if any of them is wrong\n"
+            "  --seed        seed of the random inputs, the same seed gives the same file (default 0)\n"
+            "  --max-report  number of mismatching vectors to print (default %d)\n"
+            "  --threads     number of worker threads, 0 for one per processor (default 0)\n",
+            program, program, DEFAULT_MAX_REPORTED);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || (strcmp(argv[1], "generate") && strcmp(argv[1], "verify"))) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    const int generating = !strcmp(argv[1], "generate");
+
+    const layout_spec_t *spec = NULL;
+    uint64_t count = 0;
+    int has_count = 0;
+    uint64_t seed = 0;
+    uint64_t max_reported = DEFAULT_MAX_REPORTED;
+    uint64_t thread_count = 0;
+    const char *path = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (generating && !strcmp(argv[i], "--layout") && i + 1 < argc) {
+            spec = NULL;
+            for (size_t j = 0; j < LAYOUT_COUNT; j++) {
+                if (!strcmp(argv[i + 1], layout_specs[j].name)) {
+                    spec = &layout_specs[j];
+                }
+            }
+            if (!spec) {
+                print_usage(argv[0]);
+                return -1;
+            }
+            i++;
+        } else if (generating && !strcmp(argv[i], "--count") && i + 1 < argc && !parse_count(argv[i + 1], &count)) {
+            has_count = 1;
+            i++;
+        } else if (generating && !strcmp(argv[i], "--seed") && i + 1 < argc && !parse_count(argv[i + 1], &seed)) {
+            i++;
+        } else if (!generating && !strcmp(argv[i], "--max-report") && i + 1 < argc && !parse_count(argv[i + 1], &max_reported) && max_reported <= MAX_REPORTED) {
+            i++;
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc && !parse_count(argv[i + 1], &thread_count) && thread_count <= MAX_THREADS) {
+            i++;
+        } else if (!path && '-' != argv[i][0]) {
+            path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (!path || (generating && (!spec || !has_count))) {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    if (0 == thread_count) {
+        long online_processors = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online_processors > 0 && online_processors <= MAX_THREADS ? (uint64_t) online_processors : 1;
+    }
+
+    if (check_examples()) {
+        return -1;
+    }
+
+    if (generating) {
+        return generate(path, spec, count, seed, (unsigned) thread_count);
+    }
+    return verify(path, (size_t) max_reported, (unsigned) thread_count);
+}
@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// Writes the Arrow IPC streaming format without depending on the Arrow libraries.
+// The flatbuffer metadata is laid out front to back: a table is written before the
+// strings, vectors and tables it refers to, and the offsets to those are patched in
+// once they are placed, which keeps every offset pointing forward as flatbuffers require.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arrow_writer.h"
+
+#define ARROW_CONTINUATION_MARKER UINT32_C(0xFFFFFFFF)
+// MetadataVersion V5
+#define ARROW_METADATA_VERSION 4
+// members of the MessageHeader union
+#define ARROW_MESSAGE_SCHEMA 1
+#define ARROW_MESSAGE_RECORD_BATCH 3
+// members of the Type union
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FIXED_SIZE_BINARY 15
+// buffers of the message body, and the message metadata, are padded to this
+#define ARROW_ALIGNMENT 8
+
+#define COLUMN_COUNT 5
+// a validity bitmap and a value buffer per column
+#define BUFFER_COUNT (2 * COLUMN_COUNT)
+#define MAX_TABLE_FIELDS 8
+// FieldNode and Buffer are both structs of two longs
+#define STRUCT_SIZE 16
+
+typedef struct {
+    const char *name;
+    uint8_t nullable;
+    uint8_t type;
+    // bit width of integers, byte width of fixed size binaries
+    int32_t width;
+    uint8_t is_signed;
+    // bytes per row of the value buffer
+    size_t value_size;
+} column_t;
+
+#define PID_COLUMN 0
+#define CPID_COLUMN 1
+#define CREATION_TIME_TICKS_COLUMN 2
+#define PID_NAMESPACE_COLUMN 3
+#define PID_NAMESPACE_TGID_COLUMN 4
+
+static const column_t columns[COLUMN_COUNT] = {
+    {"pid", 0, ARROW_TYPE_INT, 32, 1, sizeof(int32_t)},
+    {"cpid", 1, ARROW_TYPE_FIXED_SIZE_BINARY, sizeof(uuid_t), 0, sizeof(uuid_t)},
+    {"creation_time_ticks", 1, ARROW_TYPE_INT, 64, 0, sizeof(uint64_t)},
+    {"pid_namespace", 1, ARROW_TYPE_INT, 64, 0, sizeof(uint64_t)},
+    {"pid_namespace_tgid", 1, ARROW_TYPE_INT, 32, 1, sizeof(int32_t)},
+};
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    int failed;
+} builder_t;
+
+typedef struct {
+    uint16_t id;
+    uint8_t size;
+    uint64_t value;
+    // populated by write_table, to patch offset fields once their target is placed
+    size_t position;
+} table_field_t;
+
+static size_t align_up(const size_t value, const size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void store_le(uint8_t *const destination, const uint64_t value, const size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        destination[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+// pads to alignment and reserves n zeroed bytes, returns where they start
+static size_t builder_reserve(builder_t *const builder, const size_t alignment, const size_t n) {
+    const size_t position = align_up(builder->size, alignment);
+    if (builder->failed) {
+        return 0;
+    }
+
+    if (position + n > builder->capacity) {
+        #define BUILDER_INITIAL_CAPACITY 1024
+        size_t capacity = builder->capacity ? builder->capacity : BUILDER_INITIAL_CAPACITY;
+        while (capacity < position + n) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(builder->data, capacity);
+        if (!data) {
+            builder->failed = 1;
+            return 0;
+        }
+        memset(data + builder->capacity, 0, capacity - builder->capacity);
+        builder->data = data;
+        builder->capacity = capacity;
+    }
+
+    builder->size = position + n;
+    return position;
+}
+
+static void builder_store(builder_t *const builder, const size_t position, const uint64_t value, const size_t size) {
+    if (!builder->failed) {
+        store_le(builder->data + position, value, size);
+    }
+}
+
+static void patch_offset(builder_t *const builder, const size_t field_position, const size_t target_position) {
+    builder_store(builder, field_position, target_position - field_position, sizeof(uint32_t));
+}
+
+static size_t write_table(builder_t *const builder, table_field_t *const fields, const size_t count) {
+    uint16_t slot_count = 0;
+    size_t alignment = sizeof(uint32_t);
+    for (size_t i = 0; i < count; i++) {
+        if (fields[i].id >= slot_count) {
+            slot_count = (uint16_t) (fields[i].id + 1);
+        }
+        if (fields[i].size > alignment) {
+            alignment = fields[i].size;
+        }
+    }
+
+    // the table starts with the offset to its vtable, then the fields by decreasing size
+    size_t offsets[MAX_TABLE_FIELDS] = {0};
+    size_t inline_size = sizeof(int32_t);
+    for (size_t size = sizeof(uint64_t); size; size /= 2) {
+        for (size_t i = 0; i < count; i++) {
+            if (size == fields[i].size) {
+                inline_size = align_up(inline_size, size);
+                offsets[i] = inline_size;
+                inline_size += size;
+            }
+        }
+    }
+
+    const size_t vtable_size = 2 * sizeof(uint16_t) + slot_count * sizeof(uint16_t);
+    const size_t vtable_position = builder_reserve(builder, sizeof(uint16_t), vtable_size);
+    const size_t table_position = builder_reserve(builder, alignment, inline_size);
+
+    builder_store(builder, vtable_position, vtable_size, sizeof(uint16_t));
+    builder_store(builder, vtable_position + sizeof(uint16_t), inline_size, sizeof(uint16_t));
+    for (size_t i = 0; i < count; i++) {
+        builder_store(builder, vtable_position + (2 + fields[i].id) * sizeof(uint16_t), offsets[i], sizeof(uint16_t));
+        fields[i].position = table_position + offsets[i];
+        builder_store(builder, fields[i].position, fields[i].value, fields[i].size);
+    }
+    // the vtable is found by subtracting this from the table position
+    builder_store(builder, table_position, table_position - vtable_position, sizeof(int32_t));
+
+    return table_position;
+}
+
+static size_t write_string(builder_t *const builder, const char *const text) {
+    const size_t length = strlen(text);
+    // the NUL terminator is part of the encoding but not of the length
+    const size_t position = builder_reserve(builder, sizeof(uint32_t), sizeof(uint32_t) + length + 1);
+    builder_store(builder, position, length, sizeof(uint32_t));
+    if (!builder->failed) {
+        memcpy(builder->data + position + sizeof(uint32_t), text, length);
+    }
+    return position;
+}
+
+// the offset of element i is at the returned position + 4 + 4 * i
+static size_t write_offset_vector(builder_t *const builder, const size_t count) {
+    const size_t position = builder_reserve(builder, sizeof(uint32_t), sizeof(uint32_t) * (1 + count));
+    builder_store(builder, position, count, sizeof(uint32_t));
+    return position;
+}
+
+// the elements hold longs, so they have to start 8-aligned right after the 4-byte length
+static size_t write_struct_vector(builder_t *const builder, const size_t count) {
+    if (0 == align_up(builder->size, sizeof(uint32_t)) % sizeof(uint64_t)) {
+        builder_reserve(builder, sizeof(uint32_t), sizeof(uint32_t));
+    }
+    const size_t position = builder_reserve(builder, sizeof(uint32_t), sizeof(uint32_t) + count * STRUCT_SIZE);
+    builder_store(builder, position, count, sizeof(uint32_t));
+    return position;
+}
+
+static int write_message(FILE *const out, const builder_t *const metadata, const uint8_t *const body, const size_t body_length) {
+    if (metadata->failed) {
+        return -1;
+    }
+
+    // the metadata size covers the padding that aligns the body
+    const size_t metadata_size = align_up(metadata->size, ARROW_ALIGNMENT);
+    uint8_t prefix[2 * sizeof(uint32_t)];
+    store_le(prefix, ARROW_CONTINUATION_MARKER, sizeof(uint32_t));
+    store_le(prefix + sizeof(uint32_t), metadata_size, sizeof(uint32_t));
+
+    static const uint8_t padding[ARROW_ALIGNMENT] = {0};
+    if (1 != fwrite(prefix, sizeof(prefix), 1, out) || 1 != fwrite(metadata->data, metadata->size, 1, out)) {
+        return -1;
+    }
+    if (metadata_size > metadata->size && 1 != fwrite(padding, metadata_size - metadata->size, 1, out)) {
+        return -1;
+    }
+    if (body_length && 1 != fwrite(body, body_length, 1, out)) {
+        return -1;
+    }
+    return 0;
+}
+
+static size_t write_message_table(builder_t *const builder, const uint8_t header_type, const size_t body_length, size_t *const header_position) {
+    const size_t root_position = builder_reserve(builder, sizeof(uint32_t), sizeof(uint32_t));
+    table_field_t message[] = {
+        {.id = 0, .size = sizeof(int16_t), .value = ARROW_METADATA_VERSION},
+        {.id = 1, .size = sizeof(uint8_t), .value = header_type},
+        {.id = 2, .size = sizeof(uint32_t)},
+        {.id = 3, .size = sizeof(int64_t), .value = body_length},
+    };
+    const size_t message_position = write_table(builder, message, sizeof(message) / sizeof(message[0]));
+    patch_offset(builder, root_position, message_position);
+    *header_position = message[2].position;
+    return message_position;
+}
+
+static void write_key_value(builder_t *const builder, const size_t element_position, const char *const key, const char *const value) {
+    table_field_t key_value[] = {
+        {.id = 0, .size = sizeof(uint32_t)},
+        {.id = 1, .size = sizeof(uint32_t)},
+    };
+    patch_offset(builder, element_position, write_table(builder, key_value, 2));
+    patch_offset(builder, key_value[0].position, write_string(builder, key));
+    patch_offset(builder, key_value[1].position, write_string(builder, value));
+}
+
+static void write_field(builder_t *const builder, const size_t element_position, const size_t column) {
+    const column_t *const spec = &columns[column];
+
+    table_field_t field[] = {
+        {.id = 0, .size = sizeof(uint32_t)},
+        {.id = 1, .size = sizeof(uint8_t), .value = spec->nullable},
+        {.id = 2, .size = sizeof(uint8_t), .value = spec->type},
+        {.id = 3, .size = sizeof(uint32_t)},
+        // readers expect the children even if there are none
+        {.id = 5, .size = sizeof(uint32_t)},
+        {.id = 6, .size = sizeof(uint32_t)},
+    };
+    const size_t field_count = CPID_COLUMN == column ? 6 : 5;
+    patch_offset(builder, element_position, write_table(builder, field, field_count));
+    patch_offset(builder, field[0].position, write_string(builder, spec->name));
+
+    if (ARROW_TYPE_INT == spec->type) {
+        table_field_t type[] = {
+            {.id = 0, .size = sizeof(int32_t), .value = (uint64_t) spec->width},
+            {.id = 1, .size = sizeof(uint8_t), .value = spec->is_signed},
+        };
+        patch_offset(builder, field[3].position, write_table(builder, type, 2));
+    } else {
+        table_field_t type[] = {
+            {.id = 0, .size = sizeof(int32_t), .value = (uint64_t) spec->width},
+        };
+        patch_offset(builder, field[3].position, write_table(builder, type, 1));
+    }
+
+    patch_offset(builder, field[4].position, write_offset_vector(builder, 0));
+
+    if (CPID_COLUMN == column) {
+        // the canonical UUID extension type, readers without it see the 16-byte storage type
+        const size_t metadata_position = write_offset_vector(builder, 2);
+        patch_offset(builder, field[5].position, metadata_position);
+        write_key_value(builder, metadata_position + sizeof(uint32_t), "ARROW:extension:name", "arrow.uuid");
+        write_key_value(builder, metadata_position + 2 * sizeof(uint32_t), "ARROW:extension:metadata", "");
+    }
+}
+
+int arrow_write_schema(FILE *const out) {
+    builder_t builder = {0};
+
+    size_t header_position = 0;
+    write_message_table(&builder, ARROW_MESSAGE_SCHEMA, 0, &header_position);
+
+    table_field_t schema[] = {
+        // little endian
+        {.id = 0, .size = sizeof(int16_t), .value = 0},
+        {.id = 1, .size = sizeof(uint32_t)},
+    };
+    patch_offset(&builder, header_position, write_table(&builder, schema, 2));
+
+    const size_t fields_position = write_offset_vector(&builder, COLUMN_COUNT);
+    patch_offset(&builder, schema[1].position, fields_position);
+    for (size_t column = 0; column < COLUMN_COUNT; column++) {
+        write_field(&builder, fields_position + sizeof(uint32_t) * (1 + column), column);
+    }
+
+    const int return_code = write_message(out, &builder, NULL, 0);
+    free(builder.data);
+
+    return return_code;
+}
+
+int arrow_write_record_batch(FILE *const out, const pid_t *const pids, const cpid_record_t *const records, const int *const statuses, const size_t count) {
+    if (!pids || !records || !statuses) {
+        return -1;
+    }
+
+    // a validity bitmap for each nullable column, then the values, each buffer 8-aligned
+    size_t buffer_offsets[BUFFER_COUNT] = {0};
+    size_t buffer_lengths[BUFFER_COUNT] = {0};
+    size_t body_length = 0;
+    for (size_t column = 0; column < COLUMN_COUNT; column++) {
+        buffer_offsets[2 * column] = body_length;
+        if (columns[column].nullable) {
+            buffer_lengths[2 * column] = (count + 7) / 8;
+            body_length += align_up(buffer_lengths[2 * column], ARROW_ALIGNMENT);
+        }
+        buffer_offsets[2 * column + 1] = body_length;
+        buffer_lengths[2 * column + 1] = count * columns[column].value_size;
+        body_length += align_up(buffer_lengths[2 * column + 1], ARROW_ALIGNMENT);
+    }
+
+    uint8_t *body = calloc(body_length ? body_length : 1, 1);
+    if (!body) {
+        return -1;
+    }
+
+    #define VALUE_AT(column, row) (body + buffer_offsets[2 * (column) + 1] + (row) * columns[column].value_size)
+    size_t null_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        store_le(VALUE_AT(PID_COLUMN, i), (uint32_t) pids[i], sizeof(int32_t));
+
+        // null rows keep zeroed values
+        if (statuses[i]) {
+            null_count++;
+            continue;
+        }
+        for (size_t column = 0; column < COLUMN_COUNT; column++) {
+            if (columns[column].nullable) {
+                body[buffer_offsets[2 * column] + i / 8] |= (uint8_t) (1u << (i % 8));
+            }
+        }
+        memcpy(VALUE_AT(CPID_COLUMN, i), records[i].uuid, sizeof(uuid_t));
+        store_le(VALUE_AT(CREATION_TIME_TICKS_COLUMN, i), records[i].input.creation_time_ticks, sizeof(uint64_t));
+        store_le(VALUE_AT(PID_NAMESPACE_COLUMN, i), (uint64_t) records[i].input.pid_namespace, sizeof(uint64_t));
+        store_le(VALUE_AT(PID_NAMESPACE_TGID_COLUMN, i), (uint32_t) records[i].input.pid_namespace_tgid, sizeof(int32_t));
+    }
+
+    builder_t builder = {0};
+    size_t header_position = 0;
+    write_message_table(&builder, ARROW_MESSAGE_RECORD_BATCH, body_length, &header_position);
+
+    table_field_t record_batch[] = {
+        {.id = 0, .size = sizeof(int64_t), .value = count},
+        {.id = 1, .size = sizeof(uint32_t)},
+        {.id = 2, .size = sizeof(uint32_t)},
+    };
+    patch_offset(&builder, header_position, write_table(&builder, record_batch, 3));
+
+    // FieldNode: length, null_count
+    const size_t nodes_position = write_struct_vector(&builder, COLUMN_COUNT);
+    patch_offset(&builder, record_batch[1].position, nodes_position);
+    for (size_t column = 0; column < COLUMN_COUNT; column++) {
+        const size_t node_position = nodes_position + sizeof(uint32_t) + column * STRUCT_SIZE;
+        builder_store(&builder, node_position, count, sizeof(int64_t));
+        builder_store(&builder, node_position + sizeof(int64_t), columns[column].nullable ? null_count : 0, sizeof(int64_t));
+    }
+
+    // Buffer: offset, length
+    const size_t buffers_position = write_struct_vector(&builder, BUFFER_COUNT);
+    patch_offset(&builder, record_batch[2].position, buffers_position);
+    for (size_t buffer = 0; buffer < BUFFER_COUNT; buffer++) {
+        const size_t buffer_position = buffers_position + sizeof(uint32_t) + buffer * STRUCT_SIZE;
+        builder_store(&builder, buffer_position, buffer_offsets[buffer], sizeof(int64_t));
+        builder_store(&builder, buffer_position + sizeof(int64_t), buffer_lengths[buffer], sizeof(int64_t));
+    }
+
+    const int return_code = write_message(out, &builder, body, body_length);
+    free(builder.data);
+    free(body);
+
+    return return_code;
+}
+
+int arrow_write_end_of_stream(FILE *const out) {
+    uint8_t marker[2 * sizeof(uint32_t)] = {0};
+    store_le(marker, ARROW_CONTINUATION_MARKER, sizeof(uint32_t));
+    return 1 == fwrite(marker, sizeof(marker), 1, out) ? 0 : -1;
+}
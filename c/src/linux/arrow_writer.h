@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <stdio.h>
+
+#include "cpid/cpid_linux.h"
+
+/**
+ * Writes the schema message that starts an Arrow IPC stream of process records.
+ *
+ * @details The columns are pid (int32), cpid (fixed_size_binary(16) with the arrow.uuid extension),
+ *          creation_time_ticks (uint64), pid_namespace (uint64) and pid_namespace_tgid (int32).
+ *          All but pid are null for processes whose record couldn't be sourced.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int arrow_write_schema(FILE *const out);
+
+/**
+ * Writes a record batch of count rows to an Arrow IPC stream.
+ *
+ * @details Row i has the PID pids[i] and, if statuses[i] is 0, the CPID UUID and inputs of records[i].
+ *
+ * @return 0 on success, -1 on error.
+ */
+int arrow_write_record_batch(FILE *const out, const pid_t *const pids, const cpid_record_t *const records, const int *const statuses, const size_t count);
+
+/**
+ * Writes the end-of-stream marker of an Arrow IPC stream.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int arrow_write_end_of_stream(FILE *const out);
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0 OR Apache-2.0
+
+#include "vmlinux.h"
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+
+#include "cpid_capture_event.h"
+
+// bpf_get_current_task_btf and BTF-typed tracepoints are only available to GPL programs
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
+
+#define NSEC_PER_SEC 1000000000ULL
+#define CAPTURE_RING_BUFFER_SIZE (4 * 1024 * 1024)
+
+// set by the loader to sysconf(_SC_CLK_TCK) before the program is loaded
+const volatile __u64 user_hz = 100;
+// set by the loader to the boottime offset of its time namespace, which /proc adds for its readers
+const volatile __u64 boottime_offset_ns = 0;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, CAPTURE_RING_BUFFER_SIZE);
+} events SEC(".maps");
+
+// events dropped because the ring buffer was full, read by cpid_bpf_get_lost_count
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, __u64);
+} lost_events SEC(".maps");
+
+// task_struct::start_boottime was named real_start_time before Linux 5.5
+struct task_struct___pre_5_5 {
+    __u64 real_start_time;
+} __attribute__((preserve_access_index));
+
+static __always_inline __u64 get_start_boottime(struct task_struct *task) {
+    if (bpf_core_field_exists(task->start_boottime)) {
+        return BPF_CORE_READ(task, start_boottime);
+    }
+
+    struct task_struct___pre_5_5 *old_task = (void *) task;
+    return BPF_CORE_READ(old_task, real_start_time);
+}
+
+static __always_inline int submit_event(struct task_struct *task, const __u32 event) {
+    // /proc/<pid>/stat reports the start time of the thread group leader
+    struct task_struct *leader = BPF_CORE_READ(task, group_leader);
+
+    struct cpid_capture_event *capture_event = bpf_ringbuf_reserve(&events, sizeof(*capture_event), 0);
+    if (!capture_event) {
+        // the ring buffer is full, userspace isn't keeping up
+        // the program can't migrate, so the counter of this CPU isn't written concurrently
+        __u32 key = 0;
+        __u64 *lost_count = bpf_map_lookup_elem(&lost_events, &key);
+        if (lost_count) {
+            (*lost_count)++;
+        }
+        return 0;
+    }
+
+    // /proc/<pid>/stat starttime is nsec_to_clock_t(timens_add_boottime_ns(start_boottime)),
+    // which is an exact division whenever USER_HZ divides NSEC_PER_SEC.
+    // The offset is added modulo 2^64 like the kernel does, a negative one included.
+    capture_event->creation_time_ticks = (get_start_boottime(leader) + boottime_offset_ns) / (NSEC_PER_SEC / user_hz);
+
+    // The deepest level of the TGID struct pid holds the namespace the process was created in
+    // and the TGID in that namespace, the same values as /proc/<pid>/ns/pid and the end of NStgid.
+    struct pid *tgid_pid = BPF_CORE_READ(leader, thread_pid);
+    unsigned int level = BPF_CORE_READ(tgid_pid, level);
+    struct upid deepest_upid = {0};
+    bpf_core_read(&deepest_upid, sizeof(deepest_upid), &tgid_pid->numbers[level]);
+
+    capture_event->pid_namespace = BPF_CORE_READ(deepest_upid.ns, ns.inum);
+    capture_event->pid_namespace_tgid = deepest_upid.nr;
+    capture_event->pid = BPF_CORE_READ(task, tgid);
+    capture_event->event = event;
+
+    bpf_ringbuf_submit(capture_event, 0);
+    return 0;
+}
+
+SEC("tp_btf/sched_process_fork")
+int BPF_PROG(capture_fork, struct task_struct *parent, struct task_struct *child) {
+    // thread creation is traced as a fork as well
+    if (BPF_CORE_READ(child, pid) != BPF_CORE_READ(child, tgid)) {
+        return 0;
+    }
+
+    return submit_event(child, CPID_CAPTURE_EVENT_FORK);
+}
+
+SEC("tp_btf/sched_process_exec")
+int BPF_PROG(capture_exec, struct task_struct *task, pid_t old_pid, struct linux_binprm *bprm) {
+    return submit_event(task, CPID_CAPTURE_EVENT_EXEC);
+}
+
+SEC("tp_btf/sched_process_exit")
+int BPF_PROG(capture_exit, struct task_struct *task) {
+    // thread exits are traced as well
+    if (BPF_CORE_READ(task, pid) != BPF_CORE_READ(task, tgid)) {
+        return 0;
+    }
+
+    return submit_event(task, CPID_CAPTURE_EVENT_EXIT);
+}
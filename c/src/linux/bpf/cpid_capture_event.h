@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Shared between the BPF program and its userspace loader.
+// Fixed-width fields keep the layout identical on both sides of the ring buffer.
+
+#define CPID_CAPTURE_EVENT_FORK 1
+#define CPID_CAPTURE_EVENT_EXEC 2
+#define CPID_CAPTURE_EVENT_EXIT 3
+
+struct cpid_capture_event {
+    // the same three CPID UUID inputs that are otherwise sourced from /proc
+    __u64 pid_namespace;
+    __u64 creation_time_ticks;
+    __s64 pid_namespace_tgid;
+    // the TGID of the process in the initial PID namespace
+    __s32 pid;
+    __u32 event;
+};
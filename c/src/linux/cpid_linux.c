@@ -1,22 +1,43 @@
 // SPDX-License-Identifier: Apache-2.0
 
 // We enforce standard C with no extensions in CMake
-// This is needed for readlink method to be defined
-#define _POSIX_C_SOURCE 200112L
+// This is needed for the openat, readlinkat and memrchr methods to be defined
+#define _GNU_SOURCE
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <uuid/uuid.h>
+#ifdef CPID_BUILTIN_SHA256
+#include "../common/cpid_sha256.h"
+#else
 #include <openssl/evp.h>
+#endif
 
+#include "cpid/cpid_format.h"
 #include "cpid/cpid_linux.h"
+#include "cpid_linux_internal.h"
 
 #define LINUX_EXPECTED_DIGEST_INPUT_CONTENT_SIZE 40
 #define OPEN_SSL_SUCCESS 1
 #define SHA256_BUFFER_SIZE 32
+#ifdef CPID_BUILTIN_SHA256
+#define DIGEST_DESTINATION_BUFFER_SIZE SHA256_BUFFER_SIZE
+#else
+#define DIGEST_DESTINATION_BUFFER_SIZE EVP_MAX_MD_SIZE
+#endif
+#define CPID_CACHE_LINE_SIZE 64
 
 #pragma pack(push, 1)
 typedef struct {
@@ -29,16 +50,72 @@ typedef struct {
 
 _Static_assert(LINUX_EXPECTED_DIGEST_INPUT_CONTENT_SIZE == sizeof(digest_input_content_t), "Linux digest_input_content_t size should be 40 bytes.");
 
+// immutable after creation, shared by all the handles created from it
 typedef struct {
+    atomic_size_t reference_count;
+    int proc_directory_fd;
+    ino_t proc_pid_namespace;
+#ifndef CPID_BUILTIN_SHA256
+    // fetched by the first digest for the default context, at creation otherwise
+    _Atomic(EVP_MD *) sha256;
+#endif
+    uuid_t boot_uuid;
+} *cpid_context_internal_t;
+
+// mutable per-thread state
+typedef struct {
+    cpid_context_internal_t context;
+    cpid_linux_cache_t cache;
+    int cache_flags;
+#ifndef CPID_BUILTIN_SHA256
     EVP_MD_CTX *digest_context;
-    EVP_MD *sha256;
-    uint8_t digest_destination_buffer[EVP_MAX_MD_SIZE];
+#endif
+    uint8_t digest_destination_buffer[DIGEST_DESTINATION_BUFFER_SIZE];
     digest_input_content_t digest_input_content;
+#ifdef CPID_ENABLE_STATS
+    cpid_stats_t stats;
+#endif
 } *cpid_handle_internal_t;
 
-_Static_assert(EVP_MAX_MD_SIZE >= SHA256_BUFFER_SIZE, "OpenSSL EVP_MAX_MD_SIZE must be larger than SHA256_BUFFER_SIZE.");
+_Static_assert(DIGEST_DESTINATION_BUFFER_SIZE >= SHA256_BUFFER_SIZE, "DIGEST_DESTINATION_BUFFER_SIZE must be larger than SHA256_BUFFER_SIZE.");
 _Static_assert(SHA256_BUFFER_SIZE >= sizeof(uuid_t), "SHA256_BUFFER_SIZE must be larger than uuid_t.");
 
+#ifdef CPID_ENABLE_STATS
+// The monotonic clock is read through the vDSO, without a system call.
+static uint64_t stats_now_ns(void) {
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+// Records a stage that started at start_ns and passes its return code through, negative on failure.
+static int stats_record_stage(cpid_handle_internal_t const library_handle_internal, const cpid_stage_t stage, const uint64_t start_ns, const int return_code) {
+    const uint64_t latency_ns = stats_now_ns() - start_ns;
+
+    size_t bucket = 0;
+    for (uint64_t remaining = latency_ns >> 1; remaining && bucket < CPID_STATS_HISTOGRAM_BUCKET_COUNT - 1; remaining >>= 1) {
+        bucket++;
+    }
+
+    cpid_stage_stats_t *const stage_stats = &library_handle_internal->stats.stages[stage];
+    stage_stats->calls++;
+    stage_stats->failures += return_code < 0;
+    stage_stats->total_latency_ns += latency_ns;
+    stage_stats->latency_histogram[bucket]++;
+
+    return return_code;
+}
+
+// Plain increments, the handle isn't shared between threads
+#define STATS_STAGE_START(start_ns) const uint64_t start_ns = stats_now_ns()
+#define STATS_STAGE_END(library_handle_internal, stage, start_ns, return_code) stats_record_stage((library_handle_internal), (stage), (start_ns), (return_code))
+#define STATS_COUNT(library_handle_internal, counter) ((library_handle_internal)->stats.counter++)
+#else
+#define STATS_STAGE_START(start_ns)
+#define STATS_STAGE_END(library_handle_internal, stage, start_ns, return_code) (return_code)
+#define STATS_COUNT(library_handle_internal, counter) ((void) (library_handle_internal))
+#endif
+
 static int cpid_get_boot_uuid(uuid_t boot_uuid) {
 
     uuid_string_t boot_uuid_string = {0};
@@ -69,71 +146,294 @@ static int cpid_get_boot_uuid(uuid_t boot_uuid) {
     return 0;
 }
 
-cpid_handle_t cpid_initialize(void) {
+// defined with the other /proc parsing helpers below
+static int get_proc_pid_namespace(const int proc_directory_fd, ino_t *const proc_pid_namespace);
 
-    cpid_handle_internal_t library_handle_internal = calloc(1, sizeof(*library_handle_internal));
-    if (!library_handle_internal) {
+static cpid_context_internal_t context_allocate(const int defer_digest) {
+
+    cpid_context_internal_t context_internal = calloc(1, sizeof(*context_internal));
+    if (!context_internal) {
+        return NULL;
+    }
+
+    atomic_init(&context_internal->reference_count, 1);
+    // calloc leaves the descriptor at 0, which is a valid descriptor number
+    context_internal->proc_directory_fd = -1;
+
+#ifndef CPID_BUILTIN_SHA256
+    // fetched once per context, since fetching takes the OpenSSL provider lock
+    atomic_init(&context_internal->sha256, defer_digest ? NULL : EVP_MD_fetch(NULL, "SHA256", NULL));
+    if (!defer_digest && !atomic_load_explicit(&context_internal->sha256, memory_order_relaxed)) {
+        cpid_context_release(context_internal);
+        context_internal = NULL;
+    }
+#else
+    (void) defer_digest;
+#endif
+
+    return context_internal;
+}
+
+static cpid_context_internal_t context_create(const int defer_digest) {
+
+    cpid_context_internal_t context_internal = context_allocate(defer_digest);
+    if (!context_internal) {
         return NULL;
     }
 
     int return_code = 0;
     do {
-        library_handle_internal->sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
-        if (!library_handle_internal->sha256) {
+        // per-process files are opened relative to this directory,
+        // which saves formatting and resolving the full /proc path on every lookup
+        context_internal->proc_directory_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (context_internal->proc_directory_fd < 0) {
             return_code = -1;
             break;
         }
 
-        library_handle_internal->digest_context = EVP_MD_CTX_new();
-        if (!library_handle_internal->digest_context) {
+        if (get_proc_pid_namespace(context_internal->proc_directory_fd, &context_internal->proc_pid_namespace)) {
             return_code = -1;
             break;
         }
 
-
-        if(cpid_get_boot_uuid(library_handle_internal->digest_input_content.boot_uuid)) {
+        if(cpid_get_boot_uuid(context_internal->boot_uuid)) {
             return_code = -1;
         }
     } while(0);
 
     if (return_code) {
-        cpid_finalize(library_handle_internal);
-        library_handle_internal = NULL;
+        cpid_context_release(context_internal);
+        context_internal = NULL;
     }
 
+    return context_internal;
+}
+
+cpid_context_t cpid_context_create(void) {
+    return context_create(0);
+}
+
+// built by the first caller and never freed, since the process keeps a reference
+static pthread_mutex_t default_context_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic(cpid_context_internal_t) default_context = NULL;
+
+cpid_context_t cpid_context_get_default(void) {
+
+    cpid_context_internal_t context_internal = atomic_load_explicit(&default_context, memory_order_acquire);
+    if (!context_internal) {
+        // a failed creation is retried by the next caller
+        pthread_mutex_lock(&default_context_mutex);
+        context_internal = atomic_load_explicit(&default_context, memory_order_relaxed);
+        if (!context_internal) {
+            context_internal = context_create(1);
+            atomic_store_explicit(&default_context, context_internal, memory_order_release);
+        }
+        pthread_mutex_unlock(&default_context_mutex);
+    }
+
+    return cpid_context_retain(context_internal);
+}
+
+cpid_context_t cpid_context_create_with_boot_uuid(const uuid_t boot_uuid) {
+    if (!boot_uuid) {
+        return NULL;
+    }
+
+    // /proc isn't opened, so the processes of the local boot are out of reach of handles created from this context
+    cpid_context_internal_t context_internal = context_allocate(0);
+    if (context_internal) {
+        memcpy(context_internal->boot_uuid, boot_uuid, sizeof(uuid_t));
+    }
+
+    return context_internal;
+}
+
+cpid_context_t cpid_context_retain(cpid_context_t const context) {
+
+    cpid_context_internal_t context_internal = (cpid_context_internal_t) context;
+
+    if (context_internal) {
+        atomic_fetch_add_explicit(&context_internal->reference_count, 1, memory_order_relaxed);
+    }
+
+    return context_internal;
+}
+
+void cpid_context_release(cpid_context_t const context) {
+
+    cpid_context_internal_t context_internal = (cpid_context_internal_t) context;
+
+    if (!context_internal) {
+        return;
+    }
+
+    // the last release frees the context, after every other thread is done with it
+    if (1 != atomic_fetch_sub_explicit(&context_internal->reference_count, 1, memory_order_acq_rel)) {
+        return;
+    }
+
+#ifndef CPID_BUILTIN_SHA256
+    EVP_MD *sha256 = atomic_load_explicit(&context_internal->sha256, memory_order_relaxed);
+    if (sha256) {
+        EVP_MD_free(sha256);
+    }
+#endif
+
+    if (context_internal->proc_directory_fd >= 0) {
+        close(context_internal->proc_directory_fd);
+    }
+
+    free(context_internal);
+}
+
+cpid_handle_t cpid_initialize_from_context(cpid_context_t const context) {
+    if (!context) {
+        return NULL;
+    }
+
+    // Handles are cache line aligned and sized so that handles used by different threads
+    // never share a cache line.
+    #define HANDLE_ALLOCATION_SIZE ((sizeof(*(cpid_handle_internal_t) NULL) + CPID_CACHE_LINE_SIZE - 1) / CPID_CACHE_LINE_SIZE * CPID_CACHE_LINE_SIZE)
+    cpid_handle_internal_t library_handle_internal = aligned_alloc(CPID_CACHE_LINE_SIZE, HANDLE_ALLOCATION_SIZE);
+    if (!library_handle_internal) {
+        return NULL;
+    }
+    memset(library_handle_internal, 0, HANDLE_ALLOCATION_SIZE);
+
+    library_handle_internal->context = cpid_context_retain(context);
+    memcpy(library_handle_internal->digest_input_content.boot_uuid, library_handle_internal->context->boot_uuid, sizeof(uuid_t));
+
+#ifndef CPID_BUILTIN_SHA256
+    // handles of the default context leave this to their first digest too
+    if (atomic_load_explicit(&library_handle_internal->context->sha256, memory_order_relaxed)) {
+        library_handle_internal->digest_context = EVP_MD_CTX_new();
+        if (!library_handle_internal->digest_context) {
+            cpid_finalize(library_handle_internal);
+            library_handle_internal = NULL;
+        }
+    }
+#endif
+
     return library_handle_internal;
 }
 
+cpid_context_t cpid_linux_get_context(cpid_handle_t const library_handle) {
+    return ((cpid_handle_internal_t) library_handle)->context;
+}
+
+int cpid_linux_get_proc_directory_fd(cpid_handle_t const library_handle) {
+    return ((cpid_handle_internal_t) library_handle)->context->proc_directory_fd;
+}
+
+int cpid_linux_is_offline(cpid_handle_t const library_handle) {
+    // only contexts with a given boot UUID leave /proc unopened
+    return library_handle && ((cpid_handle_internal_t) library_handle)->context->proc_directory_fd < 0;
+}
+
+cpid_handle_t cpid_initialize_lazy(void) {
+
+    cpid_context_t context = cpid_context_get_default();
+    if (!context) {
+        return NULL;
+    }
+
+    cpid_handle_t library_handle = cpid_initialize_from_context(context);
+    cpid_context_release(context);
+
+    return library_handle;
+}
+
+cpid_handle_t cpid_initialize(void) {
+
+    cpid_context_t context = cpid_context_create();
+    if (!context) {
+        return NULL;
+    }
+
+    // the handle keeps its own reference to the context
+    cpid_handle_t library_handle = cpid_initialize_from_context(context);
+    cpid_context_release(context);
+
+    return library_handle;
+}
+
 void cpid_finalize(cpid_handle_t const library_handle) {
 
     cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
 
     if (library_handle_internal) {
+#ifndef CPID_BUILTIN_SHA256
         if (library_handle_internal->digest_context) {
             EVP_MD_CTX_free(library_handle_internal->digest_context);
         }
+#endif
 
-        if (library_handle_internal->sha256) {
-            EVP_MD_free(library_handle_internal->sha256);
-        }
+        cpid_linux_cache_destroy(library_handle_internal->cache);
+
+        cpid_context_release(library_handle_internal->context);
 
         free(library_handle_internal);
     }
 }
 
-int cpid_make_uuid(cpid_handle_t const library_handle, const pid_t pid_namespace_tgid, const uint64_t creation_time_ticks, const ino_t pid_namespace, uuid_t uuid) {
-    if (!library_handle || !uuid) {
-        return -1;
+#ifndef CPID_BUILTIN_SHA256
+static const EVP_MD *context_get_sha256(cpid_context_internal_t const context_internal) {
+    EVP_MD *sha256 = atomic_load_explicit(&context_internal->sha256, memory_order_acquire);
+    if (!sha256) {
+        // threads racing for the first digest of the default context keep the first fetch
+        EVP_MD *fetched = EVP_MD_fetch(NULL, "SHA256", NULL);
+        if (!fetched) {
+            return NULL;
+        }
+        if (atomic_compare_exchange_strong_explicit(&context_internal->sha256, &sha256, fetched, memory_order_acq_rel, memory_order_acquire)) {
+            sha256 = fetched;
+        } else {
+            EVP_MD_free(fetched);
+        }
     }
+    return sha256;
+}
+#endif
 
-    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+// Sets the version and variant bits in the digest and copies it to uuid.
+static void cpid_digest_destination_buffer_to_uuid(cpid_handle_internal_t const library_handle_internal, uuid_t uuid) {
+    #define UUID_VERSION_BYTE_INDEX 6
+    #define UUID_VERSION_BIT_MASK 0x0F
+    #define UUID_VERSION_CONTENT 0x80
+    library_handle_internal->digest_destination_buffer[UUID_VERSION_BYTE_INDEX] = (library_handle_internal->digest_destination_buffer[UUID_VERSION_BYTE_INDEX] & UUID_VERSION_BIT_MASK) | UUID_VERSION_CONTENT;
 
-    library_handle_internal->digest_input_content.pid_namespace = pid_namespace;
-    library_handle_internal->digest_input_content.process_creation_time_ticks = creation_time_ticks;
-    library_handle_internal->digest_input_content.pid_namespace_tgid = pid_namespace_tgid;
+
+    #define UUID_VARIANT_BYTE_INDEX 8
+    #define UUID_VARIANT_BIT_MASK 0x3F
+    #define UUID_VARIANT_CONTENT 0x80
+    library_handle_internal->digest_destination_buffer[UUID_VARIANT_BYTE_INDEX] = (library_handle_internal->digest_destination_buffer[UUID_VARIANT_BYTE_INDEX] & UUID_VARIANT_BIT_MASK) | UUID_VARIANT_CONTENT;
+
+    // copy the first 128 bits of the digest to the output buffer
+    memcpy(uuid, library_handle_internal->digest_destination_buffer, sizeof(uuid_t));
+}
+
+static int cpid_digest_input_content_to_uuid(cpid_handle_internal_t const library_handle_internal, uuid_t uuid) {
+#ifdef CPID_BUILTIN_SHA256
+    // the whole input fits in the final block, so the padding is laid out at compile time
+    _Static_assert(sizeof(digest_input_content_t) <= CPID_SHA256_MAX_TAIL_SIZE, "digest_input_content_t must fit in one SHA-256 block.");
+    cpid_sha256_state_t state;
+    cpid_sha256_init(&state);
+    cpid_sha256_finish(&state, &library_handle_internal->digest_input_content, sizeof(digest_input_content_t), sizeof(digest_input_content_t), library_handle_internal->digest_destination_buffer);
+#else
+    const EVP_MD *const sha256 = context_get_sha256(library_handle_internal->context);
+    if (!sha256) {
+        return -1;
+    }
+
+    if (!library_handle_internal->digest_context) {
+        library_handle_internal->digest_context = EVP_MD_CTX_new();
+        if (!library_handle_internal->digest_context) {
+            return -1;
+        }
+    }
 
     // initialize digest context for new digest calculation
-    if (OPEN_SSL_SUCCESS != EVP_DigestInit_ex2(library_handle_internal->digest_context, library_handle_internal->sha256, NULL)) {
+    if (OPEN_SSL_SUCCESS != EVP_DigestInit_ex2(library_handle_internal->digest_context, sha256, NULL)) {
         return -1;
     }
 
@@ -151,291 +451,725 @@ int cpid_make_uuid(cpid_handle_t const library_handle, const pid_t pid_namespace
     } else if (SHA256_BUFFER_SIZE != digest_size) {
         return -1;
     }
+#endif
 
-    #define UUID_VERSION_BYTE_INDEX 6
-    #define UUID_VERSION_BIT_MASK 0x0F
-    #define UUID_VERSION_CONTENT 0x80
-    library_handle_internal->digest_destination_buffer[UUID_VERSION_BYTE_INDEX] = (library_handle_internal->digest_destination_buffer[UUID_VERSION_BYTE_INDEX] & UUID_VERSION_BIT_MASK) | UUID_VERSION_CONTENT;
+    cpid_digest_destination_buffer_to_uuid(library_handle_internal, uuid);
 
+    return 0;
+}
 
-    #define UUID_VARIANT_BYTE_INDEX 8
-    #define UUID_VARIANT_BIT_MASK 0x3F
-    #define UUID_VARIANT_CONTENT 0x80
-    library_handle_internal->digest_destination_buffer[UUID_VARIANT_BYTE_INDEX] = (library_handle_internal->digest_destination_buffer[UUID_VARIANT_BYTE_INDEX] & UUID_VARIANT_BIT_MASK) | UUID_VARIANT_CONTENT;
+int cpid_make_uuid(cpid_handle_t const library_handle, const pid_t pid_namespace_tgid, const uint64_t creation_time_ticks, const ino_t pid_namespace, uuid_t uuid) {
+    if (!library_handle || !uuid) {
+        return -1;
+    }
 
-    // copy the first 128 bits of the digest to the output buffer
-    memcpy(uuid, library_handle_internal->digest_destination_buffer, sizeof(uuid_t));
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
 
-    return 0;
+    library_handle_internal->digest_input_content.pid_namespace = pid_namespace;
+    library_handle_internal->digest_input_content.process_creation_time_ticks = creation_time_ticks;
+    library_handle_internal->digest_input_content.pid_namespace_tgid = pid_namespace_tgid;
+
+    STATS_STAGE_START(digest_start_ns);
+    return STATS_STAGE_END(library_handle_internal, CPID_STAGE_DIGEST, digest_start_ns, cpid_digest_input_content_to_uuid(library_handle_internal, uuid));
 }
 
-static int advance_file_to_last_number_in_line(FILE *const file) {
-    long last_number_start_position = 0;
-    uint8_t on_number = 0;
-    int c = 0;
-    while(EOF != (c = fgetc(file))) {
-        if('\n' == c) {
-            break;
+int cpid_make_uuid_batch(cpid_handle_t const library_handle, const cpid_linux_input_t *const inputs, const size_t n, uuid_t *const uuids) {
+    if (!library_handle) {
+        return -1;
+    }
+
+    if (0 == n) {
+        return 0;
+    }
+
+    if (!inputs || !uuids) {
+        return -1;
+    }
+
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+
+#ifdef CPID_BUILTIN_SHA256
+    // each digest input is a single block, the blocks of a chunk of records are compressed
+    // side by side in the vector lanes of cpid_sha256_compress_many
+    #define BATCH_CHUNK_SIZE 64
+    cpid_sha256_state_t initial_state;
+    cpid_sha256_init(&initial_state);
+
+    for (size_t chunk_start = 0; chunk_start < n; chunk_start += BATCH_CHUNK_SIZE) {
+        const size_t chunk_size = n - chunk_start < BATCH_CHUNK_SIZE ? n - chunk_start : BATCH_CHUNK_SIZE;
+        uint8_t blocks[BATCH_CHUNK_SIZE][CPID_SHA256_BLOCK_SIZE];
+        cpid_sha256_state_t states[BATCH_CHUNK_SIZE];
+
+        STATS_STAGE_START(digest_start_ns);
+        for (size_t i = 0; i < chunk_size; i++) {
+            const cpid_linux_input_t *const input = &inputs[chunk_start + i];
+            library_handle_internal->digest_input_content.pid_namespace = input->pid_namespace;
+            library_handle_internal->digest_input_content.process_creation_time_ticks = input->creation_time_ticks;
+            library_handle_internal->digest_input_content.pid_namespace_tgid = input->pid_namespace_tgid;
+            cpid_sha256_pad(&library_handle_internal->digest_input_content, sizeof(digest_input_content_t), sizeof(digest_input_content_t), blocks[i]);
         }
-        
-        long position = ftell(file);
-
-        if('0' <= c && '9' >= c) {
-            // newly on a number
-            if(!on_number) {
-                on_number = 1;
-                last_number_start_position = position - 1;
-            }
-        } else {
-            // not on a number
-            on_number = 0;
+
+        cpid_sha256_compress_many(&initial_state, blocks[0], chunk_size, states);
+
+        for (size_t i = 0; i < chunk_size; i++) {
+            cpid_sha256_get_digest(&states[i], library_handle_internal->digest_destination_buffer);
+            cpid_digest_destination_buffer_to_uuid(library_handle_internal, uuids[chunk_start + i]);
         }
+        // a chunk counts as one digest stage
+        (void) STATS_STAGE_END(library_handle_internal, CPID_STAGE_DIGEST, digest_start_ns, 0);
     }
+#else
+    // the boot uuid prefix of the digest input is shared by every record,
+    // so only the per-process tail of the scratch input is rewritten
+    for (size_t i = 0; i < n; i++) {
+        library_handle_internal->digest_input_content.pid_namespace = inputs[i].pid_namespace;
+        library_handle_internal->digest_input_content.process_creation_time_ticks = inputs[i].creation_time_ticks;
+        library_handle_internal->digest_input_content.pid_namespace_tgid = inputs[i].pid_namespace_tgid;
+
+        STATS_STAGE_START(digest_start_ns);
+        if (STATS_STAGE_END(library_handle_internal, CPID_STAGE_DIGEST, digest_start_ns, cpid_digest_input_content_to_uuid(library_handle_internal, uuids[i]))) {
+            return -1;
+        }
+    }
+#endif
 
-    // If we didn't find a number, return an error
-    if(!last_number_start_position) {
-        return -1;
+    return 0;
+}
+
+static int parse_decimal(const char *const begin, const char *const end, uint64_t *const value) {
+    uint64_t parsed_value = 0;
+    const char *position = begin;
+    for (; position < end && '0' <= *position && '9' >= *position; position++) {
+        uint64_t digit = (uint64_t) (*position - '0');
+
+        // reject values that don't fit in 64 bits
+        if (parsed_value > (UINT64_MAX - digit) / 10) {
+            return -1;
+        }
+
+        parsed_value = parsed_value * 10 + digit;
     }
 
-    // Now, set file position to the start of the last number
-    if(fseek(file, last_number_start_position, 0)) {
+    // at least one digit is required
+    if (position == begin) {
         return -1;
     }
 
+    *value = parsed_value;
     return 0;
 }
 
-static int advance_file_to_next_line(FILE *const file) {
-    int c = 0;
-    while(EOF != (c = fgetc(file))) {
-        if('\n' == c) {
-            return 0;
-        }
+static int parse_last_decimal_in_line(const char *const line_start, const char *const line_end, uint64_t *const value) {
+    // walk back over trailing whitespace and then over the digits of the last number
+    const char *last_number_end = line_end;
+    while (last_number_end > line_start && ('0' > last_number_end[-1] || '9' < last_number_end[-1])) {
+        last_number_end--;
+    }
+    const char *last_number_start = last_number_end;
+    while (last_number_start > line_start && '0' <= last_number_start[-1] && '9' >= last_number_start[-1]) {
+        last_number_start--;
     }
 
-    // returns error if new line not found
-    return -1;
+    return parse_decimal(last_number_start, last_number_end, value);
 }
 
-static int is_file_line_nstgid(FILE *file, uint8_t *is_nstgid) {
-    #define NSTGID_LINE_START_BUFFER_SIZE 8 // 7 known characters + null terminator
-    char nstgid_line_start_read_string[NSTGID_LINE_START_BUFFER_SIZE] = {0};
+static int parse_first_decimal_in_line(const char *const line_start, const char *const line_end, uint64_t *const value) {
+    // skip the whitespace in front of the first number
+    const char *first_number_start = line_start;
+    while (first_number_start < line_end && (' ' == *first_number_start || '\t' == *first_number_start)) {
+        first_number_start++;
+    }
 
-    int c  = 0;
-    for(int i = 0; i < NSTGID_LINE_START_BUFFER_SIZE - 1; i++) {
-        if(EOF == (c = fgetc(file))) {
-            return -1;
+    return parse_decimal(first_number_start, line_end, value);
+}
+
+static int open_pid_directory(const int proc_directory_fd, const pid_t pid) {
+    // max 11 characters for pid (-2147483648) + null terminator
+    #define PID_DIRECTORY_NAME_BUFFER_SIZE 16
+    char pid_directory_name[PID_DIRECTORY_NAME_BUFFER_SIZE] = {0};
+
+    int chars_written = snprintf(pid_directory_name, PID_DIRECTORY_NAME_BUFFER_SIZE, "%d", pid);
+
+    if (chars_written < 0 || chars_written >= PID_DIRECTORY_NAME_BUFFER_SIZE) {
+        // error condition or truncation
+        return -1;
+    }
+
+    // All per-process files are opened relative to this directory.
+    // The directory stays bound to the process it was opened for, so later reads
+    // fail instead of reading a different process if the PID is reused.
+    return openat(proc_directory_fd, pid_directory_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+static ssize_t read_proc_single_line_file(const int pid_directory_fd, const char *const file_name, char *const buffer, const size_t buffer_size) {
+    int file_fd = openat(pid_directory_fd, file_name, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+        return -1;
+    }
+
+    // /proc generates the whole line on the first read if the buffer is large enough,
+    // so this loop normally performs a single read
+    size_t length = 0;
+    ssize_t return_value = -1;
+    while (length < buffer_size) {
+        ssize_t bytes_read = read(file_fd, buffer + length, buffer_size - length);
+        if (bytes_read < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+
+        length += (size_t) bytes_read;
+
+        if (0 == bytes_read || '\n' == buffer[length - 1]) {
+            return_value = (ssize_t) length;
+            break;
         }
-        nstgid_line_start_read_string[i] = (char) c;
     }
 
-    #define NSTGID_LINE_START "NStgid:"
+    // a full buffer without the line end means truncation and is treated as an error
 
-    // compare the read string to the known string to see if we are on the NStgid line
-    if(!strncmp(NSTGID_LINE_START, nstgid_line_start_read_string, NSTGID_LINE_START_BUFFER_SIZE)) {
-        *is_nstgid = 1;
+    if (close(file_fd)) {
+        return_value = -1;
     }
 
-    return 0;
+    return return_value;
 }
 
-static int advance_file_to_nstgid_line(FILE *const file) {
-    int return_code = 0;
-    do {
-        long line_start_position = ftell(file);
+static int read_proc_file_line(const int pid_directory_fd, const char *const file_name, const char *const line_prefix, char *const buffer, const size_t buffer_size, const char **const line_end) {
+    int file_fd = openat(pid_directory_fd, file_name, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+        return -1;
+    }
 
-        // check if the line starts with "NStgid:"
-        uint8_t is_nstgid = 0;
-        if(is_file_line_nstgid(file, &is_nstgid)) {
-            return_code = -1;
+    const size_t line_prefix_length = strlen(line_prefix);
+    size_t length = 0;
+    // set when the start of the current line was discarded because the line didn't fit in the buffer
+    uint8_t skipping_line = 0;
+    int return_code = -1;
+
+    while (return_code) {
+        ssize_t bytes_read = read(file_fd, buffer + length, buffer_size - length);
+        if (bytes_read < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
             break;
         }
 
-        // reset file position to the start of the line
-        if(fseek(file, line_start_position, 0)) {
-            return_code = -1;
-            break;
+        uint8_t at_end_of_file = 0 == bytes_read;
+        length += (size_t) bytes_read;
+
+        const char *const buffer_end = buffer + length;
+        char *line_start = buffer;
+        while (line_start < buffer_end) {
+            // memchr is vectorized by libc, making this cheap even for long lines
+            char *newline = memchr(line_start, '\n', (size_t) (buffer_end - line_start));
+            if (!newline) {
+                if (!at_end_of_file) {
+                    break;
+                }
+                // the last line of the file has no line end
+                newline = (char *) buffer_end;
+            }
+
+            if (skipping_line) {
+                skipping_line = 0;
+            } else if ((size_t) (newline - line_start) >= line_prefix_length && !memcmp(line_start, line_prefix, line_prefix_length)) {
+                // move the matching line to the start of the buffer for the caller
+                memmove(buffer, line_start, (size_t) (newline - line_start));
+                *line_end = buffer + (newline - line_start);
+                return_code = 0;
+                break;
+            }
+
+            line_start = newline + 1;
         }
 
-        if(is_nstgid) {
+        if (!return_code || at_end_of_file) {
             break;
         }
-    } while(!advance_file_to_next_line(file));
+
+        // keep the incomplete last line at the start of the buffer for the next read
+        size_t remaining = (size_t) (buffer_end - line_start);
+        if (remaining == buffer_size) {
+            // the line doesn't fit in the buffer at all, so it can't be the line we want
+            skipping_line = 1;
+            remaining = 0;
+        }
+        memmove(buffer, line_start, remaining);
+        length = remaining;
+    }
+
+    if (close(file_fd)) {
+        return_code = -1;
+    }
 
     return return_code;
 }
 
-static int get_pid_namespace_tgid(const pid_t pid, pid_t *const pid_namespace_tgid) {
-    // 13 known characters + max 10 characters for pid (2^32 = 4294967296) + null terminator 
-    // so max 24 characters in theory
-    #define PROC_STATUS_FILE_PATH_BUFFER_SIZE 128 
-    char proc_status_path[PROC_STATUS_FILE_PATH_BUFFER_SIZE] = {0};
-    int chars_written = snprintf(proc_status_path, PROC_STATUS_FILE_PATH_BUFFER_SIZE, "/proc/%u/status", pid);
+static int get_pid_namespace_tgid(const int pid_directory_fd, pid_t *const pid_namespace_tgid) {
+    // The whole status file fits in this buffer for practically all processes.
+    // Longer files (e.g. a very long "Groups" line) are still handled by read_proc_file_line.
+    #define PROC_STATUS_BUFFER_SIZE 4096
+    char status_buffer[PROC_STATUS_BUFFER_SIZE];
 
-    if (chars_written < 0 || chars_written >= PROC_STATUS_FILE_PATH_BUFFER_SIZE) {
-        // error condition or truncation
+    // Retrieve the rightmost numeric value from the "NStgid" line. This is the tgid of the process in the namespace it was created in.
+    // Example line: "NStgid:  8165    25"
+    #define NSTGID_LINE_START "NStgid:"
+    const char *line_end = NULL;
+    if (read_proc_file_line(pid_directory_fd, "status", NSTGID_LINE_START, status_buffer, PROC_STATUS_BUFFER_SIZE, &line_end)) {
         return -1;
     }
 
-    FILE *file = fopen(proc_status_path, "r");
-    if (!file) {
+    uint64_t parsed_value = 0;
+    if (parse_last_decimal_in_line(status_buffer + sizeof(NSTGID_LINE_START) - 1, line_end, &parsed_value) || parsed_value > INT32_MAX) {
         return -1;
     }
 
-    int return_code = 0;
-    do {
-        // Retrieve the rightmost numeric value from the "NStgid" line. This is the tgid of the process in the namespace it was created in.
-        // Example line: "NStgid:  8165    25"
+    *pid_namespace_tgid = (pid_t) parsed_value;
 
-        if(advance_file_to_nstgid_line(file)) {
-            return_code = -1;
-            break;
-        }
+    return 0;
+}
 
-        if(advance_file_to_last_number_in_line(file)) {
-            return_code = -1;
-            break;
+static int get_stat_fields(const int directory_fd, const char *const stat_path, uint64_t *const creation_time_ticks, pid_t *const parent_pid) {
+    // The stat line is bounded: the command name is truncated by the kernel
+    // and the remaining 50 or so fields are at most 20 digits each.
+    #define PROC_STAT_BUFFER_SIZE 2048
+    char stat_buffer[PROC_STAT_BUFFER_SIZE];
+
+    ssize_t length = read_proc_single_line_file(directory_fd, stat_path, stat_buffer, PROC_STAT_BUFFER_SIZE);
+    if (length <= 0) {
+        return -1;
+    }
+
+    // The command name is bracketed and may itself contain brackets and spaces,
+    // so parsing starts after the last occurence of a right bracket ')'
+    const char *const stat_end = stat_buffer + length;
+    const char *position = memrchr(stat_buffer, ')', (size_t) length);
+    if (!position) {
+        return -1;
+    }
+    position++;
+    // the bracket may end the buffer, the search of each field starts after a separator
+    if (position >= stat_end) {
+        return -1;
+    }
+
+    // ppid is the 2nd and starttime the 20th space separated field after the command name
+    #define STAT_FIELDS_BEFORE_PPID 1
+    #define STAT_FIELDS_BEFORE_STARTTIME 19
+    for (int field = 0; field < STAT_FIELDS_BEFORE_STARTTIME; field++) {
+        position = memchr(position + 1, ' ', (size_t) (stat_end - position - 1));
+        if (!position || position + 1 >= stat_end) {
+            return -1;
         }
 
-        int parsed_fields = fscanf(file, "%d", pid_namespace_tgid);
-        if (1 != parsed_fields) {
-            return_code = -1;
+        if (parent_pid && STAT_FIELDS_BEFORE_PPID == field + 1) {
+            // the parent PID as seen by the PID namespace of /proc, 0 if the parent isn't visible
+            uint64_t parsed_parent_pid = 0;
+            if (parse_decimal(position + 1, stat_end, &parsed_parent_pid) || parsed_parent_pid > INT32_MAX) {
+                return -1;
+            }
+            *parent_pid = (pid_t) parsed_parent_pid;
         }
-    } while(0);
+    }
+
+    return parse_decimal(position + 1, stat_end, creation_time_ticks);
+}
+
+static int get_pid_namespace(const int pid_directory_fd, ino_t *const pid_namespace) {
+    // The namespace link resolves to an nsfs inode whose inode number is the namespace identifier.
+    // This is the number shown in the link content (e.g. "pid:[4026531836]") without having to parse it.
+    struct stat ns_stat = {0};
+    if (fstatat(pid_directory_fd, "ns/pid", &ns_stat, 0)) {
+        return -1;
+    }
+
+    *pid_namespace = ns_stat.st_ino;
+
+    return 0;
+}
 
-    if(fclose(file)) {
+static int get_proc_pid_namespace(const int proc_directory_fd, ino_t *const proc_pid_namespace) {
+    *proc_pid_namespace = 0;
+
+    // "/proc/self" links to the PID of the calling process as seen by this /proc mount.
+    // It only matches getpid() when /proc belongs to the PID namespace of the calling process.
+    // Otherwise (e.g. the host /proc mounted into a container) the namespace of the caller
+    // says nothing about the PIDs /proc hands out, and the fast path stays disabled.
+    #define PROC_SELF_BUFFER_SIZE 16
+    char self_content[PROC_SELF_BUFFER_SIZE] = {0};
+    ssize_t chars_read = readlinkat(proc_directory_fd, "self", self_content, PROC_SELF_BUFFER_SIZE);
+    if (chars_read <= 0 || chars_read >= PROC_SELF_BUFFER_SIZE) {
+        return 0;
+    }
+
+    uint64_t self_pid = 0;
+    if (parse_decimal(self_content, self_content + chars_read, &self_pid) || (uint64_t) getpid() != self_pid) {
+        return 0;
+    }
+
+    int self_directory_fd = openat(proc_directory_fd, "self", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (self_directory_fd < 0) {
+        return -1;
+    }
+
+    int return_code = get_pid_namespace(self_directory_fd, proc_pid_namespace);
+
+    if (close(self_directory_fd)) {
         return_code = -1;
     }
 
     return return_code;
 }
 
-static int advance_file_to_after_last_right_bracket(FILE *const file) {
-    long last_right_bracket_position = 0;
+static int get_process_input(cpid_handle_internal_t const library_handle_internal, const int pid_directory_fd, const pid_t pid, cpid_linux_input_t *const input, pid_t *const parent_pid) {
+    STATS_STAGE_START(pid_namespace_start_ns);
+    if(STATS_STAGE_END(library_handle_internal, CPID_STAGE_PID_NAMESPACE, pid_namespace_start_ns, get_pid_namespace(pid_directory_fd, &input->pid_namespace))) {
+        return -1;
+    }
 
-    // find the position of the last right bracket
-    int c = 0;
-    while(EOF != (c = fgetc(file))) {
-        if(')' == c) { 
-            last_right_bracket_position = ftell(file);
+    // A non-zero TGID has already been sourced by the caller.
+    // A process created in the PID namespace that /proc belongs to has its deepest-namespace TGID
+    // equal to the PID that /proc knows it by, so the status file doesn't need to be read.
+    if (input->pid_namespace_tgid) {
+        // already sourced
+    } else if (library_handle_internal->context->proc_pid_namespace && input->pid_namespace == library_handle_internal->context->proc_pid_namespace) {
+        input->pid_namespace_tgid = pid;
+    } else {
+        STATS_STAGE_START(pid_namespace_tgid_start_ns);
+        if(STATS_STAGE_END(library_handle_internal, CPID_STAGE_PID_NAMESPACE_TGID, pid_namespace_tgid_start_ns, get_pid_namespace_tgid(pid_directory_fd, &input->pid_namespace_tgid))) {
+            return -1;
         }
     }
 
-    if (0 == last_right_bracket_position) {
-        // no right bracket found
+    STATS_STAGE_START(creation_time_start_ns);
+    if(STATS_STAGE_END(library_handle_internal, CPID_STAGE_CREATION_TIME, creation_time_start_ns, get_stat_fields(pid_directory_fd, "stat", &input->creation_time_ticks, parent_pid))) {
         return -1;
     }
-    
 
-    // move the file pointer to after the last right bracket
-    if(fseek(file, last_right_bracket_position, 0)) {
+    return 0;
+}
+
+int cpid_linux_source_process_input(cpid_handle_t const library_handle, const pid_t pid, cpid_linux_input_t *const input) {
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+
+    STATS_STAGE_START(open_start_ns);
+    int pid_directory_fd = STATS_STAGE_END(library_handle_internal, CPID_STAGE_OPEN_PID_DIRECTORY, open_start_ns, open_pid_directory(library_handle_internal->context->proc_directory_fd, pid));
+    if (pid_directory_fd < 0) {
         return -1;
     }
 
+    input->pid_namespace_tgid = 0;
+    int return_code = get_process_input(library_handle_internal, pid_directory_fd, pid, input, NULL);
+
+    if (close(pid_directory_fd)) {
+        return_code = -1;
+    }
+
+    return return_code;
+}
+
+int cpid_get_uuid(cpid_handle_t const library_handle, const pid_t pid, uuid_t uuid) {
+    if (!library_handle || !uuid) {
+        return -1;
+    }
+
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+    STATS_COUNT(library_handle_internal, lookups);
+
+    cpid_linux_cache_entry_t entry;
+    if (!cpid_linux_cache_lookup(library_handle, pid, &entry)) {
+        STATS_COUNT(library_handle_internal, cache_hits);
+        memcpy(uuid, entry.uuid, sizeof(uuid_t));
+        return 0;
+    }
+
+    entry.pid = pid;
+    entry.parent_pid = -1;
+    if (cpid_linux_source_process_input(library_handle, pid, &entry.input)) {
+        STATS_COUNT(library_handle_internal, lookup_failures);
+        return -1;
+    }
+
+    if (cpid_make_uuid(library_handle, entry.input.pid_namespace_tgid, entry.input.creation_time_ticks, entry.input.pid_namespace, uuid)) {
+        STATS_COUNT(library_handle_internal, lookup_failures);
+        return -1;
+    }
+
+    memcpy(entry.uuid, uuid, sizeof(uuid_t));
+    cpid_linux_cache_store(library_handle, &entry);
+
     return 0;
 }
 
-static int get_creation_time_ticks(const pid_t pid, uint64_t *const creation_time_ticks) {    
-    // 11 known characters + max 10 characters for pid (2^32 = 4294967296) + null terminator 
-    // so max 22 characters in theory
-    #define PROC_STAT_FILE_PATH_BUFFER_SIZE 128
-    char proc_stat_file_path[PROC_STAT_FILE_PATH_BUFFER_SIZE] = {0};
+// Gets the CPID UUID, its inputs and the parent PID of a process, from the cache if possible.
+static int get_process_entry(cpid_handle_internal_t const library_handle_internal, const pid_t pid, cpid_linux_cache_entry_t *const entry) {
+    if (!cpid_linux_cache_lookup(library_handle_internal, pid, entry) && entry->parent_pid >= 0) {
+        return 0;
+    }
 
-    int chars_written = snprintf(proc_stat_file_path, PROC_STAT_FILE_PATH_BUFFER_SIZE, "/proc/%d/stat", pid);
-    
-    if (chars_written < 0 || chars_written >= PROC_STAT_FILE_PATH_BUFFER_SIZE) {
-        // error condition or truncation
+    STATS_STAGE_START(open_start_ns);
+    int pid_directory_fd = STATS_STAGE_END(library_handle_internal, CPID_STAGE_OPEN_PID_DIRECTORY, open_start_ns, open_pid_directory(library_handle_internal->context->proc_directory_fd, pid));
+    if (pid_directory_fd < 0) {
         return -1;
     }
 
-    FILE *file = fopen(proc_stat_file_path, "r");
-    if (!file) {
+    memset(entry, 0, sizeof(*entry));
+    entry->pid = pid;
+
+    // the parent PID comes from the same stat read as the creation time
+    int return_code = get_process_input(library_handle_internal, pid_directory_fd, pid, &entry->input, &entry->parent_pid);
+
+    if (close(pid_directory_fd)) {
+        return_code = -1;
+    }
+
+    if (return_code) {
         return -1;
     }
 
-    int return_code = 0;
-    do {
-        // An-all-in one fscanf generates warnings and I dont trust the handling of the bracketed filename
-        // This skips the file to after the last last occurence of a right bracket ')'
-        if(advance_file_to_after_last_right_bracket(file)) {
-            return_code = -1;
+    if (cpid_make_uuid(library_handle_internal, entry->input.pid_namespace_tgid, entry->input.creation_time_ticks, entry->input.pid_namespace, entry->uuid)) {
+        return -1;
+    }
+
+    cpid_linux_cache_store(library_handle_internal, entry);
+
+    return 0;
+}
+
+int cpid_get_process_record(cpid_handle_t const library_handle, const pid_t pid, const int flags, cpid_record_t *const record) {
+    if (!library_handle || !record || (flags & ~CPID_RECORD_PARENT_UUID)) {
+        return -1;
+    }
+
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+
+    memset(record, 0, sizeof(*record));
+    record->pid = pid;
+    record->parent_status = -1;
+
+    cpid_linux_cache_entry_t entry;
+    if (get_process_entry(library_handle_internal, pid, &entry)) {
+        return -1;
+    }
+
+    record->parent_pid = entry.parent_pid;
+    record->input = entry.input;
+    memcpy(record->uuid, entry.uuid, sizeof(uuid_t));
+
+    if ((flags & CPID_RECORD_PARENT_UUID) && record->parent_pid) {
+        // The parent may have exited and its PID been reused since the stat file was read.
+        // A process reusing the PID started after the child, which is treated as no parent.
+        cpid_linux_cache_entry_t parent_entry;
+        if (!get_process_entry(library_handle_internal, record->parent_pid, &parent_entry)
+            && parent_entry.input.creation_time_ticks <= record->input.creation_time_ticks) {
+            memcpy(record->parent_uuid, parent_entry.uuid, sizeof(uuid_t));
+            record->parent_status = 0;
+        }
+    }
+
+    return 0;
+}
+
+int cpid_get_ancestry(cpid_handle_t const library_handle, const pid_t pid, uuid_t *const chain, const size_t max_depth, size_t *const depth) {
+    if (!library_handle || !chain || 0 == max_depth || !depth) {
+        return -1;
+    }
+
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+
+    *depth = 0;
+    pid_t current_pid = pid;
+    uint64_t child_creation_time_ticks = UINT64_MAX;
+    while (*depth < max_depth) {
+        cpid_linux_cache_entry_t entry;
+        if (get_process_entry(library_handle_internal, current_pid, &entry)) {
+            // the chain ends at the first ancestor that has already exited
             break;
         }
 
-        unsigned long long local_creation_time_ticks = 0;
-        int parsed_fields = fscanf(file, " %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu", &local_creation_time_ticks);
-        if(1 != parsed_fields) {
-            return_code = -1;
+        // a process with the parent PID that started after the child is a reused PID
+        if (entry.input.creation_time_ticks > child_creation_time_ticks) {
             break;
         }
-        
-        *creation_time_ticks = (uint64_t) local_creation_time_ticks;
-    } while(0);
 
-    if(fclose(file)) {
-        return_code = -1;
+        memcpy(chain[*depth], entry.uuid, sizeof(uuid_t));
+        (*depth)++;
+
+        // PID 0 is the parent of init and kthreadd, and of processes whose parent isn't visible
+        if (0 == entry.parent_pid || current_pid == entry.parent_pid) {
+            break;
+        }
+
+        child_creation_time_ticks = entry.input.creation_time_ticks;
+        current_pid = entry.parent_pid;
     }
 
-    return return_code;
+    // the process itself has to be found
+    return *depth ? 0 : -1;
 }
 
-static int get_pid_namespace(const pid_t pid, ino_t *const pid_namespace) {
-    // 13 known characters + max 10 characters for pid (2^32 = 4294967296) + null terminator
-    // so max 34 characters in theory
-    #define PROC_NS_PATH_BUFFER_SIZE 128  
-    char proc_ns_path[PROC_NS_PATH_BUFFER_SIZE] = {0};
+int cpid_cache_enable(cpid_handle_t const library_handle, const size_t capacity, const int flags) {
+    if (!library_handle || (flags & ~CPID_CACHE_TRUST_EVICTION)) {
+        return -1;
+    }
 
-    int chars_written = snprintf(proc_ns_path, PROC_NS_PATH_BUFFER_SIZE, "/proc/%d/ns/pid", pid);
-    
-    if (chars_written < 0 || chars_written >= PROC_NS_PATH_BUFFER_SIZE) {
-        // error condition or truncation
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+
+    cpid_linux_cache_t cache = NULL;
+    if (capacity) {
+        cache = cpid_linux_cache_create(capacity);
+        if (!cache) {
+            return -1;
+        }
+    }
+
+    // entries aren't carried over, so enabling again also clears the cache
+    cpid_linux_cache_destroy(library_handle_internal->cache);
+    library_handle_internal->cache = cache;
+    library_handle_internal->cache_flags = flags;
+
+    return 0;
+}
+
+void cpid_cache_evict(cpid_handle_t const library_handle, const pid_t pid) {
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+
+    if (library_handle_internal && library_handle_internal->cache) {
+        cpid_linux_cache_remove(library_handle_internal->cache, pid);
+    }
+}
+
+int cpid_linux_read_stat(const int proc_directory_fd, const pid_t pid, uint64_t *const creation_time_ticks, pid_t *const parent_pid) {
+    // The stat file is read straight from the /proc directory,
+    // without opening the process directory or touching the namespace.
+    // 5 known characters + max 10 characters for pid + null terminator
+    #define PID_STAT_PATH_BUFFER_SIZE 24
+    char stat_path[PID_STAT_PATH_BUFFER_SIZE] = {0};
+    int chars_written = snprintf(stat_path, PID_STAT_PATH_BUFFER_SIZE, "%d/stat", pid);
+    if (chars_written < 0 || chars_written >= PID_STAT_PATH_BUFFER_SIZE) {
         return -1;
     }
 
-    // example: "pid:[4026531836]"
-    // 6 known characters + max 10 characters for ns (2^32 = 4294967296) + null terminator
-    // so max 17 characters in theory
-    #define NS_BUFFER_SIZE 64
-    char ns_content[NS_BUFFER_SIZE] = {0};
-    ssize_t chars_read = readlink(proc_ns_path, ns_content, NS_BUFFER_SIZE);
+    return get_stat_fields(proc_directory_fd, stat_path, creation_time_ticks, parent_pid);
+}
+
+int cpid_linux_cache_lookup(cpid_handle_t const library_handle, const pid_t pid, cpid_linux_cache_entry_t *const entry) {
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
 
-    // less than 0 means error
-    // in [0,6] means that there wasn't enough content for an acutal namespace number to have been read
-    // greater than or equal to NS_BUFFER_SIZE means truncation since only NS_BUFFER_SIZE - 1 characters should be read at most
-    if(chars_read <= 6 || chars_read >= NS_BUFFER_SIZE) {
+    if (!library_handle_internal->cache) {
         return -1;
     }
 
-    int parsed_fields = sscanf(ns_content, "pid:[%lu]", pid_namespace);
-    if (1 != parsed_fields) {
+    cpid_linux_cache_entry_t *const cached_entry = cpid_linux_cache_find(library_handle_internal->cache, pid);
+    if (!cached_entry) {
         return -1;
     }
 
+    if (!(library_handle_internal->cache_flags & CPID_CACHE_TRUST_EVICTION)) {
+        // A reused PID belongs to a process with a later start time, so reading the start time
+        // is enough to revalidate the entry.
+        // The same read refreshes the parent PID, which changes when the parent exits.
+        uint64_t creation_time_ticks = 0;
+        pid_t parent_pid = -1;
+        STATS_STAGE_START(revalidation_start_ns);
+        if (STATS_STAGE_END(library_handle_internal, CPID_STAGE_CACHE_REVALIDATION, revalidation_start_ns, cpid_linux_read_stat(library_handle_internal->context->proc_directory_fd, pid, &creation_time_ticks, &parent_pid))
+            || creation_time_ticks != cached_entry->input.creation_time_ticks) {
+            cpid_linux_cache_remove(library_handle_internal->cache, pid);
+            return -1;
+        }
+
+        cached_entry->parent_pid = parent_pid;
+    }
+
+    *entry = *cached_entry;
+
     return 0;
 }
 
-int cpid_get_uuid(cpid_handle_t const library_handle, const pid_t pid, uuid_t uuid) {
-    if (!library_handle || !uuid) {
+void cpid_linux_cache_store(cpid_handle_t const library_handle, const cpid_linux_cache_entry_t *const entry) {
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+
+    if (library_handle_internal->cache) {
+        cpid_linux_cache_insert(library_handle_internal->cache, entry);
+    }
+}
+
+int cpid_get_uuid_pidfd(cpid_handle_t const library_handle, const int pidfd, uuid_t uuid) {
+    if (!library_handle || pidfd < 0 || !uuid) {
         return -1;
     }
 
-    pid_t pid_namespace_tgid = 0;
-    uint64_t creation_time_ticks = 0;
-    ino_t pid_namespace = 0;
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+
+    // 12 known characters + max 10 characters for fd (2^31 = 2147483648) + null terminator
+    // so max 23 characters in theory
+    #define PIDFD_FDINFO_PATH_BUFFER_SIZE 32
+    char fdinfo_path[PIDFD_FDINFO_PATH_BUFFER_SIZE] = {0};
+    int chars_written = snprintf(fdinfo_path, PIDFD_FDINFO_PATH_BUFFER_SIZE, "self/fdinfo/%d", pidfd);
 
-    if(get_pid_namespace_tgid(pid, &pid_namespace_tgid)) {
+    if (chars_written < 0 || chars_written >= PIDFD_FDINFO_PATH_BUFFER_SIZE) {
+        // error condition or truncation
         return -1;
     }
 
-    if(get_creation_time_ticks(pid, &creation_time_ticks)) {
+    // The pidfd fdinfo "NSpid" line lists the PIDs of the process from the PID namespace of /proc
+    // down to the namespace the process was created in (Linux 5.10 and later).
+    // The line is absent if the process has been reaped or isn't visible from this /proc.
+    // Example line: "NSpid:  8165    25"
+    #define PIDFD_FDINFO_BUFFER_SIZE 1024
+    #define NSPID_LINE_START "NSpid:"
+    char fdinfo_buffer[PIDFD_FDINFO_BUFFER_SIZE];
+    const char *line_end = NULL;
+    if (read_proc_file_line(library_handle_internal->context->proc_directory_fd, fdinfo_path, NSPID_LINE_START, fdinfo_buffer, PIDFD_FDINFO_BUFFER_SIZE, &line_end)) {
         return -1;
     }
 
-    if(get_pid_namespace(pid, &pid_namespace)) {
+    const char *const line_start = fdinfo_buffer + sizeof(NSPID_LINE_START) - 1;
+    uint64_t proc_pid = 0;
+    uint64_t pid_namespace_tgid = 0;
+    if (parse_first_decimal_in_line(line_start, line_end, &proc_pid) || 0 == proc_pid || proc_pid > INT32_MAX) {
+        return -1;
+    }
+    if (parse_last_decimal_in_line(line_start, line_end, &pid_namespace_tgid) || 0 == pid_namespace_tgid || pid_namespace_tgid > INT32_MAX) {
         return -1;
     }
 
-    if (cpid_make_uuid(library_handle, pid_namespace_tgid, creation_time_ticks, pid_namespace, uuid)) {
+    STATS_STAGE_START(open_start_ns);
+    int pid_directory_fd = STATS_STAGE_END(library_handle_internal, CPID_STAGE_OPEN_PID_DIRECTORY, open_start_ns, open_pid_directory(library_handle_internal->context->proc_directory_fd, (pid_t) proc_pid));
+    if (pid_directory_fd < 0) {
+        return -1;
+    }
+
+    int return_code = 0;
+    cpid_linux_input_t input = {0};
+    input.pid_namespace_tgid = (pid_t) pid_namespace_tgid;
+    do {
+        // The PID can't be reused until the process behind the pidfd has been reaped.
+        // If the process is still there after its /proc directory was opened,
+        // the directory belongs to that process and every file read through it does too.
+        // Signal 0 only reports ESRCH once it has been reaped, EPERM means it is there
+        // but the caller may not signal it, which cpid_get_uuid doesn't require either.
+        if (syscall(SYS_pidfd_send_signal, pidfd, 0, NULL, 0) && EPERM != errno) {
+            return_code = -1;
+            break;
+        }
+
+        return_code = get_process_input(library_handle_internal, pid_directory_fd, (pid_t) proc_pid, &input, NULL);
+    } while(0);
+
+    if (close(pid_directory_fd)) {
+        return_code = -1;
+    }
+
+    if (return_code) {
+        return -1;
+    }
+
+    if (cpid_make_uuid(library_handle, input.pid_namespace_tgid, input.creation_time_ticks, input.pid_namespace, uuid)) {
         return -1;
     }
 
@@ -452,8 +1186,44 @@ int cpid_get_uuid_string(cpid_handle_t const library_handle, const pid_t pid, uu
     if (cpid_get_uuid(library_handle, pid, uuid)) {
         return -1;
     }
-    
-    uuid_unparse(uuid, uuid_string);
+
+    return cpid_format_batch(uuid, 1, uuid_string, sizeof(uuid_string_t));
+}
+
+int cpid_get_stats(cpid_handle_t const library_handle, cpid_stats_t *const stats) {
+#ifdef CPID_ENABLE_STATS
+    if (!library_handle || !stats) {
+        return -1;
+    }
+
+    *stats = ((cpid_handle_internal_t) library_handle)->stats;
 
     return 0;
+#else
+    (void) library_handle;
+    (void) stats;
+    return -1;
+#endif
+}
+
+void cpid_linux_stats_merge(cpid_handle_t const library_handle, cpid_handle_t const source_handle) {
+#ifdef CPID_ENABLE_STATS
+    cpid_stats_t *const stats = &((cpid_handle_internal_t) library_handle)->stats;
+    const cpid_stats_t *const source_stats = &((cpid_handle_internal_t) source_handle)->stats;
+
+    stats->lookups += source_stats->lookups;
+    stats->lookup_failures += source_stats->lookup_failures;
+    stats->cache_hits += source_stats->cache_hits;
+    for (size_t i = 0; i < CPID_STAGE_COUNT; i++) {
+        stats->stages[i].calls += source_stats->stages[i].calls;
+        stats->stages[i].failures += source_stats->stages[i].failures;
+        stats->stages[i].total_latency_ns += source_stats->stages[i].total_latency_ns;
+        for (size_t j = 0; j < CPID_STATS_HISTOGRAM_BUCKET_COUNT; j++) {
+            stats->stages[i].latency_histogram[j] += source_stats->stages[i].latency_histogram[j];
+        }
+    }
+#else
+    (void) library_handle;
+    (void) source_handle;
+#endif
 }
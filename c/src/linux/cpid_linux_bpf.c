@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/types.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "cpid/cpid_linux_bpf.h"
+#include "cpid_linux_internal.h"
+#include "bpf/cpid_capture_event.h"
+#include "cpid_capture.skel.h"
+
+// kernel inputs are hashed in batches of this size
+#define CAPTURE_HASH_BATCH_SIZE 64
+// returned by the ring buffer callback to stop consuming once the caller's records are full
+#define CAPTURE_BATCH_FULL (-ENOSPC)
+
+typedef struct {
+    cpid_handle_t library_handle;
+    struct cpid_capture_bpf *skeleton;
+    struct ring_buffer *ring_buffer;
+    // a value of the per-CPU lost event counter for each possible CPU
+    int possible_cpu_count;
+    uint64_t *lost_count_values;
+    // the caller's records for the batch in progress
+    cpid_stream_record_t *records;
+    size_t capacity;
+    size_t count;
+    size_t pending_count;
+    cpid_linux_input_t pending_inputs[CAPTURE_HASH_BATCH_SIZE];
+    uuid_t pending_uuids[CAPTURE_HASH_BATCH_SIZE];
+} *cpid_bpf_internal_t;
+
+static void flush_pending_inputs(cpid_bpf_internal_t const capture_internal) {
+    if (0 == capture_internal->pending_count) {
+        return;
+    }
+
+    // the pending inputs belong to the last pending_count records
+    cpid_stream_record_t *const first_pending_record = &capture_internal->records[capture_internal->count - capture_internal->pending_count];
+
+    // records keep their -1 status if the batch can't be hashed
+    if (!cpid_make_uuid_batch(capture_internal->library_handle, capture_internal->pending_inputs, capture_internal->pending_count, capture_internal->pending_uuids)) {
+        for (size_t i = 0; i < capture_internal->pending_count; i++) {
+            first_pending_record[i].creation_time_ticks = capture_internal->pending_inputs[i].creation_time_ticks;
+            memcpy(first_pending_record[i].uuid, capture_internal->pending_uuids[i], sizeof(uuid_t));
+            first_pending_record[i].status = 0;
+        }
+    }
+
+    capture_internal->pending_count = 0;
+}
+
+static int handle_capture_event(void *context, void *data, size_t data_size) {
+    cpid_bpf_internal_t capture_internal = (cpid_bpf_internal_t) context;
+
+    if (data_size < sizeof(struct cpid_capture_event)) {
+        return 0;
+    }
+
+    const struct cpid_capture_event *const capture_event = (const struct cpid_capture_event *) data;
+
+    cpid_stream_record_t *const record = &capture_internal->records[capture_internal->count];
+    record->pid = capture_event->pid;
+    record->status = -1;
+    record->creation_time_ticks = 0;
+    memset(record->uuid, 0, sizeof(uuid_t));
+    switch (capture_event->event) {
+        case CPID_CAPTURE_EVENT_FORK:
+            record->event = CPID_STREAM_EVENT_FORK;
+            break;
+        case CPID_CAPTURE_EVENT_EXEC:
+            record->event = CPID_STREAM_EVENT_EXEC;
+            break;
+        case CPID_CAPTURE_EVENT_EXIT:
+            record->event = CPID_STREAM_EVENT_EXIT;
+            break;
+        default:
+            return 0;
+    }
+
+    cpid_linux_input_t *const input = &capture_internal->pending_inputs[capture_internal->pending_count];
+    input->pid_namespace_tgid = (pid_t) capture_event->pid_namespace_tgid;
+    input->creation_time_ticks = capture_event->creation_time_ticks;
+    input->pid_namespace = (ino_t) capture_event->pid_namespace;
+
+    capture_internal->count++;
+    capture_internal->pending_count++;
+
+    if (CAPTURE_HASH_BATCH_SIZE == capture_internal->pending_count) {
+        flush_pending_inputs(capture_internal);
+    }
+
+    // the event has been consumed either way, stopping only leaves the rest in the ring buffer
+    return capture_internal->count == capture_internal->capacity ? CAPTURE_BATCH_FULL : 0;
+}
+
+static int get_boottime_offset_ns(uint64_t *const boottime_offset_ns) {
+    // Kernels without time namespaces have no offsets file, their offset is 0.
+    // The file shows the namespace of the children, which is that of the process
+    // unless it unshared CLONE_NEWTIME without a child entering the new namespace.
+    *boottime_offset_ns = 0;
+    FILE *file = fopen("/proc/self/timens_offsets", "r");
+    if (!file) {
+        return ENOENT == errno ? 0 : -1;
+    }
+
+    #define CLOCK_NAME_BUFFER_SIZE 16
+    char clock_name[CLOCK_NAME_BUFFER_SIZE] = {0};
+    long long seconds = 0;
+    long nanoseconds = 0;
+    int return_code = -1;
+    while (3 == fscanf(file, "%15s %lld %ld", clock_name, &seconds, &nanoseconds)) {
+        if (!strcmp(clock_name, "boottime")) {
+            *boottime_offset_ns = (uint64_t) seconds * 1000000000u + (uint64_t) nanoseconds;
+            return_code = 0;
+            break;
+        }
+    }
+    fclose(file);
+
+    return return_code;
+}
+
+cpid_bpf_t cpid_bpf_open(cpid_handle_t const library_handle) {
+    if (!library_handle) {
+        return NULL;
+    }
+
+    // the events are of the local boot, a given boot UUID would give them the CPID UUIDs of another
+    if (cpid_linux_is_offline(library_handle)) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+
+    cpid_bpf_internal_t capture_internal = calloc(1, sizeof(*capture_internal));
+    if (!capture_internal) {
+        return NULL;
+    }
+
+    capture_internal->library_handle = library_handle;
+
+    int return_code = 0;
+    do {
+        long clock_ticks_per_second = sysconf(_SC_CLK_TCK);
+        if (clock_ticks_per_second <= 0) {
+            return_code = -1;
+            break;
+        }
+
+        capture_internal->possible_cpu_count = libbpf_num_possible_cpus();
+        if (capture_internal->possible_cpu_count <= 0) {
+            return_code = -1;
+            break;
+        }
+        capture_internal->lost_count_values = calloc((size_t) capture_internal->possible_cpu_count, sizeof(uint64_t));
+        if (!capture_internal->lost_count_values) {
+            return_code = -1;
+            break;
+        }
+
+        capture_internal->skeleton = cpid_capture_bpf__open();
+        if (!capture_internal->skeleton) {
+            return_code = -1;
+            break;
+        }
+
+        // /proc reports start times in USER_HZ ticks, the BPF program has to use the same unit
+        capture_internal->skeleton->rodata->user_hz = (__u64) clock_ticks_per_second;
+        // and the start times as seen from the time namespace of the reader
+        uint64_t boottime_offset_ns = 0;
+        if (get_boottime_offset_ns(&boottime_offset_ns)) {
+            return_code = -1;
+            break;
+        }
+        capture_internal->skeleton->rodata->boottime_offset_ns = boottime_offset_ns;
+
+        if (cpid_capture_bpf__load(capture_internal->skeleton)) {
+            return_code = -1;
+            break;
+        }
+
+        capture_internal->ring_buffer = ring_buffer__new(bpf_map__fd(capture_internal->skeleton->maps.events), handle_capture_event, capture_internal, NULL);
+        if (!capture_internal->ring_buffer) {
+            return_code = -1;
+            break;
+        }
+
+        if (cpid_capture_bpf__attach(capture_internal->skeleton)) {
+            return_code = -1;
+        }
+    } while(0);
+
+    if (return_code) {
+        // callers tell a missing privilege (EPERM) or BPF support (ENOSYS) by errno
+        const int open_errno = errno;
+        cpid_bpf_close(capture_internal);
+        capture_internal = NULL;
+        errno = open_errno;
+    }
+
+    return capture_internal;
+}
+
+void cpid_bpf_close(cpid_bpf_t const capture) {
+
+    cpid_bpf_internal_t capture_internal = (cpid_bpf_internal_t) capture;
+
+    if (capture_internal) {
+        if (capture_internal->ring_buffer) {
+            ring_buffer__free(capture_internal->ring_buffer);
+        }
+
+        if (capture_internal->skeleton) {
+            cpid_capture_bpf__destroy(capture_internal->skeleton);
+        }
+
+        free(capture_internal->lost_count_values);
+        free(capture_internal);
+    }
+}
+
+int cpid_bpf_get_fd(cpid_bpf_t const capture) {
+    if (!capture) {
+        return -1;
+    }
+
+    return ring_buffer__epoll_fd(((cpid_bpf_internal_t) capture)->ring_buffer);
+}
+
+int cpid_bpf_next_batch(cpid_bpf_t const capture, cpid_stream_record_t *const records, const size_t capacity, size_t *const count, const int timeout_ms) {
+    if (!capture || !records || 0 == capacity || !count) {
+        return -1;
+    }
+
+    cpid_bpf_internal_t capture_internal = (cpid_bpf_internal_t) capture;
+    capture_internal->records = records;
+    capture_internal->capacity = capacity;
+    capture_internal->count = 0;
+    capture_internal->pending_count = 0;
+
+    int poll_result = ring_buffer__poll(capture_internal->ring_buffer, timeout_ms);
+
+    flush_pending_inputs(capture_internal);
+    *count = capture_internal->count;
+
+    capture_internal->records = NULL;
+    capture_internal->capacity = 0;
+
+    if (poll_result < 0 && CAPTURE_BATCH_FULL != poll_result && -EINTR != poll_result) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int cpid_bpf_get_lost_count(cpid_bpf_t const capture, uint64_t *const lost_count) {
+    if (!capture || !lost_count) {
+        return -1;
+    }
+
+    cpid_bpf_internal_t capture_internal = (cpid_bpf_internal_t) capture;
+
+    // a lookup of a per-CPU array copies the value of every possible CPU
+    const __u32 key = 0;
+    if (bpf_map_lookup_elem(bpf_map__fd(capture_internal->skeleton->maps.lost_events), &key, capture_internal->lost_count_values)) {
+        return -1;
+    }
+
+    *lost_count = 0;
+    for (int i = 0; i < capture_internal->possible_cpu_count; i++) {
+        *lost_count += capture_internal->lost_count_values[i];
+    }
+
+    return 0;
+}
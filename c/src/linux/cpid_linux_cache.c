@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "cpid/cpid_linux.h"
+#include "cpid_linux_internal.h"
+
+// Open addressing with linear probing. PID 0 never names a process in /proc,
+// so it marks empty slots. Removal shifts the following entries back instead
+// of leaving tombstones, which keeps probe sequences short under exit churn.
+typedef struct {
+    size_t slot_mask;
+    unsigned slot_bits;
+    size_t count;
+    size_t capacity;
+    cpid_linux_cache_entry_t entries[];
+} *cpid_linux_cache_internal_t;
+
+static size_t home_slot(const cpid_linux_cache_internal_t cache_internal, const pid_t pid) {
+    // Fibonacci hashing spreads the sequentially allocated PIDs over the table
+    #define CACHE_HASH_MULTIPLIER UINT64_C(0x9E3779B97F4A7C15)
+    return (size_t) (((uint64_t) (uint32_t) pid * CACHE_HASH_MULTIPLIER) >> (64 - cache_internal->slot_bits));
+}
+
+cpid_linux_cache_t cpid_linux_cache_create(const size_t capacity) {
+    if (0 == capacity || capacity > SIZE_MAX / 4 / sizeof(cpid_linux_cache_entry_t)) {
+        return NULL;
+    }
+
+    // at least twice as many slots as entries keeps the load factor at or below one half
+    unsigned slot_bits = 1;
+    while (((size_t) 1 << slot_bits) < capacity * 2) {
+        slot_bits++;
+    }
+    const size_t slot_count = (size_t) 1 << slot_bits;
+
+    cpid_linux_cache_internal_t cache_internal = calloc(1, sizeof(*cache_internal) + slot_count * sizeof(cpid_linux_cache_entry_t));
+    if (!cache_internal) {
+        return NULL;
+    }
+
+    cache_internal->slot_mask = slot_count - 1;
+    cache_internal->slot_bits = slot_bits;
+    cache_internal->capacity = capacity;
+
+    return cache_internal;
+}
+
+void cpid_linux_cache_destroy(cpid_linux_cache_t const cache) {
+    free(cache);
+}
+
+cpid_linux_cache_entry_t *cpid_linux_cache_find(cpid_linux_cache_t const cache, const pid_t pid) {
+    cpid_linux_cache_internal_t cache_internal = (cpid_linux_cache_internal_t) cache;
+
+    if (0 == pid) {
+        return NULL;
+    }
+
+    for (size_t slot = home_slot(cache_internal, pid);; slot = (slot + 1) & cache_internal->slot_mask) {
+        cpid_linux_cache_entry_t *const entry = &cache_internal->entries[slot];
+        if (pid == entry->pid) {
+            return entry;
+        }
+        if (0 == entry->pid) {
+            return NULL;
+        }
+    }
+}
+
+void cpid_linux_cache_insert(cpid_linux_cache_t const cache, const cpid_linux_cache_entry_t *const new_entry) {
+    cpid_linux_cache_internal_t cache_internal = (cpid_linux_cache_internal_t) cache;
+    const pid_t pid = new_entry->pid;
+
+    if (0 == pid) {
+        return;
+    }
+
+    const size_t home = home_slot(cache_internal, pid);
+    cpid_linux_cache_entry_t *entry = cpid_linux_cache_find(cache, pid);
+
+    if (!entry) {
+        if (cache_internal->count >= cache_internal->capacity && cache_internal->entries[home].pid) {
+            // A full cache replaces whatever occupies the home slot.
+            // Probe sequences stay intact since the slot stays occupied.
+            entry = &cache_internal->entries[home];
+        } else {
+            if (cache_internal->count + 1 >= cache_internal->slot_mask) {
+                // only reachable when evictions kept landing on empty home slots,
+                // start over rather than let probe sequences run through the whole table
+                memset(cache_internal->entries, 0, (cache_internal->slot_mask + 1) * sizeof(cpid_linux_cache_entry_t));
+                cache_internal->count = 0;
+            }
+
+            size_t slot = home;
+            while (cache_internal->entries[slot].pid) {
+                slot = (slot + 1) & cache_internal->slot_mask;
+            }
+            entry = &cache_internal->entries[slot];
+            cache_internal->count++;
+        }
+    }
+
+    *entry = *new_entry;
+}
+
+void cpid_linux_cache_remove(cpid_linux_cache_t const cache, const pid_t pid) {
+    cpid_linux_cache_internal_t cache_internal = (cpid_linux_cache_internal_t) cache;
+
+    cpid_linux_cache_entry_t *const entry = cpid_linux_cache_find(cache, pid);
+    if (!entry) {
+        return;
+    }
+
+    size_t hole = (size_t) (entry - cache_internal->entries);
+    entry->pid = 0;
+    cache_internal->count--;
+
+    // move back any later entry of the probe run that can no longer be reached past the hole
+    for (size_t slot = (hole + 1) & cache_internal->slot_mask; cache_internal->entries[slot].pid; slot = (slot + 1) & cache_internal->slot_mask) {
+        const size_t home = home_slot(cache_internal, cache_internal->entries[slot].pid);
+
+        // the entry stays if its home slot lies cyclically within (hole, slot]
+        const size_t distance_to_home = (slot - home) & cache_internal->slot_mask;
+        const size_t distance_to_hole = (slot - hole) & cache_internal->slot_mask;
+        if (distance_to_home < distance_to_hole) {
+            continue;
+        }
+
+        cache_internal->entries[hole] = cache_internal->entries[slot];
+        cache_internal->entries[slot].pid = 0;
+        hole = slot;
+    }
+}
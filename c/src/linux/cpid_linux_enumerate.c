@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// We enforce standard C with no extensions in CMake
+// This is needed for the openat, syscall and sysconf methods to be defined
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cpid/cpid_linux.h"
+#include "cpid_linux_internal.h"
+
+// /proc hands out directory entries a page or so at a time, a larger buffer lets
+// a single getdents64 call return many of them
+#define ENUMERATE_DIRECTORY_BUFFER_SIZE (64 * 1024)
+// workers claim PIDs in chunks of this size and hash each chunk in one batch
+#define ENUMERATE_CHUNK_SIZE 64
+
+// the layout returned by the getdents64 system call, glibc doesn't declare it
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} linux_dirent64_t;
+
+typedef struct {
+    const pid_t *pids;
+    size_t pid_count;
+    atomic_size_t next_index;
+    cpid_entry_t *entries;
+    // NULL, or populated alongside entries
+    cpid_linux_input_t *inputs;
+    // set for every index whose CPID was sourced
+    uint8_t *found;
+} enumerate_work_t;
+
+typedef struct {
+    enumerate_work_t *work;
+    cpid_handle_t library_handle;
+    pthread_t thread;
+    int return_code;
+} enumerate_worker_t;
+
+static int parse_pid_directory_name(const char *name, pid_t *const pid) {
+    uint64_t value = 0;
+
+    if (!*name) {
+        return -1;
+    }
+
+    for (; *name; name++) {
+        if (*name < '0' || *name > '9') {
+            return -1;
+        }
+        value = value * 10 + (uint64_t) (*name - '0');
+        if (value > INT32_MAX) {
+            return -1;
+        }
+    }
+
+    *pid = (pid_t) value;
+
+    return 0;
+}
+
+static int list_pids(const int proc_directory_fd, pid_t **const pids, size_t *const pid_count) {
+    // a separate descriptor is needed since reading a directory moves its offset
+    int directory_fd = openat(proc_directory_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd < 0) {
+        return -1;
+    }
+
+    char *directory_buffer = malloc(ENUMERATE_DIRECTORY_BUFFER_SIZE);
+    pid_t *pid_list = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    int return_code = -1;
+
+    while (directory_buffer) {
+        long bytes_read = syscall(SYS_getdents64, directory_fd, directory_buffer, ENUMERATE_DIRECTORY_BUFFER_SIZE);
+        if (bytes_read < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+
+        if (0 == bytes_read) {
+            return_code = 0;
+            break;
+        }
+
+        long offset = 0;
+        while (offset < bytes_read) {
+            const linux_dirent64_t *const entry = (const linux_dirent64_t *) (directory_buffer + offset);
+            offset += entry->d_reclen;
+
+            pid_t pid = 0;
+            if (parse_pid_directory_name(entry->d_name, &pid)) {
+                // not a process directory (e.g. "self" or "meminfo")
+                continue;
+            }
+
+            if (count == capacity) {
+                #define ENUMERATE_INITIAL_PID_CAPACITY 1024
+                size_t new_capacity = capacity ? capacity * 2 : ENUMERATE_INITIAL_PID_CAPACITY;
+                pid_t *new_pid_list = realloc(pid_list, new_capacity * sizeof(pid_t));
+                if (!new_pid_list) {
+                    offset = bytes_read;
+                    bytes_read = -1;
+                    break;
+                }
+                pid_list = new_pid_list;
+                capacity = new_capacity;
+            }
+
+            pid_list[count++] = pid;
+        }
+
+        if (bytes_read < 0) {
+            break;
+        }
+    }
+
+    free(directory_buffer);
+
+    if (close(directory_fd)) {
+        return_code = -1;
+    }
+
+    if (return_code) {
+        free(pid_list);
+        return -1;
+    }
+
+    *pids = pid_list;
+    *pid_count = count;
+
+    return 0;
+}
+
+static int enumerate_chunks(enumerate_work_t *const work, cpid_handle_t const library_handle) {
+    cpid_linux_input_t inputs[ENUMERATE_CHUNK_SIZE];
+    uuid_t uuids[ENUMERATE_CHUNK_SIZE];
+    size_t input_indices[ENUMERATE_CHUNK_SIZE];
+
+    for (;;) {
+        const size_t chunk_start = atomic_fetch_add_explicit(&work->next_index, ENUMERATE_CHUNK_SIZE, memory_order_relaxed);
+        if (chunk_start >= work->pid_count) {
+            return 0;
+        }
+
+        size_t chunk_end = chunk_start + ENUMERATE_CHUNK_SIZE;
+        if (chunk_end > work->pid_count) {
+            chunk_end = work->pid_count;
+        }
+
+        size_t input_count = 0;
+        for (size_t i = chunk_start; i < chunk_end; i++) {
+            // processes that exited since the directory was read, or whose namespace
+            // can't be inspected by the caller, are left out of the result
+            if (cpid_linux_source_process_input(library_handle, work->pids[i], &inputs[input_count])) {
+                continue;
+            }
+            input_indices[input_count++] = i;
+        }
+
+        if (cpid_make_uuid_batch(library_handle, inputs, input_count, uuids)) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < input_count; i++) {
+            cpid_entry_t *const entry = &work->entries[input_indices[i]];
+            entry->pid = work->pids[input_indices[i]];
+            entry->creation_time_ticks = inputs[i].creation_time_ticks;
+            memcpy(entry->uuid, uuids[i], sizeof(uuid_t));
+            if (work->inputs) {
+                work->inputs[input_indices[i]] = inputs[i];
+            }
+            work->found[input_indices[i]] = 1;
+        }
+    }
+}
+
+static void *enumerate_worker_main(void *argument) {
+    enumerate_worker_t *const worker = argument;
+
+    worker->return_code = enumerate_chunks(worker->work, worker->library_handle);
+
+    return NULL;
+}
+
+static unsigned get_worker_count(const unsigned threads, const size_t pid_count) {
+    unsigned worker_count = threads;
+    if (0 == worker_count) {
+        long online_processors = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = online_processors > 0 ? (unsigned) online_processors : 1;
+    }
+
+    // there is no point in a worker without at least one chunk to claim
+    size_t chunk_count = (pid_count + ENUMERATE_CHUNK_SIZE - 1) / ENUMERATE_CHUNK_SIZE;
+    if (worker_count > chunk_count) {
+        worker_count = chunk_count ? (unsigned) chunk_count : 1;
+    }
+
+    return worker_count;
+}
+
+int cpid_enumerate_all(cpid_handle_t const library_handle, cpid_entry_t *const out, const size_t cap, size_t *const n, const unsigned threads) {
+    return cpid_enumerate_all_with_inputs(library_handle, out, NULL, cap, n, threads);
+}
+
+int cpid_enumerate_all_with_inputs(cpid_handle_t const library_handle, cpid_entry_t *const out, cpid_linux_input_t *const inputs, const size_t cap, size_t *const n, const unsigned threads) {
+    if (!library_handle || !n || (!out && cap)) {
+        return -1;
+    }
+
+    pid_t *pids = NULL;
+    size_t pid_count = 0;
+    if (list_pids(cpid_linux_get_proc_directory_fd(library_handle), &pids, &pid_count)) {
+        return -1;
+    }
+
+    if (pid_count > cap) {
+        // report the number of processes so the caller can retry with a larger buffer
+        *n = pid_count;
+        free(pids);
+        return -1;
+    }
+
+    enumerate_work_t work = {
+        .pids = pids,
+        .pid_count = pid_count,
+        .entries = out,
+        .inputs = inputs,
+        .found = calloc(pid_count ? pid_count : 1, sizeof(uint8_t)),
+    };
+    atomic_init(&work.next_index, 0);
+
+    const unsigned worker_count = get_worker_count(threads, pid_count);
+    enumerate_worker_t *workers = calloc(worker_count, sizeof(enumerate_worker_t));
+
+    int return_code = 0;
+    unsigned started_count = 0;
+    do {
+        if (!work.found || !workers) {
+            return_code = -1;
+            break;
+        }
+
+        // The calling thread is worker 0 and uses the caller's handle,
+        // the other workers get their own handles sharing the caller's context.
+        // Workers that can't be started don't fail the sweep, since chunks are claimed
+        // by whichever worker is free and the calling thread always takes part.
+        for (unsigned i = 1; i < worker_count; i++) {
+            workers[i].work = &work;
+            workers[i].library_handle = cpid_initialize_from_context(cpid_linux_get_context(library_handle));
+            if (!workers[i].library_handle) {
+                break;
+            }
+
+            if (pthread_create(&workers[i].thread, NULL, enumerate_worker_main, &workers[i])) {
+                cpid_finalize(workers[i].library_handle);
+                workers[i].library_handle = NULL;
+                break;
+            }
+            started_count = i;
+        }
+
+        if (enumerate_chunks(&work, library_handle)) {
+            return_code = -1;
+        }
+    } while(0);
+
+    for (unsigned i = 1; i <= started_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].return_code) {
+            return_code = -1;
+        }
+        // the sweep is accounted to the caller's handle
+        cpid_linux_stats_merge(library_handle, workers[i].library_handle);
+        cpid_finalize(workers[i].library_handle);
+    }
+
+    if (!return_code) {
+        // compact the result in /proc order
+        size_t entry_count = 0;
+        for (size_t i = 0; i < pid_count; i++) {
+            if (work.found[i]) {
+                if (entry_count != i) {
+                    out[entry_count] = out[i];
+                    if (inputs) {
+                        inputs[entry_count] = inputs[i];
+                    }
+                }
+                entry_count++;
+            }
+        }
+        *n = entry_count;
+    }
+
+    free(workers);
+    free(work.found);
+    free(pids);
+
+    return return_code;
+}
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <sys/types.h>
+
+#include "cpid/cpid_linux.h"
+
+/**
+ * Sources the CPID UUID inputs for the living process with the given userspace PID.
+ *
+ * @details This is the sourcing step of cpid_get_uuid without the digest calculation,
+ *          for subsystems that collect inputs for many processes and hash them in one batch.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_linux_source_process_input(cpid_handle_t const library_handle, const pid_t pid, cpid_linux_input_t *const input);
+
+/**
+ * Gets the context that a handle was created from.
+ *
+ * @details The returned context isn't retained, it is valid for as long as the handle is.
+ *
+ * @return The context of the handle.
+ */
+cpid_context_t cpid_linux_get_context(cpid_handle_t const library_handle);
+
+/**
+ * Gets the /proc directory descriptor of the context that a handle was created from.
+ *
+ * @return The /proc directory descriptor.
+ */
+int cpid_linux_get_proc_directory_fd(cpid_handle_t const library_handle);
+
+/**
+ * Tells whether a handle was created from a context with a given boot UUID, see cpid_context_create_with_boot_uuid.
+ *
+ * @return 1 if the handle can't be used with processes of the local boot, 0 otherwise.
+ */
+int cpid_linux_is_offline(cpid_handle_t const library_handle);
+
+typedef void *cpid_linux_cache_t;
+
+/**
+ * A cached CPID UUID with the inputs it was calculated from.
+ */
+typedef struct {
+    pid_t pid;
+    // -1 if the parent PID isn't known
+    pid_t parent_pid;
+    cpid_linux_input_t input;
+    uuid_t uuid;
+} cpid_linux_cache_entry_t;
+
+/**
+ * Creates an empty PID keyed cache holding up to capacity entries.
+ *
+ * @details When the cache is full an insert replaces an existing entry.
+ *          Caches aren't thread-safe, each one belongs to a single handle.
+ *
+ * @return NULL on error, a cache on success.
+ */
+cpid_linux_cache_t cpid_linux_cache_create(const size_t capacity);
+
+/**
+ * Destroys a cache.
+ */
+void cpid_linux_cache_destroy(cpid_linux_cache_t const cache);
+
+/**
+ * Finds the cache entry of a PID.
+ *
+ * @details The entry is valid until the next insert or remove.
+ *
+ * @return NULL if the PID isn't cached, the entry otherwise.
+ */
+cpid_linux_cache_entry_t *cpid_linux_cache_find(cpid_linux_cache_t const cache, const pid_t pid);
+
+/**
+ * Inserts or replaces the cache entry of a PID.
+ */
+void cpid_linux_cache_insert(cpid_linux_cache_t const cache, const cpid_linux_cache_entry_t *const entry);
+
+/**
+ * Removes the cache entry of a PID, if there is one.
+ */
+void cpid_linux_cache_remove(cpid_linux_cache_t const cache, const pid_t pid);
+
+/**
+ * Reads the creation time ticks of a process, and its parent PID if parent_pid isn't NULL,
+ * with a single read of <pid>/stat relative to a /proc directory descriptor.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cpid_linux_read_stat(const int proc_directory_fd, const pid_t pid, uint64_t *const creation_time_ticks, pid_t *const parent_pid);
+
+/**
+ * Looks up a PID in the cache of a handle.
+ *
+ * @details Unless the cache was enabled with CPID_CACHE_TRUST_EVICTION the hit is
+ *          revalidated against the current start time of the PID, which also refreshes
+ *          the parent PID. A stale entry is removed.
+ *          entry is populated with a copy of the cache entry on a hit.
+ *
+ * @return 0 on a valid hit, -1 otherwise (including when the handle has no cache).
+ */
+int cpid_linux_cache_lookup(cpid_handle_t const library_handle, const pid_t pid, cpid_linux_cache_entry_t *const entry);
+
+/**
+ * Stores a calculated CPID UUID in the cache of a handle, if the handle has one.
+ */
+void cpid_linux_cache_store(cpid_handle_t const library_handle, const cpid_linux_cache_entry_t *const entry);
+
+/**
+ * Adds the stats of source_handle to those of library_handle, see cpid_get_stats.
+ *
+ * @details For subsystems that work through handles of their own on behalf of a caller's handle.
+ *          Does nothing if the library is built without stats.
+ */
+void cpid_linux_stats_merge(cpid_handle_t const library_handle, cpid_handle_t const source_handle);
@@ -0,0 +1,507 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpid/cpid_linux.h"
+#include "cpid_linux_internal.h"
+
+// the table is shared between processes, which requires address-free atomics
+#if ATOMIC_INT_LOCK_FREE != 2 || ATOMIC_LLONG_LOCK_FREE != 2
+#error "cpid_shm requires lock-free 32 and 64-bit atomics"
+#endif
+
+#define SHM_MAGIC UINT64_C(0x3144495043534843)
+#define SHM_VERSION 2
+#define SHM_HEADER_SIZE 64
+
+// Open addressing with linear probing and backward shift removal, like the handle cache.
+// There is a single writer, and every slot is guarded by a seqlock of its own: the writer
+// makes the sequence odd, updates the slot and makes it even again, and readers retry
+// until they see the same even sequence before and after reading the slot.
+// All fields are atomics accessed with relaxed ordering between the fences.
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_bits;
+    uint64_t capacity;
+    uint64_t pid_namespace;
+    // CLOCK_MONOTONIC nanoseconds of the last heartbeat, 0 until the first one
+    _Atomic uint64_t heartbeat_ns;
+} cpid_shm_header_t;
+
+_Static_assert(sizeof(cpid_shm_header_t) <= SHM_HEADER_SIZE, "shm header exceeds its reserved size");
+
+typedef struct {
+    _Atomic uint32_t sequence;
+    _Atomic int32_t pid;
+    // the creation time the CPID UUID was calculated from, consumers check it against /proc
+    _Atomic uint64_t creation_time_ticks;
+    _Atomic uint64_t uuid_words[2];
+} cpid_shm_slot_t;
+
+typedef struct {
+    void *mapping;
+    size_t mapping_size;
+    cpid_shm_header_t *header;
+    cpid_shm_slot_t *slots;
+    size_t slot_mask;
+    // consumer only, -1 with the CPID_SHM_TRUST_EVICTION flag
+    int proc_directory_fd;
+    // producer only
+    int is_producer;
+    size_t count;
+    char *name;
+} *cpid_shm_internal_t;
+
+// readers give up on a slot that stays mid-update, e.g. since the producer died there
+#define SHM_READ_RETRIES 64
+
+static uint64_t monotonic_ns(void) {
+    // served by the vDSO, so it doesn't enter the kernel
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static size_t home_slot(const cpid_shm_internal_t shm_internal, const pid_t pid) {
+    // Fibonacci hashing spreads the sequentially allocated PIDs over the table
+    #define SHM_HASH_MULTIPLIER UINT64_C(0x9E3779B97F4A7C15)
+    return (size_t) (((uint64_t) (uint32_t) pid * SHM_HASH_MULTIPLIER) >> (64 - shm_internal->header->slot_bits));
+}
+
+static int get_pid_namespace(uint64_t *const pid_namespace) {
+    struct stat namespace_stat;
+    if (stat("/proc/self/ns/pid", &namespace_stat)) {
+        return -1;
+    }
+    *pid_namespace = (uint64_t) namespace_stat.st_ino;
+    return 0;
+}
+
+static void write_slot(cpid_shm_slot_t *const slot, const pid_t pid, const uint64_t creation_time_ticks, const uint64_t uuid_words[2]) {
+    const uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->pid, pid, memory_order_relaxed);
+    atomic_store_explicit(&slot->creation_time_ticks, creation_time_ticks, memory_order_relaxed);
+    atomic_store_explicit(&slot->uuid_words[0], uuid_words[0], memory_order_relaxed);
+    atomic_store_explicit(&slot->uuid_words[1], uuid_words[1], memory_order_relaxed);
+
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+}
+
+static int read_slot(const cpid_shm_slot_t *const slot, pid_t *const pid, uint64_t *const creation_time_ticks, uint64_t uuid_words[2]) {
+    for (int retry = 0; retry < SHM_READ_RETRIES; retry++) {
+        const uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence & 1) {
+            continue;
+        }
+
+        *pid = atomic_load_explicit(&slot->pid, memory_order_relaxed);
+        *creation_time_ticks = atomic_load_explicit(&slot->creation_time_ticks, memory_order_relaxed);
+        uuid_words[0] = atomic_load_explicit(&slot->uuid_words[0], memory_order_relaxed);
+        uuid_words[1] = atomic_load_explicit(&slot->uuid_words[1], memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// the producer is the only writer, so it reads its own slots without the seqlock
+static pid_t slot_pid(const cpid_shm_slot_t *const slot) {
+    return atomic_load_explicit(&slot->pid, memory_order_relaxed);
+}
+
+static cpid_shm_slot_t *find_slot(const cpid_shm_internal_t shm_internal, const pid_t pid) {
+    for (size_t slot = home_slot(shm_internal, pid);; slot = (slot + 1) & shm_internal->slot_mask) {
+        const pid_t occupant = slot_pid(&shm_internal->slots[slot]);
+        if (pid == occupant) {
+            return &shm_internal->slots[slot];
+        }
+        if (0 == occupant) {
+            return NULL;
+        }
+    }
+}
+
+static void destroy_shm(const cpid_shm_internal_t shm_internal) {
+    if (shm_internal->proc_directory_fd >= 0) {
+        close(shm_internal->proc_directory_fd);
+    }
+    if (shm_internal->mapping) {
+        munmap(shm_internal->mapping, shm_internal->mapping_size);
+    }
+    free(shm_internal->name);
+    free(shm_internal);
+}
+
+cpid_shm_t cpid_shm_create(const char *const name, const size_t capacity) {
+    if (!name || 0 == capacity || capacity > INT32_MAX) {
+        return NULL;
+    }
+
+    // at least twice as many slots as entries keeps the load factor at or below one half
+    unsigned slot_bits = 1;
+    while (((size_t) 1 << slot_bits) < capacity * 2) {
+        slot_bits++;
+    }
+    const size_t slot_count = (size_t) 1 << slot_bits;
+
+    cpid_shm_internal_t shm_internal = calloc(1, sizeof(*shm_internal));
+    if (!shm_internal) {
+        return NULL;
+    }
+    shm_internal->proc_directory_fd = -1;
+    shm_internal->is_producer = 1;
+    shm_internal->slot_mask = slot_count - 1;
+    shm_internal->mapping_size = SHM_HEADER_SIZE + slot_count * sizeof(cpid_shm_slot_t);
+
+    int return_code = -1;
+    int fd = -1;
+    do {
+        uint64_t pid_namespace = 0;
+        if (get_pid_namespace(&pid_namespace)) {
+            break;
+        }
+
+        shm_internal->name = strdup(name);
+        if (!shm_internal->name) {
+            break;
+        }
+
+        // consumers of a replaced table keep their mapping until they see its heartbeat stop
+        if (shm_unlink(name) && ENOENT != errno) {
+            break;
+        }
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            break;
+        }
+        // readable by every consumer regardless of the umask
+        if (fchmod(fd, 0644) || ftruncate(fd, (off_t) shm_internal->mapping_size)) {
+            break;
+        }
+
+        shm_internal->mapping = mmap(NULL, shm_internal->mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == shm_internal->mapping) {
+            shm_internal->mapping = NULL;
+            break;
+        }
+        shm_internal->header = shm_internal->mapping;
+        shm_internal->slots = (cpid_shm_slot_t *) ((char *) shm_internal->mapping + SHM_HEADER_SIZE);
+
+        // the object is zero-filled, so every slot starts out empty and the heartbeat unset
+        shm_internal->header->version = SHM_VERSION;
+        shm_internal->header->slot_bits = slot_bits;
+        shm_internal->header->capacity = capacity;
+        shm_internal->header->pid_namespace = pid_namespace;
+        atomic_thread_fence(memory_order_release);
+        shm_internal->header->magic = SHM_MAGIC;
+
+        return_code = 0;
+    } while (0);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (return_code) {
+        if (shm_internal->mapping) {
+            shm_unlink(name);
+        }
+        destroy_shm(shm_internal);
+        return NULL;
+    }
+
+    return shm_internal;
+}
+
+int cpid_shm_publish(cpid_shm_t const shm, const pid_t pid, const uint64_t creation_time_ticks, const uuid_t uuid) {
+    cpid_shm_internal_t shm_internal = (cpid_shm_internal_t) shm;
+    if (!shm_internal || !shm_internal->is_producer || pid <= 0 || !uuid) {
+        return -1;
+    }
+
+    uint64_t uuid_words[2];
+    memcpy(uuid_words, uuid, sizeof(uuid_words));
+
+    cpid_shm_slot_t *slot = find_slot(shm_internal, pid);
+    if (!slot) {
+        if (shm_internal->count >= shm_internal->header->capacity) {
+            return -1;
+        }
+        size_t index = home_slot(shm_internal, pid);
+        while (slot_pid(&shm_internal->slots[index])) {
+            index = (index + 1) & shm_internal->slot_mask;
+        }
+        slot = &shm_internal->slots[index];
+        shm_internal->count++;
+    }
+
+    write_slot(slot, pid, creation_time_ticks, uuid_words);
+
+    return 0;
+}
+
+void cpid_shm_withdraw(cpid_shm_t const shm, const pid_t pid) {
+    cpid_shm_internal_t shm_internal = (cpid_shm_internal_t) shm;
+    if (!shm_internal || !shm_internal->is_producer || pid <= 0) {
+        return;
+    }
+
+    cpid_shm_slot_t *const slot = find_slot(shm_internal, pid);
+    if (!slot) {
+        return;
+    }
+
+    static const uint64_t empty_words[2] = {0, 0};
+    size_t hole = (size_t) (slot - shm_internal->slots);
+    write_slot(slot, 0, 0, empty_words);
+    shm_internal->count--;
+
+    // Move back any later entry of the probe run that can no longer be reached past the hole.
+    // The entry is written to the hole before its old slot is cleared, so a concurrent reader
+    // may miss it for the moment but never finds a PID with another PID's CPID UUID.
+    for (size_t index = (hole + 1) & shm_internal->slot_mask; slot_pid(&shm_internal->slots[index]); index = (index + 1) & shm_internal->slot_mask) {
+        cpid_shm_slot_t *const moving = &shm_internal->slots[index];
+        const pid_t moving_pid = slot_pid(moving);
+        const size_t home = home_slot(shm_internal, moving_pid);
+
+        // the entry stays if its home slot lies cyclically within (hole, index]
+        const size_t distance_to_home = (index - home) & shm_internal->slot_mask;
+        const size_t distance_to_hole = (index - hole) & shm_internal->slot_mask;
+        if (distance_to_home < distance_to_hole) {
+            continue;
+        }
+
+        const uint64_t moving_words[2] = {
+            atomic_load_explicit(&moving->uuid_words[0], memory_order_relaxed),
+            atomic_load_explicit(&moving->uuid_words[1], memory_order_relaxed),
+        };
+        write_slot(&shm_internal->slots[hole], moving_pid, atomic_load_explicit(&moving->creation_time_ticks, memory_order_relaxed), moving_words);
+        write_slot(moving, 0, 0, empty_words);
+        hole = index;
+    }
+}
+
+static int compare_pids(const void *const a, const void *const b) {
+    const pid_t pid_a = *(const pid_t *) a;
+    const pid_t pid_b = *(const pid_t *) b;
+    return (pid_a > pid_b) - (pid_a < pid_b);
+}
+
+int cpid_shm_replace_all(cpid_shm_t const shm, const cpid_entry_t *const entries, const size_t n) {
+    cpid_shm_internal_t shm_internal = (cpid_shm_internal_t) shm;
+    if (!shm_internal || !shm_internal->is_producer || (!entries && n)) {
+        return -1;
+    }
+
+    pid_t *kept = malloc((n ? n : 1) * sizeof(pid_t));
+    pid_t *withdrawn = malloc((shm_internal->count ? shm_internal->count : 1) * sizeof(pid_t));
+    if (!kept || !withdrawn) {
+        free(kept);
+        free(withdrawn);
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        kept[i] = entries[i].pid;
+    }
+    qsort(kept, n, sizeof(pid_t), compare_pids);
+
+    // collect first, since removal moves entries around the table
+    size_t withdrawn_count = 0;
+    for (size_t index = 0; index <= shm_internal->slot_mask; index++) {
+        const pid_t pid = slot_pid(&shm_internal->slots[index]);
+        if (pid && !bsearch(&pid, kept, n, sizeof(pid_t), compare_pids)) {
+            withdrawn[withdrawn_count++] = pid;
+        }
+    }
+    for (size_t i = 0; i < withdrawn_count; i++) {
+        cpid_shm_withdraw(shm, withdrawn[i]);
+    }
+
+    int return_code = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (cpid_shm_publish(shm, entries[i].pid, entries[i].creation_time_ticks, entries[i].uuid)) {
+            return_code = -1;
+        }
+    }
+
+    free(kept);
+    free(withdrawn);
+
+    return return_code;
+}
+
+void cpid_shm_heartbeat(cpid_shm_t const shm) {
+    cpid_shm_internal_t shm_internal = (cpid_shm_internal_t) shm;
+    if (!shm_internal || !shm_internal->is_producer) {
+        return;
+    }
+
+    atomic_store_explicit(&shm_internal->header->heartbeat_ns, monotonic_ns(), memory_order_release);
+}
+
+cpid_shm_t cpid_shm_open(const char *const name, const int flags) {
+    return cpid_shm_open_with_owner(name, geteuid(), flags);
+}
+
+cpid_shm_t cpid_shm_open_with_owner(const char *const name, const uid_t owner_uid, const int flags) {
+    if (!name) {
+        return NULL;
+    }
+
+    cpid_shm_internal_t shm_internal = calloc(1, sizeof(*shm_internal));
+    if (!shm_internal) {
+        return NULL;
+    }
+    shm_internal->proc_directory_fd = -1;
+
+    int return_code = -1;
+    int fd = -1;
+    do {
+        uint64_t pid_namespace = 0;
+        if (get_pid_namespace(&pid_namespace)) {
+            break;
+        }
+
+        fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0) {
+            break;
+        }
+        struct stat shm_stat;
+        if (fstat(fd, &shm_stat) || shm_stat.st_size < SHM_HEADER_SIZE) {
+            break;
+        }
+        // anyone can create the name in /dev/shm while the producer isn't running,
+        // only a table that no one but root or the owner could have written is trusted
+        if ((0 != shm_stat.st_uid && owner_uid != shm_stat.st_uid) || (shm_stat.st_mode & (S_IWGRP | S_IWOTH))) {
+            errno = EACCES;
+            break;
+        }
+        shm_internal->mapping_size = (size_t) shm_stat.st_size;
+
+        shm_internal->mapping = mmap(NULL, shm_internal->mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == shm_internal->mapping) {
+            shm_internal->mapping = NULL;
+            break;
+        }
+        shm_internal->header = shm_internal->mapping;
+        shm_internal->slots = (cpid_shm_slot_t *) ((char *) shm_internal->mapping + SHM_HEADER_SIZE);
+
+        const cpid_shm_header_t *const header = shm_internal->header;
+        if (SHM_MAGIC != header->magic) {
+            break;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (SHM_VERSION != header->version || header->slot_bits < 1 || header->slot_bits > 32) {
+            break;
+        }
+        const size_t slot_count = (size_t) 1 << header->slot_bits;
+        if (shm_internal->mapping_size != SHM_HEADER_SIZE + slot_count * sizeof(cpid_shm_slot_t)) {
+            break;
+        }
+        // the PIDs in the table are those of the producer's PID namespace
+        if (header->pid_namespace != pid_namespace) {
+            errno = EXDEV;
+            break;
+        }
+        shm_internal->slot_mask = slot_count - 1;
+
+        if (!(flags & CPID_SHM_TRUST_EVICTION)) {
+            shm_internal->proc_directory_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (shm_internal->proc_directory_fd < 0) {
+                break;
+            }
+        }
+
+        return_code = 0;
+    } while (0);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (return_code) {
+        destroy_shm(shm_internal);
+        return NULL;
+    }
+
+    return shm_internal;
+}
+
+static int lookup(const cpid_shm_internal_t shm_internal, const pid_t pid, uuid_t uuid) {
+    const uint64_t heartbeat_ns = atomic_load_explicit(&shm_internal->header->heartbeat_ns, memory_order_acquire);
+    if (!heartbeat_ns || monotonic_ns() - heartbeat_ns > (uint64_t) CPID_SHM_HEARTBEAT_TIMEOUT_MS * 1000000u) {
+        return -1;
+    }
+
+    size_t slot = home_slot(shm_internal, pid);
+    for (size_t probe = 0; probe <= shm_internal->slot_mask; probe++, slot = (slot + 1) & shm_internal->slot_mask) {
+        pid_t occupant = 0;
+        uint64_t slot_creation_time_ticks = 0;
+        uint64_t uuid_words[2];
+        if (read_slot(&shm_internal->slots[slot], &occupant, &slot_creation_time_ticks, uuid_words) || 0 == occupant) {
+            return -1;
+        }
+        if (pid != occupant) {
+            continue;
+        }
+
+        // A reused PID belongs to a process with a later start time, so a single read of its
+        // stat file tells whether the producer has yet to process the exit of the previous one.
+        if (shm_internal->proc_directory_fd >= 0) {
+            uint64_t creation_time_ticks = 0;
+            if (cpid_linux_read_stat(shm_internal->proc_directory_fd, pid, &creation_time_ticks, NULL)
+                || creation_time_ticks != slot_creation_time_ticks) {
+                return -1;
+            }
+        }
+        memcpy(uuid, uuid_words, sizeof(uuid_words));
+        return 0;
+    }
+    return -1;
+}
+
+int cpid_shm_get_uuid(cpid_shm_t const shm, cpid_handle_t const library_handle, const pid_t pid, uuid_t uuid) {
+    cpid_shm_internal_t shm_internal = (cpid_shm_internal_t) shm;
+    if (!shm_internal || !uuid) {
+        return -1;
+    }
+
+    if (pid > 0 && !lookup(shm_internal, pid, uuid)) {
+        return 0;
+    }
+
+    return library_handle ? cpid_get_uuid(library_handle, pid, uuid) : -1;
+}
+
+void cpid_shm_close(cpid_shm_t const shm) {
+    cpid_shm_internal_t shm_internal = (cpid_shm_internal_t) shm;
+    if (!shm_internal) {
+        return;
+    }
+
+    if (shm_internal->is_producer) {
+        // consumers that keep their mapping fall back from now on
+        atomic_store_explicit(&shm_internal->header->heartbeat_ns, 0, memory_order_release);
+        shm_unlink(shm_internal->name);
+    }
+
+    destroy_shm(shm_internal);
+}
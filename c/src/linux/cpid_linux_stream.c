@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+
+#include "cpid/cpid_linux.h"
+#include "cpid_linux_internal.h"
+
+// every proc connector event arrives in its own small netlink datagram
+#define STREAM_RECEIVE_BUFFER_SIZE 4096
+// the kernel drops events when the socket buffer overflows, so ask for a generous one
+#define STREAM_SOCKET_BUFFER_SIZE (4 * 1024 * 1024)
+// sourced CPID inputs are hashed in batches of this size
+#define STREAM_HASH_BATCH_SIZE 64
+
+typedef struct {
+    int socket_fd;
+    cpid_handle_t library_handle;
+    // times the kernel reported that events were dropped since the stream was opened
+    uint64_t lost_count;
+    size_t pending_count;
+    cpid_linux_input_t pending_inputs[STREAM_HASH_BATCH_SIZE];
+    cpid_stream_record_t *pending_records[STREAM_HASH_BATCH_SIZE];
+    // -1 unless the event reported the parent
+    pid_t pending_parent_pids[STREAM_HASH_BATCH_SIZE];
+    uuid_t pending_uuids[STREAM_HASH_BATCH_SIZE];
+    // uint64_t elements keep the netlink headers aligned
+    uint64_t receive_buffer[STREAM_RECEIVE_BUFFER_SIZE / sizeof(uint64_t)];
+} *cpid_stream_internal_t;
+
+static int send_multicast_operation(const int socket_fd, const enum proc_cn_mcast_op operation) {
+    #define MULTICAST_OPERATION_CONTENT_SIZE (sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))
+    uint64_t message_buffer[NLMSG_SPACE(MULTICAST_OPERATION_CONTENT_SIZE) / sizeof(uint64_t) + 1] = {0};
+
+    struct nlmsghdr *header = (struct nlmsghdr *) message_buffer;
+    header->nlmsg_len = NLMSG_LENGTH(MULTICAST_OPERATION_CONTENT_SIZE);
+    header->nlmsg_type = NLMSG_DONE;
+
+    struct cn_msg *message = (struct cn_msg *) NLMSG_DATA(header);
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len = sizeof(enum proc_cn_mcast_op);
+    memcpy(message->data, &operation, sizeof(operation));
+
+    ssize_t bytes_sent = send(socket_fd, header, header->nlmsg_len, 0);
+    if (bytes_sent < 0 || (size_t) bytes_sent != header->nlmsg_len) {
+        return -1;
+    }
+
+    return 0;
+}
+
+cpid_stream_t cpid_stream_open(cpid_handle_t const library_handle) {
+    if (!library_handle) {
+        return NULL;
+    }
+
+    // the events are of the local boot, a given boot UUID would give them the CPID UUIDs of another
+    if (cpid_linux_is_offline(library_handle)) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+
+    cpid_stream_internal_t stream_internal = calloc(1, sizeof(*stream_internal));
+    if (!stream_internal) {
+        return NULL;
+    }
+
+    // calloc leaves the descriptor at 0, which is a valid descriptor number
+    stream_internal->socket_fd = -1;
+    stream_internal->library_handle = library_handle;
+
+    int return_code = 0;
+    do {
+        stream_internal->socket_fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+        if (stream_internal->socket_fd < 0) {
+            return_code = -1;
+            break;
+        }
+
+        // best effort, the buffer size is capped by net.core.rmem_max
+        int socket_buffer_size = STREAM_SOCKET_BUFFER_SIZE;
+        (void) setsockopt(stream_internal->socket_fd, SOL_SOCKET, SO_RCVBUF, &socket_buffer_size, sizeof(socket_buffer_size));
+
+        struct sockaddr_nl address = {0};
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = CN_IDX_PROC;
+        if (bind(stream_internal->socket_fd, (struct sockaddr *) &address, sizeof(address))) {
+            return_code = -1;
+            break;
+        }
+
+        // requires CAP_NET_ADMIN in the initial user namespace
+        if (send_multicast_operation(stream_internal->socket_fd, PROC_CN_MCAST_LISTEN)) {
+            return_code = -1;
+        }
+    } while(0);
+
+    if (return_code) {
+        cpid_stream_close(stream_internal);
+        stream_internal = NULL;
+    }
+
+    return stream_internal;
+}
+
+void cpid_stream_close(cpid_stream_t const stream) {
+
+    cpid_stream_internal_t stream_internal = (cpid_stream_internal_t) stream;
+
+    if (stream_internal) {
+        if (stream_internal->socket_fd >= 0) {
+            (void) send_multicast_operation(stream_internal->socket_fd, PROC_CN_MCAST_IGNORE);
+            close(stream_internal->socket_fd);
+        }
+
+        free(stream_internal);
+    }
+}
+
+int cpid_stream_get_fd(cpid_stream_t const stream) {
+    if (!stream) {
+        return -1;
+    }
+
+    return ((cpid_stream_internal_t) stream)->socket_fd;
+}
+
+static void flush_pending_inputs(cpid_stream_internal_t const stream_internal) {
+    if (0 == stream_internal->pending_count) {
+        return;
+    }
+
+    // records keep their -1 status if the batch can't be hashed
+    if (!cpid_make_uuid_batch(stream_internal->library_handle, stream_internal->pending_inputs, stream_internal->pending_count, stream_internal->pending_uuids)) {
+        for (size_t i = 0; i < stream_internal->pending_count; i++) {
+            cpid_stream_record_t *const record = stream_internal->pending_records[i];
+            record->creation_time_ticks = stream_internal->pending_inputs[i].creation_time_ticks;
+            memcpy(record->uuid, stream_internal->pending_uuids[i], sizeof(uuid_t));
+            record->status = 0;
+
+            // later lookups of the process through the handle can use the cache
+            if (CPID_STREAM_EVENT_EXIT != record->event) {
+                cpid_linux_cache_entry_t entry = {
+                    .pid = record->pid,
+                    .parent_pid = stream_internal->pending_parent_pids[i],
+                    .input = stream_internal->pending_inputs[i],
+                };
+                memcpy(entry.uuid, record->uuid, sizeof(uuid_t));
+                cpid_linux_cache_store(stream_internal->library_handle, &entry);
+            }
+        }
+    }
+
+    stream_internal->pending_count = 0;
+}
+
+static int add_event_record(cpid_stream_internal_t const stream_internal, const struct proc_event *const event, cpid_stream_record_t *const record) {
+    pid_t pid = 0;
+    pid_t parent_pid = -1;
+    cpid_stream_event_t stream_event = 0;
+
+    switch (event->what) {
+        case PROC_EVENT_FORK:
+            // thread creation is reported as a fork as well
+            if (event->event_data.fork.child_pid != event->event_data.fork.child_tgid) {
+                return -1;
+            }
+            pid = event->event_data.fork.child_tgid;
+            parent_pid = event->event_data.fork.parent_tgid;
+            stream_event = CPID_STREAM_EVENT_FORK;
+            break;
+        case PROC_EVENT_EXEC:
+            pid = event->event_data.exec.process_tgid;
+            stream_event = CPID_STREAM_EVENT_EXEC;
+            break;
+        case PROC_EVENT_EXIT:
+            // thread exits are reported as well
+            if (event->event_data.exit.process_pid != event->event_data.exit.process_tgid) {
+                return -1;
+            }
+            pid = event->event_data.exit.process_tgid;
+            stream_event = CPID_STREAM_EVENT_EXIT;
+            break;
+        default:
+            return -1;
+    }
+
+    record->pid = pid;
+    record->event = stream_event;
+    record->status = -1;
+    record->creation_time_ticks = 0;
+    memset(record->uuid, 0, sizeof(uuid_t));
+
+    if (CPID_STREAM_EVENT_EXIT == stream_event) {
+        // Exiting processes have already released their namespaces, so the inputs usually can't be sourced.
+        // A cached CPID is still available, the lookup checks that it belongs to this process.
+        cpid_linux_cache_entry_t entry;
+        int cache_hit = !cpid_linux_cache_lookup(stream_internal->library_handle, pid, &entry);
+        cpid_cache_evict(stream_internal->library_handle, pid);
+        if (cache_hit) {
+            record->creation_time_ticks = entry.input.creation_time_ticks;
+            memcpy(record->uuid, entry.uuid, sizeof(uuid_t));
+            record->status = 0;
+            return 0;
+        }
+    }
+
+    // Inputs are sourced as soon as the event is read, while the process is most likely still around.
+    // Without a cache EXIT records usually keep the -1 status.
+    cpid_linux_input_t *const input = &stream_internal->pending_inputs[stream_internal->pending_count];
+    if (!cpid_linux_source_process_input(stream_internal->library_handle, pid, input)) {
+        stream_internal->pending_records[stream_internal->pending_count] = record;
+        stream_internal->pending_parent_pids[stream_internal->pending_count] = parent_pid;
+        stream_internal->pending_count++;
+
+        if (STREAM_HASH_BATCH_SIZE == stream_internal->pending_count) {
+            flush_pending_inputs(stream_internal);
+        }
+    }
+
+    return 0;
+}
+
+int cpid_stream_next_batch(cpid_stream_t const stream, cpid_stream_record_t *const records, const size_t capacity, size_t *const count) {
+    if (!stream || !records || 0 == capacity || !count) {
+        return -1;
+    }
+
+    cpid_stream_internal_t stream_internal = (cpid_stream_internal_t) stream;
+    *count = 0;
+
+    int return_code = 0;
+    while (*count < capacity) {
+        // block until the first record is available, then only drain what is already queued
+        int receive_flags = *count ? MSG_DONTWAIT : 0;
+
+        struct sockaddr_nl sender = {0};
+        socklen_t sender_size = sizeof(sender);
+        ssize_t bytes_received = recvfrom(stream_internal->socket_fd, stream_internal->receive_buffer, sizeof(stream_internal->receive_buffer), receive_flags, (struct sockaddr *) &sender, &sender_size);
+        if (bytes_received < 0) {
+            if (ENOBUFS == errno) {
+                // the kernel dropped events, the caller finds out through cpid_stream_get_lost_count
+                stream_internal->lost_count++;
+                continue;
+            }
+            if (EINTR == errno) {
+                continue;
+            }
+            if (*count && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+                break;
+            }
+            return_code = *count ? 0 : -1;
+            break;
+        }
+
+        // only the kernel may send proc connector events
+        if (0 != sender.nl_pid) {
+            continue;
+        }
+
+        size_t remaining = (size_t) bytes_received;
+        for (struct nlmsghdr *header = (struct nlmsghdr *) stream_internal->receive_buffer; NLMSG_OK(header, remaining) && *count < capacity; header = NLMSG_NEXT(header, remaining)) {
+            if (NLMSG_ERROR == header->nlmsg_type || NLMSG_NOOP == header->nlmsg_type) {
+                continue;
+            }
+
+            if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(struct proc_event))) {
+                continue;
+            }
+
+            const struct cn_msg *message = (const struct cn_msg *) NLMSG_DATA(header);
+            if (CN_IDX_PROC != message->id.idx || CN_VAL_PROC != message->id.val) {
+                continue;
+            }
+
+            if (!add_event_record(stream_internal, (const struct proc_event *) message->data, &records[*count])) {
+                (*count)++;
+            }
+        }
+    }
+
+    flush_pending_inputs(stream_internal);
+
+    return return_code;
+}
+
+int cpid_stream_get_lost_count(cpid_stream_t const stream, uint64_t *const lost_count) {
+    if (!stream || !lost_count) {
+        return -1;
+    }
+
+    *lost_count = ((cpid_stream_internal_t) stream)->lost_count;
+    return 0;
+}
@@ -0,0 +1,406 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// Publishes the CPID UUIDs of the live processes of the host in a shared-memory table,
+// so that any number of consumers can look them up with cpid_shm_get_uuid without
+// each of them reading /proc. The table is fed by the proc connector stream, or by
+// the eBPF capture when built with it, and swept against /proc periodically since
+// events dropped by the kernel can't be recovered otherwise. Sweeps run on a thread
+// of their own, so that the event loop keeps draining the source while they do.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpid/cpid_linux.h"
+#ifdef CPIDD_WITH_BPF
+#include "cpid/cpid_linux_bpf.h"
+#endif
+
+#define DEFAULT_CAPACITY 65536
+#define DEFAULT_RESYNC_SECONDS 60
+// also the heartbeat interval, well within CPID_SHM_HEARTBEAT_TIMEOUT_MS
+#define POLL_TIMEOUT_MS 1000
+#define BATCH_CAPACITY 256
+
+typedef struct {
+    cpid_stream_t stream;
+#ifdef CPIDD_WITH_BPF
+    cpid_bpf_t capture;
+#endif
+} source_t;
+
+// A sweep enumerates /proc into entries with a handle of its own, since handles aren't thread-safe.
+typedef struct {
+    cpid_handle_t handle;
+    cpid_entry_t *entries;
+    size_t capacity;
+    pthread_mutex_t mutex;
+    pthread_cond_t requested;
+    // guarded by mutex
+    int is_requested;
+    int is_done;
+    int is_stopping;
+    int result;
+    size_t count;
+} sweeper_t;
+
+// Records read while a sweep is in flight, applied again on top of its result
+// since the sweep may have read /proc before or after each of them.
+typedef struct {
+    cpid_stream_record_t *records;
+    size_t count;
+    size_t capacity;
+    // records were left out for lack of memory, so another sweep is needed
+    int is_incomplete;
+} replay_log_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int signal_number) {
+    (void) signal_number;
+    stop_requested = 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// waits up to timeout_ms for events, count is 0 on timeout or when interrupted by a signal
+static int source_next_batch(const source_t *const source, cpid_stream_record_t *const records, const size_t capacity, size_t *const count, const int timeout_ms) {
+    *count = 0;
+
+#ifdef CPIDD_WITH_BPF
+    if (source->capture) {
+        if (cpid_bpf_next_batch(source->capture, records, capacity, count, timeout_ms)) {
+            return EINTR == errno ? 0 : -1;
+        }
+        return 0;
+    }
+#endif
+
+    struct pollfd poll_fd = {.fd = cpid_stream_get_fd(source->stream), .events = POLLIN};
+    const int ready = poll(&poll_fd, 1, timeout_ms);
+    if (ready < 0) {
+        return EINTR == errno ? 0 : -1;
+    }
+    if (0 == ready) {
+        return 0;
+    }
+    return cpid_stream_next_batch(source->stream, records, capacity, count);
+}
+
+static uint64_t source_lost_count(const source_t *const source) {
+    uint64_t lost_count = 0;
+#ifdef CPIDD_WITH_BPF
+    if (source->capture) {
+        (void) cpid_bpf_get_lost_count(source->capture, &lost_count);
+        return lost_count;
+    }
+#endif
+    if (source->stream) {
+        (void) cpid_stream_get_lost_count(source->stream, &lost_count);
+    }
+    return lost_count;
+}
+
+static void apply_records(cpid_shm_t const shm, const cpid_stream_record_t *const records, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const cpid_stream_record_t *const record = &records[i];
+        if (CPID_STREAM_EVENT_EXIT == record->event) {
+            cpid_shm_withdraw(shm, record->pid);
+        } else if (0 == record->status) {
+            // a full table leaves the process to the fallback of the consumers
+            cpid_shm_publish(shm, record->pid, record->creation_time_ticks, record->uuid);
+        } else {
+            // the process was gone before its inputs could be read, don't keep a previous process of the PID
+            cpid_shm_withdraw(shm, record->pid);
+        }
+    }
+}
+
+static void append_records(replay_log_t *const replay_log, const cpid_stream_record_t *const records, const size_t count) {
+    if (replay_log->is_incomplete || 0 == count) {
+        return;
+    }
+
+    if (replay_log->count + count > replay_log->capacity) {
+        size_t capacity = replay_log->capacity ? replay_log->capacity : BATCH_CAPACITY;
+        while (capacity < replay_log->count + count) {
+            capacity *= 2;
+        }
+        cpid_stream_record_t *const grown = realloc(replay_log->records, capacity * sizeof(cpid_stream_record_t));
+        if (!grown) {
+            replay_log->is_incomplete = 1;
+            return;
+        }
+        replay_log->records = grown;
+        replay_log->capacity = capacity;
+    }
+
+    memcpy(&replay_log->records[replay_log->count], records, count * sizeof(cpid_stream_record_t));
+    replay_log->count += count;
+}
+
+static void *sweeper_main(void *argument) {
+    sweeper_t *const sweeper = argument;
+
+    pthread_mutex_lock(&sweeper->mutex);
+    while (!sweeper->is_stopping) {
+        if (!sweeper->is_requested) {
+            pthread_cond_wait(&sweeper->requested, &sweeper->mutex);
+            continue;
+        }
+        sweeper->is_requested = 0;
+        pthread_mutex_unlock(&sweeper->mutex);
+
+        size_t count = 0;
+        int result = cpid_enumerate_all(sweeper->handle, sweeper->entries, sweeper->capacity, &count, 1);
+        if (result) {
+            if (count > sweeper->capacity) {
+                fprintf(stderr, "Found %zu processes, more than the capacity of %zu.\n", count, sweeper->capacity);
+            } else {
+                fprintf(stderr, "Failed to enumerate processes.\n");
+            }
+        }
+
+        pthread_mutex_lock(&sweeper->mutex);
+        sweeper->result = result;
+        sweeper->count = count;
+        sweeper->is_done = 1;
+    }
+    pthread_mutex_unlock(&sweeper->mutex);
+
+    return NULL;
+}
+
+static void request_sweep(sweeper_t *const sweeper) {
+    pthread_mutex_lock(&sweeper->mutex);
+    sweeper->is_requested = 1;
+    pthread_cond_signal(&sweeper->requested);
+    pthread_mutex_unlock(&sweeper->mutex);
+}
+
+// 1 if the requested sweep has finished, its entries are then not touched until the next request
+static int take_sweep_result(sweeper_t *const sweeper, int *const result, size_t *const count) {
+    pthread_mutex_lock(&sweeper->mutex);
+    const int is_done = sweeper->is_done;
+    if (is_done) {
+        sweeper->is_done = 0;
+        *result = sweeper->result;
+        *count = sweeper->count;
+    }
+    pthread_mutex_unlock(&sweeper->mutex);
+
+    return is_done;
+}
+
+static int parse_count(const char *const text, unsigned long *const value) {
+    char *endptr = NULL;
+    errno = 0;
+    *value = strtoul(text, &endptr, 10);
+    return (endptr == text || *endptr || ERANGE == errno) ? -1 : 0;
+}
+
+static void print_usage(const char *const program) {
+    fprintf(stderr,
+            "Usage: %s [--name NAME] [--capacity N] [--resync-s N]"
+#ifdef CPIDD_WITH_BPF
+            " [--bpf]"
+#endif
+            "\n"
+            "\n"
+            "  --name      name of the shared-memory table (default %s)\n"
+            "  --capacity  maximum number of processes in the table (default %d)\n"
+            "  --resync-s  seconds between sweeps of /proc, 0 for only the initial one and those after lost events (default %d)\n"
+#ifdef CPIDD_WITH_BPF
+            "  --bpf       feed the table with the eBPF capture instead of the proc connector\n"
+#endif
+            ,
+            program, CPID_SHM_DEFAULT_NAME, DEFAULT_CAPACITY, DEFAULT_RESYNC_SECONDS);
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = CPID_SHM_DEFAULT_NAME;
+    unsigned long capacity = DEFAULT_CAPACITY;
+    unsigned long resync_seconds = DEFAULT_RESYNC_SECONDS;
+    int use_bpf = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--name") && i + 1 < argc) {
+            name = argv[++i];
+        } else if (!strcmp(argv[i], "--capacity") && i + 1 < argc && !parse_count(argv[i + 1], &capacity) && capacity && capacity <= INT32_MAX) {
+            i++;
+        } else if (!strcmp(argv[i], "--resync-s") && i + 1 < argc && !parse_count(argv[i + 1], &resync_seconds)) {
+            i++;
+#ifdef CPIDD_WITH_BPF
+        } else if (!strcmp(argv[i], "--bpf")) {
+            use_bpf = 1;
+#endif
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // no SA_RESTART, so that waiting for events is interrupted
+    struct sigaction stop_action = {.sa_handler = handle_stop_signal};
+    sigemptyset(&stop_action.sa_mask);
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+
+    cpid_context_t context = cpid_context_create();
+    cpid_handle_t handle = context ? cpid_initialize_from_context(context) : NULL;
+    sweeper_t sweeper = {.handle = context ? cpid_initialize_from_context(context) : NULL, .capacity = capacity};
+    cpid_context_release(context);
+    if (!handle || !sweeper.handle) {
+        fprintf(stderr, "Error initializing CPID library.\n");
+        cpid_finalize(sweeper.handle);
+        cpid_finalize(handle);
+        return 1;
+    }
+
+    int return_code = 1;
+    source_t source = {0};
+    cpid_shm_t shm = NULL;
+    replay_log_t replay_log = {0};
+    int sweeper_started = 0;
+    pthread_t sweeper_thread;
+    do {
+        // the source is opened before the first sweep so that no process falls in between
+        if (use_bpf) {
+#ifdef CPIDD_WITH_BPF
+            source.capture = cpid_bpf_open(handle);
+            if (!source.capture) {
+                fprintf(stderr, "Failed to open the eBPF capture, which requires CAP_BPF and CAP_PERFMON.\n");
+                break;
+            }
+#endif
+        } else {
+            source.stream = cpid_stream_open(handle);
+            if (!source.stream) {
+                fprintf(stderr, "Failed to open the proc connector stream, which requires CAP_NET_ADMIN.\n");
+                break;
+            }
+        }
+
+        sweeper.entries = malloc(capacity * sizeof(cpid_entry_t));
+        if (!sweeper.entries) {
+            fprintf(stderr, "Failed to allocate memory.\n");
+            break;
+        }
+
+        shm = cpid_shm_create(name, capacity);
+        if (!shm) {
+            fprintf(stderr, "Failed to create the shared-memory table %s: %s\n", name, strerror(errno));
+            break;
+        }
+
+        if (pthread_mutex_init(&sweeper.mutex, NULL)) {
+            break;
+        }
+        if (pthread_cond_init(&sweeper.requested, NULL)) {
+            pthread_mutex_destroy(&sweeper.mutex);
+            break;
+        }
+        if (pthread_create(&sweeper_thread, NULL, sweeper_main, &sweeper)) {
+            fprintf(stderr, "Failed to start the sweep thread.\n");
+            pthread_cond_destroy(&sweeper.requested);
+            pthread_mutex_destroy(&sweeper.mutex);
+            break;
+        }
+        sweeper_started = 1;
+
+        // consumers use the table from the first heartbeat on, once the initial sweep is applied
+        request_sweep(&sweeper);
+        int is_sweeping = 1;
+        int is_sweep_wanted = 0;
+        int is_table_complete = 0;
+
+        uint64_t next_resync_ns = 0;
+        uint64_t lost_count = source_lost_count(&source);
+        cpid_stream_record_t records[BATCH_CAPACITY];
+        return_code = 0;
+        while (!stop_requested) {
+            size_t count = 0;
+            if (source_next_batch(&source, records, BATCH_CAPACITY, &count, POLL_TIMEOUT_MS)) {
+                fprintf(stderr, "Failed to read process events.\n");
+                return_code = 1;
+                break;
+            }
+            apply_records(shm, records, count);
+            if (is_sweeping) {
+                append_records(&replay_log, records, count);
+            }
+
+            // the kernel dropped events, which only a sweep recovers
+            const uint64_t current_lost_count = source_lost_count(&source);
+            is_sweep_wanted |= current_lost_count != lost_count;
+            lost_count = current_lost_count;
+            is_sweep_wanted |= is_table_complete && resync_seconds && now_ns() >= next_resync_ns;
+
+            // a finished sweep is picked up within POLL_TIMEOUT_MS
+            int sweep_result = 0;
+            size_t sweep_count = 0;
+            if (is_sweeping && take_sweep_result(&sweeper, &sweep_result, &sweep_count)) {
+                is_sweeping = 0;
+                if (!sweep_result) {
+                    sweep_result = cpid_shm_replace_all(shm, sweeper.entries, sweep_count);
+                    apply_records(shm, replay_log.records, replay_log.count);
+                }
+                if (!is_table_complete && sweep_result) {
+                    return_code = 1;
+                    break;
+                }
+                // a failed sweep keeps the table as it is, the events still update it
+                is_table_complete = 1;
+                is_sweep_wanted |= replay_log.is_incomplete;
+                replay_log.count = 0;
+                replay_log.is_incomplete = 0;
+                next_resync_ns = now_ns() + (uint64_t) resync_seconds * 1000000000u;
+            }
+
+            if (!is_sweeping && is_sweep_wanted) {
+                request_sweep(&sweeper);
+                is_sweeping = 1;
+                is_sweep_wanted = 0;
+            }
+
+            if (is_table_complete) {
+                cpid_shm_heartbeat(shm);
+            }
+        }
+    } while (0);
+
+    if (sweeper_started) {
+        // a sweep in flight is finished first
+        pthread_mutex_lock(&sweeper.mutex);
+        sweeper.is_stopping = 1;
+        pthread_cond_signal(&sweeper.requested);
+        pthread_mutex_unlock(&sweeper.mutex);
+        pthread_join(sweeper_thread, NULL);
+        pthread_cond_destroy(&sweeper.requested);
+        pthread_mutex_destroy(&sweeper.mutex);
+    }
+
+    cpid_shm_close(shm);
+    free(replay_log.records);
+    free(sweeper.entries);
+    cpid_stream_close(source.stream);
+#ifdef CPIDD_WITH_BPF
+    cpid_bpf_close(source.capture);
+#endif
+    cpid_finalize(sweeper.handle);
+    cpid_finalize(handle);
+
+    return return_code;
+}
@@ -0,0 +1,423 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// Calculates CPID UUIDs from recorded CPID inputs, for logs of hosts and boots other than the local one.
+// Each input line is written back with the CPID UUID appended as a last column.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpid/cpid_format.h"
+#include "cpid/cpid_linux.h"
+
+// input is read in blocks of this size, cut at the last complete line
+#define BLOCK_SIZE (4 * 1024 * 1024)
+// blocks of a round are processed concurrently and written in input order once the round is done
+#define BLOCKS_PER_THREAD 2
+// handles for recently seen boot UUIDs are kept per worker
+#define MAX_WORKER_HANDLES 64
+#define MAX_THREADS 256
+// the appended ",<cpid>" column
+#define CPID_COLUMN_LENGTH (1 + CPID_UUID_STRING_LENGTH)
+
+typedef struct {
+    char *input;
+    size_t input_size;
+    char *output;
+    size_t output_size;
+    size_t output_capacity;
+    size_t failed_line_count;
+} block_t;
+
+typedef struct {
+    uuid_t boot_uuid;
+    cpid_handle_t handle;
+} worker_handle_t;
+
+typedef struct {
+    block_t *blocks;
+    size_t block_count;
+    atomic_size_t next_block;
+    // set when the boot UUID is given on the command line, rather than as the first column
+    const uuid_t *fixed_boot_uuid;
+} round_t;
+
+typedef struct {
+    round_t *round;
+    worker_handle_t handles[MAX_WORKER_HANDLES];
+    size_t handle_count;
+    int failed;
+    pthread_t thread;
+} worker_t;
+
+// Parses a decimal column ending in a comma, or at end for the last column.
+static int parse_uint64(const char **const cursor, const char *const end, const int last_column, uint64_t *const value) {
+    const char *position = *cursor;
+    uint64_t parsed_value = 0;
+    // 19 digits always fit, which is enough for every input column
+    #define MAX_DIGITS 19
+    while (position < end && *position >= '0' && *position <= '9' && position - *cursor < MAX_DIGITS) {
+        parsed_value = parsed_value * 10 + (uint64_t) (*position - '0');
+        position++;
+    }
+
+    if (position == *cursor || (last_column ? position != end : position == end || ',' != *position)) {
+        return -1;
+    }
+
+    *value = parsed_value;
+    *cursor = position + 1;
+    return 0;
+}
+
+static cpid_handle_t get_worker_handle(worker_t *const worker, const uuid_t boot_uuid) {
+    for (size_t i = 0; i < worker->handle_count; i++) {
+        if (!memcmp(worker->handles[i].boot_uuid, boot_uuid, sizeof(uuid_t))) {
+            // move to front, archives are usually sorted or clustered by host
+            worker_handle_t found = worker->handles[i];
+            memmove(&worker->handles[1], &worker->handles[0], i * sizeof(worker_handle_t));
+            worker->handles[0] = found;
+            return found.handle;
+        }
+    }
+
+    cpid_context_t context = cpid_context_create_with_boot_uuid(boot_uuid);
+    if (!context) {
+        return NULL;
+    }
+    cpid_handle_t handle = cpid_initialize_from_context(context);
+    cpid_context_release(context);
+    if (!handle) {
+        return NULL;
+    }
+
+    // the least recently used handle makes room
+    if (MAX_WORKER_HANDLES == worker->handle_count) {
+        cpid_finalize(worker->handles[MAX_WORKER_HANDLES - 1].handle);
+        worker->handle_count--;
+    }
+    memmove(&worker->handles[1], &worker->handles[0], worker->handle_count * sizeof(worker_handle_t));
+    memcpy(worker->handles[0].boot_uuid, boot_uuid, sizeof(uuid_t));
+    worker->handles[0].handle = handle;
+    worker->handle_count++;
+
+    return handle;
+}
+
+// Input columns are boot_uuid,pid_namespace,creation_time_ticks,pid_namespace_tgid
+// or the last three with a fixed boot UUID.
+static int enrich_line(worker_t *const worker, const char *const line, const char *const end, uuid_t uuid) {
+    const char *cursor = line;
+    uuid_t boot_uuid = {0};
+    if (worker->round->fixed_boot_uuid) {
+        memcpy(boot_uuid, *worker->round->fixed_boot_uuid, sizeof(uuid_t));
+    } else {
+        uuid_string_t boot_uuid_string = {0};
+        if (end - cursor <= CPID_UUID_STRING_LENGTH || ',' != cursor[CPID_UUID_STRING_LENGTH]) {
+            return -1;
+        }
+        memcpy(boot_uuid_string, cursor, CPID_UUID_STRING_LENGTH);
+        if (uuid_parse(boot_uuid_string, boot_uuid)) {
+            return -1;
+        }
+        cursor += CPID_UUID_STRING_LENGTH + 1;
+    }
+
+    uint64_t pid_namespace = 0;
+    uint64_t creation_time_ticks = 0;
+    uint64_t pid_namespace_tgid = 0;
+    if (parse_uint64(&cursor, end, 0, &pid_namespace)
+        || parse_uint64(&cursor, end, 0, &creation_time_ticks)
+        || parse_uint64(&cursor, end, 1, &pid_namespace_tgid)
+        || pid_namespace_tgid > INT32_MAX) {
+        return -1;
+    }
+
+    cpid_handle_t handle = get_worker_handle(worker, boot_uuid);
+    if (!handle) {
+        return -1;
+    }
+
+    return cpid_make_uuid(handle, (pid_t) pid_namespace_tgid, creation_time_ticks, (ino_t) pid_namespace, uuid);
+}
+
+static int enrich_block(worker_t *const worker, block_t *const block) {
+    block->output_size = 0;
+    block->failed_line_count = 0;
+
+    const char *line = block->input;
+    const char *const input_end = block->input + block->input_size;
+    while (line < input_end) {
+        // every block ends with a newline
+        const char *line_end = memchr(line, '\n', (size_t) (input_end - line));
+        size_t line_length = (size_t) (line_end - line);
+        // a CRLF line ending is kept, the column goes before it
+        size_t content_length = line_length && '\r' == line[line_length - 1] ? line_length - 1 : line_length;
+
+        size_t required_capacity = block->output_size + line_length + CPID_COLUMN_LENGTH + 1;
+        if (required_capacity > block->output_capacity) {
+            size_t capacity = block->output_capacity ? block->output_capacity : BLOCK_SIZE;
+            while (capacity < required_capacity) {
+                capacity *= 2;
+            }
+            char *output = realloc(block->output, capacity);
+            if (!output) {
+                return -1;
+            }
+            block->output = output;
+            block->output_capacity = capacity;
+        }
+
+        // blank lines are kept as they are
+        char *output_cursor = block->output + block->output_size;
+        if (0 == content_length) {
+            memcpy(output_cursor, line, line_length + 1);
+            block->output_size += line_length + 1;
+            line = line_end + 1;
+            continue;
+        }
+
+        memcpy(output_cursor, line, content_length);
+        output_cursor += content_length;
+        *output_cursor++ = ',';
+
+        // lines that can't be enriched get an empty CPID column
+        uuid_t uuid = {0};
+        if (enrich_line(worker, line, line + content_length, uuid)) {
+            block->failed_line_count++;
+        } else {
+            // the NUL terminator is overwritten by the line ending
+            cpid_format_batch(uuid, 1, output_cursor, CPID_UUID_STRING_LENGTH + 1);
+            output_cursor += CPID_UUID_STRING_LENGTH;
+        }
+
+        memcpy(output_cursor, line + content_length, line_length - content_length + 1);
+        output_cursor += line_length - content_length + 1;
+        block->output_size = (size_t) (output_cursor - block->output);
+
+        line = line_end + 1;
+    }
+
+    return 0;
+}
+
+static void process_round_blocks(worker_t *const worker) {
+    round_t *const round = worker->round;
+    for (;;) {
+        size_t index = atomic_fetch_add_explicit(&round->next_block, 1, memory_order_relaxed);
+        if (index >= round->block_count) {
+            return;
+        }
+
+        if (enrich_block(worker, &round->blocks[index])) {
+            worker->failed = 1;
+        }
+    }
+}
+
+static void *worker_main(void *argument) {
+    process_round_blocks((worker_t *) argument);
+
+    return NULL;
+}
+
+// Reads the next block, moving the incomplete last line to carry.
+// A missing newline at the end of the input is added.
+static int read_block(FILE *const input, block_t *const block, char *const carry, size_t *const carry_size) {
+    memcpy(block->input, carry, *carry_size);
+    size_t read_size = fread(block->input + *carry_size, 1, BLOCK_SIZE - *carry_size, input);
+    size_t size = *carry_size + read_size;
+    *carry_size = 0;
+    if (ferror(input)) {
+        return -1;
+    }
+
+    if (size < BLOCK_SIZE) {
+        if (size && '\n' != block->input[size - 1]) {
+            block->input[size++] = '\n';
+        }
+        block->input_size = size;
+        return 0;
+    }
+
+    char *last_newline = NULL;
+    for (char *position = block->input + size; position > block->input; position--) {
+        if ('\n' == position[-1]) {
+            last_newline = position - 1;
+            break;
+        }
+    }
+    if (!last_newline) {
+        fprintf(stderr, "Input line longer than %d bytes.\n", BLOCK_SIZE);
+        return -1;
+    }
+
+    block->input_size = (size_t) (last_newline + 1 - block->input);
+    *carry_size = size - block->input_size;
+    memcpy(carry, last_newline + 1, *carry_size);
+
+    return 0;
+}
+
+static int run(FILE *const input, worker_t *const workers, const unsigned thread_count, round_t *const round, size_t *const failed_line_count) {
+    char *carry = malloc(BLOCK_SIZE);
+    size_t carry_size = 0;
+    if (!carry) {
+        return -1;
+    }
+
+    int return_code = 0;
+    int at_end_of_input = 0;
+    while (!at_end_of_input && !return_code) {
+        round->block_count = 0;
+        while (round->block_count < (size_t) thread_count * BLOCKS_PER_THREAD && !at_end_of_input) {
+            block_t *block = &round->blocks[round->block_count];
+            if (read_block(input, block, carry, &carry_size)) {
+                return_code = -1;
+                break;
+            }
+            at_end_of_input = block->input_size < BLOCK_SIZE && feof(input);
+            if (block->input_size) {
+                round->block_count++;
+            }
+        }
+        if (return_code) {
+            break;
+        }
+
+        atomic_store_explicit(&round->next_block, 0, memory_order_relaxed);
+
+        // the main thread is worker 0
+        unsigned started_count = 1;
+        for (; started_count < thread_count; started_count++) {
+            if (pthread_create(&workers[started_count].thread, NULL, worker_main, &workers[started_count])) {
+                return_code = -1;
+                break;
+            }
+        }
+        process_round_blocks(&workers[0]);
+        for (unsigned i = 1; i < started_count; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+
+        for (unsigned i = 0; i < thread_count; i++) {
+            if (workers[i].failed) {
+                return_code = -1;
+            }
+        }
+
+        for (size_t i = 0; i < round->block_count && !return_code; i++) {
+            if (round->blocks[i].output_size != fwrite(round->blocks[i].output, 1, round->blocks[i].output_size, stdout)) {
+                return_code = -1;
+            }
+            *failed_line_count += round->blocks[i].failed_line_count;
+        }
+    }
+
+    free(carry);
+
+    return return_code;
+}
+
+static void print_usage(const char *const program) {
+    fprintf(stderr,
+            "Usage: %s [--boot-id UUID] [--threads N] [FILE]\n"
+            "\n"
+            "Appends a CPID column to CSV lines of recorded CPID inputs, read from FILE or stdin.\n"
+            "Input columns are boot_id,pid_namespace,creation_time_ticks,pid_namespace_tgid,\n"
+            "or pid_namespace,creation_time_ticks,pid_namespace_tgid with --boot-id.\n"
+            "Lines that don't match get an empty CPID column.\n"
+            "\n"
+            "  --boot-id  the boot UUID of every input line\n"
+            "  --threads  number of worker threads, 0 for one per processor (default 0)\n",
+            program);
+}
+
+int main(int argc, char *argv[]) {
+    uuid_t fixed_boot_uuid = {0};
+    int has_fixed_boot_uuid = 0;
+    unsigned thread_count = 0;
+    const char *input_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        char *endptr = NULL;
+        if (!strcmp(argv[i], "--boot-id") && i + 1 < argc && !uuid_parse(argv[i + 1], fixed_boot_uuid)) {
+            has_fixed_boot_uuid = 1;
+            i++;
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc
+                   && (thread_count = (unsigned) strtoul(argv[i + 1], &endptr, 10)) <= MAX_THREADS
+                   && endptr != argv[i + 1] && '\0' == *endptr) {
+            i++;
+        } else if ('-' != argv[i][0] && !input_path) {
+            input_path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (0 == thread_count) {
+        long online_processors = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online_processors > 0 && online_processors <= MAX_THREADS ? (unsigned) online_processors : 1;
+    }
+
+    FILE *input = input_path ? fopen(input_path, "rb") : stdin;
+    if (!input) {
+        fprintf(stderr, "Failed to open %s: %s\n", input_path, strerror(errno));
+        return -1;
+    }
+
+    round_t round = {0};
+    round.fixed_boot_uuid = has_fixed_boot_uuid ? (const uuid_t *) &fixed_boot_uuid : NULL;
+    size_t max_block_count = (size_t) thread_count * BLOCKS_PER_THREAD;
+    round.blocks = calloc(max_block_count, sizeof(block_t));
+    worker_t *workers = calloc(thread_count, sizeof(worker_t));
+    int return_code = round.blocks && workers ? 0 : -1;
+    for (size_t i = 0; !return_code && i < max_block_count; i++) {
+        // one spare byte for a newline added at the end of the input
+        round.blocks[i].input = malloc(BLOCK_SIZE + 1);
+        if (!round.blocks[i].input) {
+            return_code = -1;
+        }
+    }
+    for (unsigned i = 0; !return_code && i < thread_count; i++) {
+        workers[i].round = &round;
+    }
+
+    // blocks are written whole, stdio buffering would only add a copy
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    size_t failed_line_count = 0;
+    if (return_code) {
+        fprintf(stderr, "Failed to allocate buffers.\n");
+    } else if (run(input, workers, thread_count, &round, &failed_line_count)) {
+        fprintf(stderr, "Failed to enrich input.\n");
+        return_code = -1;
+    }
+
+    if (failed_line_count) {
+        fprintf(stderr, "%zu lines couldn't be enriched.\n", failed_line_count);
+    }
+
+    for (unsigned i = 0; workers && i < thread_count; i++) {
+        for (size_t j = 0; j < workers[i].handle_count; j++) {
+            cpid_finalize(workers[i].handles[j].handle);
+        }
+    }
+    for (size_t i = 0; round.blocks && i < max_block_count; i++) {
+        free(round.blocks[i].input);
+        free(round.blocks[i].output);
+    }
+    free(workers);
+    free(round.blocks);
+
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    return return_code;
+}
@@ -1,29 +1,333 @@
 // SPDX-License-Identifier: Apache-2.0
 
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <limits.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "cpid/cpid_format.h"
 #include "cpid/cpid_linux.h"
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Exactly one program argument equal to the process PID is required.\n");
-    }
+#include "arrow_writer.h"
+
+// PIDs read from stdin are processed in chunks of this size,
+// the output of a chunk is written in input order once all workers are done with it
+#define STDIN_CHUNK_SIZE 65536
+// workers claim PIDs of a chunk in slices of this size
+#define WORKER_SLICE_SIZE 256
+// a PID that occurs repeatedly in the input is looked up in the cache of the worker
+#define WORKER_CACHE_CAPACITY 4096
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+#define MAX_THREADS 256
+
+typedef enum {
+    OUTPUT_FORMAT_CSV,
+    OUTPUT_FORMAT_NDJSON,
+    OUTPUT_FORMAT_ARROW,
+} output_format_t;
+
+typedef struct {
+    const pid_t *pids;
+    size_t count;
+    atomic_size_t next_index;
+    uuid_t *uuids;
+    // for the Arrow format, which also has the inputs, populated instead of uuids
+    cpid_record_t *records;
+    // 0 for every index whose CPID was calculated
+    int *statuses;
+} chunk_t;
 
+typedef struct {
+    chunk_t *chunk;
+    cpid_handle_t handle;
+    pthread_t thread;
+} worker_t;
+
+static int parse_pid(const char *const text, pid_t *const pid) {
     char *endptr = NULL;
-    long parsed_pid = strtol(argv[1], &endptr, 10);
-    if (endptr == NULL || endptr == argv[1] || *endptr != '\0') {
-        fprintf(stderr, "Error parsing supplied PID.\n");
+    long parsed_pid = strtol(text, &endptr, 10);
+    if (endptr == NULL || endptr == text || (*endptr != '\0' && *endptr != '\n' && *endptr != '\r')) {
         return -1;
     }
 
     if (parsed_pid < INT_MIN || parsed_pid > INT_MAX) {
-        fprintf(stderr, "Supplied PID must be a valid 32-bit integer.\n");
         return -1;
     }
 
-    pid_t pid =  (pid_t) parsed_pid;
+    *pid = (pid_t) parsed_pid;
+    return 0;
+}
+
+static int write_header(const output_format_t format) {
+    if (OUTPUT_FORMAT_ARROW == format) {
+        return arrow_write_schema(stdout);
+    }
+    if (OUTPUT_FORMAT_CSV == format) {
+        fputs("pid,cpid\n", stdout);
+    }
+    return 0;
+}
+
+static void write_record(const output_format_t format, const pid_t pid, const uuid_t uuid) {
+    uuid_string_t uuid_string = {0};
+    cpid_format_batch(uuid, 1, uuid_string, sizeof(uuid_string_t));
+
+    if (OUTPUT_FORMAT_CSV == format) {
+        printf("%d,%s\n", pid, uuid_string);
+    } else {
+        printf("{\"pid\":%d,\"cpid\":\"%s\"}\n", pid, uuid_string);
+    }
+}
+
+static void process_chunk_slices(chunk_t *const chunk, cpid_handle_t const handle) {
+    for (;;) {
+        size_t start = atomic_fetch_add_explicit(&chunk->next_index, WORKER_SLICE_SIZE, memory_order_relaxed);
+        if (start >= chunk->count) {
+            return;
+        }
+
+        size_t end = start + WORKER_SLICE_SIZE < chunk->count ? start + WORKER_SLICE_SIZE : chunk->count;
+        for (size_t i = start; i < end; i++) {
+            if (chunk->records) {
+                chunk->statuses[i] = cpid_get_process_record(handle, chunk->pids[i], 0, &chunk->records[i]);
+            } else {
+                chunk->statuses[i] = cpid_get_uuid(handle, chunk->pids[i], chunk->uuids[i]);
+            }
+        }
+    }
+}
+
+static void *worker_main(void *argument) {
+    worker_t *const worker = argument;
+
+    process_chunk_slices(worker->chunk, worker->handle);
+
+    return NULL;
+}
+
+// Workers that can't be started leave their slices to the others, the main thread always takes part.
+static void process_chunk(chunk_t *const chunk, worker_t *const workers, const unsigned thread_count) {
+    static int start_failure_reported = 0;
+
+    atomic_store_explicit(&chunk->next_index, 0, memory_order_relaxed);
+
+    // the main thread is worker 0
+    unsigned started_count = 1;
+    for (; started_count < thread_count; started_count++) {
+        workers[started_count].chunk = chunk;
+        if (pthread_create(&workers[started_count].thread, NULL, worker_main, &workers[started_count])) {
+            break;
+        }
+    }
+
+    process_chunk_slices(chunk, workers[0].handle);
+
+    for (unsigned i = 1; i < started_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    if (started_count < thread_count && !start_failure_reported) {
+        fprintf(stderr, "Failed to start %u of %u worker threads, continuing with fewer.\n", thread_count - started_count, thread_count);
+        start_failure_reported = 1;
+    }
+}
+
+static int run_stdin(const output_format_t format, worker_t *const workers, const unsigned thread_count) {
+    chunk_t chunk = {0};
+    pid_t *pids = calloc(STDIN_CHUNK_SIZE, sizeof(pid_t));
+    // the input line of each PID, for reporting the PIDs whose CPID can't be calculated
+    size_t *line_numbers = calloc(STDIN_CHUNK_SIZE, sizeof(size_t));
+    chunk.uuids = calloc(STDIN_CHUNK_SIZE, sizeof(uuid_t));
+    chunk.statuses = calloc(STDIN_CHUNK_SIZE, sizeof(int));
+    chunk.records = OUTPUT_FORMAT_ARROW == format ? calloc(STDIN_CHUNK_SIZE, sizeof(cpid_record_t)) : NULL;
+    chunk.pids = pids;
+    if (!pids || !line_numbers || !chunk.uuids || !chunk.statuses || (OUTPUT_FORMAT_ARROW == format && !chunk.records)) {
+        fprintf(stderr, "Failed to allocate PID buffers.\n");
+        free(pids);
+        free(line_numbers);
+        free(chunk.uuids);
+        free(chunk.records);
+        free(chunk.statuses);
+        return -1;
+    }
+
+    int return_code = write_header(format);
+    #define LINE_BUFFER_SIZE 64
+    char line[LINE_BUFFER_SIZE];
+    size_t line_number = 0;
+    int at_end_of_input = 0;
+    while (!at_end_of_input && !return_code) {
+        chunk.count = 0;
+        while (chunk.count < STDIN_CHUNK_SIZE) {
+            if (!fgets(line, LINE_BUFFER_SIZE, stdin)) {
+                at_end_of_input = 1;
+                break;
+            }
+            line_number++;
+
+            // blank lines are skipped quietly
+            if ('\n' == line[0] || ('\r' == line[0] && '\n' == line[1])) {
+                continue;
+            }
+
+            // the rest of an overlong line is discarded, it can't be a PID
+            size_t length = strlen(line);
+            int overlong = '\n' != line[length - 1] && !feof(stdin);
+            for (int c = 0; overlong && EOF != (c = getchar()) && '\n' != c;) {
+            }
+
+            if (overlong || parse_pid(line, &pids[chunk.count])) {
+                fprintf(stderr, "Skipping line %zu, it is not a PID.\n", line_number);
+                continue;
+            }
+            line_numbers[chunk.count++] = line_number;
+        }
+
+        process_chunk(&chunk, workers, thread_count);
+
+        // PIDs whose CPID can't be calculated are reported and skipped like lines that aren't PIDs
+        size_t kept_count = 0;
+        for (size_t i = 0; i < chunk.count; i++) {
+            if (chunk.statuses[i]) {
+                fprintf(stderr, "Skipping line %zu, the CPID of PID %d can't be calculated.\n", line_numbers[i], pids[i]);
+                continue;
+            }
+            pids[kept_count] = pids[i];
+            if (chunk.records) {
+                chunk.records[kept_count] = chunk.records[i];
+            } else {
+                memcpy(chunk.uuids[kept_count], chunk.uuids[i], sizeof(uuid_t));
+            }
+            chunk.statuses[kept_count] = 0;
+            kept_count++;
+        }
+
+        // a record batch per chunk
+        if (OUTPUT_FORMAT_ARROW == format) {
+            if (kept_count && arrow_write_record_batch(stdout, chunk.pids, chunk.records, chunk.statuses, kept_count)) {
+                return_code = -1;
+            }
+        } else {
+            for (size_t i = 0; i < kept_count; i++) {
+                write_record(format, chunk.pids[i], chunk.uuids[i]);
+            }
+        }
+    }
+
+    if (OUTPUT_FORMAT_ARROW == format && !return_code) {
+        return_code = arrow_write_end_of_stream(stdout);
+    }
+
+    free(pids);
+    free(line_numbers);
+    free(chunk.uuids);
+    free(chunk.records);
+    free(chunk.statuses);
+
+    return return_code;
+}
+
+// the inputs come from the enumeration, so the rows are the processes and CPIDs it found
+static int write_all_arrow(const cpid_entry_t *const entries, const cpid_linux_input_t *const inputs, const size_t count) {
+    pid_t *pids = calloc(STDIN_CHUNK_SIZE, sizeof(pid_t));
+    cpid_record_t *records = calloc(STDIN_CHUNK_SIZE, sizeof(cpid_record_t));
+    // every row has a CPID
+    int *statuses = calloc(STDIN_CHUNK_SIZE, sizeof(int));
+
+    int return_code = -1;
+    do {
+        if (!pids || !records || !statuses) {
+            fprintf(stderr, "Failed to allocate PID buffers.\n");
+            break;
+        }
+
+        if (arrow_write_schema(stdout)) {
+            break;
+        }
+
+        // a record batch per STDIN_CHUNK_SIZE processes, like with --stdin
+        return_code = 0;
+        for (size_t start = 0; start < count && !return_code; start += STDIN_CHUNK_SIZE) {
+            const size_t batch_count = count - start < STDIN_CHUNK_SIZE ? count - start : STDIN_CHUNK_SIZE;
+            for (size_t i = 0; i < batch_count; i++) {
+                pids[i] = entries[start + i].pid;
+                records[i].pid = entries[start + i].pid;
+                records[i].input = inputs[start + i];
+                memcpy(records[i].uuid, entries[start + i].uuid, sizeof(uuid_t));
+            }
+
+            if (arrow_write_record_batch(stdout, pids, records, statuses, batch_count)) {
+                return_code = -1;
+            }
+        }
+
+        if (!return_code) {
+            return_code = arrow_write_end_of_stream(stdout);
+        }
+    } while (0);
+
+    free(pids);
+    free(records);
+    free(statuses);
+
+    return return_code;
+}
+
+static int run_all(const output_format_t format, worker_t *const workers, const unsigned thread_count) {
+    cpid_handle_t const handle = workers[0].handle;
+    size_t capacity = 0;
+    cpid_entry_t *entries = NULL;
+    // for the Arrow format, which also has the inputs
+    cpid_linux_input_t *inputs = NULL;
+    size_t count = 0;
+
+    // the number of processes is only known after a first attempt, and may grow meanwhile
+    #define ENUMERATE_ATTEMPTS 8
+    #define ENUMERATE_HEADROOM 1024
+    int return_code = -1;
+    for (int attempt = 0; attempt < ENUMERATE_ATTEMPTS && return_code; attempt++) {
+        return_code = cpid_enumerate_all_with_inputs(handle, entries, inputs, capacity, &count, thread_count);
+        if (return_code && count > capacity) {
+            capacity = count + ENUMERATE_HEADROOM;
+            cpid_entry_t *new_entries = realloc(entries, capacity * sizeof(cpid_entry_t));
+            if (!new_entries) {
+                break;
+            }
+            entries = new_entries;
+            if (OUTPUT_FORMAT_ARROW == format) {
+                cpid_linux_input_t *new_inputs = realloc(inputs, capacity * sizeof(cpid_linux_input_t));
+                if (!new_inputs) {
+                    break;
+                }
+                inputs = new_inputs;
+            }
+        } else if (return_code) {
+            break;
+        }
+    }
+
+    if (return_code) {
+        fprintf(stderr, "Failed to enumerate processes.\n");
+    } else if (OUTPUT_FORMAT_ARROW == format) {
+        return_code = write_all_arrow(entries, inputs, count);
+    } else {
+        write_header(format);
+        for (size_t i = 0; i < count; i++) {
+            write_record(format, entries[i].pid, entries[i].uuid);
+        }
+    }
+
+    free(entries);
+    free(inputs);
+
+    return return_code;
+}
+
+static int run_single(const pid_t pid) {
     uuid_string_t uuid_string = {0};
 
     cpid_handle_t cpid_handle = cpid_initialize();
@@ -44,3 +348,117 @@ int main(int argc, char *argv[]) {
 
     return return_code;
 }
+
+static void print_usage(const char *const program) {
+    fprintf(stderr,
+            "Usage: %s <PID>\n"
+            "       %s [--format csv|ndjson|arrow] [--threads N] --stdin\n"
+            "       %s [--format csv|ndjson|arrow] [--threads N] --all\n"
+            "\n"
+            "  --stdin    calculate the CPID of every PID read from stdin, one per line\n"
+            "  --all      calculate the CPID of every process in /proc\n"
+            "  --format   output pid,cpid CSV lines (default), NDJSON objects or an Arrow IPC stream\n"
+            "             of pid, cpid, creation_time_ticks, pid_namespace and pid_namespace_tgid\n"
+            "  --threads  number of worker threads, 0 for one per processor (default 1)\n",
+            program, program, program);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    int read_stdin = 0;
+    int read_all = 0;
+    output_format_t format = OUTPUT_FORMAT_CSV;
+    unsigned thread_count = 1;
+    if (2 == argc && '-' != argv[1][0]) {
+        pid_t pid = 0;
+        if (parse_pid(argv[1], &pid) || strchr(argv[1], '\n')) {
+            fprintf(stderr, "Error parsing supplied PID.\n");
+            return -1;
+        }
+        return run_single(pid);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        char *endptr = NULL;
+        if (!strcmp(argv[i], "--stdin")) {
+            read_stdin = 1;
+        } else if (!strcmp(argv[i], "--all")) {
+            read_all = 1;
+        } else if (!strcmp(argv[i], "--format") && i + 1 < argc && !strcmp(argv[i + 1], "csv")) {
+            format = OUTPUT_FORMAT_CSV;
+            i++;
+        } else if (!strcmp(argv[i], "--format") && i + 1 < argc && !strcmp(argv[i + 1], "ndjson")) {
+            format = OUTPUT_FORMAT_NDJSON;
+            i++;
+        } else if (!strcmp(argv[i], "--format") && i + 1 < argc && !strcmp(argv[i + 1], "arrow")) {
+            format = OUTPUT_FORMAT_ARROW;
+            i++;
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc
+                   && (thread_count = (unsigned) strtoul(argv[i + 1], &endptr, 10)) <= MAX_THREADS
+                   && endptr != argv[i + 1] && '\0' == *endptr) {
+            i++;
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (read_stdin == read_all) {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    if (0 == thread_count) {
+        long online_processors = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online_processors > 0 && online_processors <= MAX_THREADS ? (unsigned) online_processors : 1;
+    }
+
+    // one context for the whole run, with a handle and a cache per worker thread
+    cpid_context_t context = cpid_context_create();
+    if (!context) {
+        fprintf(stderr, "Failed to initialize CPID context.\n");
+        return -1;
+    }
+
+    worker_t *workers = calloc(thread_count, sizeof(worker_t));
+    unsigned handle_count = 0;
+    int return_code = workers ? 0 : -1;
+    for (; !return_code && handle_count < thread_count; handle_count++) {
+        workers[handle_count].handle = cpid_initialize_from_context(context);
+        if (!workers[handle_count].handle || (read_stdin && cpid_cache_enable(workers[handle_count].handle, WORKER_CACHE_CAPACITY, 0))) {
+            cpid_finalize(workers[handle_count].handle);
+            return_code = -1;
+            break;
+        }
+    }
+    cpid_context_release(context);
+
+    if (return_code) {
+        fprintf(stderr, "Failed to initialize cpid_instance_t.\n");
+    } else {
+        // output is fully buffered, even when it goes to a terminal
+        static char output_buffer[OUTPUT_BUFFER_SIZE];
+        setvbuf(stdout, output_buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+        if (read_stdin) {
+            return_code = run_stdin(format, workers, thread_count);
+        } else {
+            return_code = run_all(format, workers, thread_count);
+        }
+
+        if (fflush(stdout)) {
+            return_code = -1;
+        }
+    }
+
+    for (unsigned i = 0; i < handle_count; i++) {
+        cpid_finalize(workers[i].handle);
+    }
+    free(workers);
+
+    return return_code;
+}
@@ -1,16 +1,29 @@
 // SPDX-License-Identifier: Apache-2.0
 
-#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <string.h>
+#include <unistd.h>
 #include <uuid/uuid.h>
 #include <IOKit/IOKitLib.h>
 #include <sys/sysctl.h>
+#ifdef CPID_BUILTIN_SHA256
+#include "../common/cpid_sha256.h"
+#else
 #include <openssl/evp.h>
+#endif
 
 
+#include "cpid/cpid_format.h"
 #include "cpid/cpid_macos.h"
+#include "cpid_macos_internal.h"
 
 #define KERNEL_TASK_PID 0
 #define LAUNCHD_PID 1
@@ -20,6 +33,11 @@
 #define MIN_MICROS_OFFSET 0
 #define OPEN_SSL_SUCCESS 1
 #define SHA256_BUFFER_SIZE 32
+#ifdef CPID_BUILTIN_SHA256
+#define DIGEST_DESTINATION_BUFFER_SIZE SHA256_BUFFER_SIZE
+#else
+#define DIGEST_DESTINATION_BUFFER_SIZE EVP_MAX_MD_SIZE
+#endif
 
 #pragma pack(push, 1)
 typedef struct {
@@ -38,15 +56,37 @@ typedef struct {
 #pragma pack(pop)
 
 _Static_assert(MACOS_EXPECTED_DIGEST_INPUT_CONTENT_SIZE == sizeof(digest_input_content_t), "digest_input_content_t is not the expected size.");
+_Static_assert(CPID_SERIAL_NUMBER_BUFFER_SIZE == MACOS_SERIAL_NUMBER_BUFFER_SIZE, "cpid_macos_boot_identity_t serial_number should match the digest input.");
+
+// The boot identifying fields never change after cpid_initialize and fill exactly one SHA-256 block.
+// The digest state after this block (the midstate) is computed once and only the
+// process-specific tail is hashed per CPID.
+#define SHA256_BLOCK_SIZE 64
+#define MACOS_CONSTANT_PREFIX_SIZE offsetof(digest_input_content_t, process_creation_time)
+
+_Static_assert(SHA256_BLOCK_SIZE == MACOS_CONSTANT_PREFIX_SIZE, "digest_input_content_t constant prefix should be one SHA-256 block.");
 
 typedef struct {
+#ifdef CPID_BUILTIN_SHA256
+    cpid_sha256_state_t constant_prefix_state;
+#else
+    EVP_MD_CTX *constant_prefix_digest_context;
     EVP_MD_CTX *digest_context;
     EVP_MD *sha256;
-    uint8_t digest_destination_buffer[EVP_MAX_MD_SIZE];
+#endif
+    uint8_t digest_destination_buffer[DIGEST_DESTINATION_BUFFER_SIZE];
     digest_input_content_t digest_input_content;
+    // 0 for a handle from cpid_initialize_with_boot_identity, which can't source local processes
+    int local_boot_identity;
+    // 0 until the digest contexts are prepared, which handles from cpid_initialize_lazy defer to their first digest
+    int digest_ready;
+    struct kinfo_proc *snapshot_process_info;
+    size_t snapshot_process_info_capacity;
+    cpid_entry_t *snapshot_entries;
+    size_t snapshot_entries_capacity;
 } *cpid_handle_internal_t;
 
-_Static_assert(EVP_MAX_MD_SIZE >= SHA256_BUFFER_SIZE, "OpenSSL EVP_MAX_MD_SIZE must be larger than SHA256_BUFFER_SIZE.");
+_Static_assert(DIGEST_DESTINATION_BUFFER_SIZE >= SHA256_BUFFER_SIZE, "DIGEST_DESTINATION_BUFFER_SIZE must be larger than SHA256_BUFFER_SIZE.");
 _Static_assert(SHA256_BUFFER_SIZE >= sizeof(uuid_t), "SHA256_BUFFER_SIZE must be larger than uuid_t.");
 
 static int cpid_get_serial_number(char *const serial_number, const size_t serial_number_size) {
@@ -110,7 +150,7 @@ static int cpid_get_hardware_uuid(uuid_t hardware_uuid) {
     return 0;
 }
 
-static int cpid_get_process_creation_time(const pid_t pid, process_creation_time_t *const process_creation_time) {
+static int cpid_get_process_info(const pid_t pid, process_creation_time_t *const process_creation_time, pid_t *const parent_pid) {
     if(!process_creation_time) {
         return -1;
     }
@@ -131,50 +171,111 @@ static int cpid_get_process_creation_time(const pid_t pid, process_creation_time
 
     process_creation_time->unix_epoch_seconds = process_info.kp_proc.p_starttime.tv_sec;
     process_creation_time->micros_offset = process_info.kp_proc.p_starttime.tv_usec;
+
+    if (parent_pid) {
+        *parent_pid = process_info.kp_eproc.e_ppid;
+    }
     
     return 0;
 }
 
-cpid_handle_t cpid_initialize(void) {
-
-    cpid_handle_internal_t library_handle_internal = calloc(1, sizeof(*library_handle_internal));
-    if (!library_handle_internal) {
-        return NULL;
-    }
+static int cpid_get_process_creation_time(const pid_t pid, process_creation_time_t *const process_creation_time) {
+    return cpid_get_process_info(pid, process_creation_time, NULL);
+}
 
-    int return_code = 0;
-    do {
+// Prepares the digest contexts once the boot identifying fields of the digest input are populated.
+// A failed attempt can be retried, what was already allocated is kept.
+static int cpid_initialize_digest_contexts(cpid_handle_internal_t const library_handle_internal) {
+#ifdef CPID_BUILTIN_SHA256
+    // hash the constant prefix once, each digest calculation finishes from a copy of this state
+    cpid_sha256_init(&library_handle_internal->constant_prefix_state);
+    cpid_sha256_compress(&library_handle_internal->constant_prefix_state, (const uint8_t *) &library_handle_internal->digest_input_content, 1);
+#else
+    if (!library_handle_internal->sha256) {
         library_handle_internal->sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
         if (!library_handle_internal->sha256) {
-            return_code = -1;
-            break;
+            return -1;
         }
+    }
 
+    if (!library_handle_internal->digest_context) {
         library_handle_internal->digest_context = EVP_MD_CTX_new();
         if (!library_handle_internal->digest_context) {
-            return_code = -1;
-            break;
+            return -1;
         }
+    }
 
-        return_code = cpid_get_serial_number(library_handle_internal->digest_input_content.serial_number, sizeof(library_handle_internal->digest_input_content.serial_number));
-        if (return_code) {
-            break;
+    // hash the constant prefix once, each digest calculation starts from a copy of this context
+    if (!library_handle_internal->constant_prefix_digest_context) {
+        library_handle_internal->constant_prefix_digest_context = EVP_MD_CTX_new();
+        if (!library_handle_internal->constant_prefix_digest_context) {
+            return -1;
         }
+    }
 
-        return_code = cpid_get_hardware_uuid(library_handle_internal->digest_input_content.hardware_uuid);
-        if (return_code) {
-            break;
-        }
+    if (OPEN_SSL_SUCCESS != EVP_DigestInit_ex2(library_handle_internal->constant_prefix_digest_context, library_handle_internal->sha256, NULL)) {
+        return -1;
+    }
 
-        return_code = cpid_get_process_creation_time(KERNEL_TASK_PID, &library_handle_internal->digest_input_content.kernel_task_creation_time);
-        if (return_code) {
-            break;
-        }
+    if (OPEN_SSL_SUCCESS != EVP_DigestUpdate(library_handle_internal->constant_prefix_digest_context, &library_handle_internal->digest_input_content, MACOS_CONSTANT_PREFIX_SIZE)) {
+        return -1;
+    }
+#endif
+
+    library_handle_internal->digest_ready = 1;
+    return 0;
+}
+
+static int cpid_is_valid_boot_identity(const cpid_macos_boot_identity_t *const boot_identity) {
+    if (boot_identity->kernel_task_creation_time_micros_offset < MIN_MICROS_OFFSET || boot_identity->kernel_task_creation_time_micros_offset > MAX_MICROS_OFFSET
+            || boot_identity->launchd_creation_time_micros_offset < MIN_MICROS_OFFSET || boot_identity->launchd_creation_time_micros_offset > MAX_MICROS_OFFSET) {
+        return 0;
+    }
+
+    // the serial number is NUL terminated in the digest input, as CFStringGetCString leaves it
+    return NULL != memchr(boot_identity->serial_number, '\0', sizeof(boot_identity->serial_number));
+}
+
+static int cpid_source_boot_identity(cpid_macos_boot_identity_t *const boot_identity) {
+    memset(boot_identity, 0, sizeof(*boot_identity));
 
-        return_code = cpid_get_process_creation_time(LAUNCHD_PID, &library_handle_internal->digest_input_content.launchd_creation_time);
-    } while(0);
+    process_creation_time_t kernel_task_creation_time;
+    process_creation_time_t launchd_creation_time;
+    if (cpid_get_serial_number(boot_identity->serial_number, sizeof(boot_identity->serial_number))
+            || cpid_get_hardware_uuid(boot_identity->hardware_uuid)
+            || cpid_get_process_creation_time(KERNEL_TASK_PID, &kernel_task_creation_time)
+            || cpid_get_process_creation_time(LAUNCHD_PID, &launchd_creation_time)) {
+        return -1;
+    }
+
+    boot_identity->kernel_task_creation_time_unix_epoch_seconds = kernel_task_creation_time.unix_epoch_seconds;
+    boot_identity->kernel_task_creation_time_micros_offset = (int32_t) kernel_task_creation_time.micros_offset;
+    boot_identity->launchd_creation_time_unix_epoch_seconds = launchd_creation_time.unix_epoch_seconds;
+    boot_identity->launchd_creation_time_micros_offset = (int32_t) launchd_creation_time.micros_offset;
+
+    return 0;
+}
 
-    if (return_code) {
+static cpid_handle_internal_t cpid_handle_from_boot_identity(const cpid_macos_boot_identity_t *const boot_identity, const int local_boot_identity, const int defer_digest) {
+    if (!cpid_is_valid_boot_identity(boot_identity)) {
+        return NULL;
+    }
+
+    cpid_handle_internal_t library_handle_internal = calloc(1, sizeof(*library_handle_internal));
+    if (!library_handle_internal) {
+        return NULL;
+    }
+
+    size_t serial_number_length = strlen(boot_identity->serial_number);
+    memcpy(library_handle_internal->digest_input_content.serial_number, boot_identity->serial_number, serial_number_length);
+    memcpy(library_handle_internal->digest_input_content.hardware_uuid, boot_identity->hardware_uuid, sizeof(uuid_t));
+    library_handle_internal->digest_input_content.kernel_task_creation_time.unix_epoch_seconds = boot_identity->kernel_task_creation_time_unix_epoch_seconds;
+    library_handle_internal->digest_input_content.kernel_task_creation_time.micros_offset = boot_identity->kernel_task_creation_time_micros_offset;
+    library_handle_internal->digest_input_content.launchd_creation_time.unix_epoch_seconds = boot_identity->launchd_creation_time_unix_epoch_seconds;
+    library_handle_internal->digest_input_content.launchd_creation_time.micros_offset = boot_identity->launchd_creation_time_micros_offset;
+    library_handle_internal->local_boot_identity = local_boot_identity;
+
+    if (!defer_digest && cpid_initialize_digest_contexts(library_handle_internal)) {
         cpid_finalize(library_handle_internal);
         library_handle_internal = NULL;
     }
@@ -182,18 +283,162 @@ cpid_handle_t cpid_initialize(void) {
     return library_handle_internal;
 }
 
+cpid_handle_t cpid_initialize(void) {
+
+    cpid_macos_boot_identity_t boot_identity;
+    if (cpid_source_boot_identity(&boot_identity)) {
+        return NULL;
+    }
+
+    return cpid_handle_from_boot_identity(&boot_identity, 1, 0);
+}
+
+cpid_handle_t cpid_initialize_with_boot_identity(const cpid_macos_boot_identity_t *const boot_identity) {
+    if (!boot_identity) {
+        return NULL;
+    }
+
+    return cpid_handle_from_boot_identity(boot_identity, 0, 0);
+}
+
+int cpid_macos_is_offline(cpid_handle_t const library_handle) {
+    return library_handle && !((cpid_handle_internal_t) library_handle)->local_boot_identity;
+}
+
+#define BOOT_IDENTITY_CACHE_MAGIC 0x43504944
+#define BOOT_IDENTITY_CACHE_VERSION 1
+
+// Only read back by the same library build, so the layout is the native one.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    // kern.boottime of the boot the identity was sourced in
+    int64_t boot_time_seconds;
+    int64_t boot_time_micros;
+    cpid_macos_boot_identity_t boot_identity;
+} boot_identity_cache_t;
+
+static int cpid_get_boot_time(struct timeval *const boot_time) {
+    int mib[2] = {CTL_KERN, KERN_BOOTTIME};
+    size_t boot_time_size = sizeof(*boot_time);
+    return sysctl(mib, 2, boot_time, &boot_time_size, NULL, 0) ? -1 : 0;
+}
+
+static int cpid_load_boot_identity_cache(const char *const cache_path, const struct timeval *const boot_time, cpid_macos_boot_identity_t *const boot_identity) {
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        return -1;
+    }
+
+    boot_identity_cache_t cache;
+    ssize_t bytes_read = read(fd, &cache, sizeof(cache));
+    close(fd);
+
+    // a cache of another boot, or of another library version, is sourced again
+    if ((ssize_t) sizeof(cache) != bytes_read || BOOT_IDENTITY_CACHE_MAGIC != cache.magic || BOOT_IDENTITY_CACHE_VERSION != cache.version
+            || boot_time->tv_sec != cache.boot_time_seconds || boot_time->tv_usec != cache.boot_time_micros
+            || !cpid_is_valid_boot_identity(&cache.boot_identity)) {
+        return -1;
+    }
+
+    *boot_identity = cache.boot_identity;
+    return 0;
+}
+
+// Failing to write the cache isn't an error, the next process sources the boot identity again.
+static void cpid_store_boot_identity_cache(const char *const cache_path, const struct timeval *const boot_time, const cpid_macos_boot_identity_t *const boot_identity) {
+    // replaced by a rename so that concurrent readers never see a partial cache
+    char temporary_path[PATH_MAX];
+    int path_length = snprintf(temporary_path, sizeof(temporary_path), "%s.%d", cache_path, (int) getpid());
+    if (path_length < 0 || (size_t) path_length >= sizeof(temporary_path)) {
+        return;
+    }
+
+    boot_identity_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = BOOT_IDENTITY_CACHE_MAGIC;
+    cache.version = BOOT_IDENTITY_CACHE_VERSION;
+    cache.boot_time_seconds = boot_time->tv_sec;
+    cache.boot_time_micros = boot_time->tv_usec;
+    cache.boot_identity = *boot_identity;
+
+    int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        return;
+    }
+
+    int written = (ssize_t) sizeof(cache) == write(fd, &cache, sizeof(cache));
+    if (close(fd)) {
+        written = 0;
+    }
+
+    if (!written || rename(temporary_path, cache_path)) {
+        unlink(temporary_path);
+    }
+}
+
+// sourced by the first cpid_initialize_lazy of the process and shared with the later ones
+static pthread_mutex_t process_boot_identity_mutex = PTHREAD_MUTEX_INITIALIZER;
+static cpid_macos_boot_identity_t process_boot_identity;
+static int has_process_boot_identity = 0;
+
+static int cpid_get_process_boot_identity(const char *const cache_path, cpid_macos_boot_identity_t *const boot_identity) {
+    int return_code = 0;
+
+    pthread_mutex_lock(&process_boot_identity_mutex);
+    if (!has_process_boot_identity) {
+        // the cache is only used for the boot it was written in
+        struct timeval boot_time;
+        const int use_cache = cache_path && !cpid_get_boot_time(&boot_time);
+        if (!use_cache || cpid_load_boot_identity_cache(cache_path, &boot_time, &process_boot_identity)) {
+            return_code = cpid_source_boot_identity(&process_boot_identity);
+            if (!return_code && use_cache) {
+                cpid_store_boot_identity_cache(cache_path, &boot_time, &process_boot_identity);
+            }
+        }
+        // a failure is retried by the next call
+        has_process_boot_identity = !return_code;
+    }
+
+    if (!return_code) {
+        *boot_identity = process_boot_identity;
+    }
+    pthread_mutex_unlock(&process_boot_identity_mutex);
+
+    return return_code;
+}
+
+cpid_handle_t cpid_initialize_lazy(const char *const cache_path) {
+
+    cpid_macos_boot_identity_t boot_identity;
+    if (cpid_get_process_boot_identity(cache_path, &boot_identity)) {
+        return NULL;
+    }
+
+    return cpid_handle_from_boot_identity(&boot_identity, 1, 1);
+}
+
 void cpid_finalize(cpid_handle_t const library_handle) {
 
     cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
 
     if (library_handle_internal) {
+#ifndef CPID_BUILTIN_SHA256
         if (library_handle_internal->digest_context) {
             EVP_MD_CTX_free(library_handle_internal->digest_context);
         }
 
+        if (library_handle_internal->constant_prefix_digest_context) {
+            EVP_MD_CTX_free(library_handle_internal->constant_prefix_digest_context);
+        }
+
         if (library_handle_internal->sha256) {
             EVP_MD_free(library_handle_internal->sha256);
         }
+#endif
+
+        free(library_handle_internal->snapshot_process_info);
+        free(library_handle_internal->snapshot_entries);
 
         free(library_handle_internal);
     }
@@ -210,18 +455,33 @@ int cpid_make_uuid(cpid_handle_t const library_handle, const pid_t pid, const in
 
     cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
 
+    if (!library_handle_internal->digest_ready && cpid_initialize_digest_contexts(library_handle_internal)) {
+        return -1;
+    }
+
     // set the process-specific information
     library_handle_internal->digest_input_content.pid = pid;
     library_handle_internal->digest_input_content.process_creation_time.unix_epoch_seconds = creation_time_unix_epoch_seconds;
     library_handle_internal->digest_input_content.process_creation_time.micros_offset = creation_time_micros_offset;
 
+#ifdef CPID_BUILTIN_SHA256
+    // the tail fits in the final block, so its padding is laid out at compile time
+    #define MACOS_TAIL_SIZE (sizeof(digest_input_content_t) - MACOS_CONSTANT_PREFIX_SIZE)
+    _Static_assert(MACOS_TAIL_SIZE <= CPID_SHA256_MAX_TAIL_SIZE, "digest_input_content_t tail must fit in one SHA-256 block.");
+    cpid_sha256_finish(&library_handle_internal->constant_prefix_state, (const uint8_t *) &library_handle_internal->digest_input_content + MACOS_CONSTANT_PREFIX_SIZE, MACOS_TAIL_SIZE, sizeof(digest_input_content_t), library_handle_internal->digest_destination_buffer);
+#else
     // initialize digest context for new digest calculation
-    if (OPEN_SSL_SUCCESS != EVP_DigestInit_ex2(library_handle_internal->digest_context, library_handle_internal->sha256, NULL)) {
+    // starting from the midstate of the constant prefix
+    // both contexts are allocated once per handle and reused by every CPID UUID of it, including the
+    // cpid_snapshot_all batch, the copy only duplicates the provider state of the digest.
+    // OpenSSL 3.0 allocates that state on each copy (and on each EVP_DigestInit_ex2),
+    // CPID_BUILTIN_SHA256 copies the midstate by value and doesn't allocate per CPID UUID
+    if (OPEN_SSL_SUCCESS != EVP_MD_CTX_copy_ex(library_handle_internal->digest_context, library_handle_internal->constant_prefix_digest_context)) {
         return -1;
     }
 
-    // update digest with the input content
-    if (OPEN_SSL_SUCCESS != EVP_DigestUpdate(library_handle_internal->digest_context, &library_handle_internal->digest_input_content, sizeof(library_handle_internal->digest_input_content))) {
+    // update digest with the process-specific input content
+    if (OPEN_SSL_SUCCESS != EVP_DigestUpdate(library_handle_internal->digest_context, (const uint8_t *) &library_handle_internal->digest_input_content + MACOS_CONSTANT_PREFIX_SIZE, sizeof(library_handle_internal->digest_input_content) - MACOS_CONSTANT_PREFIX_SIZE)) {
         return -1;
     }
 
@@ -234,6 +494,7 @@ int cpid_make_uuid(cpid_handle_t const library_handle, const pid_t pid, const in
     } else if (SHA256_BUFFER_SIZE != digest_size) {
         return -1;
     }
+#endif
 
     #define UUID_VERSION_BYTE_INDEX 6
     #define UUID_VERSION_BIT_MASK 0x0F
@@ -257,6 +518,10 @@ int cpid_get_uuid(cpid_handle_t const library_handle, const pid_t pid, uuid_t uu
         return -1;
     }
 
+    if (!((cpid_handle_internal_t) library_handle)->local_boot_identity) {
+        return -1;
+    }
+
     process_creation_time_t process_creation_time;
 
     if (cpid_get_process_creation_time(pid, &process_creation_time)) {
@@ -270,6 +535,51 @@ int cpid_get_uuid(cpid_handle_t const library_handle, const pid_t pid, uuid_t uu
     return 0;
 }
 
+int cpid_get_process_record(cpid_handle_t const library_handle, const pid_t pid, const int flags, cpid_record_t *const record) {
+    if (!library_handle || !record || (flags & ~CPID_RECORD_PARENT_UUID)) {
+        return -1;
+    }
+
+    if (!((cpid_handle_internal_t) library_handle)->local_boot_identity) {
+        return -1;
+    }
+
+    memset(record, 0, sizeof(*record));
+    record->pid = pid;
+    record->parent_status = -1;
+
+    // the parent PID comes from the same sysctl as the creation time
+    process_creation_time_t process_creation_time;
+    if (cpid_get_process_info(pid, &process_creation_time, &record->parent_pid)) {
+        return -1;
+    }
+
+    record->creation_time_unix_epoch_seconds = process_creation_time.unix_epoch_seconds;
+    record->creation_time_micros_offset = (int32_t) process_creation_time.micros_offset;
+
+    if (cpid_make_uuid(library_handle, pid, record->creation_time_unix_epoch_seconds, record->creation_time_micros_offset, record->uuid)) {
+        return -1;
+    }
+
+    // kernel_task is its own parent
+    if ((flags & CPID_RECORD_PARENT_UUID) && record->parent_pid != pid) {
+        // The parent may have exited and its PID been reused since the sysctl.
+        // A process reusing the PID started after the child, which is treated as no parent.
+        process_creation_time_t parent_creation_time;
+        if (!cpid_get_process_creation_time(record->parent_pid, &parent_creation_time)
+            && (parent_creation_time.unix_epoch_seconds < process_creation_time.unix_epoch_seconds
+                || (parent_creation_time.unix_epoch_seconds == process_creation_time.unix_epoch_seconds
+                    && parent_creation_time.micros_offset <= process_creation_time.micros_offset))
+            && !cpid_make_uuid(library_handle, record->parent_pid, parent_creation_time.unix_epoch_seconds, (int32_t) parent_creation_time.micros_offset, record->parent_uuid)) {
+            record->parent_status = 0;
+        } else {
+            memset(record->parent_uuid, 0, sizeof(uuid_t));
+        }
+    }
+
+    return 0;
+}
+
 int cpid_get_uuid_string(cpid_handle_t const library_handle, const pid_t pid, uuid_string_t uuid_string) {
 
     if (!library_handle || !uuid_string) {
@@ -281,14 +591,98 @@ int cpid_get_uuid_string(cpid_handle_t const library_handle, const pid_t pid, uu
     if (cpid_get_uuid(library_handle, pid, uuid)) {
         return -1;
     }
-    
-    uuid_unparse(uuid, uuid_string);
 
-    // MacOS libuuid returns uppercase uuid string
-    // normalize to lowercase
-    for (size_t i = 0; i < sizeof(uuid_string_t); i++) {
-        uuid_string[i] = (char) tolower(uuid_string[i]);
+    // MacOS libuuid returns uppercase uuid strings, the shared formatter is lowercase
+    return cpid_format_batch(uuid, 1, uuid_string, sizeof(uuid_string_t));
+}
+
+// Read the kinfo_proc of every process into the handle's reusable buffer.
+// The buffer only grows, so repeated snapshots normally cost one probe
+// and one read sysctl with no allocation.
+static int cpid_get_all_process_info(cpid_handle_internal_t library_handle_internal, size_t *const process_count) {
+    int mib[3] = {CTL_KERN, KERN_PROC, KERN_PROC_ALL};
+
+    // processes may be created between the probe and the read
+    // in which case the read fails with ENOMEM and the probe is retried
+    #define SNAPSHOT_MAX_ATTEMPTS 8
+    for (int attempt = 0; attempt < SNAPSHOT_MAX_ATTEMPTS; attempt++) {
+        size_t info_size = 0;
+        if (sysctl(mib, 3, NULL, &info_size, NULL, 0)) {
+            return -1;
+        }
+
+        // leave headroom for processes created after the probe
+        #define SNAPSHOT_HEADROOM_DIVISOR 8
+        size_t required_count = info_size / sizeof(struct kinfo_proc);
+        required_count += required_count / SNAPSHOT_HEADROOM_DIVISOR + 1;
+
+        if (required_count > library_handle_internal->snapshot_process_info_capacity) {
+            struct kinfo_proc *process_info = realloc(library_handle_internal->snapshot_process_info, required_count * sizeof(struct kinfo_proc));
+            if (!process_info) {
+                return -1;
+            }
+            library_handle_internal->snapshot_process_info = process_info;
+            library_handle_internal->snapshot_process_info_capacity = required_count;
+        }
+
+        info_size = library_handle_internal->snapshot_process_info_capacity * sizeof(struct kinfo_proc);
+        if (0 == sysctl(mib, 3, library_handle_internal->snapshot_process_info, &info_size, NULL, 0)) {
+            *process_count = info_size / sizeof(struct kinfo_proc);
+            return 0;
+        }
+
+        if (ENOMEM != errno) {
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+int cpid_snapshot_all(cpid_handle_t const library_handle, const cpid_entry_t **const entries, size_t *const count) {
+    if (!library_handle || !entries || !count) {
+        return -1;
+    }
+
+    cpid_handle_internal_t library_handle_internal = (cpid_handle_internal_t) library_handle;
+
+    if (!library_handle_internal->local_boot_identity) {
+        return -1;
+    }
+
+    size_t process_count = 0;
+    if (cpid_get_all_process_info(library_handle_internal, &process_count)) {
+        return -1;
+    }
+
+    if (process_count > library_handle_internal->snapshot_entries_capacity) {
+        cpid_entry_t *snapshot_entries = realloc(library_handle_internal->snapshot_entries, process_count * sizeof(cpid_entry_t));
+        if (!snapshot_entries) {
+            return -1;
+        }
+        library_handle_internal->snapshot_entries = snapshot_entries;
+        library_handle_internal->snapshot_entries_capacity = process_count;
+    }
+
+    size_t entry_count = 0;
+    for (size_t i = 0; i < process_count; i++) {
+        const struct extern_proc *const process = &library_handle_internal->snapshot_process_info[i].kp_proc;
+
+        // processes without a start time are rejected by cpid_get_uuid as well
+        if (0 == process->p_starttime.tv_sec) {
+            continue;
+        }
+
+        cpid_entry_t *const entry = &library_handle_internal->snapshot_entries[entry_count];
+        entry->pid = process->p_pid;
+        if (cpid_make_uuid(library_handle, process->p_pid, process->p_starttime.tv_sec, process->p_starttime.tv_usec, entry->uuid)) {
+            return -1;
+        }
+        entry_count++;
     }
 
+    *entries = library_handle_internal->snapshot_entries;
+    *count = entry_count;
+
     return 0;
 }
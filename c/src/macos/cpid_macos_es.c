@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <bsm/libbsm.h>
+#include <EndpointSecurity/EndpointSecurity.h>
+
+#include "cpid/cpid_macos_es.h"
+#include "cpid_macos_internal.h"
+
+// events queued between the Endpoint Security handler and cpid_es_next_batch, more are dropped
+#define ES_QUEUE_CAPACITY 65536
+// events are taken off the queue in batches of this size, so the handler isn't held up by the hashing
+#define ES_HASH_BATCH_SIZE 64
+// es_process_t.start_time is populated from this message version on
+#define ES_START_TIME_MESSAGE_VERSION 3
+
+typedef struct {
+    pid_t pid;
+    cpid_es_event_t event;
+    // 0 if the message predates start_time, the CPID UUID is then sourced by PID
+    int has_start_time;
+    int32_t start_time_micros_offset;
+    int64_t start_time_unix_epoch_seconds;
+} es_queued_event_t;
+
+typedef struct {
+    cpid_handle_t library_handle;
+    es_client_t *client;
+    int sync_initialized;
+    pthread_mutex_t mutex;
+    pthread_cond_t queue_not_empty;
+    es_queued_event_t *queue;
+    size_t queue_head;
+    size_t queue_count;
+    uint64_t lost_count;
+} *cpid_es_internal_t;
+
+int cpid_make_uuid_from_es_process(cpid_handle_t const library_handle, const es_process_t *const process, const uint32_t message_version, uuid_t uuid) {
+    if (!library_handle || !process || !uuid) {
+        return -1;
+    }
+
+    // the messages are of the local boot, a given boot identity would give them the CPID UUIDs of another
+    if (cpid_macos_is_offline(library_handle)) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    const pid_t pid = audit_token_to_pid(process->audit_token);
+    if (message_version < ES_START_TIME_MESSAGE_VERSION) {
+        return cpid_get_uuid(library_handle, pid, uuid);
+    }
+
+    return cpid_make_uuid(library_handle, pid, process->start_time.tv_sec, (int32_t) process->start_time.tv_usec, uuid);
+}
+
+// Called on the queue of the Endpoint Security client, the message is only valid during the call.
+static void enqueue_message(cpid_es_internal_t const es_internal, const es_message_t *const message) {
+    es_queued_event_t queued_event;
+    memset(&queued_event, 0, sizeof(queued_event));
+
+    const es_process_t *process = message->process;
+    switch (message->event_type) {
+        case ES_EVENT_TYPE_NOTIFY_FORK:
+            process = message->event.fork.child;
+            queued_event.event = CPID_ES_EVENT_FORK;
+            break;
+        case ES_EVENT_TYPE_NOTIFY_EXEC:
+            // exec keeps the PID and start time of the process, and so its CPID UUID
+            queued_event.event = CPID_ES_EVENT_EXEC;
+            break;
+        case ES_EVENT_TYPE_NOTIFY_EXIT:
+            queued_event.event = CPID_ES_EVENT_EXIT;
+            break;
+        default:
+            return;
+    }
+
+    queued_event.pid = audit_token_to_pid(process->audit_token);
+    if (message->version >= ES_START_TIME_MESSAGE_VERSION) {
+        queued_event.has_start_time = 1;
+        queued_event.start_time_unix_epoch_seconds = process->start_time.tv_sec;
+        queued_event.start_time_micros_offset = (int32_t) process->start_time.tv_usec;
+    }
+
+    pthread_mutex_lock(&es_internal->mutex);
+    if (ES_QUEUE_CAPACITY == es_internal->queue_count) {
+        es_internal->lost_count++;
+    } else {
+        es_internal->queue[(es_internal->queue_head + es_internal->queue_count) % ES_QUEUE_CAPACITY] = queued_event;
+        es_internal->queue_count++;
+        pthread_cond_signal(&es_internal->queue_not_empty);
+    }
+    pthread_mutex_unlock(&es_internal->mutex);
+}
+
+cpid_es_t cpid_es_open(cpid_handle_t const library_handle) {
+    if (!library_handle) {
+        return NULL;
+    }
+
+    // the events are of the local boot, a given boot identity would give them the CPID UUIDs of another
+    if (cpid_macos_is_offline(library_handle)) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+
+    cpid_es_internal_t es_internal = calloc(1, sizeof(*es_internal));
+    if (!es_internal) {
+        return NULL;
+    }
+
+    es_internal->library_handle = library_handle;
+
+    int return_code = 0;
+    do {
+        es_internal->queue = calloc(ES_QUEUE_CAPACITY, sizeof(es_queued_event_t));
+        if (!es_internal->queue) {
+            return_code = -1;
+            break;
+        }
+
+        if (pthread_mutex_init(&es_internal->mutex, NULL)) {
+            return_code = -1;
+            break;
+        }
+        if (pthread_cond_init(&es_internal->queue_not_empty, NULL)) {
+            pthread_mutex_destroy(&es_internal->mutex);
+            return_code = -1;
+            break;
+        }
+        es_internal->sync_initialized = 1;
+
+        es_new_client_result_t result = es_new_client(&es_internal->client, ^(es_client_t *client, const es_message_t *message) {
+            (void) client;
+            enqueue_message(es_internal, message);
+        });
+        if (ES_NEW_CLIENT_RESULT_SUCCESS != result) {
+            es_internal->client = NULL;
+            if (ES_NEW_CLIENT_RESULT_ERR_NOT_ENTITLED == result || ES_NEW_CLIENT_RESULT_ERR_NOT_PERMITTED == result
+                    || ES_NEW_CLIENT_RESULT_ERR_NOT_PRIVILEGED == result) {
+                errno = EPERM;
+            }
+            return_code = -1;
+            break;
+        }
+
+        es_event_type_t events[] = {ES_EVENT_TYPE_NOTIFY_FORK, ES_EVENT_TYPE_NOTIFY_EXEC, ES_EVENT_TYPE_NOTIFY_EXIT};
+        if (ES_RETURN_SUCCESS != es_subscribe(es_internal->client, events, sizeof(events) / sizeof(events[0]))) {
+            return_code = -1;
+        }
+    } while(0);
+
+    if (return_code) {
+        cpid_es_close(es_internal);
+        es_internal = NULL;
+    }
+
+    return es_internal;
+}
+
+void cpid_es_close(cpid_es_t const es) {
+
+    cpid_es_internal_t es_internal = (cpid_es_internal_t) es;
+
+    if (es_internal) {
+        // no message is handled once the client is deleted
+        if (es_internal->client) {
+            es_unsubscribe_all(es_internal->client);
+            es_delete_client(es_internal->client);
+        }
+
+        if (es_internal->sync_initialized) {
+            pthread_cond_destroy(&es_internal->queue_not_empty);
+            pthread_mutex_destroy(&es_internal->mutex);
+        }
+
+        free(es_internal->queue);
+        free(es_internal);
+    }
+}
+
+static void wait_for_events(cpid_es_internal_t const es_internal, const int timeout_ms) {
+    if (timeout_ms < 0) {
+        while (0 == es_internal->queue_count) {
+            pthread_cond_wait(&es_internal->queue_not_empty, &es_internal->mutex);
+        }
+        return;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    long deadline_nanos = (long) now.tv_usec * 1000 + (long) (timeout_ms % 1000) * 1000000;
+    struct timespec deadline = {
+        .tv_sec = now.tv_sec + timeout_ms / 1000 + deadline_nanos / 1000000000,
+        .tv_nsec = deadline_nanos % 1000000000,
+    };
+    while (0 == es_internal->queue_count) {
+        if (ETIMEDOUT == pthread_cond_timedwait(&es_internal->queue_not_empty, &es_internal->mutex, &deadline)) {
+            break;
+        }
+    }
+}
+
+int cpid_es_next_batch(cpid_es_t const es, cpid_es_record_t *const records, const size_t capacity, size_t *const count, const int timeout_ms) {
+    if (!es || !records || 0 == capacity || !count) {
+        return -1;
+    }
+
+    cpid_es_internal_t es_internal = (cpid_es_internal_t) es;
+    *count = 0;
+
+    pthread_mutex_lock(&es_internal->mutex);
+    if (timeout_ms) {
+        wait_for_events(es_internal, timeout_ms);
+    }
+    pthread_mutex_unlock(&es_internal->mutex);
+
+    while (*count < capacity) {
+        es_queued_event_t pending_events[ES_HASH_BATCH_SIZE];
+        size_t pending_count = 0;
+
+        pthread_mutex_lock(&es_internal->mutex);
+        while (es_internal->queue_count && pending_count < ES_HASH_BATCH_SIZE && *count + pending_count < capacity) {
+            pending_events[pending_count++] = es_internal->queue[es_internal->queue_head];
+            es_internal->queue_head = (es_internal->queue_head + 1) % ES_QUEUE_CAPACITY;
+            es_internal->queue_count--;
+        }
+        pthread_mutex_unlock(&es_internal->mutex);
+
+        if (0 == pending_count) {
+            break;
+        }
+
+        for (size_t i = 0; i < pending_count; i++) {
+            const es_queued_event_t *const pending_event = &pending_events[i];
+            cpid_es_record_t *const record = &records[(*count)++];
+            record->pid = pending_event->pid;
+            record->event = pending_event->event;
+            if (pending_event->has_start_time) {
+                record->status = cpid_make_uuid(es_internal->library_handle, pending_event->pid, pending_event->start_time_unix_epoch_seconds, pending_event->start_time_micros_offset, record->uuid);
+            } else {
+                record->status = cpid_get_uuid(es_internal->library_handle, pending_event->pid, record->uuid);
+            }
+            if (record->status) {
+                record->status = -1;
+                memset(record->uuid, 0, sizeof(uuid_t));
+            }
+        }
+    }
+
+    return 0;
+}
+
+int cpid_es_get_lost_count(cpid_es_t const es, uint64_t *const lost_count) {
+    if (!es || !lost_count) {
+        return -1;
+    }
+
+    cpid_es_internal_t es_internal = (cpid_es_internal_t) es;
+    pthread_mutex_lock(&es_internal->mutex);
+    *lost_count = es_internal->lost_count;
+    pthread_mutex_unlock(&es_internal->mutex);
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "cpid/cpid_macos.h"
+
+/**
+ * Tells whether a handle was initialized with a given boot identity, see cpid_initialize_with_boot_identity.
+ *
+ * @return 1 if the handle can't be used with processes of the local boot, 0 otherwise.
+ */
+int cpid_macos_is_offline(cpid_handle_t const library_handle);
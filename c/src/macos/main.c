@@ -2,40 +2,109 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
+#include "cpid/cpid_format.h"
 #include "cpid/cpid_macos.h"
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Exactly one program argument equal to the process PID is required.\n");
-    }
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
 
+typedef enum {
+    OUTPUT_FORMAT_CSV,
+    OUTPUT_FORMAT_NDJSON,
+} output_format_t;
+
+static int parse_pid(const char *const text, pid_t *const pid) {
     char *endptr = NULL;
-    long parsed_pid = strtol(argv[1], &endptr, 10);
-    if (endptr == NULL || endptr == argv[1] || *endptr != '\0') {
-        fprintf(stderr, "Error parsing supplied PID.\n");
+    long parsed_pid = strtol(text, &endptr, 10);
+    if (endptr == NULL || endptr == text || (*endptr != '\0' && *endptr != '\n' && *endptr != '\r')) {
         return -1;
     }
 
     if (parsed_pid < INT_MIN || parsed_pid > INT_MAX) {
-        fprintf(stderr, "Supplied PID must be a valid 32-bit integer.\n");
         return -1;
     }
 
-    pid_t pid =  (pid_t) parsed_pid;
+    *pid = (pid_t) parsed_pid;
+    return 0;
+}
+
+static void write_header(const output_format_t format) {
+    if (OUTPUT_FORMAT_CSV == format) {
+        fputs("pid,cpid\n", stdout);
+    }
+}
+
+static void write_record(const output_format_t format, const pid_t pid, const uuid_t uuid) {
     uuid_string_t uuid_string = {0};
+    cpid_format_batch(uuid, 1, uuid_string, sizeof(uuid_string_t));
 
-    cpid_handle_t cpid_handle = cpid_initialize();
-    if (NULL == cpid_handle) {
-        fprintf(stderr, "Failed to initialize cpid_instance_t.\n");
+    if (OUTPUT_FORMAT_CSV == format) {
+        printf("%d,%s\n", pid, uuid_string);
+    } else {
+        printf("{\"pid\":%d,\"cpid\":\"%s\"}\n", pid, uuid_string);
+    }
+}
+
+static int run_stdin(const output_format_t format, cpid_handle_t const handle) {
+    write_header(format);
+
+    #define LINE_BUFFER_SIZE 64
+    char line[LINE_BUFFER_SIZE];
+    size_t line_number = 0;
+    while (fgets(line, LINE_BUFFER_SIZE, stdin)) {
+        line_number++;
+
+        // blank lines are skipped quietly
+        if ('\n' == line[0] || ('\r' == line[0] && '\n' == line[1])) {
+            continue;
+        }
+
+        // the rest of an overlong line is discarded, it can't be a PID
+        size_t length = strlen(line);
+        int overlong = '\n' != line[length - 1] && !feof(stdin);
+        for (int c = 0; overlong && EOF != (c = getchar()) && '\n' != c;) {
+        }
+
+        pid_t pid = 0;
+        if (overlong || parse_pid(line, &pid)) {
+            fprintf(stderr, "Skipping line %zu, it is not a PID.\n", line_number);
+            continue;
+        }
+
+        // PIDs whose CPID can't be calculated are reported and skipped like lines that aren't PIDs
+        uuid_t uuid = {0};
+        if (cpid_get_uuid(handle, pid, uuid)) {
+            fprintf(stderr, "Skipping line %zu, the CPID of PID %d can't be calculated.\n", line_number, pid);
+            continue;
+        }
+        write_record(format, pid, uuid);
+    }
+
+    return ferror(stdin) ? -1 : 0;
+}
+
+static int run_all(const output_format_t format, cpid_handle_t const handle) {
+    const cpid_entry_t *entries = NULL;
+    size_t count = 0;
+    if (cpid_snapshot_all(handle, &entries, &count)) {
+        fprintf(stderr, "Failed to enumerate processes.\n");
         return -1;
     }
 
-    int return_code = cpid_get_uuid_string(cpid_handle, pid, uuid_string);
+    write_header(format);
+    for (size_t i = 0; i < count; i++) {
+        write_record(format, entries[i].pid, entries[i].uuid);
+    }
 
-    cpid_finalize(cpid_handle);
+    return 0;
+}
 
+static int run_single(cpid_handle_t const handle, const pid_t pid) {
+    uuid_string_t uuid_string = {0};
+
+    int return_code = cpid_get_uuid_string(handle, pid, uuid_string);
     if (return_code) {
         fprintf(stderr, "Failed to calculate CPID.\n");
     } else {
@@ -44,3 +113,80 @@ int main(int argc, char *argv[]) {
 
     return return_code;
 }
+
+static void print_usage(const char *const program) {
+    fprintf(stderr,
+            "Usage: %s <PID>\n"
+            "       %s [--format csv|ndjson] --stdin\n"
+            "       %s [--format csv|ndjson] --all\n"
+            "\n"
+            "  --stdin    calculate the CPID of every PID read from stdin, one per line\n"
+            "  --all      calculate the CPID of every running process\n"
+            "  --format   output pid,cpid CSV lines (default) or NDJSON objects\n",
+            program, program, program);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    int read_stdin = 0;
+    int read_all = 0;
+    output_format_t format = OUTPUT_FORMAT_CSV;
+    pid_t pid = 0;
+    if (2 == argc && '-' != argv[1][0]) {
+        if (parse_pid(argv[1], &pid) || strchr(argv[1], '\n')) {
+            fprintf(stderr, "Error parsing supplied PID.\n");
+            return -1;
+        }
+    } else {
+        for (int i = 1; i < argc; i++) {
+            if (!strcmp(argv[i], "--stdin")) {
+                read_stdin = 1;
+            } else if (!strcmp(argv[i], "--all")) {
+                read_all = 1;
+            } else if (!strcmp(argv[i], "--format") && i + 1 < argc && !strcmp(argv[i + 1], "csv")) {
+                format = OUTPUT_FORMAT_CSV;
+                i++;
+            } else if (!strcmp(argv[i], "--format") && i + 1 < argc && !strcmp(argv[i + 1], "ndjson")) {
+                format = OUTPUT_FORMAT_NDJSON;
+                i++;
+            } else {
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+
+        if (read_stdin == read_all) {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    cpid_handle_t cpid_handle = cpid_initialize();
+    if (NULL == cpid_handle) {
+        fprintf(stderr, "Failed to initialize cpid_instance_t.\n");
+        return -1;
+    }
+
+    int return_code = 0;
+    if (read_stdin || read_all) {
+        // output is fully buffered, even when it goes to a terminal
+        static char output_buffer[OUTPUT_BUFFER_SIZE];
+        setvbuf(stdout, output_buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+        return_code = read_stdin ? run_stdin(format, cpid_handle) : run_all(format, cpid_handle);
+
+        if (fflush(stdout)) {
+            return_code = -1;
+        }
+    } else {
+        return_code = run_single(cpid_handle, pid);
+    }
+
+    cpid_finalize(cpid_handle);
+
+    return return_code;
+}
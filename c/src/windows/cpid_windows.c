@@ -1,8 +1,12 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <cpid/cpid_windows.h>
+#include "cpid_windows_internal.h"
 #include <winternl.h>
 #include <bcrypt.h>
+#include <aclapi.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 
@@ -10,11 +14,11 @@ extern NTSTATUS WINAPI RtlGetVersion(_Out_ OSVERSIONINFOW* versionInfo);
 
 #define SYSTEM_PID 4
 
-static DWORD get_process_creation_time(_In_ const DWORD pid,
-                                       _Out_ UINT64* const pct)
+static DWORD get_process_handle_info(_In_ const HANDLE processHandle,
+                                     _Out_ UINT64* const pct,
+                                     _Out_opt_ DWORD* const parentPid)
 {
     DWORD w32err = ERROR_SUCCESS;
-    HANDLE processHandle = NULL;
 
     // Check that the out parameter is non-null.
     if (!pct)
@@ -23,24 +27,56 @@ static DWORD get_process_creation_time(_In_ const DWORD pid,
         goto Exit;
     }
 
-    // Open the process with sufficient access to query the creation time.
-    processHandle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
-    if (!processHandle)
+    // Get the various timestamps associated with process.
+    FILETIME _;
+    if (!GetProcessTimes(processHandle, (FILETIME*)pct, &_, &_, &_))
     {
         w32err = GetLastError();
         assert(ERROR_SUCCESS != w32err);
         goto Exit;
     }
 
-    // Get the various timestamps associated with process.
-    FILETIME _;
-    if (!GetProcessTimes(processHandle, (FILETIME*)pct, &_, &_, &_))
+    // Get the parent PID from the same process handle if requested. The
+    // InheritedFromUniqueProcessId member is named Reserved3 in winternl.h.
+    if (parentPid)
+    {
+        PROCESS_BASIC_INFORMATION basicInformation;
+        const NTSTATUS status = NtQueryInformationProcess(processHandle,
+                                                          ProcessBasicInformation,
+                                                          &basicInformation,
+                                                          sizeof(basicInformation),
+                                                          NULL);
+        if (!NT_SUCCESS(status))
+        {
+            w32err = RtlNtStatusToDosError(status);
+            assert(ERROR_SUCCESS != w32err);
+            goto Exit;
+        }
+        *parentPid = (DWORD)(ULONG_PTR)basicInformation.Reserved3;
+    }
+
+Exit:
+    return w32err;
+}
+
+static DWORD get_process_info(_In_ const DWORD pid,
+                              _Out_ UINT64* const pct,
+                              _Out_opt_ DWORD* const parentPid)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    HANDLE processHandle = NULL;
+
+    // Open the process with sufficient access to query the creation time.
+    processHandle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!processHandle)
     {
         w32err = GetLastError();
         assert(ERROR_SUCCESS != w32err);
         goto Exit;
     }
 
+    w32err = get_process_handle_info(processHandle, pct, parentPid);
+
 Exit:
     if (processHandle)
     {
@@ -49,34 +85,66 @@ Exit:
     return w32err;
 }
 
+static DWORD get_process_creation_time(_In_ const DWORD pid,
+                                       _Out_ UINT64* const pct)
+{
+    return get_process_info(pid, pct, NULL);
+}
+
 typedef struct _CPID_LIBRARY_DATA
 {
     UUID MachineGuid;
     UINT64 BootTime;
     BCRYPT_ALG_HANDLE Sha256AlgHandle;
+    // Set when the boot identity was supplied by the caller, in which case
+    // processes of the local boot can't be sourced.
+    BOOL IsOffline;
+    // Set for handles from cpid_initialize_lazy(), which have no algorithm
+    // handle of their own but share the one opened by the first hash.
+    BOOL IsLazy;
 } CPID_LIBRARY_DATA;
 
-DWORD cpid_initialize(_Out_ HANDLE* const libraryHandle)
+// Sets *algHandle to NULL where the SHA256 pseudo-handle can be used instead.
+static DWORD open_sha256_algorithm(_Out_ BCRYPT_ALG_HANDLE* const algHandle)
 {
-    DWORD w32err = ERROR_SUCCESS;
-    CPID_LIBRARY_DATA* libraryData = NULL;
+    *algHandle = NULL;
 
-    // Check that parameter is non-null.
-    if (!libraryHandle)
+    // Get the Windows version information.
+    RTL_OSVERSIONINFOW versionInfo;
+    versionInfo.dwOSVersionInfoSize = sizeof(versionInfo);
+    NTSTATUS status = RtlGetVersion(&versionInfo);
+    if (!NT_SUCCESS(status))
     {
-        w32err = ERROR_INVALID_PARAMETER;
-        goto Exit;
+        const DWORD w32err = RtlNtStatusToDosError(status);
+        assert(ERROR_SUCCESS != w32err);
+        return w32err;
     }
-    *libraryHandle = NULL;
 
-    // Allocate a zero-initialised instance of the library data structure.
-    libraryData = calloc(1, sizeof(CPID_LIBRARY_DATA));
-    if (!libraryData)
+    // Determine if we're on a pre-Win10 version.
+    if (versionInfo.dwMajorVersion < 10)
     {
-        w32err = ERROR_OUTOFMEMORY;
-        goto Exit;
+        // No pseudo-handles to crypto algorithms before Win10 so we must get a
+        // real handle to the SHA256 algorithm.
+        status = BCryptOpenAlgorithmProvider(algHandle,
+                                             BCRYPT_SHA256_ALGORITHM,
+                                             NULL,
+                                             0);
+        if (!NT_SUCCESS(status))
+        {
+            const DWORD w32err = RtlNtStatusToDosError(status);
+            assert(ERROR_SUCCESS != w32err);
+            return w32err;
+        }
     }
 
+    return ERROR_SUCCESS;
+}
+
+static DWORD source_boot_identity(_Out_ UUID* const machineGuid,
+                                  _Out_ UINT64* const bootTime)
+{
+    DWORD w32err = ERROR_SUCCESS;
+
     // Determine if the current process is WOW64.
     BOOL isWow64;
     if (!IsWow64Process(GetCurrentProcess(), &isWow64))
@@ -102,45 +170,56 @@ DWORD cpid_initialize(_Out_ HANDLE* const libraryHandle)
     }
 
     // Parse the machine GUID which is stored in RFC UUID format.
-    w32err = UuidFromStringA((RPC_CSTR)value, &libraryData->MachineGuid);
+    w32err = UuidFromStringA((RPC_CSTR)value, machineGuid);
     if (ERROR_SUCCESS != w32err)
     {
         goto Exit;
     }
 
     // Use creation time of the System process as a proxy for boot time.
-    w32err = get_process_creation_time(SYSTEM_PID, &libraryData->BootTime);
+    w32err = get_process_creation_time(SYSTEM_PID, bootTime);
     if (ERROR_SUCCESS != w32err)
     {
         goto Exit;
     }
 
-    // Get the Windows version information.
-    RTL_OSVERSIONINFOW versionInfo;
-    versionInfo.dwOSVersionInfoSize = sizeof(versionInfo);
-    NTSTATUS status = RtlGetVersion(&versionInfo);
-    if (!NT_SUCCESS(status))
+Exit:
+    return w32err;
+}
+
+DWORD cpid_initialize(_Out_ HANDLE* const libraryHandle)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    CPID_LIBRARY_DATA* libraryData = NULL;
+
+    // Check that parameter is non-null.
+    if (!libraryHandle)
     {
-        w32err = RtlNtStatusToDosError(status);
-        assert(ERROR_SUCCESS != w32err);
+        w32err = ERROR_INVALID_PARAMETER;
         goto Exit;
     }
+    *libraryHandle = NULL;
 
-    // Determine if we're on a pre-Win10 version.
-    if (versionInfo.dwMajorVersion < 10)
+    // Allocate a zero-initialised instance of the library data structure.
+    libraryData = calloc(1, sizeof(CPID_LIBRARY_DATA));
+    if (!libraryData)
     {
-        // No pseudo-handles to crypto algorithms before Win10 so we must get a
-        // real handle to the SHA256 algorithm.
-        status = BCryptOpenAlgorithmProvider(&libraryData->Sha256AlgHandle,
-                                             BCRYPT_SHA256_ALGORITHM,
-                                             NULL,
-                                             0);
-        if (!NT_SUCCESS(status))
-        {
-            w32err = RtlNtStatusToDosError(status);
-            assert(ERROR_SUCCESS != w32err);
-            goto Exit;
-        }
+        w32err = ERROR_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    // Read the boot identity from the registry and System process.
+    w32err = source_boot_identity(&libraryData->MachineGuid, &libraryData->BootTime);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    // Get a handle to the SHA256 algorithm where one is needed.
+    w32err = open_sha256_algorithm(&libraryData->Sha256AlgHandle);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
     }
 
     // Use address of library data as an opaque handle to the library.
@@ -154,146 +233,1056 @@ Exit:
     return w32err;
 }
 
-DWORD cpid_finalize(_In_ const HANDLE libraryHandle)
+DWORD cpid_initialize_with_boot_identity(_In_ const UUID* const machineGuid,
+                                         _In_ const UINT64 bootTime,
+                                         _Out_ HANDLE* const libraryHandle)
 {
     DWORD w32err = ERROR_SUCCESS;
     CPID_LIBRARY_DATA* libraryData = NULL;
 
-    // Check that parameter is non-null.
+    // Check that parameters are non-null.
     if (!libraryHandle)
     {
-        w32err = ERROR_INVALID_HANDLE;
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+    *libraryHandle = NULL;
+    if (!machineGuid)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
         goto Exit;
     }
-    libraryData = libraryHandle;
 
-    // Determine if we obtained a handle to the SHA256 algorithm.
-    if (libraryData->Sha256AlgHandle)
+    // Allocate a zero-initialised instance of the library data structure.
+    libraryData = calloc(1, sizeof(CPID_LIBRARY_DATA));
+    if (!libraryData)
     {
-        // Close the SHA256 algorithm handle.
-        const NTSTATUS status = BCryptCloseAlgorithmProvider(libraryData->Sha256AlgHandle, 0);
-        if (!NT_SUCCESS(status))
-        {
-            w32err = RtlNtStatusToDosError(status);
-            assert(ERROR_SUCCESS != w32err);
-            goto Exit;
-        }
+        w32err = ERROR_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    // Take the boot identity as given rather than from the local registry
+    // and System process.
+    libraryData->MachineGuid = *machineGuid;
+    libraryData->BootTime = bootTime;
+    libraryData->IsOffline = TRUE;
+
+    // Get a handle to the SHA256 algorithm where one is needed.
+    w32err = open_sha256_algorithm(&libraryData->Sha256AlgHandle);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
     }
+
+    // Use address of library data as an opaque handle to the library.
+    *libraryHandle = libraryData;
+
 Exit:
-    if (libraryData)
+    if (ERROR_SUCCESS != w32err)
     {
         free(libraryData);
     }
     return w32err;
 }
 
-// Set packing level explicitly to ensure no padding in the struct. It is vital
-// that the constituent parts of the message data are laid out back-to-back in
-// memory.
-#pragma pack(push, 1)
+#define BOOT_IDENTITY_CACHE_MAGIC 0x43504944
+#define BOOT_IDENTITY_CACHE_VERSION 1
 
-typedef struct _CPID_MESSAGE_DATA
+// Only read back by the same library build, so the layout is the native one.
+typedef struct _CPID_BOOT_IDENTITY_CACHE
 {
-    UUID    MachineGuid;
-    UINT64  BootTime;
-    UINT64  CreationTime;
-    UINT64  ProcessId;
-} CPID_MESSAGE_DATA;
-
-#pragma pack(pop)
+    UINT32 Magic;
+    UINT32 Version;
+    // Kernel boot time of the boot the identity was sourced in.
+    UINT64 KernelBootTime;
+    UUID MachineGuid;
+    UINT64 BootTime;
+} CPID_BOOT_IDENTITY_CACHE;
 
-#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+static DWORD get_kernel_boot_time(_Out_ UINT64* const kernelBootTime)
+{
+    DWORD w32err = ERROR_SUCCESS;
 
-// We have C11 or higher so do a compile time check to ensure no padding.
-static_assert(sizeof(CPID_MESSAGE_DATA) == (sizeof(((CPID_MESSAGE_DATA*)NULL)->MachineGuid) +
-                                            sizeof(((CPID_MESSAGE_DATA*)NULL)->BootTime) +
-                                            sizeof(((CPID_MESSAGE_DATA*)NULL)->CreationTime) +
-                                            sizeof(((CPID_MESSAGE_DATA*)NULL)->ProcessId)),
-              "The CPID_MESSAGE_DATA structure has an unexpected size.");
+    // The BootTime member starts the block named Reserved1 in winternl.h. The
+    // kernel moves it along with the system clock, which costs a cache miss.
+    SYSTEM_TIMEOFDAY_INFORMATION timeOfDayInformation;
+    const NTSTATUS status = NtQuerySystemInformation(SystemTimeOfDayInformation,
+                                                     &timeOfDayInformation,
+                                                     sizeof(timeOfDayInformation),
+                                                     NULL);
+    if (!NT_SUCCESS(status))
+    {
+        w32err = RtlNtStatusToDosError(status);
+        assert(ERROR_SUCCESS != w32err);
+        goto Exit;
+    }
+    memcpy(kernelBootTime, timeOfDayInformation.Reserved1, sizeof(*kernelBootTime));
 
-#endif
+Exit:
+    return w32err;
+}
 
-DWORD cpid_make_cpid(_In_ const HANDLE libraryHandle,
-                     _In_ const DWORD pid,
-                     _In_ const UINT64 pct,
-                     _Out_ UUID* const cpid)
+// The returned buffer is freed with free().
+static DWORD get_process_user(_Outptr_ TOKEN_USER** const tokenUser)
 {
     DWORD w32err = ERROR_SUCCESS;
-    CPID_LIBRARY_DATA* libraryData = NULL;
+    HANDLE token = NULL;
+    TOKEN_USER* user = NULL;
 
-    // Check that parameters are non-null.
-    if (!libraryHandle)
+    *tokenUser = NULL;
+
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token))
     {
-        w32err = ERROR_INVALID_HANDLE;
+        w32err = GetLastError();
+        assert(ERROR_SUCCESS != w32err);
         goto Exit;
     }
-    if (!cpid)
+
+    DWORD size = 0;
+    if (!GetTokenInformation(token, TokenUser, NULL, 0, &size) &&
+        ERROR_INSUFFICIENT_BUFFER != GetLastError())
     {
-        w32err = ERROR_INVALID_PARAMETER;
+        w32err = GetLastError();
+        assert(ERROR_SUCCESS != w32err);
         goto Exit;
     }
 
-    // Cast the caller-supplied handle to the library data structure.
-    libraryData = libraryHandle;
-
-    // Fill out the message data that is hashed to get the CPID.
-    const CPID_MESSAGE_DATA messageData =
+    user = malloc(size);
+    if (!user)
     {
-        libraryData->MachineGuid,
-        libraryData->BootTime,
-        pct,
-        pid,
-    };
+        w32err = ERROR_NOT_ENOUGH_MEMORY;
+        goto Exit;
+    }
 
-    // Hash the stucture using SHA256.
-    UCHAR sha256Digest[32];
-    const NTSTATUS status = BCryptHash(libraryData->Sha256AlgHandle
-                                       ? libraryData->Sha256AlgHandle
-                                       : BCRYPT_SHA256_ALG_HANDLE,
-                                       NULL,
-                                       0,
-                                       (UCHAR*)&messageData,
-                                       sizeof(messageData),
-                                       sha256Digest,
-                                       sizeof(sha256Digest));
-    if (!NT_SUCCESS(status))
+    if (!GetTokenInformation(token, TokenUser, user, size, &size))
     {
-        w32err = RtlNtStatusToDosError(status);
+        w32err = GetLastError();
         assert(ERROR_SUCCESS != w32err);
         goto Exit;
     }
 
-    // Use the first 16 bytes of the SHA256 as the CPID.
-    memcpy(cpid, sha256Digest, sizeof(*cpid));
-
-    // The CPID is an example of what RFC9562 terms a UUIDv8 ("a format for
-    // experimental or vendor-specific use cases"). The only requirement to
-    // be UUIDv8 compliant is that the 4-bit version field and 2-bit variant
-    // field are set to 8.
-    cpid->Data3 = (cpid->Data3 & 0x0fff) | 0x8000;
-    cpid->Data4[0] = (cpid->Data4[0] & 0x3f) | 0x80;
+    *tokenUser = user;
+    user = NULL;
 
 Exit:
+    free(user);
+    if (token)
+    {
+        CloseHandle(token);
+    }
     return w32err;
 }
 
-DWORD cpid_get_cpid(_In_ const HANDLE libraryHandle,
-                    _In_ const DWORD pid,
-                    _Out_ UUID* const cpid)
+// Anyone who can create the cache path could otherwise hand out a boot
+// identity of their choosing, so only a cache owned by the user of the process
+// or by SYSTEM is trusted.
+static BOOL is_trusted_cache_owner(_In_ const HANDLE file)
 {
-    DWORD w32err = ERROR_SUCCESS;
+    BOOL isTrusted = FALSE;
+    PSID ownerSid = NULL;
+    PSECURITY_DESCRIPTOR securityDescriptor = NULL;
+    TOKEN_USER* tokenUser = NULL;
 
-    // Get the process creation time (PCT).
-    UINT64 pct;
-    w32err = get_process_creation_time(pid, &pct);
-    if (ERROR_SUCCESS != w32err)
+    if (ERROR_SUCCESS != GetSecurityInfo(file,
+                                         SE_FILE_OBJECT,
+                                         OWNER_SECURITY_INFORMATION,
+                                         &ownerSid,
+                                         NULL,
+                                         NULL,
+                                         NULL,
+                                         &securityDescriptor))
     {
         goto Exit;
     }
 
-    // Call the main implementation to get the CPID from the PID and PCT.
-    w32err = cpid_make_cpid(libraryHandle, pid, pct, cpid);
+    if (IsWellKnownSid(ownerSid, WinLocalSystemSid))
+    {
+        isTrusted = TRUE;
+        goto Exit;
+    }
 
-Exit:
+    if (ERROR_SUCCESS != get_process_user(&tokenUser))
+    {
+        goto Exit;
+    }
+
+    isTrusted = EqualSid(ownerSid, tokenUser->User.Sid);
+
+Exit:
+    free(tokenUser);
+    if (securityDescriptor)
+    {
+        LocalFree(securityDescriptor);
+    }
+    return isTrusted;
+}
+
+static DWORD load_boot_identity_cache(_In_ PCSTR cachePath,
+                                      _In_ const UINT64 kernelBootTime,
+                                      _Out_ UUID* const machineGuid,
+                                      _Out_ UINT64* const bootTime)
+{
+    DWORD w32err = ERROR_SUCCESS;
+
+    // Share deletion so that the cache can be replaced while it is read.
+    const HANDLE file = CreateFileA(cachePath,
+                                    GENERIC_READ,
+                                    FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                    NULL,
+                                    OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL,
+                                    NULL);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        w32err = GetLastError();
+        assert(ERROR_SUCCESS != w32err);
+        goto Exit;
+    }
+
+    // The owner is checked on the opened file, which can't be swapped for
+    // another one underneath.
+    CPID_BOOT_IDENTITY_CACHE cache;
+    DWORD bytesRead = 0;
+    const BOOL isTrusted = is_trusted_cache_owner(file);
+    const BOOL isRead = isTrusted && ReadFile(file, &cache, sizeof(cache), &bytesRead, NULL);
+    CloseHandle(file);
+
+    // A cache of another boot, or of another library version, is sourced again.
+    if (!isRead ||
+        sizeof(cache) != bytesRead ||
+        BOOT_IDENTITY_CACHE_MAGIC != cache.Magic ||
+        BOOT_IDENTITY_CACHE_VERSION != cache.Version ||
+        kernelBootTime != cache.KernelBootTime)
+    {
+        w32err = ERROR_INVALID_DATA;
+        goto Exit;
+    }
+
+    *machineGuid = cache.MachineGuid;
+    *bootTime = cache.BootTime;
+
+Exit:
+    return w32err;
+}
+
+// Failing to write the cache isn't an error, the next process sources the
+// boot identity again.
+static void store_boot_identity_cache(_In_ PCSTR cachePath,
+                                      _In_ const UINT64 kernelBootTime,
+                                      _In_ const UUID* const machineGuid,
+                                      _In_ const UINT64 bootTime)
+{
+    // Replaced by a move so that concurrent readers never see a partial cache.
+    char temporaryPath[MAX_PATH];
+    const int pathLength = snprintf(temporaryPath,
+                                    sizeof(temporaryPath),
+                                    "%s.%lu",
+                                    cachePath,
+                                    GetCurrentProcessId());
+    if (pathLength < 0 || (size_t)pathLength >= sizeof(temporaryPath))
+    {
+        return;
+    }
+
+    CPID_BOOT_IDENTITY_CACHE cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.Magic = BOOT_IDENTITY_CACHE_MAGIC;
+    cache.Version = BOOT_IDENTITY_CACHE_VERSION;
+    cache.KernelBootTime = kernelBootTime;
+    cache.MachineGuid = *machineGuid;
+    cache.BootTime = bootTime;
+
+    // The file is owned by the user of the process, and only that user has
+    // access to it, instead of whatever the directory would pass on. An
+    // existing file would keep its own security, so it isn't overwritten. A
+    // leftover of an earlier process with the same ID is removed first.
+    TOKEN_USER* tokenUser = NULL;
+    if (ERROR_SUCCESS != get_process_user(&tokenUser))
+    {
+        return;
+    }
+
+    const DWORD aclSize = sizeof(ACL) +
+                          sizeof(ACCESS_ALLOWED_ACE) - sizeof(DWORD) +
+                          GetLengthSid(tokenUser->User.Sid);
+    ACL* acl = malloc(aclSize);
+    SECURITY_DESCRIPTOR securityDescriptor;
+    if (!acl ||
+        !InitializeAcl(acl, aclSize, ACL_REVISION) ||
+        !AddAccessAllowedAce(acl, ACL_REVISION, FILE_ALL_ACCESS, tokenUser->User.Sid) ||
+        !InitializeSecurityDescriptor(&securityDescriptor, SECURITY_DESCRIPTOR_REVISION) ||
+        !SetSecurityDescriptorOwner(&securityDescriptor, tokenUser->User.Sid, FALSE) ||
+        !SetSecurityDescriptorDacl(&securityDescriptor, TRUE, acl, FALSE) ||
+        !SetSecurityDescriptorControl(&securityDescriptor, SE_DACL_PROTECTED, SE_DACL_PROTECTED))
+    {
+        free(acl);
+        free(tokenUser);
+        return;
+    }
+
+    SECURITY_ATTRIBUTES securityAttributes;
+    securityAttributes.nLength = sizeof(securityAttributes);
+    securityAttributes.lpSecurityDescriptor = &securityDescriptor;
+    securityAttributes.bInheritHandle = FALSE;
+
+    DeleteFileA(temporaryPath);
+    const HANDLE file = CreateFileA(temporaryPath,
+                                    GENERIC_WRITE,
+                                    0,
+                                    &securityAttributes,
+                                    CREATE_NEW,
+                                    FILE_ATTRIBUTE_NORMAL,
+                                    NULL);
+    free(acl);
+    free(tokenUser);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        return;
+    }
+
+    DWORD bytesWritten = 0;
+    BOOL isWritten = WriteFile(file, &cache, sizeof(cache), &bytesWritten, NULL) &&
+                     sizeof(cache) == bytesWritten;
+    if (!CloseHandle(file))
+    {
+        isWritten = FALSE;
+    }
+
+    if (!isWritten || !MoveFileExA(temporaryPath, cachePath, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileA(temporaryPath);
+    }
+}
+
+// Sourced by the first cpid_initialize_lazy() of the process and shared with
+// the later ones.
+static SRWLOCK ProcessBootIdentityLock = SRWLOCK_INIT;
+static BOOL HasProcessBootIdentity = FALSE;
+static UUID ProcessMachineGuid;
+static UINT64 ProcessBootTime;
+
+static DWORD get_process_boot_identity(_In_opt_ PCSTR cachePath,
+                                       _Out_ UUID* const machineGuid,
+                                       _Out_ UINT64* const bootTime)
+{
+    DWORD w32err = ERROR_SUCCESS;
+
+    AcquireSRWLockExclusive(&ProcessBootIdentityLock);
+    if (!HasProcessBootIdentity)
+    {
+        // The cache is only used for the boot it was written in.
+        UINT64 kernelBootTime = 0;
+        const BOOL useCache = cachePath && ERROR_SUCCESS == get_kernel_boot_time(&kernelBootTime);
+        if (!useCache ||
+            ERROR_SUCCESS != load_boot_identity_cache(cachePath, kernelBootTime, &ProcessMachineGuid, &ProcessBootTime))
+        {
+            w32err = source_boot_identity(&ProcessMachineGuid, &ProcessBootTime);
+            if (ERROR_SUCCESS == w32err && useCache)
+            {
+                store_boot_identity_cache(cachePath, kernelBootTime, &ProcessMachineGuid, ProcessBootTime);
+            }
+        }
+        // A failure is retried by the next call.
+        HasProcessBootIdentity = ERROR_SUCCESS == w32err;
+    }
+
+    if (ERROR_SUCCESS == w32err)
+    {
+        *machineGuid = ProcessMachineGuid;
+        *bootTime = ProcessBootTime;
+    }
+    ReleaseSRWLockExclusive(&ProcessBootIdentityLock);
+
+    return w32err;
+}
+
+DWORD cpid_initialize_lazy(_In_opt_ PCSTR cachePath,
+                           _Out_ HANDLE* const libraryHandle)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    CPID_LIBRARY_DATA* libraryData = NULL;
+
+    // Check that parameter is non-null.
+    if (!libraryHandle)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+    *libraryHandle = NULL;
+
+    // Allocate a zero-initialised instance of the library data structure.
+    libraryData = calloc(1, sizeof(CPID_LIBRARY_DATA));
+    if (!libraryData)
+    {
+        w32err = ERROR_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    // Take the boot identity of the process, sourcing it on the first call.
+    w32err = get_process_boot_identity(cachePath, &libraryData->MachineGuid, &libraryData->BootTime);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    // The SHA256 algorithm is left to the first hash.
+    libraryData->IsLazy = TRUE;
+
+    // Use address of library data as an opaque handle to the library.
+    *libraryHandle = libraryData;
+
+Exit:
+    if (ERROR_SUCCESS != w32err)
+    {
+        free(libraryData);
+    }
+    return w32err;
+}
+
+BOOL cpid_windows_is_offline(_In_ const HANDLE libraryHandle)
+{
+    return libraryHandle && ((const CPID_LIBRARY_DATA*)libraryHandle)->IsOffline;
+}
+
+DWORD cpid_finalize(_In_ const HANDLE libraryHandle)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    CPID_LIBRARY_DATA* libraryData = NULL;
+
+    // Check that parameter is non-null.
+    if (!libraryHandle)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+    libraryData = libraryHandle;
+
+    // Determine if we obtained a handle to the SHA256 algorithm.
+    if (libraryData->Sha256AlgHandle)
+    {
+        // Close the SHA256 algorithm handle.
+        const NTSTATUS status = BCryptCloseAlgorithmProvider(libraryData->Sha256AlgHandle, 0);
+        if (!NT_SUCCESS(status))
+        {
+            w32err = RtlNtStatusToDosError(status);
+            assert(ERROR_SUCCESS != w32err);
+            goto Exit;
+        }
+    }
+Exit:
+    if (libraryData)
+    {
+        free(libraryData);
+    }
+    return w32err;
+}
+
+// Set packing level explicitly to ensure no padding in the struct. It is vital
+// that the constituent parts of the message data are laid out back-to-back in
+// memory.
+#pragma pack(push, 1)
+
+typedef struct _CPID_MESSAGE_DATA
+{
+    UUID    MachineGuid;
+    UINT64  BootTime;
+    UINT64  CreationTime;
+    UINT64  ProcessId;
+} CPID_MESSAGE_DATA;
+
+#pragma pack(pop)
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+
+// We have C11 or higher so do a compile time check to ensure no padding.
+static_assert(sizeof(CPID_MESSAGE_DATA) == (sizeof(((CPID_MESSAGE_DATA*)NULL)->MachineGuid) +
+                                            sizeof(((CPID_MESSAGE_DATA*)NULL)->BootTime) +
+                                            sizeof(((CPID_MESSAGE_DATA*)NULL)->CreationTime) +
+                                            sizeof(((CPID_MESSAGE_DATA*)NULL)->ProcessId)),
+              "The CPID_MESSAGE_DATA structure has an unexpected size.");
+
+#endif
+
+static void digest_to_cpid(_In_reads_(32) const UCHAR* const sha256Digest,
+                           _Out_ UUID* const cpid)
+{
+    // Use the first 16 bytes of the SHA256 as the CPID.
+    memcpy(cpid, sha256Digest, sizeof(*cpid));
+
+    // The CPID is an example of what RFC9562 terms a UUIDv8 ("a format for
+    // experimental or vendor-specific use cases"). The only requirement to
+    // be UUIDv8 compliant is that the 4-bit version field and 2-bit variant
+    // field are set to 8.
+    cpid->Data3 = (cpid->Data3 & 0x0fff) | 0x8000;
+    cpid->Data4[0] = (cpid->Data4[0] & 0x3f) | 0x80;
+}
+
+// The SHA256 algorithm shared by lazy handles, opened by the first hash of any
+// of them and never closed.
+static SRWLOCK ProcessSha256Lock = SRWLOCK_INIT;
+static BOOL IsProcessSha256Open = FALSE;
+static BCRYPT_ALG_HANDLE ProcessSha256AlgHandle = NULL;
+
+static DWORD get_sha256_algorithm(_In_ const CPID_LIBRARY_DATA* const libraryData,
+                                  _Out_ BCRYPT_ALG_HANDLE* const algHandle)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    BCRYPT_ALG_HANDLE sha256AlgHandle = libraryData->Sha256AlgHandle;
+
+    if (libraryData->IsLazy)
+    {
+        AcquireSRWLockShared(&ProcessSha256Lock);
+        BOOL isOpen = IsProcessSha256Open;
+        sha256AlgHandle = ProcessSha256AlgHandle;
+        ReleaseSRWLockShared(&ProcessSha256Lock);
+
+        if (!isOpen)
+        {
+            AcquireSRWLockExclusive(&ProcessSha256Lock);
+            if (!IsProcessSha256Open)
+            {
+                w32err = open_sha256_algorithm(&ProcessSha256AlgHandle);
+                IsProcessSha256Open = ERROR_SUCCESS == w32err;
+            }
+            sha256AlgHandle = ProcessSha256AlgHandle;
+            ReleaseSRWLockExclusive(&ProcessSha256Lock);
+            if (ERROR_SUCCESS != w32err)
+            {
+                goto Exit;
+            }
+        }
+    }
+
+    *algHandle = sha256AlgHandle ? sha256AlgHandle : BCRYPT_SHA256_ALG_HANDLE;
+
+Exit:
+    return w32err;
+}
+
+DWORD cpid_make_cpid(_In_ const HANDLE libraryHandle,
+                     _In_ const DWORD pid,
+                     _In_ const UINT64 pct,
+                     _Out_ UUID* const cpid)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    CPID_LIBRARY_DATA* libraryData = NULL;
+
+    // Check that parameters are non-null.
+    if (!libraryHandle)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+    if (!cpid)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    // Cast the caller-supplied handle to the library data structure.
+    libraryData = libraryHandle;
+
+    // Get the SHA256 algorithm, which lazy handles open on their first hash.
+    BCRYPT_ALG_HANDLE sha256AlgHandle;
+    w32err = get_sha256_algorithm(libraryData, &sha256AlgHandle);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    // Fill out the message data that is hashed to get the CPID.
+    const CPID_MESSAGE_DATA messageData =
+    {
+        libraryData->MachineGuid,
+        libraryData->BootTime,
+        pct,
+        pid,
+    };
+
+    // Hash the stucture using SHA256.
+    UCHAR sha256Digest[32];
+    const NTSTATUS status = BCryptHash(sha256AlgHandle,
+                                       NULL,
+                                       0,
+                                       (UCHAR*)&messageData,
+                                       sizeof(messageData),
+                                       sha256Digest,
+                                       sizeof(sha256Digest));
+    if (!NT_SUCCESS(status))
+    {
+        w32err = RtlNtStatusToDosError(status);
+        assert(ERROR_SUCCESS != w32err);
+        goto Exit;
+    }
+
+    digest_to_cpid(sha256Digest, cpid);
+
+Exit:
+    return w32err;
+}
+
+DWORD cpid_make_cpid_batch(_In_ const HANDLE libraryHandle,
+                           _In_reads_(count) const DWORD* const pids,
+                           _In_reads_(count) const UINT64* const pcts,
+                           _In_ const size_t count,
+                           _Out_writes_(count) UUID* const cpids)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    CPID_LIBRARY_DATA* libraryData = NULL;
+    BCRYPT_HASH_HANDLE hashHandle = NULL;
+    NTSTATUS status;
+
+    // Check that parameters are non-null.
+    if (!libraryHandle)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+    if (0 == count)
+    {
+        goto Exit;
+    }
+    if (!pids || !pcts || !cpids)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    // Cast the caller-supplied handle to the library data structure.
+    libraryData = libraryHandle;
+
+    // Get the SHA256 algorithm, which lazy handles open on their first hash.
+    BCRYPT_ALG_HANDLE sha256AlgHandle;
+    w32err = get_sha256_algorithm(libraryData, &sha256AlgHandle);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    // Create a single reusable hash object for the whole batch. After each
+    // BCryptFinishHash the object is reset and ready for the next message, so
+    // the CNG object setup cost is paid once per batch rather than per CPID.
+    // The object is owned by this call (rather than the library data) so that
+    // a library handle remains safe to share between threads.
+    // Reusable hash objects need Windows 8. If one can't be created, a hash
+    // object is created per CPID instead.
+    status = BCryptCreateHash(sha256AlgHandle,
+                              &hashHandle,
+                              NULL,
+                              0,
+                              NULL,
+                              0,
+                              BCRYPT_HASH_REUSABLE_FLAG);
+    const BOOL isReusable = NT_SUCCESS(status);
+    if (!isReusable)
+    {
+        hashHandle = NULL;
+    }
+
+    // The machine GUID and boot time are common to every message in the batch.
+    CPID_MESSAGE_DATA messageData =
+    {
+        libraryData->MachineGuid,
+        libraryData->BootTime,
+        0,
+        0,
+    };
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        messageData.CreationTime = pcts[i];
+        messageData.ProcessId = pids[i];
+
+        if (!isReusable)
+        {
+            status = BCryptCreateHash(sha256AlgHandle,
+                                      &hashHandle,
+                                      NULL,
+                                      0,
+                                      NULL,
+                                      0,
+                                      0);
+            if (!NT_SUCCESS(status))
+            {
+                hashHandle = NULL;
+                w32err = RtlNtStatusToDosError(status);
+                assert(ERROR_SUCCESS != w32err);
+                goto Exit;
+            }
+        }
+
+        // Hash the stucture using SHA256.
+        UCHAR sha256Digest[32];
+        status = BCryptHashData(hashHandle,
+                                (UCHAR*)&messageData,
+                                sizeof(messageData),
+                                0);
+        if (!NT_SUCCESS(status))
+        {
+            w32err = RtlNtStatusToDosError(status);
+            assert(ERROR_SUCCESS != w32err);
+            goto Exit;
+        }
+
+        status = BCryptFinishHash(hashHandle,
+                                  sha256Digest,
+                                  sizeof(sha256Digest),
+                                  0);
+        if (!NT_SUCCESS(status))
+        {
+            w32err = RtlNtStatusToDosError(status);
+            assert(ERROR_SUCCESS != w32err);
+            goto Exit;
+        }
+
+        // A hash object that isn't reusable is done after BCryptFinishHash.
+        if (!isReusable)
+        {
+            BCryptDestroyHash(hashHandle);
+            hashHandle = NULL;
+        }
+
+        digest_to_cpid(sha256Digest, &cpids[i]);
+    }
+
+Exit:
+    if (hashHandle)
+    {
+        BCryptDestroyHash(hashHandle);
+    }
+    return w32err;
+}
+
+DWORD cpid_get_cpid(_In_ const HANDLE libraryHandle,
+                    _In_ const DWORD pid,
+                    _Out_ UUID* const cpid)
+{
+    DWORD w32err = ERROR_SUCCESS;
+
+    // A supplied boot identity can't be combined with a local process.
+    if (libraryHandle && ((const CPID_LIBRARY_DATA*)libraryHandle)->IsOffline)
+    {
+        w32err = ERROR_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    // Get the process creation time (PCT).
+    UINT64 pct;
+    w32err = get_process_creation_time(pid, &pct);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    // Call the main implementation to get the CPID from the PID and PCT.
+    w32err = cpid_make_cpid(libraryHandle, pid, pct, cpid);
+
+Exit:
+    return w32err;
+}
+
+DWORD cpid_get_cpid_from_handle(_In_ const HANDLE libraryHandle,
+                                _In_ const HANDLE processHandle,
+                                _Out_ UUID* const cpid)
+{
+    DWORD w32err = ERROR_SUCCESS;
+
+    // A supplied boot identity can't be combined with a local process.
+    if (libraryHandle && ((const CPID_LIBRARY_DATA*)libraryHandle)->IsOffline)
+    {
+        w32err = ERROR_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    // Check that the process handle is non-null.
+    if (!processHandle)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+
+    // Get the PID and the PCT through the caller's handle, which pins the
+    // process so that neither can belong to a later process with the PID.
+    const DWORD pid = GetProcessId(processHandle);
+    if (!pid)
+    {
+        w32err = GetLastError();
+        assert(ERROR_SUCCESS != w32err);
+        goto Exit;
+    }
+    UINT64 pct;
+    w32err = get_process_handle_info(processHandle, &pct, NULL);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    // Call the main implementation to get the CPID from the PID and PCT.
+    w32err = cpid_make_cpid(libraryHandle, pid, pct, cpid);
+
+Exit:
+    return w32err;
+}
+
+DWORD cpid_get_process_record(_In_ const HANDLE libraryHandle,
+                              _In_ const DWORD pid,
+                              _In_ const DWORD flags,
+                              _Out_ cpid_record_t* const record)
+{
+    DWORD w32err = ERROR_SUCCESS;
+
+    // Check that parameters are valid.
+    if (!libraryHandle)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+    if (!record || (flags & ~CPID_RECORD_PARENT_CPID))
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+    if (((const CPID_LIBRARY_DATA*)libraryHandle)->IsOffline)
+    {
+        w32err = ERROR_NOT_SUPPORTED;
+        goto Exit;
+    }
+    memset(record, 0, sizeof(*record));
+    record->Pid = pid;
+    record->ParentStatus = ERROR_NOT_FOUND;
+
+    // Get the PCT and the parent PID through the same process handle.
+    w32err = get_process_info(pid, &record->Pct, &record->ParentPid);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    w32err = cpid_make_cpid(libraryHandle, pid, record->Pct, &record->Cpid);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    if (flags & CPID_RECORD_PARENT_CPID)
+    {
+        // The parent PID is recorded at creation and not updated when the
+        // parent exits, so it may have been reused by a later process. A
+        // process that was created after the child can't be its parent.
+        UINT64 parentPct;
+        record->ParentStatus = get_process_creation_time(record->ParentPid, &parentPct);
+        if (ERROR_SUCCESS == record->ParentStatus && parentPct > record->Pct)
+        {
+            record->ParentStatus = ERROR_NOT_FOUND;
+        }
+        if (ERROR_SUCCESS == record->ParentStatus)
+        {
+            record->ParentStatus = cpid_make_cpid(libraryHandle, record->ParentPid, parentPct, &record->ParentCpid);
+        }
+        if (ERROR_SUCCESS != record->ParentStatus)
+        {
+            memset(&record->ParentCpid, 0, sizeof(record->ParentCpid));
+        }
+    }
+
+Exit:
+    return w32err;
+}
+
+// The SYSTEM_PROCESS_INFORMATION structure in winternl.h hides the process
+// creation time in a reserved field, so declare the documented prefix of the
+// structure here. Only the fields up to UniqueProcessId are accessed.
+typedef struct _CPID_SYSTEM_PROCESS_INFORMATION
+{
+    ULONG           NextEntryOffset;
+    ULONG           NumberOfThreads;
+    LARGE_INTEGER   WorkingSetPrivateSize;
+    ULONG           HardFaultCount;
+    ULONG           NumberOfThreadsHighWatermark;
+    ULONGLONG       CycleTime;
+    LARGE_INTEGER   CreateTime;
+    LARGE_INTEGER   UserTime;
+    LARGE_INTEGER   KernelTime;
+    UNICODE_STRING  ImageName;
+    LONG            BasePriority;
+    HANDLE          UniqueProcessId;
+} CPID_SYSTEM_PROCESS_INFORMATION;
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+
+// We have C11 or higher so do a compile time check that the prefix agrees
+// with the public definition.
+static_assert(offsetof(CPID_SYSTEM_PROCESS_INFORMATION, NextEntryOffset) == offsetof(SYSTEM_PROCESS_INFORMATION, NextEntryOffset) &&
+              offsetof(CPID_SYSTEM_PROCESS_INFORMATION, ImageName) == offsetof(SYSTEM_PROCESS_INFORMATION, ImageName) &&
+              offsetof(CPID_SYSTEM_PROCESS_INFORMATION, UniqueProcessId) == offsetof(SYSTEM_PROCESS_INFORMATION, UniqueProcessId),
+              "The CPID_SYSTEM_PROCESS_INFORMATION structure has an unexpected layout.");
+
+#endif
+
+// Slack added to the size reported by NtQuerySystemInformation to absorb
+// processes created between the sizing call and the query itself.
+#define SNAPSHOT_BUFFER_SLACK (64 * 1024)
+
+#ifndef STATUS_INFO_LENGTH_MISMATCH
+#define STATUS_INFO_LENGTH_MISMATCH ((NTSTATUS)0xC0000004L)
+#endif
+
+static DWORD query_system_process_information(_Outptr_ void** const buffer)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    void* information = NULL;
+    ULONG informationSize = 0;
+    NTSTATUS status;
+
+    *buffer = NULL;
+
+    // Grow the buffer until the process list fits. The required size can
+    // change between calls as processes are created so loop until success.
+    for (;;)
+    {
+        status = NtQuerySystemInformation(SystemProcessInformation,
+                                          information,
+                                          informationSize,
+                                          &informationSize);
+        if (STATUS_INFO_LENGTH_MISMATCH != status)
+        {
+            break;
+        }
+
+        free(information);
+        informationSize += SNAPSHOT_BUFFER_SLACK;
+        information = malloc(informationSize);
+        if (!information)
+        {
+            w32err = ERROR_OUTOFMEMORY;
+            goto Exit;
+        }
+    }
+    if (!NT_SUCCESS(status))
+    {
+        w32err = RtlNtStatusToDosError(status);
+        assert(ERROR_SUCCESS != w32err);
+        goto Exit;
+    }
+
+    *buffer = information;
+    information = NULL;
+
+Exit:
+    free(information);
+    return w32err;
+}
+
+DWORD cpid_snapshot_all(_In_ const HANDLE libraryHandle,
+                        _Outptr_result_buffer_(*count) cpid_entry_t** const entries,
+                        _Out_ size_t* const count)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    void* information = NULL;
+    cpid_entry_t* snapshot = NULL;
+    DWORD* pids = NULL;
+    UINT64* pcts = NULL;
+    UUID* cpids = NULL;
+    size_t snapshotCount = 0;
+
+    // Check that parameters are non-null.
+    if (!libraryHandle)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+    if (!entries || !count)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+    *entries = NULL;
+    *count = 0;
+    if (((const CPID_LIBRARY_DATA*)libraryHandle)->IsOffline)
+    {
+        w32err = ERROR_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    // Get the PID and creation time of every process in a single query.
+    w32err = query_system_process_information(&information);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    // Count the entries so the output can be allocated in one go.
+    size_t entryCount = 0;
+    const CPID_SYSTEM_PROCESS_INFORMATION* processInformation = information;
+    for (;;)
+    {
+        ++entryCount;
+        if (!processInformation->NextEntryOffset)
+        {
+            break;
+        }
+        processInformation = (const CPID_SYSTEM_PROCESS_INFORMATION*)((const UCHAR*)processInformation + processInformation->NextEntryOffset);
+    }
+
+    snapshot = calloc(entryCount, sizeof(*snapshot));
+    pids = calloc(entryCount, sizeof(*pids));
+    pcts = calloc(entryCount, sizeof(*pcts));
+    cpids = calloc(entryCount, sizeof(*cpids));
+    if (!snapshot || !pids || !pcts || !cpids)
+    {
+        w32err = ERROR_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    processInformation = information;
+    for (;;)
+    {
+        const DWORD pid = (DWORD)(ULONG_PTR)processInformation->UniqueProcessId;
+
+        // Skip the System Idle Process, it is not a real process and has no
+        // creation time (cpid_get_cpid() cannot open it either).
+        if (0 != pid)
+        {
+            pids[snapshotCount] = pid;
+            pcts[snapshotCount] = (UINT64)processInformation->CreateTime.QuadPart;
+            ++snapshotCount;
+        }
+
+        if (!processInformation->NextEntryOffset)
+        {
+            break;
+        }
+        processInformation = (const CPID_SYSTEM_PROCESS_INFORMATION*)((const UCHAR*)processInformation + processInformation->NextEntryOffset);
+    }
+
+    // Hash all of the entries as a single batch.
+    w32err = cpid_make_cpid_batch(libraryHandle, pids, pcts, snapshotCount, cpids);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    for (size_t i = 0; i < snapshotCount; ++i)
+    {
+        snapshot[i].Pid = pids[i];
+        snapshot[i].Pct = pcts[i];
+        snapshot[i].Cpid = cpids[i];
+    }
+
+    *entries = snapshot;
+    *count = snapshotCount;
+    snapshot = NULL;
+
+Exit:
+    free(cpids);
+    free(pcts);
+    free(pids);
+    free(snapshot);
+    free(information);
     return w32err;
 }
+
+void cpid_snapshot_free(_In_opt_ cpid_entry_t* const entries)
+{
+    free(entries);
+}
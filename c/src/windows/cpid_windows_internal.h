@@ -0,0 +1,13 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cpid/cpid_windows.h>
+
+/**
+* Determines whether a library handle was initialized with a supplied boot
+* identity, see cpid_initialize_with_boot_identity().
+*
+* @return TRUE if the handle can't be used with processes of the local boot.
+*/
+BOOL cpid_windows_is_offline(_In_ const HANDLE libraryHandle);
@@ -0,0 +1,534 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cpid/cpid_windows.h>
+#include "cpid_windows_internal.h"
+#include <evntrace.h>
+#include <evntcons.h>
+#include <wchar.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Microsoft-Windows-Kernel-Process {22FB2CD6-0E7B-422B-A0C7-2FAD1FD0E716}
+static const GUID KernelProcessProviderGuid =
+    { 0x22fb2cd6, 0x0e7b, 0x422b, { 0xa0, 0xc7, 0x2f, 0xad, 0x1f, 0xd0, 0xe7, 0x16 } };
+
+// WINEVENT_KEYWORD_PROCESS of the provider manifest.
+#define KERNEL_PROCESS_KEYWORD_PROCESS 0x10
+
+// Event IDs of the provider manifest.
+#define KERNEL_PROCESS_EVENT_PROCESS_START 1
+#define KERNEL_PROCESS_EVENT_PROCESS_STOP  2
+
+// Both events start with the ProcessID (UInt32) and CreateTime (FILETIME)
+// fields, ProcessStart follows them with ParentProcessID (UInt32). The
+// payload is packed.
+#define PAYLOAD_PROCESS_ID_OFFSET        0
+#define PAYLOAD_CREATE_TIME_OFFSET       4
+#define PAYLOAD_PARENT_PROCESS_ID_OFFSET 12
+#define PROCESS_START_MIN_PAYLOAD_SIZE   16
+#define PROCESS_STOP_MIN_PAYLOAD_SIZE    12
+
+// Events that arrive while the queue is full are dropped and counted.
+#define QUEUE_CAPACITY 65536
+
+// CPIDs are made in chunks of this many records.
+#define HASH_CHUNK_SIZE 256
+
+// Room for "cpid-stream-<pid>-<counter>" and the terminating null.
+#define SESSION_NAME_LENGTH 48
+
+// The session name is copied in behind the properties by ETW.
+typedef struct _CPID_TRACE_PROPERTIES
+{
+    EVENT_TRACE_PROPERTIES  Properties;
+    WCHAR                   SessionName[SESSION_NAME_LENGTH];
+} CPID_TRACE_PROPERTIES;
+
+typedef struct _CPID_STREAM_QUEUE_ENTRY
+{
+    DWORD               Pid;
+    DWORD               ParentPid;
+    UINT64              Pct;
+    cpid_stream_event_t Event;
+} CPID_STREAM_QUEUE_ENTRY;
+
+typedef struct _CPID_STREAM_DATA
+{
+    HANDLE                      LibraryHandle;
+    WCHAR                       SessionName[SESSION_NAME_LENGTH];
+    TRACEHANDLE                 SessionHandle;
+    TRACEHANDLE                 TraceHandle;
+    HANDLE                      ThreadHandle;
+    // Manual-reset event, signalled while the queue is non-empty or the
+    // session has stopped.
+    HANDLE                      ReadyEvent;
+    SRWLOCK                     QueueLock;
+    CPID_STREAM_QUEUE_ENTRY*    Queue;
+    size_t                      QueueHead;
+    size_t                      QueueCount;
+    UINT64                      DroppedCount;
+    BOOL                        IsStopped;
+    DWORD                       StopError;
+} CPID_STREAM_DATA;
+
+static volatile LONG SessionCounter = 0;
+
+static EVENT_TRACE_PROPERTIES* init_trace_properties(_Out_ CPID_TRACE_PROPERTIES* const traceProperties)
+{
+    EVENT_TRACE_PROPERTIES* const properties = &traceProperties->Properties;
+
+    memset(traceProperties, 0, sizeof(CPID_TRACE_PROPERTIES));
+    properties->Wnode.BufferSize = sizeof(CPID_TRACE_PROPERTIES);
+    properties->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    // Query performance counter timestamps.
+    properties->Wnode.ClientContext = 1;
+    properties->LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
+    // Flush buffers every second so that quiet systems still see events.
+    properties->FlushTimer = 1;
+    properties->LoggerNameOffset = offsetof(CPID_TRACE_PROPERTIES, SessionName);
+    return properties;
+}
+
+static void queue_event(_Inout_ CPID_STREAM_DATA* const streamData,
+                        _In_ const CPID_STREAM_QUEUE_ENTRY* const entry)
+{
+    AcquireSRWLockExclusive(&streamData->QueueLock);
+    if (QUEUE_CAPACITY == streamData->QueueCount)
+    {
+        streamData->DroppedCount++;
+    }
+    else
+    {
+        const size_t tail = (streamData->QueueHead + streamData->QueueCount) % QUEUE_CAPACITY;
+        streamData->Queue[tail] = *entry;
+        streamData->QueueCount++;
+        SetEvent(streamData->ReadyEvent);
+    }
+    ReleaseSRWLockExclusive(&streamData->QueueLock);
+}
+
+static VOID WINAPI event_record_callback(_In_ PEVENT_RECORD eventRecord)
+{
+    CPID_STREAM_DATA* const streamData = eventRecord->UserContext;
+    const BYTE* const payload = eventRecord->UserData;
+    const USHORT payloadSize = eventRecord->UserDataLength;
+    CPID_STREAM_QUEUE_ENTRY entry = { 0 };
+
+    // The session also delivers its own header event, skip anything that
+    // isn't from the kernel process provider.
+    if (!IsEqualGUID(&eventRecord->EventHeader.ProviderId, &KernelProcessProviderGuid))
+    {
+        return;
+    }
+
+    // Read the fields with memcpy since the payload isn't aligned.
+    switch (eventRecord->EventHeader.EventDescriptor.Id)
+    {
+    case KERNEL_PROCESS_EVENT_PROCESS_START:
+        if (payloadSize < PROCESS_START_MIN_PAYLOAD_SIZE)
+        {
+            return;
+        }
+        entry.Event = CPID_STREAM_EVENT_START;
+        memcpy(&entry.ParentPid, payload + PAYLOAD_PARENT_PROCESS_ID_OFFSET, sizeof(entry.ParentPid));
+        break;
+    case KERNEL_PROCESS_EVENT_PROCESS_STOP:
+        if (payloadSize < PROCESS_STOP_MIN_PAYLOAD_SIZE)
+        {
+            return;
+        }
+        entry.Event = CPID_STREAM_EVENT_EXIT;
+        break;
+    default:
+        return;
+    }
+    memcpy(&entry.Pid, payload + PAYLOAD_PROCESS_ID_OFFSET, sizeof(entry.Pid));
+    memcpy(&entry.Pct, payload + PAYLOAD_CREATE_TIME_OFFSET, sizeof(entry.Pct));
+
+    queue_event(streamData, &entry);
+}
+
+static DWORD WINAPI process_trace_thread(_In_ LPVOID parameter)
+{
+    CPID_STREAM_DATA* const streamData = parameter;
+
+    // Returns once the trace is closed or the session is stopped.
+    const ULONG w32err = ProcessTrace(&streamData->TraceHandle, 1, NULL, NULL);
+
+    // Wake readers so that they see the end of the stream.
+    AcquireSRWLockExclusive(&streamData->QueueLock);
+    streamData->IsStopped = TRUE;
+    streamData->StopError = w32err;
+    SetEvent(streamData->ReadyEvent);
+    ReleaseSRWLockExclusive(&streamData->QueueLock);
+
+    return w32err;
+}
+
+static DWORD start_session(_Inout_ CPID_STREAM_DATA* const streamData)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    CPID_TRACE_PROPERTIES traceProperties;
+
+    // Name the session after this process so that concurrent streams, also
+    // of other processes, don't collide.
+    swprintf(streamData->SessionName,
+             SESSION_NAME_LENGTH,
+             L"cpid-stream-%lu-%ld",
+             GetCurrentProcessId(),
+             InterlockedIncrement(&SessionCounter));
+
+    w32err = StartTraceW(&streamData->SessionHandle,
+                         streamData->SessionName,
+                         init_trace_properties(&traceProperties));
+    if (ERROR_ALREADY_EXISTS == w32err)
+    {
+        // A session of an earlier process with the same PID outlived it since
+        // real-time sessions aren't stopped with their controller. Stop it
+        // and retry once.
+        ControlTraceW(0,
+                      streamData->SessionName,
+                      init_trace_properties(&traceProperties),
+                      EVENT_TRACE_CONTROL_STOP);
+        w32err = StartTraceW(&streamData->SessionHandle,
+                             streamData->SessionName,
+                             init_trace_properties(&traceProperties));
+    }
+    if (ERROR_SUCCESS != w32err)
+    {
+        streamData->SessionHandle = 0;
+    }
+    return w32err;
+}
+
+static DWORD destroy_stream(_In_ CPID_STREAM_DATA* const streamData)
+{
+    DWORD w32err = ERROR_SUCCESS;
+
+    // Closing the trace makes ProcessTrace return once the buffers it has
+    // already received are processed.
+    if (INVALID_PROCESSTRACE_HANDLE != streamData->TraceHandle)
+    {
+        const ULONG status = CloseTrace(streamData->TraceHandle);
+        if (ERROR_SUCCESS != status && ERROR_CTX_CLOSE_PENDING != status)
+        {
+            w32err = status;
+        }
+    }
+
+    // Stop the session, real-time sessions aren't stopped with the process
+    // that started them.
+    if (streamData->SessionHandle)
+    {
+        CPID_TRACE_PROPERTIES traceProperties;
+        const ULONG status = ControlTraceW(streamData->SessionHandle,
+                                           NULL,
+                                           init_trace_properties(&traceProperties),
+                                           EVENT_TRACE_CONTROL_STOP);
+        if (ERROR_SUCCESS != status && ERROR_SUCCESS == w32err)
+        {
+            w32err = status;
+        }
+    }
+
+    if (streamData->ThreadHandle)
+    {
+        WaitForSingleObject(streamData->ThreadHandle, INFINITE);
+        CloseHandle(streamData->ThreadHandle);
+    }
+    if (streamData->ReadyEvent)
+    {
+        CloseHandle(streamData->ReadyEvent);
+    }
+    free(streamData->Queue);
+    free(streamData);
+    return w32err;
+}
+
+DWORD cpid_stream_open(_In_ const HANDLE libraryHandle,
+                       _Out_ HANDLE* const stream)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    CPID_STREAM_DATA* streamData = NULL;
+
+    // Check that parameters are non-null.
+    if (!stream)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+    *stream = NULL;
+    if (!libraryHandle)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+
+    // The events are of the local boot, a supplied boot identity would give
+    // them the CPIDs of another.
+    if (cpid_windows_is_offline(libraryHandle))
+    {
+        w32err = ERROR_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    // Allocate a zero-initialised instance of the stream data structure.
+    streamData = calloc(1, sizeof(CPID_STREAM_DATA));
+    if (!streamData)
+    {
+        w32err = ERROR_OUTOFMEMORY;
+        goto Exit;
+    }
+    streamData->LibraryHandle = libraryHandle;
+    streamData->TraceHandle = INVALID_PROCESSTRACE_HANDLE;
+    InitializeSRWLock(&streamData->QueueLock);
+
+    streamData->Queue = malloc(QUEUE_CAPACITY * sizeof(CPID_STREAM_QUEUE_ENTRY));
+    if (!streamData->Queue)
+    {
+        w32err = ERROR_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    streamData->ReadyEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!streamData->ReadyEvent)
+    {
+        w32err = GetLastError();
+        assert(ERROR_SUCCESS != w32err);
+        goto Exit;
+    }
+
+    w32err = start_session(streamData);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    // Only the process keyword is enabled, which carries the ProcessStart
+    // and ProcessStop events.
+    w32err = EnableTraceEx2(streamData->SessionHandle,
+                            &KernelProcessProviderGuid,
+                            EVENT_CONTROL_CODE_ENABLE_PROVIDER,
+                            TRACE_LEVEL_INFORMATION,
+                            KERNEL_PROCESS_KEYWORD_PROCESS,
+                            0,
+                            0,
+                            NULL);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    // Consume the session in real time with the stream as the context of the
+    // event callback.
+    EVENT_TRACE_LOGFILEW logFile = { 0 };
+    logFile.LoggerName = streamData->SessionName;
+    logFile.ProcessTraceMode = PROCESS_TRACE_MODE_REAL_TIME | PROCESS_TRACE_MODE_EVENT_RECORD;
+    logFile.EventRecordCallback = event_record_callback;
+    logFile.Context = streamData;
+    streamData->TraceHandle = OpenTraceW(&logFile);
+    if (INVALID_PROCESSTRACE_HANDLE == streamData->TraceHandle)
+    {
+        w32err = GetLastError();
+        assert(ERROR_SUCCESS != w32err);
+        goto Exit;
+    }
+
+    // ProcessTrace blocks, so it gets a thread of its own.
+    streamData->ThreadHandle = CreateThread(NULL, 0, process_trace_thread, streamData, 0, NULL);
+    if (!streamData->ThreadHandle)
+    {
+        w32err = GetLastError();
+        assert(ERROR_SUCCESS != w32err);
+        goto Exit;
+    }
+
+    // Use address of stream data as an opaque handle to the stream.
+    *stream = streamData;
+
+Exit:
+    if (ERROR_SUCCESS != w32err && streamData)
+    {
+        destroy_stream(streamData);
+    }
+    return w32err;
+}
+
+DWORD cpid_stream_get_wait_handle(_In_ const HANDLE stream,
+                                  _Out_ HANDLE* const waitHandle)
+{
+    DWORD w32err = ERROR_SUCCESS;
+
+    // Check that parameters are non-null.
+    if (!waitHandle)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+    *waitHandle = NULL;
+    if (!stream)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+
+    *waitHandle = ((const CPID_STREAM_DATA*)stream)->ReadyEvent;
+
+Exit:
+    return w32err;
+}
+
+DWORD cpid_stream_next_batch(_In_ const HANDLE stream,
+                             _Out_writes_to_(capacity, *count) cpid_stream_record_t* const records,
+                             _In_ const size_t capacity,
+                             _Out_ size_t* const count)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    CPID_STREAM_DATA* streamData = NULL;
+    size_t taken = 0;
+
+    // Check that parameters are non-null.
+    if (!count)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+    *count = 0;
+    if (!stream)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+    if (!records || 0 == capacity)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+    streamData = stream;
+
+    // Another reader can drain the queue between the event being signalled
+    // and the lock being taken, in which case wait again.
+    while (0 == taken)
+    {
+        if (WAIT_OBJECT_0 != WaitForSingleObject(streamData->ReadyEvent, INFINITE))
+        {
+            w32err = GetLastError();
+            assert(ERROR_SUCCESS != w32err);
+            goto Exit;
+        }
+
+        AcquireSRWLockExclusive(&streamData->QueueLock);
+        while (taken < capacity && streamData->QueueCount)
+        {
+            const CPID_STREAM_QUEUE_ENTRY* const entry = &streamData->Queue[streamData->QueueHead];
+            records[taken].Pid = entry->Pid;
+            records[taken].ParentPid = entry->ParentPid;
+            records[taken].Pct = entry->Pct;
+            records[taken].Event = entry->Event;
+            taken++;
+            streamData->QueueHead = (streamData->QueueHead + 1) % QUEUE_CAPACITY;
+            streamData->QueueCount--;
+        }
+        if (0 == streamData->QueueCount && !streamData->IsStopped)
+        {
+            ResetEvent(streamData->ReadyEvent);
+        }
+        const BOOL isDrainedAndStopped = 0 == taken && streamData->IsStopped;
+        const DWORD stopError = streamData->StopError;
+        ReleaseSRWLockExclusive(&streamData->QueueLock);
+
+        if (isDrainedAndStopped)
+        {
+            w32err = ERROR_SUCCESS == stopError ? ERROR_NO_MORE_ITEMS : stopError;
+            goto Exit;
+        }
+    }
+
+    // Make the CPIDs of the batch outside of the lock so that the event
+    // callback isn't held up by the hashing.
+    for (size_t offset = 0; offset < taken; offset += HASH_CHUNK_SIZE)
+    {
+        DWORD pids[HASH_CHUNK_SIZE];
+        UINT64 pcts[HASH_CHUNK_SIZE];
+        UUID cpids[HASH_CHUNK_SIZE];
+        const size_t chunkSize = taken - offset < HASH_CHUNK_SIZE ? taken - offset : HASH_CHUNK_SIZE;
+
+        for (size_t i = 0; i < chunkSize; ++i)
+        {
+            pids[i] = records[offset + i].Pid;
+            pcts[i] = records[offset + i].Pct;
+        }
+        w32err = cpid_make_cpid_batch(streamData->LibraryHandle, pids, pcts, chunkSize, cpids);
+        if (ERROR_SUCCESS != w32err)
+        {
+            goto Exit;
+        }
+        for (size_t i = 0; i < chunkSize; ++i)
+        {
+            records[offset + i].Cpid = cpids[i];
+        }
+    }
+
+    *count = taken;
+
+Exit:
+    return w32err;
+}
+
+DWORD cpid_stream_get_lost_count(_In_ const HANDLE stream,
+                                 _Out_ UINT64* const lostCount)
+{
+    DWORD w32err = ERROR_SUCCESS;
+    CPID_STREAM_DATA* streamData = NULL;
+    CPID_TRACE_PROPERTIES traceProperties;
+    EVENT_TRACE_PROPERTIES* properties = NULL;
+    UINT64 droppedCount;
+
+    // Check that parameters are non-null.
+    if (!lostCount)
+    {
+        w32err = ERROR_INVALID_PARAMETER;
+        goto Exit;
+    }
+    *lostCount = 0;
+    if (!stream)
+    {
+        w32err = ERROR_INVALID_HANDLE;
+        goto Exit;
+    }
+    streamData = stream;
+
+    AcquireSRWLockShared(&streamData->QueueLock);
+    droppedCount = streamData->DroppedCount;
+    ReleaseSRWLockShared(&streamData->QueueLock);
+
+    // Add the events the session itself lost.
+    properties = init_trace_properties(&traceProperties);
+    w32err = ControlTraceW(streamData->SessionHandle,
+                           NULL,
+                           properties,
+                           EVENT_TRACE_CONTROL_QUERY);
+    if (ERROR_SUCCESS != w32err)
+    {
+        goto Exit;
+    }
+
+    *lostCount = droppedCount
+               + properties->EventsLost
+               + properties->RealTimeBuffersLost;
+
+Exit:
+    return w32err;
+}
+
+DWORD cpid_stream_close(_In_ const HANDLE stream)
+{
+    // Check that parameter is non-null.
+    if (!stream)
+    {
+        return ERROR_INVALID_HANDLE;
+    }
+    return destroy_stream(stream);
+}
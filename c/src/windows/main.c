@@ -1,43 +1,238 @@
 // SPDX-License-Identifier: Apache-2.0
 
+#include <cpid/cpid_format.h>
 #include <cpid/cpid_windows.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-int main(int argc, char** argv)
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+#define LINE_BUFFER_SIZE 64
+#define CPID_STRING_SIZE (CPID_UUID_STRING_LENGTH + 1)
+
+typedef enum _OUTPUT_FORMAT
 {
-    if (argc != 2)
+    OutputFormatCsv,
+    OutputFormatNdjson,
+} OUTPUT_FORMAT;
+
+static BOOL parse_pid(_In_z_ const char* const text, _Out_ DWORD* const pid)
+{
+    char* endptr = NULL;
+    unsigned long parsedPid = strtoul(text, &endptr, 10);
+    *pid = 0;
+    if (endptr == text || '-' == text[0] || (*endptr != '\0' && *endptr != '\n' && *endptr != '\r'))
+    {
+        return FALSE;
+    }
+    if (parsedPid > MAXDWORD)
     {
-        fprintf(stderr, "usage: %s <pid>\n", argv[0]);
-        return ERROR_INVALID_PARAMETER;
+        return FALSE;
     }
 
-    HANDLE libraryHandle;
-    DWORD w32err = cpid_initialize(&libraryHandle);
+    *pid = (DWORD)parsedPid;
+    return TRUE;
+}
+
+static void write_header(_In_ const OUTPUT_FORMAT format)
+{
+    if (OutputFormatCsv == format)
+    {
+        fputs("pid,cpid\n", stdout);
+    }
+}
+
+static void write_record(_In_ const OUTPUT_FORMAT format,
+                         _In_ const DWORD pid,
+                         _In_ const UUID* const cpid)
+{
+    // same as UuidToStringA, without an allocation per CPID
+    char cpidString[CPID_STRING_SIZE] = { 0 };
+    (void)cpid_format_guid_batch(cpid, 1, cpidString, sizeof(cpidString));
+
+    if (OutputFormatCsv == format)
+    {
+        printf("%lu,%s\n", pid, cpidString);
+    }
+    else
+    {
+        printf("{\"pid\":%lu,\"cpid\":\"%s\"}\n", pid, cpidString);
+    }
+}
+
+static DWORD run_stdin(_In_ const HANDLE libraryHandle, _In_ const OUTPUT_FORMAT format)
+{
+    write_header(format);
+
+    char line[LINE_BUFFER_SIZE];
+    size_t lineNumber = 0;
+    while (fgets(line, LINE_BUFFER_SIZE, stdin))
+    {
+        lineNumber++;
+
+        // blank lines are skipped quietly
+        if ('\n' == line[0] || ('\r' == line[0] && '\n' == line[1]))
+        {
+            continue;
+        }
+
+        // the rest of an overlong line is discarded, it can't be a PID
+        size_t length = strlen(line);
+        BOOL overlong = '\n' != line[length - 1] && !feof(stdin);
+        for (int c = 0; overlong && EOF != (c = getchar()) && '\n' != c;)
+        {
+        }
+
+        DWORD pid;
+        if (overlong || !parse_pid(line, &pid))
+        {
+            fprintf(stderr, "Skipping line %zu, it is not a PID.\n", lineNumber);
+            continue;
+        }
+
+        // PIDs whose CPID can't be calculated are reported and skipped like lines that aren't PIDs
+        UUID cpid;
+        DWORD w32err = cpid_get_cpid(libraryHandle, pid, &cpid);
+        if (ERROR_SUCCESS != w32err)
+        {
+            fprintf(stderr, "Skipping line %zu, the CPID of PID %lu can't be calculated.\n", lineNumber, pid);
+            continue;
+        }
+        write_record(format, pid, &cpid);
+    }
+
+    return ferror(stdin) ? ERROR_READ_FAULT : ERROR_SUCCESS;
+}
+
+static DWORD run_all(_In_ const HANDLE libraryHandle, _In_ const OUTPUT_FORMAT format)
+{
+    cpid_entry_t* entries = NULL;
+    size_t count = 0;
+    DWORD w32err = cpid_snapshot_all(libraryHandle, &entries, &count);
     if (ERROR_SUCCESS != w32err)
     {
-        fprintf(stderr, "Error code %lu when initializing CPID library.\n", w32err);
+        fprintf(stderr, "Error code %lu when enumerating processes.\n", w32err);
         return w32err;
     }
 
+    write_header(format);
+    for (size_t i = 0; i < count; i++)
+    {
+        write_record(format, entries[i].Pid, &entries[i].Cpid);
+    }
+
+    cpid_snapshot_free(entries);
+
+    return ERROR_SUCCESS;
+}
+
+static DWORD run_single(_In_ const HANDLE libraryHandle, _In_ const DWORD pid)
+{
     UUID cpid;
-    w32err = cpid_get_cpid(libraryHandle, atol(argv[1]), &cpid);
-    (void)cpid_finalize(libraryHandle);
+    DWORD w32err = cpid_get_cpid(libraryHandle, pid, &cpid);
     if (ERROR_SUCCESS != w32err)
     {
         fprintf(stderr, "Error code %lu when getting the CPID.\n", w32err);
         return w32err;
     }
 
-    RPC_CSTR cpidString;
-    w32err = UuidToStringA(&cpid, &cpidString);
+    char cpidString[CPID_STRING_SIZE];
+    (void)cpid_format_guid_batch(&cpid, 1, cpidString, sizeof(cpidString));
+    puts(cpidString);
+
+    return ERROR_SUCCESS;
+}
+
+static void print_usage(_In_z_ const char* const program)
+{
+    fprintf(stderr,
+            "usage: %s <pid>\n"
+            "       %s [--format csv|ndjson] --stdin\n"
+            "       %s [--format csv|ndjson] --all\n"
+            "\n"
+            "  --stdin    calculate the CPID of every PID read from stdin, one per line\n"
+            "  --all      calculate the CPID of every running process\n"
+            "  --format   output pid,cpid CSV lines (default) or NDJSON objects\n",
+            program, program, program);
+}
+
+int main(int argc, char** argv)
+{
+    BOOL readStdin = FALSE;
+    BOOL readAll = FALSE;
+    OUTPUT_FORMAT format = OutputFormatCsv;
+    DWORD pid = 0;
+    if (2 == argc && '-' != argv[1][0])
+    {
+        if (!parse_pid(argv[1], &pid) || NULL != strchr(argv[1], '\n'))
+        {
+            fprintf(stderr, "Error parsing supplied PID.\n");
+            return ERROR_INVALID_PARAMETER;
+        }
+    }
+    else
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (!strcmp(argv[i], "--stdin"))
+            {
+                readStdin = TRUE;
+            }
+            else if (!strcmp(argv[i], "--all"))
+            {
+                readAll = TRUE;
+            }
+            else if (!strcmp(argv[i], "--format") && i + 1 < argc && !strcmp(argv[i + 1], "csv"))
+            {
+                format = OutputFormatCsv;
+                i++;
+            }
+            else if (!strcmp(argv[i], "--format") && i + 1 < argc && !strcmp(argv[i + 1], "ndjson"))
+            {
+                format = OutputFormatNdjson;
+                i++;
+            }
+            else
+            {
+                print_usage(argv[0]);
+                return ERROR_INVALID_PARAMETER;
+            }
+        }
+
+        if (readStdin == readAll)
+        {
+            print_usage(argv[0]);
+            return ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    HANDLE libraryHandle;
+    DWORD w32err = cpid_initialize(&libraryHandle);
     if (ERROR_SUCCESS != w32err)
     {
-        fprintf(stderr, "Error code %lu when stringifying the CPID.\n", w32err);
+        fprintf(stderr, "Error code %lu when initializing CPID library.\n", w32err);
         return w32err;
     }
-    puts((const char*)cpidString);
-    RpcStringFreeA(&cpidString);
 
-    return ERROR_SUCCESS;
+    if (readStdin || readAll)
+    {
+        // output is fully buffered, even when it goes to a console
+        static char outputBuffer[OUTPUT_BUFFER_SIZE];
+        setvbuf(stdout, outputBuffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+        w32err = readStdin ? run_stdin(libraryHandle, format) : run_all(libraryHandle, format);
+
+        if (fflush(stdout) && ERROR_SUCCESS == w32err)
+        {
+            w32err = ERROR_WRITE_FAULT;
+        }
+    }
+    else
+    {
+        w32err = run_single(libraryHandle, pid);
+    }
+
+    (void)cpid_finalize(libraryHandle);
+
+    return w32err;
 }
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include <cpid/cpid.hpp>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#define CPP_TEST_BATCH_SIZE 100
+
+// comparisons are usable in constant expressions
+static_assert(cpid::uuid{} == cpid::uuid{});
+static_assert(cpid::uuid{} < cpid::uuid{{0, 1}});
+static_assert(cpid::uuid{{2}} > cpid::uuid{{1, 0xFF}});
+static_assert(!std::is_copy_constructible_v<cpid::handle> && std::is_nothrow_move_constructible_v<cpid::handle>);
+
+static cpid::input make_input(const size_t i) {
+#if defined(__APPLE__)
+    return cpid::input{static_cast<pid_t>(i + 1), static_cast<int64_t>(1700000000 + i), static_cast<int32_t>(i * 7)};
+#else
+    return cpid::input{static_cast<pid_t>(i + 1), 1000 + i, static_cast<ino_t>(4026531836u)};
+#endif
+}
+
+void test_cpid_cpp_get(void) {
+    cpid::handle handle;
+    CU_ASSERT_TRUE(static_cast<bool>(handle));
+
+    cpid::uuid uuid;
+    CU_ASSERT_FALSE(handle.get(getpid(), uuid));
+
+    // same CPID as the C API
+    uuid_t expected;
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle.native(), getpid(), expected), 0);
+    CU_ASSERT_EQUAL(std::memcmp(uuid.bytes.data(), expected, sizeof(expected)), 0);
+
+    uuid_string_t expected_string;
+    CU_ASSERT_EQUAL(cpid_get_uuid_string(handle.native(), getpid(), expected_string), 0);
+    CU_ASSERT_STRING_EQUAL(uuid.to_string().c_str(), expected_string);
+
+    // failures carry an error code
+    cpid::uuid missing;
+    CU_ASSERT_TRUE(static_cast<bool>(handle.get(-1, missing)));
+}
+
+void test_cpid_cpp_move(void) {
+    cpid::handle handle;
+    const cpid_handle_t native = handle.native();
+
+    cpid::handle moved(std::move(handle));
+    CU_ASSERT_FALSE(static_cast<bool>(handle));
+    CU_ASSERT_PTR_EQUAL(moved.native(), native);
+
+    cpid::handle assigned;
+    assigned = std::move(moved);
+    CU_ASSERT_FALSE(static_cast<bool>(moved));
+    CU_ASSERT_PTR_EQUAL(assigned.native(), native);
+
+    cpid::uuid uuid;
+    CU_ASSERT_FALSE(assigned.get(getpid(), uuid));
+
+    // ownership can be handed back to the C API
+    cpid_handle_t released = assigned.release();
+    CU_ASSERT_PTR_EQUAL(released, native);
+    CU_ASSERT_FALSE(static_cast<bool>(assigned));
+    cpid_finalize(released);
+}
+
+void test_cpid_cpp_make_batch(void) {
+    cpid::handle handle;
+
+    std::array<cpid::input, CPP_TEST_BATCH_SIZE> inputs;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        inputs[i] = make_input(i);
+    }
+
+    // the batch writes straight into the container, and matches single calls
+    std::vector<cpid::uuid> uuids(inputs.size());
+    CU_ASSERT_FALSE(handle.make_batch(inputs, uuids));
+    int mismatches = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        cpid::uuid uuid;
+        CU_ASSERT_FALSE(handle.make(inputs[i], uuid));
+        if (uuid != uuids[i]) {
+            mismatches++;
+        }
+    }
+    CU_ASSERT_EQUAL(mismatches, 0);
+
+    // distinct inputs make distinct CPIDs
+    const std::unordered_set<cpid::uuid> distinct(uuids.begin(), uuids.end());
+    CU_ASSERT_EQUAL(distinct.size(), inputs.size());
+
+    // too small an output is rejected
+    CU_ASSERT_TRUE(static_cast<bool>(handle.make_batch(inputs, std::span(uuids).first(inputs.size() - 1))));
+    CU_ASSERT_FALSE(handle.make_batch(std::span(inputs).first(0), std::span(uuids).first(0)));
+
+    std::vector<char> strings(uuids.size() * (CPID_UUID_STRING_LENGTH + 1));
+    CU_ASSERT_FALSE(cpid::format_batch(uuids, strings, CPID_UUID_STRING_LENGTH + 1));
+    CU_ASSERT_STRING_EQUAL(strings.data(), uuids[0].to_string().c_str());
+    CU_ASSERT_STRING_EQUAL(strings.data() + (uuids.size() - 1) * (CPID_UUID_STRING_LENGTH + 1), uuids.back().to_string().c_str());
+    CU_ASSERT_TRUE(static_cast<bool>(cpid::format_batch(uuids, strings, CPID_UUID_STRING_LENGTH)));
+}
+
+#if defined(__linux__)
+void test_cpid_cpp_context(void) {
+    cpid::context context;
+    cpid::context shared = context;
+    cpid::handle first(context);
+    cpid::handle second(shared);
+
+    cpid::uuid first_uuid, second_uuid;
+    CU_ASSERT_FALSE(first.get(getpid(), first_uuid));
+    CU_ASSERT_FALSE(second.get(getpid(), second_uuid));
+    CU_ASSERT_TRUE(first_uuid == second_uuid);
+}
+#endif
+
+int main(void) {
+    CU_initialize_registry();
+    CU_pSuite suite = CU_add_suite("CPID C++ Test Suite", 0, 0);
+
+    CU_add_test(suite, "Test CPID C++ get", test_cpid_cpp_get);
+    CU_add_test(suite, "Test CPID C++ move", test_cpid_cpp_move);
+    CU_add_test(suite, "Test CPID C++ make batch", test_cpid_cpp_make_batch);
+#if defined(__linux__)
+    CU_add_test(suite, "Test CPID C++ context", test_cpid_cpp_context);
+#endif
+
+    CU_basic_run_tests();
+    int number_of_failures = CU_get_number_of_failures();
+    CU_cleanup_registry();
+    return number_of_failures;
+}
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include <cpid/cpid_format.h>
+#include <stdint.h>
+#include <string.h>
+#include <uuid/uuid.h>
+
+#define FORMAT_TEST_UUID_COUNT 1000
+#define FORMAT_TEST_STRIDE 40
+
+void test_cpid_format_batch(void) {
+    // every nibble value in every position, against libuuid
+    static uuid_t uuids[FORMAT_TEST_UUID_COUNT];
+    uint64_t state = 1;
+    for (size_t i = 0; i < FORMAT_TEST_UUID_COUNT; i++) {
+        for (size_t j = 0; j < sizeof(uuid_t); j++) {
+            state = state * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+            uuids[i][j] = (uint8_t) (state >> 56);
+        }
+    }
+    memset(uuids[0], 0x00, sizeof(uuid_t));
+    memset(uuids[1], 0xFF, sizeof(uuid_t));
+    for (size_t j = 0; j < sizeof(uuid_t); j++) {
+        uuids[2][j] = (uint8_t) (j * 0x11);
+    }
+
+    static char strings[FORMAT_TEST_UUID_COUNT * FORMAT_TEST_STRIDE];
+    memset(strings, '#', sizeof(strings));
+    CU_ASSERT_EQUAL(cpid_format_batch(uuids, FORMAT_TEST_UUID_COUNT, strings, FORMAT_TEST_STRIDE), 0);
+
+    int mismatches = 0;
+    for (size_t i = 0; i < FORMAT_TEST_UUID_COUNT; i++) {
+        char expected[CPID_UUID_STRING_LENGTH + 1] = {0};
+        uuid_unparse_lower(uuids[i], expected);
+        const char *actual = strings + i * FORMAT_TEST_STRIDE;
+        if (strcmp(actual, expected)) {
+            mismatches++;
+        }
+        // bytes after the terminator are left alone
+        if ('#' != actual[CPID_UUID_STRING_LENGTH + 1] || '#' != actual[FORMAT_TEST_STRIDE - 1]) {
+            mismatches++;
+        }
+    }
+    CU_ASSERT_EQUAL(mismatches, 0);
+    CU_ASSERT_STRING_EQUAL(strings + 2 * FORMAT_TEST_STRIDE, "00112233-4455-6677-8899-aabbccddeeff");
+
+    // the smallest stride
+    char packed[2][CPID_UUID_STRING_LENGTH + 1];
+    CU_ASSERT_EQUAL(cpid_format_batch(uuids + 1, 2, packed[0], sizeof(packed[0])), 0);
+    CU_ASSERT_STRING_EQUAL(packed[0], "ffffffff-ffff-ffff-ffff-ffffffffffff");
+    CU_ASSERT_STRING_EQUAL(packed[1], "00112233-4455-6677-8899-aabbccddeeff");
+
+    // invalid args
+    CU_ASSERT_EQUAL(cpid_format_batch(uuids, 1, strings, CPID_UUID_STRING_LENGTH), -1);
+    CU_ASSERT_EQUAL(cpid_format_batch(NULL, 1, strings, FORMAT_TEST_STRIDE), -1);
+    CU_ASSERT_EQUAL(cpid_format_batch(uuids, 1, NULL, FORMAT_TEST_STRIDE), -1);
+    CU_ASSERT_EQUAL(cpid_format_batch(NULL, 0, NULL, FORMAT_TEST_STRIDE), 0);
+}
+
+void test_cpid_format_guid_batch(void) {
+    // the memory layout of the GUID {00112233-4455-6677-8899-aabbccddeeff} on Windows
+    const uint8_t guid[16] = {0x33, 0x22, 0x11, 0x00, 0x55, 0x44, 0x77, 0x66, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+    char string[CPID_UUID_STRING_LENGTH + 1] = {0};
+    CU_ASSERT_EQUAL(cpid_format_guid_batch(guid, 1, string, sizeof(string)), 0);
+    CU_ASSERT_STRING_EQUAL(string, "00112233-4455-6677-8899-aabbccddeeff");
+
+    // invalid args
+    CU_ASSERT_EQUAL(cpid_format_guid_batch(guid, 1, string, CPID_UUID_STRING_LENGTH), -1);
+    CU_ASSERT_EQUAL(cpid_format_guid_batch(NULL, 1, string, sizeof(string)), -1);
+}
+
+int main(void) {
+    CU_initialize_registry();
+    CU_pSuite suite = CU_add_suite("CPID Format Test Suite", 0, 0);
+
+    CU_add_test(suite, "Test CPID format batch", test_cpid_format_batch);
+    CU_add_test(suite, "Test CPID format GUID batch", test_cpid_format_guid_batch);
+
+    CU_basic_run_tests();
+    int number_of_failures = CU_get_number_of_failures();
+    CU_cleanup_registry();
+    return number_of_failures;
+}
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include <cpid/cpid_map.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// deterministic UUIDv8 formatted keys, like CPID UUIDs
+static void make_test_key(const uint64_t index, uuid_t key) {
+    uint64_t state = index * UINT64_C(0x9E3779B97F4A7C15) + 1;
+    for (size_t i = 0; i < sizeof(uuid_t); i++) {
+        // splitmix64 step per byte keeps the bytes uniform
+        state += UINT64_C(0x9E3779B97F4A7C15);
+        uint64_t mixed = state;
+        mixed = (mixed ^ (mixed >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+        mixed = (mixed ^ (mixed >> 27)) * UINT64_C(0x94D049BB133111EB);
+        key[i] = (uint8_t) (mixed ^ (mixed >> 31));
+    }
+    key[6] = (key[6] & 0x0F) | 0x80;
+    key[8] = (key[8] & 0x3F) | 0x80;
+}
+
+void test_cpid_map_create_destroy(void) {
+    cpid_map_t map = cpid_map_create(16);
+    CU_ASSERT_PTR_NOT_NULL(map);
+    CU_ASSERT_EQUAL(cpid_map_count(map), 0);
+    cpid_map_destroy(map);
+
+    cpid_map_destroy(NULL);
+
+    // invalid args
+    CU_ASSERT_PTR_NULL(cpid_map_create(0));
+    CU_ASSERT_PTR_NULL(cpid_map_create(SIZE_MAX));
+}
+
+void test_cpid_map_insert_find_remove(void) {
+    #define MAP_TEST_KEY_COUNT 10000
+    cpid_map_t map = cpid_map_create(MAP_TEST_KEY_COUNT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(map);
+
+    // happy path
+    for (uint64_t i = 0; i < MAP_TEST_KEY_COUNT; i++) {
+        uuid_t key;
+        make_test_key(i, key);
+        CU_ASSERT_EQUAL(cpid_map_insert(map, key, i), 0);
+    }
+    CU_ASSERT_EQUAL(cpid_map_count(map), MAP_TEST_KEY_COUNT);
+
+    for (uint64_t i = 0; i < MAP_TEST_KEY_COUNT; i++) {
+        uuid_t key;
+        make_test_key(i, key);
+        uint64_t value = UINT64_MAX;
+        CU_ASSERT_EQUAL(cpid_map_find(map, key, &value), 0);
+        CU_ASSERT_EQUAL(value, i);
+        // set usage
+        CU_ASSERT_EQUAL(cpid_map_find(map, key, NULL), 0);
+    }
+
+    // absent keys
+    for (uint64_t i = MAP_TEST_KEY_COUNT; i < 2 * MAP_TEST_KEY_COUNT; i++) {
+        uuid_t key;
+        make_test_key(i, key);
+        CU_ASSERT_EQUAL(cpid_map_find(map, key, NULL), -1);
+        CU_ASSERT_EQUAL(cpid_map_remove(map, key), -1);
+    }
+
+    // replacing a value doesn't add an entry
+    uuid_t replaced_key;
+    make_test_key(0, replaced_key);
+    CU_ASSERT_EQUAL(cpid_map_insert(map, replaced_key, 42), 0);
+    uint64_t replaced_value = 0;
+    CU_ASSERT_EQUAL(cpid_map_find(map, replaced_key, &replaced_value), 0);
+    CU_ASSERT_EQUAL(replaced_value, 42);
+    CU_ASSERT_EQUAL(cpid_map_count(map), MAP_TEST_KEY_COUNT);
+
+    // removing every other key leaves the others reachable, including ones that overflowed
+    for (uint64_t i = 0; i < MAP_TEST_KEY_COUNT; i += 2) {
+        uuid_t key;
+        make_test_key(i, key);
+        CU_ASSERT_EQUAL(cpid_map_remove(map, key), 0);
+    }
+    CU_ASSERT_EQUAL(cpid_map_count(map), MAP_TEST_KEY_COUNT / 2);
+    for (uint64_t i = 0; i < MAP_TEST_KEY_COUNT; i++) {
+        uuid_t key;
+        make_test_key(i, key);
+        uint64_t value = UINT64_MAX;
+        if (i % 2) {
+            CU_ASSERT_EQUAL(cpid_map_find(map, key, &value), 0);
+            CU_ASSERT_EQUAL(value, i);
+        } else {
+            CU_ASSERT_EQUAL(cpid_map_find(map, key, &value), -1);
+        }
+    }
+
+    // invalid args
+    uuid_t zero_key = {0};
+    CU_ASSERT_EQUAL(cpid_map_insert(map, zero_key, 0), -1);
+    CU_ASSERT_EQUAL(cpid_map_insert(NULL, replaced_key, 0), -1);
+    CU_ASSERT_EQUAL(cpid_map_insert(map, NULL, 0), -1);
+    CU_ASSERT_EQUAL(cpid_map_find(NULL, replaced_key, NULL), -1);
+    CU_ASSERT_EQUAL(cpid_map_find(map, NULL, NULL), -1);
+    CU_ASSERT_EQUAL(cpid_map_remove(NULL, replaced_key), -1);
+    CU_ASSERT_EQUAL(cpid_map_remove(map, NULL), -1);
+    CU_ASSERT_EQUAL(cpid_map_count(NULL), 0);
+
+    cpid_map_destroy(map);
+}
+
+void test_cpid_map_full(void) {
+    #define MAP_TEST_SMALL_CAPACITY 4
+    cpid_map_t map = cpid_map_create(MAP_TEST_SMALL_CAPACITY);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(map);
+
+    // the map holds at least capacity entries and eventually rejects inserts
+    uint64_t inserted_count = 0;
+    int insert_failed = 0;
+    for (uint64_t i = 0; i < 1000 && !insert_failed; i++) {
+        uuid_t key;
+        make_test_key(i, key);
+        if (cpid_map_insert(map, key, i)) {
+            insert_failed = 1;
+        } else {
+            inserted_count++;
+        }
+    }
+    CU_ASSERT_EQUAL(insert_failed, 1);
+    CU_ASSERT(inserted_count >= MAP_TEST_SMALL_CAPACITY);
+    CU_ASSERT_EQUAL(cpid_map_count(map), inserted_count);
+
+    // every inserted key is still found
+    for (uint64_t i = 0; i < inserted_count; i++) {
+        uuid_t key;
+        make_test_key(i, key);
+        CU_ASSERT_EQUAL(cpid_map_find(map, key, NULL), 0);
+    }
+
+    cpid_map_destroy(map);
+}
+
+#define MAP_TEST_STABLE_KEY_COUNT 1000
+#define MAP_TEST_CHURN_KEY_COUNT 1000
+#define MAP_TEST_READER_COUNT 4
+
+typedef struct {
+    cpid_map_t map;
+    atomic_int done;
+    atomic_int reader_failures;
+} map_threads_test_t;
+
+static void *map_reader_main(void *argument) {
+    map_threads_test_t *const test = argument;
+    int failures = 0;
+
+    while (!atomic_load(&test->done)) {
+        for (uint64_t i = 0; i < MAP_TEST_STABLE_KEY_COUNT; i++) {
+            uuid_t key;
+            make_test_key(i, key);
+            uint64_t value = UINT64_MAX;
+            if (cpid_map_find(test->map, key, &value) || value != i) {
+                failures++;
+            }
+        }
+    }
+
+    atomic_fetch_add(&test->reader_failures, failures);
+
+    return NULL;
+}
+
+void test_cpid_map_threads(void) {
+    map_threads_test_t test = {0};
+    test.map = cpid_map_create(MAP_TEST_STABLE_KEY_COUNT + MAP_TEST_CHURN_KEY_COUNT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(test.map);
+    atomic_init(&test.done, 0);
+    atomic_init(&test.reader_failures, 0);
+
+    for (uint64_t i = 0; i < MAP_TEST_STABLE_KEY_COUNT; i++) {
+        uuid_t key;
+        make_test_key(i, key);
+        CU_ASSERT_EQUAL(cpid_map_insert(test.map, key, i), 0);
+    }
+
+    pthread_t readers[MAP_TEST_READER_COUNT];
+    for (size_t i = 0; i < MAP_TEST_READER_COUNT; i++) {
+        CU_ASSERT_EQUAL_FATAL(pthread_create(&readers[i], NULL, map_reader_main, &test), 0);
+    }
+
+    // churn keys are inserted and removed while the readers look up the stable keys,
+    // which moves overflow counts on the probe sequences of the stable keys
+    #define MAP_TEST_CHURN_ROUNDS 50
+    for (int round = 0; round < MAP_TEST_CHURN_ROUNDS; round++) {
+        for (uint64_t i = 0; i < MAP_TEST_CHURN_KEY_COUNT; i++) {
+            uuid_t key;
+            make_test_key(MAP_TEST_STABLE_KEY_COUNT + i, key);
+            CU_ASSERT_EQUAL(cpid_map_insert(test.map, key, i), 0);
+        }
+        for (uint64_t i = 0; i < MAP_TEST_CHURN_KEY_COUNT; i++) {
+            uuid_t key;
+            make_test_key(MAP_TEST_STABLE_KEY_COUNT + i, key);
+            CU_ASSERT_EQUAL(cpid_map_remove(test.map, key), 0);
+        }
+    }
+
+    atomic_store(&test.done, 1);
+    for (size_t i = 0; i < MAP_TEST_READER_COUNT; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    CU_ASSERT_EQUAL(atomic_load(&test.reader_failures), 0);
+    CU_ASSERT_EQUAL(cpid_map_count(test.map), MAP_TEST_STABLE_KEY_COUNT);
+
+    cpid_map_destroy(test.map);
+}
+
+int main(void) {
+    CU_initialize_registry();
+    CU_pSuite suite = CU_add_suite("CPID Map Test Suite", 0, 0);
+
+    CU_add_test(suite, "Test CPID map create and destroy", test_cpid_map_create_destroy);
+    CU_add_test(suite, "Test CPID map insert, find and remove", test_cpid_map_insert_find_remove);
+    CU_add_test(suite, "Test CPID map full", test_cpid_map_full);
+    CU_add_test(suite, "Test CPID map shared by threads", test_cpid_map_threads);
+
+    CU_basic_run_tests();
+    int number_of_failures = CU_get_number_of_failures();
+    CU_cleanup_registry();
+    return number_of_failures;
+}
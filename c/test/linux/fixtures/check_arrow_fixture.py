@@ -0,0 +1,58 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# Reads arrow_one_row.arrows, the stream that test_arrow_writer.c expects arrow_writer.c to write
+# byte for byte, with pyarrow and checks its schema and row. After a deliberate change of the
+# writer, regenerate the fixture from the writer's output and run this on it.
+
+import sys
+import uuid
+
+import pyarrow as pa
+
+EXPECTED_COLUMNS = [
+    ("pid", pa.int32(), False),
+    ("cpid", pa.binary(16), True),
+    ("creation_time_ticks", pa.uint64(), True),
+    ("pid_namespace", pa.uint64(), True),
+    ("pid_namespace_tgid", pa.int32(), True),
+]
+
+# the example of the specification
+EXPECTED_ROW = {
+    "pid": 29,
+    "cpid": uuid.UUID("b770a0ed-8463-822c-b5f6-30d9081ddbd9").bytes,
+    "creation_time_ticks": 55558,
+    "pid_namespace": 4026532263,
+    "pid_namespace_tgid": 29,
+}
+
+
+def main(path):
+    with pa.OSFile(path, "rb") as source:
+        reader = pa.ipc.open_stream(source)
+        schema = reader.schema
+        batches = list(reader)
+
+    assert [field.name for field in schema] == [name for name, _, _ in EXPECTED_COLUMNS], schema
+    for field, (name, expected_type, nullable) in zip(schema, EXPECTED_COLUMNS):
+        field_type = field.type
+        # pyarrow versions with the canonical extension types read the cpid column as arrow.uuid,
+        # older ones as its storage type with the extension name in the field metadata
+        if isinstance(field_type, pa.ExtensionType):
+            assert field_type.extension_name == "arrow.uuid", field
+            field_type = field_type.storage_type
+        elif name == "cpid":
+            assert field.metadata[b"ARROW:extension:name"] == b"arrow.uuid", field
+        assert field_type == expected_type, field
+        assert field.nullable == nullable, field
+
+    assert len(batches) == 1 and batches[0].num_rows == 1, batches
+    row = {name: batches[0].column(name)[0] for name, _, _ in EXPECTED_COLUMNS}
+    for name, value in row.items():
+        if isinstance(value, pa.ExtensionScalar):
+            value = value.value
+        assert value.as_py() == EXPECTED_ROW[name], (name, value)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1])
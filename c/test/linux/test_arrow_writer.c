@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// We enforce standard C with no extensions in CMake
+// This is needed for the open_memstream method to be defined
+#define _GNU_SOURCE
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arrow_writer.h"
+
+// the fixture holds the schema message, a record batch of the row below and the end-of-stream marker,
+// see fixtures/check_arrow_fixture.py for how it is checked against pyarrow
+#ifndef ARROW_FIXTURE_PATH
+#error "ARROW_FIXTURE_PATH must be defined"
+#endif
+#define ARROW_FIXTURE_MAX_SIZE 4096
+
+static size_t read_fixture(uint8_t *const data, const size_t capacity) {
+    FILE *const file = fopen(ARROW_FIXTURE_PATH, "rb");
+    if (!file) {
+        return 0;
+    }
+    size_t size = fread(data, 1, capacity, file);
+    fclose(file);
+    return size;
+}
+
+static void assert_bytes_equal(const uint8_t *const actual, const size_t actual_size, const uint8_t *const expected, const size_t expected_size) {
+    CU_ASSERT_EQUAL(actual_size, expected_size);
+    for (size_t i = 0; i < actual_size && i < expected_size; i++) {
+        if (actual[i] != expected[i]) {
+            fprintf(stderr, "first mismatch at byte %zu: 0x%02x instead of 0x%02x\n", i, actual[i], expected[i]);
+            CU_FAIL("the bytes differ from the fixture");
+            return;
+        }
+    }
+}
+
+void test_arrow_write_stream(void) {
+    static uint8_t expected[ARROW_FIXTURE_MAX_SIZE];
+    const size_t expected_size = read_fixture(expected, sizeof(expected));
+    CU_ASSERT_FATAL(expected_size > 0);
+
+    // the example of the specification
+    const pid_t pid = 29;
+    cpid_record_t record = {
+        .pid = pid,
+        .input = {.pid_namespace_tgid = 29, .creation_time_ticks = 55558, .pid_namespace = 4026532263},
+    };
+    CU_ASSERT_EQUAL_FATAL(uuid_parse("b770a0ed-8463-822c-b5f6-30d9081ddbd9", record.uuid), 0);
+    const int status = 0;
+
+    char *stream = NULL;
+    size_t stream_size = 0;
+    FILE *const out = open_memstream(&stream, &stream_size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(out);
+
+    // the schema message on its own, then the whole stream
+    CU_ASSERT_EQUAL(arrow_write_schema(out), 0);
+    CU_ASSERT_EQUAL(fflush(out), 0);
+    const size_t schema_size = stream_size;
+    CU_ASSERT(schema_size > 0 && schema_size < expected_size);
+    assert_bytes_equal((const uint8_t *) stream, schema_size, expected, schema_size);
+
+    CU_ASSERT_EQUAL(arrow_write_record_batch(out, &pid, &record, &status, 1), 0);
+    CU_ASSERT_EQUAL(arrow_write_end_of_stream(out), 0);
+    CU_ASSERT_EQUAL(fclose(out), 0);
+    assert_bytes_equal((const uint8_t *) stream, stream_size, expected, expected_size);
+
+    free(stream);
+}
+
+int main(void) {
+    CU_initialize_registry();
+    CU_pSuite suite = CU_add_suite("CPID Arrow Writer Test Suite", 0, 0);
+
+    CU_add_test(suite, "Test Arrow write stream", test_arrow_write_stream);
+
+    CU_basic_run_tests();
+    int number_of_failures = CU_get_number_of_failures();
+    CU_cleanup_registry();
+    return number_of_failures;
+}
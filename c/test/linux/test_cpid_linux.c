@@ -1,9 +1,24 @@
 // SPDX-License-Identifier: Apache-2.0
 
+// We enforce standard C with no extensions in CMake
+// This is needed for the syscall method to be defined
+#define _GNU_SOURCE
+
 #include <CUnit/CUnit.h>
 #include <CUnit/Basic.h>
 
 #include <cpid/cpid_linux.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #define BAD_PID 0xFFFFFFFF
@@ -16,6 +31,164 @@ void test_cpid_initialize_finalize(void) {
     cpid_finalize(NULL);
 }
 
+void test_cpid_context(void) {
+    // invalid args
+    CU_ASSERT_PTR_NULL(cpid_initialize_from_context(NULL));
+    CU_ASSERT_PTR_NULL(cpid_context_retain(NULL));
+    cpid_context_release(NULL);
+
+    cpid_context_t context = cpid_context_create();
+    CU_ASSERT_PTR_NOT_NULL(context);
+
+    CU_ASSERT_PTR_EQUAL(cpid_context_retain(context), context);
+    cpid_context_release(context);
+
+    cpid_handle_t handle_from_context = cpid_initialize_from_context(context);
+    CU_ASSERT_PTR_NOT_NULL(handle_from_context);
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    // the handle keeps the context alive
+    cpid_context_release(context);
+
+    // check that handles from a context behave like standalone handles
+    uuid_t uuid_from_context = {0};
+    uuid_t uuid = {0};
+    CU_ASSERT_EQUAL(cpid_make_uuid(handle_from_context, 1, 1, 1, uuid_from_context), 0);
+    CU_ASSERT_EQUAL(cpid_make_uuid(handle, 1, 1, 1, uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid_from_context, uuid, sizeof(uuid_t)), 0);
+
+    cpid_finalize(handle);
+    cpid_finalize(handle_from_context);
+}
+
+void test_cpid_context_with_boot_uuid(void) {
+    // invalid args
+    CU_ASSERT_PTR_NULL(cpid_context_create_with_boot_uuid(NULL));
+
+    // inputs recorded on another host, with the CPID UUID that the host calculated
+    uuid_t boot_uuid = {0};
+    CU_ASSERT_EQUAL(uuid_parse("2899dae4-4fa4-4eef-95b6-6bc95325f61a", boot_uuid), 0);
+    uuid_t expected_uuid = {0};
+    CU_ASSERT_EQUAL(uuid_parse("b770a0ed-8463-822c-b5f6-30d9081ddbd9", expected_uuid), 0);
+
+    cpid_context_t context = cpid_context_create_with_boot_uuid(boot_uuid);
+    CU_ASSERT_PTR_NOT_NULL(context);
+    cpid_handle_t handle = cpid_initialize_from_context(context);
+    CU_ASSERT_PTR_NOT_NULL(handle);
+    cpid_context_release(context);
+
+    uuid_t uuid = {0};
+    CU_ASSERT_EQUAL(cpid_make_uuid(handle, 29, 55558, 4026532263, uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid, expected_uuid, sizeof(uuid_t)), 0);
+
+    cpid_linux_input_t input = {.pid_namespace_tgid = 29, .creation_time_ticks = 55558, .pid_namespace = 4026532263};
+    uuid_t batch_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_make_uuid_batch(handle, &input, 1, &batch_uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(batch_uuid, expected_uuid, sizeof(uuid_t)), 0);
+
+    // local processes can't be sourced without /proc
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, getpid(), uuid), -1);
+    // nor can their events be streamed
+    errno = 0;
+    CU_ASSERT_PTR_NULL(cpid_stream_open(handle));
+    CU_ASSERT_EQUAL(errno, ENOTSUP);
+
+    cpid_finalize(handle);
+}
+
+#define CONTEXT_TEST_THREAD_COUNT 8
+#define CONTEXT_TEST_ITERATIONS 1000
+
+typedef struct {
+    cpid_context_t context;
+    int failures;
+    uuid_t uuid;
+} context_test_thread_t;
+
+static void *context_test_thread(void *argument) {
+    context_test_thread_t *thread = (context_test_thread_t *) argument;
+
+    cpid_handle_t handle = cpid_initialize_from_context(thread->context);
+    if (!handle) {
+        thread->failures++;
+        return NULL;
+    }
+
+    for (int i = 0; i < CONTEXT_TEST_ITERATIONS; i++) {
+        uuid_t uuid = {0};
+        if (cpid_get_uuid(handle, getpid(), uuid) || (i && memcmp(uuid, thread->uuid, sizeof(uuid_t)))) {
+            thread->failures++;
+        }
+        memcpy(thread->uuid, uuid, sizeof(uuid_t));
+    }
+
+    cpid_finalize(handle);
+    return NULL;
+}
+
+void test_cpid_context_threads(void) {
+    cpid_context_t context = cpid_context_create();
+    CU_ASSERT_PTR_NOT_NULL(context);
+
+    pthread_t threads[CONTEXT_TEST_THREAD_COUNT];
+    context_test_thread_t thread_data[CONTEXT_TEST_THREAD_COUNT] = {0};
+    for (int i = 0; i < CONTEXT_TEST_THREAD_COUNT; i++) {
+        thread_data[i].context = context;
+        CU_ASSERT_EQUAL(pthread_create(&threads[i], NULL, context_test_thread, &thread_data[i]), 0);
+    }
+    for (int i = 0; i < CONTEXT_TEST_THREAD_COUNT; i++) {
+        CU_ASSERT_EQUAL(pthread_join(threads[i], NULL), 0);
+    }
+
+    // check that concurrent handles sharing the context all agree
+    for (int i = 0; i < CONTEXT_TEST_THREAD_COUNT; i++) {
+        CU_ASSERT_EQUAL(thread_data[i].failures, 0);
+        CU_ASSERT_EQUAL(memcmp(thread_data[0].uuid, thread_data[i].uuid, sizeof(uuid_t)), 0);
+    }
+
+    cpid_context_release(context);
+}
+
+void test_cpid_initialize_lazy(void) {
+    cpid_context_t context = cpid_context_get_default();
+    CU_ASSERT_PTR_NOT_NULL(context);
+    // later calls take a reference to the same context
+    CU_ASSERT_PTR_EQUAL(cpid_context_get_default(), context);
+    cpid_context_release(context);
+
+    // the first digests of the threads race to fetch the SHA-256 implementation
+    pthread_t threads[CONTEXT_TEST_THREAD_COUNT];
+    context_test_thread_t thread_data[CONTEXT_TEST_THREAD_COUNT] = {0};
+    for (int i = 0; i < CONTEXT_TEST_THREAD_COUNT; i++) {
+        thread_data[i].context = context;
+        CU_ASSERT_EQUAL(pthread_create(&threads[i], NULL, context_test_thread, &thread_data[i]), 0);
+    }
+    for (int i = 0; i < CONTEXT_TEST_THREAD_COUNT; i++) {
+        CU_ASSERT_EQUAL(pthread_join(threads[i], NULL), 0);
+        CU_ASSERT_EQUAL(thread_data[i].failures, 0);
+        CU_ASSERT_EQUAL(memcmp(thread_data[0].uuid, thread_data[i].uuid, sizeof(uuid_t)), 0);
+    }
+
+    // the last reference of a caller doesn't free the default context
+    cpid_context_release(context);
+    cpid_handle_t lazy_handle = cpid_initialize_lazy();
+    CU_ASSERT_PTR_NOT_NULL(lazy_handle);
+
+    // check that lazy handles behave like standalone handles
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+    uuid_t lazy_uuid = {0};
+    uuid_t uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(lazy_handle, getpid(), lazy_uuid), 0);
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, getpid(), uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(lazy_uuid, uuid, sizeof(uuid_t)), 0);
+    CU_ASSERT_EQUAL(memcmp(thread_data[0].uuid, uuid, sizeof(uuid_t)), 0);
+
+    cpid_finalize(handle);
+    cpid_finalize(lazy_handle);
+}
+
 void test_cpid_make_uuid(void) {
     pid_t self_pid = getpid();
 
@@ -47,6 +220,42 @@ void test_cpid_make_uuid(void) {
     cpid_finalize(handle);
 }
 
+void test_cpid_make_uuid_batch(void) {
+    pid_t self_pid = getpid();
+
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    // happy path, with full 16, 8 and 4 wide vector lanes and a remainder
+    #define BATCH_SIZE 37
+    cpid_linux_input_t inputs[BATCH_SIZE] = {0};
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+        inputs[i].pid_namespace_tgid = self_pid + (pid_t) i;
+        inputs[i].creation_time_ticks = 1 + i;
+        inputs[i].pid_namespace = 1;
+    }
+    uuid_t uuids_batch[BATCH_SIZE] = {0};
+    CU_ASSERT_EQUAL(cpid_make_uuid_batch(handle, inputs, BATCH_SIZE, uuids_batch), 0);
+    // check that each batch result matches the single calculation
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+        uuid_t uuid_single = {0};
+        CU_ASSERT_EQUAL(cpid_make_uuid(handle, inputs[i].pid_namespace_tgid, inputs[i].creation_time_ticks, inputs[i].pid_namespace, uuid_single), 0);
+        CU_ASSERT_EQUAL(memcmp(uuid_single, uuids_batch[i], sizeof(uuid_t)), 0);
+    }
+    // check that different inputs yield different outputs
+    CU_ASSERT_NOT_EQUAL(memcmp(uuids_batch[0], uuids_batch[1], sizeof(uuid_t)), 0);
+
+    // empty batch
+    CU_ASSERT_EQUAL(cpid_make_uuid_batch(handle, NULL, 0, NULL), 0);
+
+    // invalid args
+    CU_ASSERT_EQUAL(cpid_make_uuid_batch(NULL, inputs, BATCH_SIZE, uuids_batch), -1);
+    CU_ASSERT_EQUAL(cpid_make_uuid_batch(handle, NULL, BATCH_SIZE, uuids_batch), -1);
+    CU_ASSERT_EQUAL(cpid_make_uuid_batch(handle, inputs, BATCH_SIZE, NULL), -1);
+
+    cpid_finalize(handle);
+}
+
 void test_cpid_get_uuid(void) {
     pid_t self_pid = getpid();
 
@@ -81,6 +290,63 @@ void test_cpid_get_uuid(void) {
     cpid_finalize(handle);
 }
 
+void test_cpid_get_uuid_pidfd(void) {
+    pid_t self_pid = getpid();
+
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    int self_pidfd = (int) syscall(SYS_pidfd_open, self_pid, 0);
+    CU_ASSERT(self_pidfd >= 0);
+
+    // happy path
+    uuid_t uuid_pid = {0};
+    uuid_t uuid_pidfd = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, self_pid, uuid_pid), 0);
+    CU_ASSERT_EQUAL(cpid_get_uuid_pidfd(handle, self_pidfd, uuid_pidfd), 0);
+    // check that the pidfd lookup matches the PID lookup for the same process
+    CU_ASSERT_EQUAL(memcmp(uuid_pid, uuid_pidfd, sizeof(uuid_t)), 0);
+
+    // init can be looked up through its pidfd whenever it can be looked up by PID,
+    // even by callers that may not signal it
+    uuid_t uuid_init_pid = {0};
+    int init_pidfd = (int) syscall(SYS_pidfd_open, 1, 0);
+    if (init_pidfd >= 0 && 0 == cpid_get_uuid(handle, 1, uuid_init_pid)) {
+        uuid_t uuid_init_pidfd = {0};
+        CU_ASSERT_EQUAL(cpid_get_uuid_pidfd(handle, init_pidfd, uuid_init_pidfd), 0);
+        CU_ASSERT_EQUAL(memcmp(uuid_init_pid, uuid_init_pidfd, sizeof(uuid_t)), 0);
+    }
+    if (init_pidfd >= 0) {
+        close(init_pidfd);
+    }
+
+    // a reaped process can't be looked up through its pidfd
+    pid_t child_pid = fork();
+    if (0 == child_pid) {
+        _exit(0);
+    }
+    CU_ASSERT(child_pid > 0);
+    int child_pidfd = (int) syscall(SYS_pidfd_open, child_pid, 0);
+    CU_ASSERT(child_pidfd >= 0);
+    CU_ASSERT_EQUAL(waitpid(child_pid, NULL, 0), child_pid);
+    uuid_t uuid_reaped = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid_pidfd(handle, child_pidfd, uuid_reaped), -1);
+    close(child_pidfd);
+
+    // invalid args
+    uuid_t uuid_invalid_args = {0};
+    int not_a_pidfd = open("/dev/null", O_RDONLY);
+    CU_ASSERT(not_a_pidfd >= 0);
+    CU_ASSERT_EQUAL(cpid_get_uuid_pidfd(NULL, self_pidfd, uuid_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_uuid_pidfd(handle, -1, uuid_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_uuid_pidfd(handle, not_a_pidfd, uuid_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_uuid_pidfd(handle, self_pidfd, NULL), -1);
+    close(not_a_pidfd);
+
+    close(self_pidfd);
+    cpid_finalize(handle);
+}
+
 void test_cpid_get_uuid_string(void) {
     pid_t self_pid = getpid();
 
@@ -116,14 +382,706 @@ void test_cpid_get_uuid_string(void) {
     cpid_finalize(handle);
 }
 
+void test_cpid_get_process_record(void) {
+    pid_t self_pid = getpid();
+
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    uuid_t self_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, self_pid, self_uuid), 0);
+
+    // happy path
+    cpid_record_t self_record;
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, self_pid, 0, &self_record), 0);
+    CU_ASSERT_EQUAL(self_record.pid, self_pid);
+    CU_ASSERT_EQUAL(self_record.parent_pid, getppid());
+    CU_ASSERT_EQUAL(memcmp(self_record.uuid, self_uuid, sizeof(uuid_t)), 0);
+    CU_ASSERT_EQUAL(self_record.parent_status, -1);
+    // the inputs reproduce the CPID UUID
+    uuid_t uuid_from_input = {0};
+    CU_ASSERT_EQUAL(cpid_make_uuid(handle, self_record.input.pid_namespace_tgid, self_record.input.creation_time_ticks, self_record.input.pid_namespace, uuid_from_input), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid_from_input, self_uuid, sizeof(uuid_t)), 0);
+
+    // the parent CPID UUID of a child is the CPID UUID of this process, with and without a cache
+    int pipe_fds[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(pipe_fds), 0);
+    pid_t child_pid = fork();
+    CU_ASSERT_FATAL(child_pid >= 0);
+    if (0 == child_pid) {
+        close(pipe_fds[1]);
+        char byte;
+        (void) !read(pipe_fds[0], &byte, 1);
+        _exit(0);
+    }
+    close(pipe_fds[0]);
+
+    for (int cached = 0; cached < 2; cached++) {
+        CU_ASSERT_EQUAL(cpid_cache_enable(handle, cached ? 16 : 0, 0), 0);
+        for (int i = 0; i < 2; i++) {
+            cpid_record_t child_record;
+            CU_ASSERT_EQUAL(cpid_get_process_record(handle, child_pid, CPID_RECORD_PARENT_UUID, &child_record), 0);
+            CU_ASSERT_EQUAL(child_record.pid, child_pid);
+            CU_ASSERT_EQUAL(child_record.parent_pid, self_pid);
+            CU_ASSERT_EQUAL(child_record.parent_status, 0);
+            CU_ASSERT_EQUAL(memcmp(child_record.parent_uuid, self_uuid, sizeof(uuid_t)), 0);
+            CU_ASSERT(child_record.input.creation_time_ticks >= self_record.input.creation_time_ticks);
+        }
+    }
+
+    close(pipe_fds[1]);
+    CU_ASSERT_EQUAL(waitpid(child_pid, NULL, 0), child_pid);
+
+    // invalid args
+    cpid_record_t record_invalid_args;
+    CU_ASSERT_EQUAL(cpid_get_process_record(NULL, self_pid, 0, &record_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, self_pid, 0, NULL), -1);
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, self_pid, ~CPID_RECORD_PARENT_UUID, &record_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, child_pid, 0, &record_invalid_args), -1);
+
+    cpid_finalize(handle);
+}
+
+void test_cpid_get_ancestry(void) {
+    pid_t self_pid = getpid();
+
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    uuid_t self_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, self_pid, self_uuid), 0);
+
+    // a child that forks a grandchild, both wait for the pipe to close
+    int pipe_fds[2];
+    int grandchild_pipe_fds[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(pipe_fds), 0);
+    CU_ASSERT_EQUAL_FATAL(pipe(grandchild_pipe_fds), 0);
+    pid_t child_pid = fork();
+    CU_ASSERT_FATAL(child_pid >= 0);
+    if (0 == child_pid) {
+        close(pipe_fds[1]);
+        close(grandchild_pipe_fds[0]);
+        pid_t grandchild_pid = fork();
+        if (grandchild_pid >= 0) {
+            if (grandchild_pid) {
+                (void) !write(grandchild_pipe_fds[1], &grandchild_pid, sizeof(grandchild_pid));
+            }
+            close(grandchild_pipe_fds[1]);
+            char byte;
+            (void) !read(pipe_fds[0], &byte, 1);
+            if (grandchild_pid) {
+                waitpid(grandchild_pid, NULL, 0);
+            }
+        }
+        _exit(0);
+    }
+    close(pipe_fds[0]);
+    close(grandchild_pipe_fds[1]);
+
+    pid_t grandchild_pid = 0;
+    CU_ASSERT_EQUAL(read(grandchild_pipe_fds[0], &grandchild_pid, sizeof(grandchild_pid)), (ssize_t) sizeof(grandchild_pid));
+    close(grandchild_pipe_fds[0]);
+
+    uuid_t child_uuid = {0};
+    uuid_t grandchild_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, child_pid, child_uuid), 0);
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, grandchild_pid, grandchild_uuid), 0);
+
+    // happy path, without a cache, with a cache and with hits from the cache
+    #define ANCESTRY_TEST_MAX_DEPTH 64
+    for (int run = 0; run < 3; run++) {
+        if (1 == run) {
+            CU_ASSERT_EQUAL(cpid_cache_enable(handle, 64, 0), 0);
+        }
+
+        uuid_t chain[ANCESTRY_TEST_MAX_DEPTH];
+        size_t depth = 0;
+        CU_ASSERT_EQUAL(cpid_get_ancestry(handle, grandchild_pid, chain, ANCESTRY_TEST_MAX_DEPTH, &depth), 0);
+        CU_ASSERT(depth >= 3);
+        CU_ASSERT(depth < ANCESTRY_TEST_MAX_DEPTH);
+        CU_ASSERT_EQUAL(memcmp(chain[0], grandchild_uuid, sizeof(uuid_t)), 0);
+        CU_ASSERT_EQUAL(memcmp(chain[1], child_uuid, sizeof(uuid_t)), 0);
+        CU_ASSERT_EQUAL(memcmp(chain[2], self_uuid, sizeof(uuid_t)), 0);
+
+        // the chain of this process is the tail of the chain of the grandchild
+        uuid_t self_chain[ANCESTRY_TEST_MAX_DEPTH];
+        size_t self_depth = 0;
+        CU_ASSERT_EQUAL(cpid_get_ancestry(handle, self_pid, self_chain, ANCESTRY_TEST_MAX_DEPTH, &self_depth), 0);
+        CU_ASSERT_EQUAL(self_depth + 2, depth);
+        CU_ASSERT_EQUAL(memcmp(self_chain, chain[2], self_depth * sizeof(uuid_t)), 0);
+
+        // the chain is cut at max_depth
+        CU_ASSERT_EQUAL(cpid_get_ancestry(handle, grandchild_pid, chain, 2, &depth), 0);
+        CU_ASSERT_EQUAL(depth, 2);
+    }
+
+    close(pipe_fds[1]);
+    CU_ASSERT_EQUAL(waitpid(child_pid, NULL, 0), child_pid);
+
+    // invalid args
+    uuid_t chain_invalid_args[1];
+    size_t depth_invalid_args = 0;
+    CU_ASSERT_EQUAL(cpid_get_ancestry(NULL, self_pid, chain_invalid_args, 1, &depth_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_ancestry(handle, self_pid, NULL, 1, &depth_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_ancestry(handle, self_pid, chain_invalid_args, 0, &depth_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_ancestry(handle, self_pid, chain_invalid_args, 1, NULL), -1);
+    CU_ASSERT_EQUAL(cpid_get_ancestry(handle, child_pid, chain_invalid_args, 1, &depth_invalid_args), -1);
+
+    cpid_finalize(handle);
+}
+
+void test_cpid_cache(void) {
+    pid_t self_pid = getpid();
+
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    uuid_t self_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, self_pid, self_uuid), 0);
+
+    // invalid args
+    CU_ASSERT_EQUAL(cpid_cache_enable(NULL, 16, 0), -1);
+    CU_ASSERT_EQUAL(cpid_cache_enable(handle, 16, ~CPID_CACHE_TRUST_EVICTION), -1);
+    cpid_cache_evict(NULL, self_pid);
+
+    // revalidated hits yield the same output as uncached calls
+    CU_ASSERT_EQUAL(cpid_cache_enable(handle, 16, 0), 0);
+    for (int i = 0; i < 3; i++) {
+        uuid_t uuid = {0};
+        CU_ASSERT_EQUAL(cpid_get_uuid(handle, self_pid, uuid), 0);
+        CU_ASSERT_EQUAL(memcmp(uuid, self_uuid, sizeof(uuid_t)), 0);
+    }
+
+    // reaped children aren't returned from a revalidating cache
+    #define CACHE_TEST_CHILD_COUNT 200
+    pid_t children[CACHE_TEST_CHILD_COUNT] = {0};
+    uuid_t child_uuids[CACHE_TEST_CHILD_COUNT];
+    int pipe_fds[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(pipe_fds), 0);
+    for (size_t i = 0; i < CACHE_TEST_CHILD_COUNT; i++) {
+        children[i] = fork();
+        CU_ASSERT_FATAL(children[i] >= 0);
+        if (0 == children[i]) {
+            // wait for the parent to close the write end
+            close(pipe_fds[1]);
+            char byte;
+            (void) !read(pipe_fds[0], &byte, 1);
+            _exit(0);
+        }
+    }
+    close(pipe_fds[0]);
+
+    CU_ASSERT_EQUAL(cpid_cache_enable(handle, 2 * CACHE_TEST_CHILD_COUNT, 0), 0);
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, children[0], child_uuids[0]), 0);
+
+    // a trusting cache returns entries until they are evicted,
+    // which makes hits and misses observable through the reaped children
+    cpid_handle_t trusting_handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(trusting_handle);
+    CU_ASSERT_EQUAL(cpid_cache_enable(trusting_handle, 2 * CACHE_TEST_CHILD_COUNT, CPID_CACHE_TRUST_EVICTION), 0);
+    for (size_t i = 0; i < CACHE_TEST_CHILD_COUNT; i++) {
+        CU_ASSERT_EQUAL(cpid_get_uuid(trusting_handle, children[i], child_uuids[i]), 0);
+    }
+
+    close(pipe_fds[1]);
+    for (size_t i = 0; i < CACHE_TEST_CHILD_COUNT; i++) {
+        CU_ASSERT_EQUAL(waitpid(children[i], NULL, 0), children[i]);
+    }
+
+    uuid_t uuid_stale = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, children[0], uuid_stale), -1);
+
+    // evict every other child, the remaining entries must still be found
+    for (size_t i = 0; i < CACHE_TEST_CHILD_COUNT; i += 2) {
+        cpid_cache_evict(trusting_handle, children[i]);
+    }
+    for (size_t i = 0; i < CACHE_TEST_CHILD_COUNT; i++) {
+        uuid_t uuid = {0};
+        if (i % 2) {
+            CU_ASSERT_EQUAL(cpid_get_uuid(trusting_handle, children[i], uuid), 0);
+            CU_ASSERT_EQUAL(memcmp(uuid, child_uuids[i], sizeof(uuid_t)), 0);
+        } else {
+            CU_ASSERT_EQUAL(cpid_get_uuid(trusting_handle, children[i], uuid), -1);
+        }
+    }
+
+    // a full cache replaces entries but keeps yielding correct output
+    CU_ASSERT_EQUAL(cpid_cache_enable(trusting_handle, 4, 0), 0);
+    for (size_t i = 0; i < CACHE_TEST_CHILD_COUNT; i++) {
+        uuid_t uuid = {0};
+        CU_ASSERT_EQUAL(cpid_get_uuid(trusting_handle, children[i], uuid), -1);
+    }
+    for (int i = 0; i < 3; i++) {
+        uuid_t uuid = {0};
+        CU_ASSERT_EQUAL(cpid_get_uuid(trusting_handle, self_pid, uuid), 0);
+        CU_ASSERT_EQUAL(memcmp(uuid, self_uuid, sizeof(uuid_t)), 0);
+    }
+
+    // disabling the cache
+    CU_ASSERT_EQUAL(cpid_cache_enable(trusting_handle, 0, 0), 0);
+    uuid_t uuid_uncached = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(trusting_handle, self_pid, uuid_uncached), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid_uncached, self_uuid, sizeof(uuid_t)), 0);
+
+    cpid_finalize(trusting_handle);
+    cpid_finalize(handle);
+}
+
+void test_cpid_get_stats(void) {
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(handle);
+
+    cpid_stats_t stats;
+    if (cpid_get_stats(handle, &stats)) {
+        // built without CPID_ENABLE_STATS
+        cpid_finalize(handle);
+        return;
+    }
+
+    // invalid args
+    CU_ASSERT_EQUAL(cpid_get_stats(NULL, &stats), -1);
+    CU_ASSERT_EQUAL(cpid_get_stats(handle, NULL), -1);
+
+    CU_ASSERT_EQUAL(stats.lookups, 0);
+    for (size_t i = 0; i < CPID_STAGE_COUNT; i++) {
+        CU_ASSERT_EQUAL(stats.stages[i].calls, 0);
+    }
+
+    #define STATS_TEST_LOOKUP_COUNT 3
+    uuid_t uuid;
+    for (int i = 0; i < STATS_TEST_LOOKUP_COUNT; i++) {
+        CU_ASSERT_EQUAL(cpid_get_uuid(handle, getpid(), uuid), 0);
+    }
+    // a PID that can't exist fails at opening its /proc directory
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, -1, uuid), -1);
+
+    CU_ASSERT_EQUAL(cpid_get_stats(handle, &stats), 0);
+    CU_ASSERT_EQUAL(stats.lookups, STATS_TEST_LOOKUP_COUNT + 1);
+    CU_ASSERT_EQUAL(stats.lookup_failures, 1);
+    CU_ASSERT_EQUAL(stats.cache_hits, 0);
+    CU_ASSERT_EQUAL(stats.stages[CPID_STAGE_OPEN_PID_DIRECTORY].calls, STATS_TEST_LOOKUP_COUNT + 1);
+    CU_ASSERT_EQUAL(stats.stages[CPID_STAGE_OPEN_PID_DIRECTORY].failures, 1);
+    CU_ASSERT_EQUAL(stats.stages[CPID_STAGE_PID_NAMESPACE].calls, STATS_TEST_LOOKUP_COUNT);
+    CU_ASSERT_EQUAL(stats.stages[CPID_STAGE_CREATION_TIME].calls, STATS_TEST_LOOKUP_COUNT);
+    CU_ASSERT_EQUAL(stats.stages[CPID_STAGE_DIGEST].calls, STATS_TEST_LOOKUP_COUNT);
+    CU_ASSERT_EQUAL(stats.stages[CPID_STAGE_DIGEST].failures, 0);
+    for (size_t i = 0; i < CPID_STAGE_COUNT; i++) {
+        uint64_t histogram_total = 0;
+        for (size_t j = 0; j < CPID_STATS_HISTOGRAM_BUCKET_COUNT; j++) {
+            histogram_total += stats.stages[i].latency_histogram[j];
+        }
+        CU_ASSERT_EQUAL(histogram_total, stats.stages[i].calls);
+    }
+
+    // revalidated cache hits
+    CU_ASSERT_EQUAL(cpid_cache_enable(handle, 16, 0), 0);
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, getpid(), uuid), 0);
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, getpid(), uuid), 0);
+    CU_ASSERT_EQUAL(cpid_get_stats(handle, &stats), 0);
+    CU_ASSERT_EQUAL(stats.cache_hits, 1);
+    CU_ASSERT_EQUAL(stats.stages[CPID_STAGE_CACHE_REVALIDATION].calls, 1);
+
+    cpid_finalize(handle);
+}
+
+void test_cpid_enumerate_all(void) {
+    pid_t self_pid = getpid();
+
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    uuid_t self_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, self_pid, self_uuid), 0);
+
+    // a too small buffer reports the number of processes found
+    size_t process_count = 0;
+    CU_ASSERT_EQUAL(cpid_enumerate_all(handle, NULL, 0, &process_count, 1), -1);
+    CU_ASSERT(process_count > 0);
+
+    // leave room for processes created since the count was taken
+    #define ENUMERATE_TEST_HEADROOM 256
+    size_t cap = process_count + ENUMERATE_TEST_HEADROOM;
+    cpid_entry_t *entries = calloc(cap, sizeof(cpid_entry_t));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(entries);
+
+    // happy path, with a single worker, several workers and one worker per processor
+    const unsigned thread_counts[] = {1, 4, 0};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        size_t n = 0;
+        CU_ASSERT_EQUAL(cpid_enumerate_all(handle, entries, cap, &n, thread_counts[t]), 0);
+        CU_ASSERT(n > 0);
+        CU_ASSERT(n <= cap);
+
+        // the calling process must be present with the same CPID as cpid_get_uuid
+        int found_self = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (self_pid == entries[i].pid) {
+                found_self = 1;
+                CU_ASSERT_EQUAL(memcmp(entries[i].uuid, self_uuid, sizeof(uuid_t)), 0);
+            }
+        }
+        CU_ASSERT_EQUAL(found_self, 1);
+    }
+
+    // the inputs of each entry are those its CPID was made from
+    cpid_record_t self_record = {0};
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, self_pid, 0, &self_record), 0);
+    cpid_linux_input_t *inputs = calloc(cap, sizeof(cpid_linux_input_t));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(inputs);
+    size_t n = 0;
+    CU_ASSERT_EQUAL(cpid_enumerate_all_with_inputs(handle, entries, inputs, cap, &n, 4), 0);
+    CU_ASSERT(n > 0);
+    int found_self = 0;
+    for (size_t i = 0; i < n; i++) {
+        uuid_t uuid = {0};
+        CU_ASSERT_EQUAL(cpid_make_uuid(handle, inputs[i].pid_namespace_tgid, inputs[i].creation_time_ticks, inputs[i].pid_namespace, uuid), 0);
+        CU_ASSERT_EQUAL(memcmp(entries[i].uuid, uuid, sizeof(uuid_t)), 0);
+        CU_ASSERT_EQUAL(entries[i].creation_time_ticks, inputs[i].creation_time_ticks);
+        if (self_pid == entries[i].pid) {
+            found_self = 1;
+            CU_ASSERT_EQUAL(inputs[i].pid_namespace_tgid, self_record.input.pid_namespace_tgid);
+            CU_ASSERT_EQUAL(inputs[i].creation_time_ticks, self_record.input.creation_time_ticks);
+            CU_ASSERT_EQUAL(inputs[i].pid_namespace, self_record.input.pid_namespace);
+        }
+    }
+    CU_ASSERT_EQUAL(found_self, 1);
+    free(inputs);
+
+    // invalid args
+    size_t n_invalid_args = 0;
+    CU_ASSERT_EQUAL(cpid_enumerate_all(NULL, entries, cap, &n_invalid_args, 1), -1);
+    CU_ASSERT_EQUAL(cpid_enumerate_all(handle, entries, cap, NULL, 1), -1);
+    CU_ASSERT_EQUAL(cpid_enumerate_all(handle, NULL, cap, &n_invalid_args, 1), -1);
+
+    free(entries);
+    cpid_finalize(handle);
+}
+
+void test_cpid_stream(void) {
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    // invalid args
+    #define STREAM_TEST_CAPACITY 16
+    cpid_stream_record_t records[STREAM_TEST_CAPACITY] = {0};
+    size_t count = 0;
+    CU_ASSERT_PTR_NULL(cpid_stream_open(NULL));
+    CU_ASSERT_EQUAL(cpid_stream_get_fd(NULL), -1);
+    CU_ASSERT_EQUAL(cpid_stream_next_batch(NULL, records, STREAM_TEST_CAPACITY, &count), -1);
+    cpid_stream_close(NULL);
+
+    cpid_stream_t stream = cpid_stream_open(handle);
+    if (!stream) {
+        // the proc connector requires CAP_NET_ADMIN
+        cpid_finalize(handle);
+        return;
+    }
+
+    CU_ASSERT_EQUAL(cpid_stream_next_batch(stream, records, 0, &count), -1);
+    CU_ASSERT_EQUAL(cpid_stream_next_batch(stream, NULL, STREAM_TEST_CAPACITY, &count), -1);
+    CU_ASSERT_EQUAL(cpid_stream_next_batch(stream, records, STREAM_TEST_CAPACITY, NULL), -1);
+    uint64_t lost_count = 1;
+    CU_ASSERT_EQUAL(cpid_stream_get_lost_count(NULL, &lost_count), -1);
+    CU_ASSERT_EQUAL(cpid_stream_get_lost_count(stream, NULL), -1);
+    CU_ASSERT_EQUAL(cpid_stream_get_lost_count(stream, &lost_count), 0);
+    CU_ASSERT_EQUAL(lost_count, 0);
+
+    // the child waits for the pipe to close before exiting
+    int release_pipe[2] = {0};
+    CU_ASSERT_EQUAL(pipe(release_pipe), 0);
+    pid_t child_pid = fork();
+    if (0 == child_pid) {
+        char c = 0;
+        close(release_pipe[1]);
+        (void) !read(release_pipe[0], &c, 1);
+        _exit(0);
+    }
+    CU_ASSERT(child_pid > 0);
+    close(release_pipe[0]);
+
+    uuid_t child_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, child_pid, child_uuid), 0);
+
+    // happy path
+    // the events of the child are expected to show up within a few seconds
+    int seen_any = 0;
+    int seen_fork = 0;
+    int seen_exit = 0;
+    struct pollfd stream_pollfd = {cpid_stream_get_fd(stream), POLLIN, 0};
+    for (int attempt = 0; attempt < 100 && !seen_exit; attempt++) {
+        if (1 != poll(&stream_pollfd, 1, 100)) {
+            continue;
+        }
+
+        count = 0;
+        CU_ASSERT_EQUAL(cpid_stream_next_batch(stream, records, STREAM_TEST_CAPACITY, &count), 0);
+        CU_ASSERT(count <= STREAM_TEST_CAPACITY);
+        seen_any = seen_any || count;
+
+        for (size_t i = 0; i < count; i++) {
+            if (records[i].pid != child_pid) {
+                continue;
+            }
+
+            if (CPID_STREAM_EVENT_FORK == records[i].event) {
+                // check that the streamed CPID matches the lookup
+                CU_ASSERT_EQUAL(records[i].status, 0);
+                CU_ASSERT_EQUAL(memcmp(records[i].uuid, child_uuid, sizeof(uuid_t)), 0);
+                seen_fork = 1;
+                close(release_pipe[1]);
+                release_pipe[1] = -1;
+            } else if (CPID_STREAM_EVENT_EXIT == records[i].event) {
+                seen_exit = 1;
+            }
+        }
+    }
+
+    if (release_pipe[1] >= 0) {
+        close(release_pipe[1]);
+    }
+    CU_ASSERT_EQUAL(waitpid(child_pid, NULL, 0), child_pid);
+
+    // events are only delivered to listeners in the initial PID and user namespaces
+    if (seen_any) {
+        CU_ASSERT_EQUAL(seen_fork, 1);
+        CU_ASSERT_EQUAL(seen_exit, 1);
+    }
+
+    cpid_stream_close(stream);
+    cpid_finalize(handle);
+}
+
+static void make_shm_test_uuid(const pid_t pid, uuid_t uuid) {
+    // a pattern of the PID, so that readers can tell torn or misplaced entries
+    for (size_t i = 0; i < sizeof(uuid_t); i++) {
+        uuid[i] = (uint8_t) (((uint32_t) pid * 2654435761u) >> (i % 4 * 8)) ^ (uint8_t) i;
+    }
+}
+
+void test_cpid_shm(void) {
+    char name[64];
+    snprintf(name, sizeof(name), "/cpid-test-%d", (int) getpid());
+
+    // invalid args
+    uuid_t uuid = {0};
+    CU_ASSERT_PTR_NULL(cpid_shm_create(NULL, 16));
+    CU_ASSERT_PTR_NULL(cpid_shm_create(name, 0));
+    CU_ASSERT_PTR_NULL(cpid_shm_open(NULL, 0));
+    CU_ASSERT_PTR_NULL(cpid_shm_open(name, 0));
+    CU_ASSERT_EQUAL(cpid_shm_publish(NULL, 1, 1, uuid), -1);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(NULL, NULL, 1, uuid), -1);
+    CU_ASSERT_EQUAL(cpid_shm_replace_all(NULL, NULL, 0), -1);
+    cpid_shm_withdraw(NULL, 1);
+    cpid_shm_heartbeat(NULL);
+    cpid_shm_close(NULL);
+
+    #define SHM_TEST_CAPACITY 64
+    cpid_shm_t producer = cpid_shm_create(name, SHM_TEST_CAPACITY);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(producer);
+    // the test PIDs aren't those of live processes, so their creation times aren't checked
+    cpid_shm_t consumer = cpid_shm_open(name, CPID_SHM_TRUST_EVICTION);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(consumer);
+
+    // consumers can't write
+    CU_ASSERT_EQUAL(cpid_shm_publish(consumer, 1, 1, uuid), -1);
+
+    uuid_t expected = {0};
+    make_shm_test_uuid(1000, expected);
+    CU_ASSERT_EQUAL(cpid_shm_publish(producer, 1000, 1, expected), 0);
+    CU_ASSERT_EQUAL(cpid_shm_publish(producer, 0, 1, expected), -1);
+
+    // the table is ignored until the first heartbeat
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(consumer, NULL, 1000, uuid), -1);
+    cpid_shm_heartbeat(producer);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(consumer, NULL, 1000, uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid, expected, sizeof(uuid_t)), 0);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(consumer, NULL, 1001, uuid), -1);
+
+    // fill to capacity, past it publishing fails
+    int failures = 0;
+    for (pid_t pid = 1; pid < SHM_TEST_CAPACITY; pid++) {
+        make_shm_test_uuid(pid, uuid);
+        failures += cpid_shm_publish(producer, pid, 1, uuid) ? 1 : 0;
+    }
+    CU_ASSERT_EQUAL(failures, 0);
+    CU_ASSERT_EQUAL(cpid_shm_publish(producer, SHM_TEST_CAPACITY, 1, uuid), -1);
+    // replacing an existing PID still works when full
+    CU_ASSERT_EQUAL(cpid_shm_publish(producer, 1000, 1, expected), 0);
+
+    // withdrawing keeps every other entry reachable
+    for (pid_t pid = 1; pid < SHM_TEST_CAPACITY; pid += 2) {
+        cpid_shm_withdraw(producer, pid);
+    }
+    int mismatches = 0;
+    for (pid_t pid = 1; pid < SHM_TEST_CAPACITY; pid++) {
+        const int found = !cpid_shm_get_uuid(consumer, NULL, pid, uuid);
+        make_shm_test_uuid(pid, expected);
+        if (found != (0 == pid % 2) || (found && memcmp(uuid, expected, sizeof(uuid_t)))) {
+            mismatches++;
+        }
+    }
+    CU_ASSERT_EQUAL(mismatches, 0);
+
+    // replace_all leaves exactly the given entries
+    cpid_entry_t entries[3] = {{.pid = 2}, {.pid = 3}, {.pid = 5000}};
+    for (size_t i = 0; i < 3; i++) {
+        make_shm_test_uuid(entries[i].pid, entries[i].uuid);
+    }
+    CU_ASSERT_EQUAL(cpid_shm_replace_all(producer, entries, 3), 0);
+    mismatches = 0;
+    for (pid_t pid = 1; pid < SHM_TEST_CAPACITY; pid++) {
+        const int found = !cpid_shm_get_uuid(consumer, NULL, pid, uuid);
+        if (found != (2 == pid || 3 == pid)) {
+            mismatches++;
+        }
+    }
+    CU_ASSERT_EQUAL(mismatches, 0);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(consumer, NULL, 1000, uuid), -1);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(consumer, NULL, 5000, uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid, entries[2].uuid, sizeof(uuid_t)), 0);
+
+    // a miss falls back to the handle
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, getpid(), expected), 0);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(consumer, handle, getpid(), uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid, expected, sizeof(uuid_t)), 0);
+
+    // by default a hit must have the creation time of the live process with the PID
+    cpid_record_t self_record;
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, getpid(), 0, &self_record), 0);
+    cpid_shm_t checking_consumer = cpid_shm_open(name, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(checking_consumer);
+    make_shm_test_uuid(getpid(), expected);
+    CU_ASSERT_EQUAL(cpid_shm_publish(producer, getpid(), self_record.input.creation_time_ticks, expected), 0);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(checking_consumer, NULL, getpid(), uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid, expected, sizeof(uuid_t)), 0);
+    // an entry of a previous process of the PID is a miss, which falls back to the handle
+    CU_ASSERT_EQUAL(cpid_shm_publish(producer, getpid(), self_record.input.creation_time_ticks - 1, expected), 0);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(checking_consumer, NULL, getpid(), uuid), -1);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(checking_consumer, handle, getpid(), uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid, self_record.uuid, sizeof(uuid_t)), 0);
+    cpid_shm_close(checking_consumer);
+    cpid_finalize(handle);
+
+    // a table that others could have written isn't trusted
+    int shm_fd = shm_open(name, O_RDWR, 0);
+    CU_ASSERT_FATAL(shm_fd >= 0);
+    CU_ASSERT_EQUAL(fchmod(shm_fd, 0666), 0);
+    errno = 0;
+    CU_ASSERT_PTR_NULL(cpid_shm_open(name, CPID_SHM_TRUST_EVICTION));
+    CU_ASSERT_EQUAL(errno, EACCES);
+    CU_ASSERT_EQUAL(fchmod(shm_fd, 0644), 0);
+    close(shm_fd);
+    cpid_shm_t owner_consumer = cpid_shm_open_with_owner(name, geteuid(), CPID_SHM_TRUST_EVICTION);
+    CU_ASSERT_PTR_NOT_NULL(owner_consumer);
+    cpid_shm_close(owner_consumer);
+    // nor is one of another user, which only root may own instead
+    if (0 != geteuid()) {
+        errno = 0;
+        CU_ASSERT_PTR_NULL(cpid_shm_open_with_owner(name, geteuid() + 1, CPID_SHM_TRUST_EVICTION));
+        CU_ASSERT_EQUAL(errno, EACCES);
+    }
+
+    // closing the producer removes the table and consumers stop using it
+    cpid_shm_close(producer);
+    CU_ASSERT_EQUAL(cpid_shm_get_uuid(consumer, NULL, 5000, uuid), -1);
+    CU_ASSERT_PTR_NULL(cpid_shm_open(name, 0));
+    cpid_shm_close(consumer);
+}
+
+#define SHM_CONCURRENCY_TEST_PID_COUNT 200
+#define SHM_CONCURRENCY_TEST_ROUNDS 2000
+
+typedef struct {
+    cpid_shm_t shm;
+    atomic_int done;
+    int lookups;
+    int hits;
+    int mismatches;
+} shm_test_reader_t;
+
+static void *shm_test_reader(void *argument) {
+    shm_test_reader_t *reader = (shm_test_reader_t *) argument;
+
+    for (pid_t pid = 1; !atomic_load(&reader->done); pid = pid % SHM_CONCURRENCY_TEST_PID_COUNT + 1) {
+        uuid_t uuid, expected;
+        reader->lookups++;
+        if (cpid_shm_get_uuid(reader->shm, NULL, pid, uuid)) {
+            continue;
+        }
+        reader->hits++;
+        make_shm_test_uuid(pid, expected);
+        if (memcmp(uuid, expected, sizeof(uuid_t))) {
+            reader->mismatches++;
+        }
+    }
+    return NULL;
+}
+
+void test_cpid_shm_concurrent(void) {
+    char name[64];
+    snprintf(name, sizeof(name), "/cpid-test-concurrent-%d", (int) getpid());
+
+    // a small table makes long probe runs, so removals keep moving entries under the reader
+    cpid_shm_t producer = cpid_shm_create(name, SHM_CONCURRENCY_TEST_PID_COUNT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(producer);
+    cpid_shm_heartbeat(producer);
+
+    shm_test_reader_t reader = {0};
+    atomic_init(&reader.done, 0);
+    reader.shm = cpid_shm_open(name, CPID_SHM_TRUST_EVICTION);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reader.shm);
+    pthread_t thread;
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&thread, NULL, shm_test_reader, &reader), 0);
+
+    uint64_t state = 1;
+    for (int round = 0; round < SHM_CONCURRENCY_TEST_ROUNDS; round++) {
+        for (int i = 0; i < SHM_CONCURRENCY_TEST_PID_COUNT; i++) {
+            state = state * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+            const pid_t pid = (pid_t) (state >> 33) % SHM_CONCURRENCY_TEST_PID_COUNT + 1;
+            if (state & (UINT64_C(1) << 20)) {
+                uuid_t uuid;
+                make_shm_test_uuid(pid, uuid);
+                cpid_shm_publish(producer, pid, 1, uuid);
+            } else {
+                cpid_shm_withdraw(producer, pid);
+            }
+        }
+    }
+
+    atomic_store(&reader.done, 1);
+    pthread_join(thread, NULL);
+
+    CU_ASSERT(reader.lookups > 0);
+    CU_ASSERT_EQUAL(reader.mismatches, 0);
+
+    cpid_shm_close(reader.shm);
+    cpid_shm_close(producer);
+}
+
 int main(void) {
     CU_initialize_registry();
     CU_pSuite suite = CU_add_suite("CPID Reference Implementation Test Suite", 0, 0);
 
     CU_add_test(suite, "Test CPID Linux basic initialize and finalize", test_cpid_initialize_finalize);
+    CU_add_test(suite, "Test CPID Linux context", test_cpid_context);
+    CU_add_test(suite, "Test CPID Linux context with boot uuid", test_cpid_context_with_boot_uuid);
+    CU_add_test(suite, "Test CPID Linux context shared by threads", test_cpid_context_threads);
+    CU_add_test(suite, "Test CPID Linux lazy initialize", test_cpid_initialize_lazy);
     CU_add_test(suite, "Test CPID Linux make uuid", test_cpid_make_uuid);
+    CU_add_test(suite, "Test CPID Linux make uuid batch", test_cpid_make_uuid_batch);
     CU_add_test(suite, "Test CPID Linux get uuid", test_cpid_get_uuid);
+    CU_add_test(suite, "Test CPID Linux get uuid pidfd", test_cpid_get_uuid_pidfd);
     CU_add_test(suite, "Test CPID Linux get uuid string", test_cpid_get_uuid_string);
+    CU_add_test(suite, "Test CPID Linux get process record", test_cpid_get_process_record);
+    CU_add_test(suite, "Test CPID Linux get ancestry", test_cpid_get_ancestry);
+    CU_add_test(suite, "Test CPID Linux cache", test_cpid_cache);
+    CU_add_test(suite, "Test CPID Linux get stats", test_cpid_get_stats);
+    CU_add_test(suite, "Test CPID Linux enumerate all", test_cpid_enumerate_all);
+    CU_add_test(suite, "Test CPID Linux stream", test_cpid_stream);
+    CU_add_test(suite, "Test CPID Linux shared-memory table", test_cpid_shm);
+    CU_add_test(suite, "Test CPID Linux shared-memory table under concurrent updates", test_cpid_shm_concurrent);
 
     CU_basic_run_tests();
     int number_of_failures = CU_get_number_of_failures();
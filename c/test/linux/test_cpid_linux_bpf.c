@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include <cpid/cpid_linux.h>
+#include <cpid/cpid_linux_bpf.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void test_cpid_bpf_open_close(void) {
+    uint64_t lost_count = 0;
+    CU_ASSERT_PTR_NULL(cpid_bpf_open(NULL));
+    CU_ASSERT_EQUAL(cpid_bpf_get_fd(NULL), -1);
+    CU_ASSERT_EQUAL(cpid_bpf_get_lost_count(NULL, &lost_count), -1);
+    cpid_bpf_close(NULL);
+
+    // the events are of the local boot, so a handle with a given boot UUID is refused
+    uuid_t boot_uuid = {0};
+    cpid_context_t context = cpid_context_create_with_boot_uuid(boot_uuid);
+    CU_ASSERT_PTR_NOT_NULL(context);
+    cpid_handle_t offline_handle = cpid_initialize_from_context(context);
+    CU_ASSERT_PTR_NOT_NULL(offline_handle);
+    cpid_context_release(context);
+    errno = 0;
+    CU_ASSERT_PTR_NULL(cpid_bpf_open(offline_handle));
+    CU_ASSERT_EQUAL(errno, ENOTSUP);
+    cpid_finalize(offline_handle);
+
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    cpid_bpf_t capture = cpid_bpf_open(handle);
+    if (!capture && (EPERM == errno || ENOSYS == errno)) {
+        // loading BPF programs requires CAP_BPF and CAP_PERFMON
+        cpid_finalize(handle);
+        return;
+    }
+    CU_ASSERT_PTR_NOT_NULL_FATAL(capture);
+    CU_ASSERT(cpid_bpf_get_fd(capture) >= 0);
+    CU_ASSERT_EQUAL(cpid_bpf_get_lost_count(capture, NULL), -1);
+    lost_count = UINT64_MAX;
+    CU_ASSERT_EQUAL(cpid_bpf_get_lost_count(capture, &lost_count), 0);
+    // nothing has been read yet, but a 4 MiB ring buffer doesn't fill up this quickly
+    CU_ASSERT_EQUAL(lost_count, 0);
+    cpid_bpf_close(capture);
+
+    cpid_finalize(handle);
+}
+
+void test_cpid_bpf_matches_proc(void) {
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    cpid_bpf_t capture = cpid_bpf_open(handle);
+    if (!capture && (EPERM == errno || ENOSYS == errno)) {
+        // loading BPF programs requires CAP_BPF and CAP_PERFMON
+        cpid_finalize(handle);
+        return;
+    }
+    CU_ASSERT_PTR_NOT_NULL_FATAL(capture);
+
+    // invalid args
+    #define BPF_TEST_CAPACITY 64
+    cpid_stream_record_t records[BPF_TEST_CAPACITY] = {0};
+    size_t count = 0;
+    CU_ASSERT_EQUAL(cpid_bpf_next_batch(NULL, records, BPF_TEST_CAPACITY, &count, 0), -1);
+    CU_ASSERT_EQUAL(cpid_bpf_next_batch(capture, NULL, BPF_TEST_CAPACITY, &count, 0), -1);
+    CU_ASSERT_EQUAL(cpid_bpf_next_batch(capture, records, 0, &count, 0), -1);
+    CU_ASSERT_EQUAL(cpid_bpf_next_batch(capture, records, BPF_TEST_CAPACITY, NULL, 0), -1);
+
+    // the child waits for the pipe to close before exiting
+    int release_pipe[2] = {0};
+    CU_ASSERT_EQUAL(pipe(release_pipe), 0);
+    pid_t child_pid = fork();
+    if (0 == child_pid) {
+        char c = 0;
+        close(release_pipe[1]);
+        (void) !read(release_pipe[0], &c, 1);
+        _exit(0);
+    }
+    CU_ASSERT(child_pid > 0);
+    close(release_pipe[0]);
+
+    // the reference CPID UUID sourced from /proc
+    uuid_t child_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, child_pid, child_uuid), 0);
+
+    int seen_fork = 0;
+    int seen_exit = 0;
+    for (int attempt = 0; attempt < 50 && !seen_exit; attempt++) {
+        count = 0;
+        CU_ASSERT_EQUAL(cpid_bpf_next_batch(capture, records, BPF_TEST_CAPACITY, &count, 100), 0);
+
+        for (size_t i = 0; i < count; i++) {
+            if (records[i].pid != child_pid) {
+                continue;
+            }
+
+            // the CPID UUID from kernel inputs must be exactly the one built from /proc,
+            // including at exit time when /proc can no longer provide it
+            CU_ASSERT_EQUAL(records[i].status, 0);
+            CU_ASSERT_EQUAL(memcmp(records[i].uuid, child_uuid, sizeof(uuid_t)), 0);
+
+            if (CPID_STREAM_EVENT_FORK == records[i].event) {
+                seen_fork = 1;
+                close(release_pipe[1]);
+                release_pipe[1] = -1;
+            } else if (CPID_STREAM_EVENT_EXIT == records[i].event) {
+                seen_exit = 1;
+            }
+        }
+    }
+
+    if (release_pipe[1] >= 0) {
+        close(release_pipe[1]);
+    }
+    CU_ASSERT_EQUAL(waitpid(child_pid, NULL, 0), child_pid);
+
+    CU_ASSERT_EQUAL(seen_fork, 1);
+    CU_ASSERT_EQUAL(seen_exit, 1);
+
+    cpid_bpf_close(capture);
+    cpid_finalize(handle);
+}
+
+int main(void) {
+    CU_initialize_registry();
+    CU_pSuite suite = CU_add_suite("CPID BPF Capture Test Suite", 0, 0);
+
+    CU_add_test(suite, "Test CPID BPF open and close", test_cpid_bpf_open_close);
+    CU_add_test(suite, "Test CPID BPF capture matches /proc", test_cpid_bpf_matches_proc);
+
+    CU_basic_run_tests();
+    int number_of_failures = CU_get_number_of_failures();
+    CU_cleanup_registry();
+    return number_of_failures;
+}
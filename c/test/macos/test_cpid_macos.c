@@ -3,6 +3,11 @@
 #include <CUnit/CUnit.h>
 #include <CUnit/Basic.h>
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <cpid/cpid_macos.h>
 
 #define BAD_PID 0xFFFFFFFF
@@ -49,6 +54,92 @@ void test_cpid_make_uuid(void) {
     cpid_finalize(handle);
 }
 
+void test_cpid_initialize_with_boot_identity(void) {
+    cpid_macos_boot_identity_t boot_identity = {
+        .serial_number = "T2T3GKP272",
+        .kernel_task_creation_time_unix_epoch_seconds = 1703173115,
+        .kernel_task_creation_time_micros_offset = 212514,
+        .launchd_creation_time_unix_epoch_seconds = 1703173115,
+        .launchd_creation_time_micros_offset = 282857,
+    };
+    CU_ASSERT_EQUAL(uuid_parse("8e923375-9510-5729-a6cc-2f66444573c9", boot_identity.hardware_uuid), 0);
+
+    cpid_handle_t handle = cpid_initialize_with_boot_identity(&boot_identity);
+    CU_ASSERT_PTR_NOT_NULL(handle);
+    cpid_handle_t same_handle = cpid_initialize_with_boot_identity(&boot_identity);
+    CU_ASSERT_PTR_NOT_NULL(same_handle);
+
+    // handles with the same boot identity agree
+    uuid_t uuid = {0};
+    uuid_t same_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_make_uuid(handle, 1330, 1703174125, 741886, uuid), 0);
+    CU_ASSERT_EQUAL(cpid_make_uuid(same_handle, 1330, 1703174125, 741886, same_uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid, same_uuid, sizeof(uuid_t)), 0);
+
+    // and differ from handles of another boot
+    boot_identity.launchd_creation_time_micros_offset++;
+    cpid_handle_t other_handle = cpid_initialize_with_boot_identity(&boot_identity);
+    CU_ASSERT_PTR_NOT_NULL(other_handle);
+    uuid_t other_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_make_uuid(other_handle, 1330, 1703174125, 741886, other_uuid), 0);
+    CU_ASSERT_NOT_EQUAL(memcmp(uuid, other_uuid, sizeof(uuid_t)), 0);
+
+    // local processes can't be sourced
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, LAUNCHD_PID, uuid), -1);
+    const cpid_entry_t *entries = NULL;
+    size_t count = 0;
+    CU_ASSERT_EQUAL(cpid_snapshot_all(handle, &entries, &count), -1);
+
+    // invalid args
+    CU_ASSERT_PTR_NULL(cpid_initialize_with_boot_identity(NULL));
+    boot_identity.kernel_task_creation_time_micros_offset = 1000000;
+    CU_ASSERT_PTR_NULL(cpid_initialize_with_boot_identity(&boot_identity));
+    boot_identity.kernel_task_creation_time_micros_offset = 212514;
+    // the serial number must be NUL terminated
+    memset(boot_identity.serial_number, 'A', sizeof(boot_identity.serial_number));
+    CU_ASSERT_PTR_NULL(cpid_initialize_with_boot_identity(&boot_identity));
+
+    cpid_finalize(other_handle);
+    cpid_finalize(same_handle);
+    cpid_finalize(handle);
+}
+
+void test_cpid_initialize_lazy(void) {
+    char cache_directory[] = "/tmp/cpid_test_XXXXXX";
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(cache_directory));
+    char cache_path[sizeof(cache_directory) + 16];
+    snprintf(cache_path, sizeof(cache_path), "%s/boot_identity", cache_directory);
+
+    // the first call of the process sources the boot identity and writes the cache
+    cpid_handle_t lazy_handle = cpid_initialize_lazy(cache_path);
+    CU_ASSERT_PTR_NOT_NULL(lazy_handle);
+    struct stat cache_stat;
+    CU_ASSERT_EQUAL(stat(cache_path, &cache_stat), 0);
+    CU_ASSERT_EQUAL(cache_stat.st_mode & 0777, 0600);
+
+    // later calls share it
+    cpid_handle_t other_lazy_handle = cpid_initialize_lazy(NULL);
+    CU_ASSERT_PTR_NOT_NULL(other_lazy_handle);
+
+    // and agree with a handle that sourced everything itself
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+    uuid_t uuid = {0};
+    uuid_t lazy_uuid = {0};
+    uuid_t other_lazy_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, LAUNCHD_PID, uuid), 0);
+    CU_ASSERT_EQUAL(cpid_get_uuid(lazy_handle, LAUNCHD_PID, lazy_uuid), 0);
+    CU_ASSERT_EQUAL(cpid_get_uuid(other_lazy_handle, LAUNCHD_PID, other_lazy_uuid), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid, lazy_uuid, sizeof(uuid_t)), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid, other_lazy_uuid, sizeof(uuid_t)), 0);
+
+    cpid_finalize(handle);
+    cpid_finalize(other_lazy_handle);
+    cpid_finalize(lazy_handle);
+    unlink(cache_path);
+    rmdir(cache_directory);
+}
+
 void test_cpid_get_uuid(void) {
     cpid_handle_t handle = cpid_initialize();
     CU_ASSERT_PTR_NOT_NULL(handle);
@@ -116,14 +207,90 @@ void test_cpid_get_uuid_string(void) {
     cpid_finalize(handle);
 }
 
+void test_cpid_get_process_record(void) {
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    uuid_t launchd_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, LAUNCHD_PID, launchd_uuid), 0);
+    uuid_t kernel_task_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, KERNEL_TASK_PID, kernel_task_uuid), 0);
+
+    // happy path, launchd is a child of kernel_task
+    cpid_record_t record;
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, LAUNCHD_PID, CPID_RECORD_PARENT_UUID, &record), 0);
+    CU_ASSERT_EQUAL(record.pid, LAUNCHD_PID);
+    CU_ASSERT_EQUAL(record.parent_pid, KERNEL_TASK_PID);
+    CU_ASSERT_EQUAL(memcmp(record.uuid, launchd_uuid, sizeof(uuid_t)), 0);
+    CU_ASSERT_EQUAL(record.parent_status, 0);
+    CU_ASSERT_EQUAL(memcmp(record.parent_uuid, kernel_task_uuid, sizeof(uuid_t)), 0);
+    // the inputs reproduce the CPID UUID
+    uuid_t uuid_from_input = {0};
+    CU_ASSERT_EQUAL(cpid_make_uuid(handle, record.pid, record.creation_time_unix_epoch_seconds, record.creation_time_micros_offset, uuid_from_input), 0);
+    CU_ASSERT_EQUAL(memcmp(uuid_from_input, launchd_uuid, sizeof(uuid_t)), 0);
+
+    // without the flag the parent isn't calculated
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, LAUNCHD_PID, 0, &record), 0);
+    CU_ASSERT_EQUAL(record.parent_status, -1);
+
+    // invalid args
+    cpid_record_t record_invalid_args;
+    CU_ASSERT_EQUAL(cpid_get_process_record(NULL, LAUNCHD_PID, 0, &record_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, LAUNCHD_PID, 0, NULL), -1);
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, LAUNCHD_PID, ~CPID_RECORD_PARENT_UUID, &record_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_get_process_record(handle, BAD_PID, 0, &record_invalid_args), -1);
+
+    cpid_finalize(handle);
+}
+
+void test_cpid_snapshot_all(void) {
+    cpid_handle_t handle = cpid_initialize();
+    CU_ASSERT_PTR_NOT_NULL(handle);
+
+    uuid_t launchd_uuid = {0};
+    CU_ASSERT_EQUAL(cpid_get_uuid(handle, LAUNCHD_PID, launchd_uuid), 0);
+
+    // happy path, run twice to exercise buffer reuse
+    for (int run = 0; run < 2; run++) {
+        const cpid_entry_t *entries = NULL;
+        size_t count = 0;
+        CU_ASSERT_EQUAL(cpid_snapshot_all(handle, &entries, &count), 0);
+        CU_ASSERT_PTR_NOT_NULL(entries);
+        CU_ASSERT(count > 1);
+
+        // launchd must be present with the same CPID as cpid_get_uuid
+        int found_launchd = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (LAUNCHD_PID == entries[i].pid) {
+                found_launchd = 1;
+                CU_ASSERT_EQUAL(memcmp(entries[i].uuid, launchd_uuid, sizeof(uuid_t)), 0);
+            }
+        }
+        CU_ASSERT_EQUAL(found_launchd, 1);
+    }
+
+    // invalid args
+    const cpid_entry_t *entries_invalid_args = NULL;
+    size_t count_invalid_args = 0;
+    CU_ASSERT_EQUAL(cpid_snapshot_all(NULL, &entries_invalid_args, &count_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_snapshot_all(handle, NULL, &count_invalid_args), -1);
+    CU_ASSERT_EQUAL(cpid_snapshot_all(handle, &entries_invalid_args, NULL), -1);
+
+    cpid_finalize(handle);
+}
+
 int main(void) {
     CU_initialize_registry();
     CU_pSuite suite = CU_add_suite("CPID Reference Implementation Test Suite", 0, 0);
 
     CU_add_test(suite, "Test CPID Mac basic initialize and finalize", test_cpid_initialize_finalize);
     CU_add_test(suite, "Test CPID Mac make uuid", test_cpid_make_uuid);
+    CU_add_test(suite, "Test CPID Mac initialize with boot identity", test_cpid_initialize_with_boot_identity);
+    CU_add_test(suite, "Test CPID Mac lazy initialize", test_cpid_initialize_lazy);
     CU_add_test(suite, "Test CPID Mac get uuid", test_cpid_get_uuid);
     CU_add_test(suite, "Test CPID Mac get uuid string", test_cpid_get_uuid_string);
+    CU_add_test(suite, "Test CPID Mac get process record", test_cpid_get_process_record);
+    CU_add_test(suite, "Test CPID Mac snapshot all", test_cpid_snapshot_all);
 
     CU_basic_run_tests();
     int number_of_failures = CU_get_number_of_failures();